@@ -113,35 +113,490 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #include "netdissect.h"
+#include "netdissect-alloc.h"
 #include "addrtoname.h"
 #include "addrtostr.h"
-#include "ethertype.h"
-#include "llc.h"
 #include "extract.h"
+#include "namemap.h"
 #include "oui.h"
+#include "resolver.h"
 
 /*
- * hash tables for whatever-to-name translations
+ * The names found for addresses, ports and the like are cached, per
+ * netdissect_options, in one open-addressing hash table with linear
+ * probing, keyed by the kind of thing named and its bytes.  The keys
+ * are hashed with a seeded 64-bit mix of all their bytes, and the
+ * table doubles in size whenever it gets half full, so lookups stay
+ * short however many addresses a capture holds.  The names, and keys
+ * too long to keep in the entry, are copied into slabs rather than
+ * each being allocated on its own.
+ *
+ * If ndo_name_cache_max is set, addrtoname_trim(), called between
+ * packets, discards the least recently used entries until the cache
+ * takes no more than that many bytes; a name handed out while a packet
+ * is being dissected therefore stays valid until the end of the packet.
+ * The entries init_addrtoname() makes, from the services and ethers
+ * files, are never discarded, as they couldn't be looked up again.
  *
- * ndo_error() called on strdup(3) failure with S_ERR_ND_MEM_ALLOC status
+ * ndo_error() called on allocation failure with S_ERR_ND_MEM_ALLOC status
  */
 
-#define HASHNAMESIZE 4096
+enum name_kind {
+	NAME_IPADDR,
+	NAME_IP6ADDR,
+	NAME_ETHERADDR,
+	NAME_BYTESTRING,	/* le64addr_string() and linkaddr_string() */
+	NAME_ISONSAP,
+	NAME_TCPPORT,
+	NAME_UDPPORT,
+	NAME_IPXSAP,
+	NAME_DNADDR
+};
 
-struct hnamemem {
-	uint32_t addr;
-	const char *name;
-	struct hnamemem *nxt;
+#define NAME_KEY_INLINE		16	/* longest key kept in the entry */
+#define NAME_CACHE_INITSIZE	256	/* initial hash table size; a power of 2 */
+#define NAME_SLAB_SIZE		16384
+
+struct name_slab {
+	struct name_slab *next;
+	size_t size;		/* bytes of data */
+	size_t used;		/* bytes handed out */
+	size_t live;		/* bytes handed out to entries still in use */
+};
+
+#define NAME_SLAB_DATA(s)	((char *)((s) + 1))
+
+struct name_entry {
+	uint32_t hash;
+	uint8_t kind;		/* enum name_kind */
+	uint8_t pinned;		/* made by init_addrtoname(); never discarded */
+	u_int keylen;
+	union {
+		u_char bytes[NAME_KEY_INLINE];
+		u_char *ptr;	/* in the slab, after the name */
+	} key;
+	char *name;		/* NULL if the entry is free */
+	struct name_slab *slab;	/* holding the name and a long key */
+	size_t size;		/* bytes of the slab they take */
+	uint32_t prev;		/* LRU list, as entry numbers; see below */
+	uint32_t next;		/* ...also the free list */
+};
+
+#define NAME_KEY(e) \
+	((e)->keylen <= NAME_KEY_INLINE ? (e)->key.bytes : (e)->key.ptr)
+
+/* What an entry in use costs, for comparing with ndo_name_cache_max */
+#define NAME_ENTRY_COST(e) \
+	(sizeof(struct name_entry) + 2 * sizeof(uint64_t) + (e)->size)
+
+/*
+ * The cache of a netdissect_options.  Entries are referred to by
+ * number, their index in entries[] plus 1, so that 0 can mean none.
+ * The hash table slots hold the hash of the entry's key in the upper
+ * 32 bits and its number in the lower 32, or 0 if unused.  The list of
+ * entries from the most to the least recently used, which leaves out
+ * pinned entries, is kept only if there's a ndo_name_cache_max;
+ * otherwise it's in the order the entries were made.
+ */
+struct addrtoname_state {
+	uint64_t *slots;
+	u_int nslots;			/* a power of 2 */
+	struct name_entry *entries;
+	u_int nentries;			/* size of entries[] */
+	u_int nmade;			/* entries[] used so far */
+	u_int nused;			/* entries in use */
+	uint32_t free_entries;		/* first free entry */
+	uint32_t lru_head;		/* most recently used entry */
+	uint32_t lru_tail;		/* least recently used entry */
+	uint32_t seed;			/* for name_hash() */
+	struct name_slab *slabs;	/* the first is being filled */
+	size_t slab_bytes;		/* in all the slabs */
+	size_t name_bytes;		/* in the slabs, in use */
+	size_t bytes;			/* NAME_ENTRY_COST() of the entries */
+	struct nd_name_cache_stats stats;
+	uint32_t f_netmask;
+	uint32_t f_localnet;
 };
 
-static struct hnamemem hnametable[HASHNAMESIZE];
-static struct hnamemem tporttable[HASHNAMESIZE];
-static struct hnamemem uporttable[HASHNAMESIZE];
-static struct hnamemem eprototable[HASHNAMESIZE];
-static struct hnamemem dnaddrtable[HASHNAMESIZE];
-static struct hnamemem ipxsaptable[HASHNAMESIZE];
+/*
+ * Get the cache of this netdissect_options, allocating it if this is
+ * the first lookup.
+ */
+static struct addrtoname_state *
+addrtoname_state(netdissect_options *ndo)
+{
+	struct addrtoname_state *st;
+
+	if (ndo->ndo_addrtoname == NULL) {
+		st = calloc(1, sizeof(struct addrtoname_state));
+		if (st == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+					  "addrtoname_state: calloc");
+		st->nslots = NAME_CACHE_INITSIZE;
+		st->slots = calloc(st->nslots, sizeof(*st->slots));
+		st->nentries = NAME_CACHE_INITSIZE / 2;
+		st->entries = malloc(st->nentries * sizeof(*st->entries));
+		if (st->slots == NULL || st->entries == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+					  "addrtoname_state: calloc");
+		/* Not secret, but it can't be known before tcpdump starts */
+		st->seed = (uint32_t)time(NULL) ^ (uint32_t)(uintptr_t)st;
+		ndo->ndo_addrtoname = st;
+	}
+	return (ndo->ndo_addrtoname);
+}
+
+static uint32_t
+name_hash(uint32_t seed, u_int kind, const u_char *key, u_int keylen)
+{
+	uint64_t h, w;
+
+	h = seed ^ ((uint64_t)kind << 32) ^
+	    ((uint64_t)keylen * 0x9e3779b97f4a7c15ULL);
+	while (keylen >= 8) {
+		memcpy(&w, key, 8);
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 29;
+		key += 8;
+		keylen -= 8;
+	}
+	if (keylen != 0) {
+		w = 0;
+		memcpy(&w, key, keylen);
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+	}
+	/* The MurmurHash3 finalizer */
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return ((uint32_t)h);
+}
+
+/* Find the entry for a key; returns its number, or 0 if there's none. */
+static uint32_t
+name_find(const struct addrtoname_state *st, u_int kind, const u_char *key,
+	  u_int keylen, uint32_t hash)
+{
+	const struct name_entry *e;
+	uint64_t slot;
+	u_int i, mask = st->nslots - 1;
+
+	for (i = hash & mask; (slot = st->slots[i]) != 0; i = (i + 1) & mask) {
+		if ((uint32_t)(slot >> 32) != hash)
+			continue;
+		e = &st->entries[(uint32_t)slot - 1];
+		if (e->kind == kind && e->keylen == keylen &&
+		    memcmp(NAME_KEY(e), key, keylen) == 0)
+			return ((uint32_t)slot);
+	}
+	return (0);
+}
+
+static void
+lru_unlink(struct addrtoname_state *st, uint32_t n)
+{
+	struct name_entry *e = &st->entries[n - 1];
+
+	if (e->prev != 0)
+		st->entries[e->prev - 1].next = e->next;
+	else
+		st->lru_head = e->next;
+	if (e->next != 0)
+		st->entries[e->next - 1].prev = e->prev;
+	else
+		st->lru_tail = e->prev;
+}
+
+static void
+lru_push(struct addrtoname_state *st, uint32_t n)
+{
+	struct name_entry *e = &st->entries[n - 1];
+
+	e->prev = 0;
+	e->next = st->lru_head;
+	if (st->lru_head != 0)
+		st->entries[st->lru_head - 1].prev = n;
+	else
+		st->lru_tail = n;
+	st->lru_head = n;
+}
+
+/*
+ * Look up the name for a key, counting a hit or a miss; returns NULL
+ * if there's none.  The key's hash is returned in *hashp, for
+ * name_add().
+ */
+static const char *
+name_lookup(netdissect_options *ndo, struct addrtoname_state *st,
+	    u_int kind, const void *key, u_int keylen, uint32_t *hashp)
+{
+	uint32_t n;
+
+	*hashp = name_hash(st->seed, kind, key, keylen);
+	n = name_find(st, kind, key, keylen, *hashp);
+	if (n == 0) {
+		st->stats.misses++;
+		return (NULL);
+	}
+	st->stats.hits++;
+	if (ndo->ndo_name_cache_max != 0 && st->lru_head != n &&
+	    !st->entries[n - 1].pinned) {
+		lru_unlink(st, n);
+		lru_push(st, n);
+	}
+	return (st->entries[n - 1].name);
+}
+
+/* Allocate space from the slabs */
+static char *
+name_alloc(netdissect_options *ndo, struct addrtoname_state *st,
+	   size_t size, struct name_slab **slabp)
+{
+	struct name_slab *s = st->slabs;
+	size_t slabsize;
+	char *p;
+
+	if (s == NULL || s->size - s->used < size) {
+		if (s != NULL && s->live == 0) {
+			/* Its names were all discarded; start again */
+			st->slabs = s->next;
+			st->slab_bytes -= s->size;
+			free(s);
+		}
+		slabsize = size > NAME_SLAB_SIZE ? size : NAME_SLAB_SIZE;
+		s = malloc(sizeof(*s) + slabsize);
+		if (s == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+					  "name_alloc: malloc");
+		s->size = slabsize;
+		s->used = 0;
+		s->live = 0;
+		s->next = st->slabs;
+		st->slabs = s;
+		st->slab_bytes += slabsize;
+	}
+	p = NAME_SLAB_DATA(s) + s->used;
+	s->used += size;
+	s->live += size;
+	st->name_bytes += size;
+	*slabp = s;
+	return (p);
+}
+
+/* Double the size of the hash table */
+static void
+name_grow(netdissect_options *ndo, struct addrtoname_state *st)
+{
+	uint64_t *slots;
+	u_int nslots = st->nslots * 2;
+	u_int i, j;
+
+	slots = calloc(nslots, sizeof(*slots));
+	if (slots == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC, "name_grow: calloc");
+	for (i = 0; i < st->nslots; i++) {
+		if (st->slots[i] == 0)
+			continue;
+		for (j = (uint32_t)(st->slots[i] >> 32) & (nslots - 1);
+		     slots[j] != 0; j = (j + 1) & (nslots - 1))
+			;
+		slots[j] = st->slots[i];
+	}
+	free(st->slots);
+	st->slots = slots;
+	st->nslots = nslots;
+}
+
+/*
+ * Add the name for a key that isn't in the cache, with the hash
+ * name_lookup() returned, and return the cached copy of the name.  The
+ * name is namelen characters long; if name is NULL, the caller fills
+ * them in.
+ */
+static char *
+name_add(netdissect_options *ndo, struct addrtoname_state *st, u_int kind,
+	 const void *key, u_int keylen, uint32_t hash, const char *name,
+	 size_t namelen, int pinned)
+{
+	struct name_entry *e, *entries;
+	uint32_t n;
+	u_int i, mask;
+	size_t size;
+
+	if (2 * (st->nused + 1) > st->nslots)
+		name_grow(ndo, st);
+
+	if (st->free_entries != 0) {
+		n = st->free_entries;
+		st->free_entries = st->entries[n - 1].next;
+	} else {
+		if (st->nmade == st->nentries) {
+			entries = realloc(st->entries,
+			    2 * st->nentries * sizeof(*entries));
+			if (entries == NULL)
+				(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+						  "name_add: realloc");
+			st->entries = entries;
+			st->nentries *= 2;
+		}
+		n = ++st->nmade;
+	}
+	st->nused++;
+
+	e = &st->entries[n - 1];
+	e->hash = hash;
+	e->kind = (uint8_t)kind;
+	e->pinned = (uint8_t)pinned;
+	e->keylen = keylen;
+	size = namelen + 1;
+	if (keylen > NAME_KEY_INLINE)
+		size += keylen;
+	e->name = name_alloc(ndo, st, size, &e->slab);
+	e->size = size;
+	if (keylen > NAME_KEY_INLINE) {
+		e->key.ptr = (u_char *)e->name + namelen + 1;
+		memcpy(e->key.ptr, key, keylen);
+	} else
+		memcpy(e->key.bytes, key, keylen);
+	if (name != NULL)
+		memcpy(e->name, name, namelen);
+	e->name[namelen] = '\0';
+
+	mask = st->nslots - 1;
+	for (i = hash & mask; st->slots[i] != 0; i = (i + 1) & mask)
+		;
+	st->slots[i] = ((uint64_t)hash << 32) | n;
+
+	if (!pinned)
+		lru_push(st, n);
+	st->bytes += NAME_ENTRY_COST(e);
+	return (e->name);
+}
+
+/* Remove an entry from the cache */
+static void
+name_remove(struct addrtoname_state *st, uint32_t n)
+{
+	struct name_entry *e = &st->entries[n - 1];
+	struct name_slab *s, **sp;
+	u_int i, j, k, mask = st->nslots - 1;
+
+	/* Take it out of the hash table, moving up the entries after it */
+	for (i = e->hash & mask; (uint32_t)st->slots[i] != n;
+	     i = (i + 1) & mask)
+		;
+	for (j = i;;) {
+		j = (j + 1) & mask;
+		if (st->slots[j] == 0)
+			break;
+		k = (uint32_t)(st->slots[j] >> 32) & mask;
+		/* Can the entry in j go in i, before its home slot k? */
+		if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+			st->slots[i] = st->slots[j];
+			i = j;
+		}
+	}
+	st->slots[i] = 0;
+
+	if (!e->pinned)
+		lru_unlink(st, n);
+	st->bytes -= NAME_ENTRY_COST(e);
+	st->name_bytes -= e->size;
+	s = e->slab;
+	s->live -= e->size;
+	if (s->live == 0 && s != st->slabs) {
+		for (sp = &st->slabs; *sp != s; sp = &(*sp)->next)
+			;
+		*sp = s->next;
+		st->slab_bytes -= s->size;
+		free(s);
+	}
+	e->name = NULL;
+	e->next = st->free_entries;
+	st->free_entries = n;
+	st->nused--;
+}
+
+/*
+ * Copy the names still in use into new slabs, freeing the old ones,
+ * when the slabs hold mostly discarded names; that happens when a few
+ * long-lived names keep otherwise unused slabs alive.
+ */
+static void
+name_compact(netdissect_options *ndo, struct addrtoname_state *st)
+{
+	struct name_slab *old = st->slabs, *s;
+	struct name_entry *e;
+	char *p;
+	u_int i;
+
+	st->slabs = NULL;
+	st->slab_bytes = 0;
+	st->name_bytes = 0;
+	for (i = 0; i < st->nmade; i++) {
+		e = &st->entries[i];
+		if (e->name == NULL)
+			continue;
+		p = name_alloc(ndo, st, e->size, &e->slab);
+		memcpy(p, e->name, e->size);
+		if (e->keylen > NAME_KEY_INLINE)
+			e->key.ptr = (u_char *)p + (e->key.ptr - (u_char *)e->name);
+		e->name = p;
+	}
+	while ((s = old) != NULL) {
+		old = s->next;
+		free(s);
+	}
+}
+
+/*
+ * Discard the least recently used names until the cache is within
+ * ndo_name_cache_max bytes.  This is called between packets, as the
+ * names discarded may have been handed out for the last one.
+ */
+void
+addrtoname_trim(netdissect_options *ndo)
+{
+	struct addrtoname_state *st = ndo->ndo_addrtoname;
+
+	if (st == NULL || ndo->ndo_name_cache_max == 0 ||
+	    st->bytes <= ndo->ndo_name_cache_max)
+		return;
+	while (st->bytes > ndo->ndo_name_cache_max && st->lru_tail != 0) {
+		name_remove(st, st->lru_tail);
+		st->stats.evictions++;
+	}
+	if (st->slab_bytes > 2 * st->name_bytes + 2 * NAME_SLAB_SIZE)
+		name_compact(ndo, st);
+}
+
+/*
+ * Get the counters of the cache: lookups that found a name and that
+ * didn't, names discarded, and the names cached and the memory they
+ * take.
+ */
+void
+nd_get_name_cache_stats(netdissect_options *ndo,
+			struct nd_name_cache_stats *stats)
+{
+	struct addrtoname_state *st = ndo->ndo_addrtoname;
+
+	if (st == NULL) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+	*stats = st->stats;
+	stats->names = st->nused;
+	stats->bytes = sizeof(*st) + st->nslots * sizeof(*st->slots) +
+	    st->nentries * sizeof(*st->entries) + st->slab_bytes;
+}
 
 #ifdef _WIN32
 /*
@@ -154,8 +609,8 @@ static struct hnamemem ipxsaptable[HASHNAMESIZE];
 static struct hostent *
 win32_gethostbyaddr(const char *addr, int len, int type)
 {
-	static struct hostent host;
-	static char hostbuf[NI_MAXHOST];
+	static ND_THREAD_LOCAL struct hostent host;
+	static ND_THREAD_LOCAL char hostbuf[NI_MAXHOST];
 	char hname[NI_MAXHOST];
 	struct sockaddr_in6 addr6;
 
@@ -183,47 +638,6 @@ win32_gethostbyaddr(const char *addr, int len, int type)
 #define gethostbyaddr win32_gethostbyaddr
 #endif /* _WIN32 */
 
-struct h6namemem {
-	nd_ipv6 addr;
-	char *name;
-	struct h6namemem *nxt;
-};
-
-static struct h6namemem h6nametable[HASHNAMESIZE];
-
-struct enamemem {
-	u_short e_addr0;
-	u_short e_addr1;
-	u_short e_addr2;
-	const char *e_name;
-	u_char *e_nsap;			/* used only for nsaptable[] */
-	struct enamemem *e_nxt;
-};
-
-static struct enamemem enametable[HASHNAMESIZE];
-static struct enamemem nsaptable[HASHNAMESIZE];
-
-struct bsnamemem {
-	u_short bs_addr0;
-	u_short bs_addr1;
-	u_short bs_addr2;
-	const char *bs_name;
-	u_char *bs_bytes;
-	unsigned int bs_nbytes;
-	struct bsnamemem *bs_nxt;
-};
-
-static struct bsnamemem bytestringtable[HASHNAMESIZE];
-
-struct protoidmem {
-	uint32_t p_oui;
-	u_short p_proto;
-	const char *p_name;
-	struct protoidmem *p_nxt;
-};
-
-static struct protoidmem protoidtable[HASHNAMESIZE];
-
 /*
  * A faster replacement for inet_ntoa().
  */
@@ -233,7 +647,7 @@ intoa(uint32_t addr)
 	char *cp;
 	u_int byte;
 	int n;
-	static char buf[sizeof(".xxx.xxx.xxx.xxx")];
+	static ND_THREAD_LOCAL char buf[sizeof(".xxx.xxx.xxx.xxx")];
 
 	NTOHL(addr);
 	cp = buf + sizeof(buf);
@@ -257,12 +671,109 @@ intoa(uint32_t addr)
 	return cp + 1;
 }
 
-static uint32_t f_netmask;
-static uint32_t f_localnet;
 #ifdef HAVE_CASPER
 extern cap_channel_t *capdns;
 #endif
 
+/*
+ * gethostbyaddr(), ether_ntohost() and the like aren't reentrant, and
+ * the printers of --workers and --chunks threads call them when there's
+ * neither -n nor --resolver-threads, so only one thread at a time may
+ * call them and copy out what they return.  nd_lookup_lock() and
+ * nd_lookup_unlock() are for printers that call such functions.
+ */
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t lookup_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOOKUP_LOCK()	pthread_mutex_lock(&lookup_lock)
+#define LOOKUP_UNLOCK()	pthread_mutex_unlock(&lookup_lock)
+#else
+#define LOOKUP_LOCK()
+#define LOOKUP_UNLOCK()
+#endif
+
+void
+nd_lookup_lock(void)
+{
+	LOOKUP_LOCK();
+}
+
+void
+nd_lookup_unlock(void)
+{
+	LOOKUP_UNLOCK();
+}
+
+/*
+ * Look up the host name of an IPv4 or IPv6 address, for ipaddr_string()
+ * and ip6addr_string(), and copy it to buf, without the domain if -N
+ * was given.  Returns RESOLVER_FOUND if there's a name, RESOLVER_NONE
+ * if there's none, and, with the resolver threads, RESOLVER_PENDING
+ * if the name isn't known yet.
+ */
+static int
+host_lookup(netdissect_options *ndo, int af, void *addr, u_int len,
+	    char *buf, size_t bufsize)
+{
+	struct hostent *hp;
+	char *dotp;
+
+#ifdef HAVE_LIBPTHREAD
+	if (nd_resolver_running) {
+		switch (nd_resolver_lookup(af, addr, buf, bufsize)) {
+
+		case RESOLVER_FOUND:
+			break;
+
+		case RESOLVER_PENDING:
+			return (RESOLVER_PENDING);
+
+		default:
+			return (RESOLVER_NONE);
+		}
+	} else
+#endif
+	{
+		LOOKUP_LOCK();
+#ifdef HAVE_CASPER
+		if (capdns != NULL)
+			hp = cap_gethostbyaddr(capdns, (char *)addr, len, af);
+		else
+#endif
+			hp = gethostbyaddr((char *)addr, len, af);
+		if (hp != NULL)
+			strlcpy(buf, hp->h_name, bufsize);
+		LOOKUP_UNLOCK();
+		if (hp == NULL)
+			return (RESOLVER_NONE);
+	}
+	if (ndo->ndo_Nflag) {
+		/* Remove domain qualifications */
+		dotp = strchr(buf, '.');
+		if (dotp)
+			*dotp = '\0';
+	}
+	return (RESOLVER_FOUND);
+}
+
+/*
+ * Copy a name that isn't to be cached into memory that lasts until the
+ * end of the packet, as the callers of ipaddr_string() and the like
+ * may hold on to two names at once.
+ */
+static const char *
+packet_name(netdissect_options *ndo, const char *name)
+{
+	size_t size = strlen(name) + 1;
+	char *p;
+
+	p = nd_malloc(ndo, size);
+	if (p == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+				  "packet_name: nd_malloc");
+	memcpy(p, name, size);
+	return (p);
+}
+
 /*
  * Return a name for the IP address pointed to by ap.  This address
  * is assumed to be in network byte order.
@@ -285,18 +796,22 @@ extern cap_channel_t *capdns;
 const char *
 ipaddr_string(netdissect_options *ndo, const u_char *ap)
 {
-	struct hostent *hp;
-	uint32_t addr;
-	struct hnamemem *p;
+	struct addrtoname_state *st = addrtoname_state(ndo);
+	uint32_t addr, hash;
+	const char *name;
+	char hname[NI_MAXHOST];
+	size_t len;
 
 	memcpy(&addr, ap, sizeof(addr));
-	p = &hnametable[addr & (HASHNAMESIZE-1)];
-	for (; p->nxt; p = p->nxt) {
-		if (p->addr == addr)
-			return (p->name);
-	}
-	p->addr = addr;
-	p->nxt = newhnamemem(ndo);
+	name = name_lookup(ndo, st, NAME_IPADDR, &addr, sizeof(addr), &hash);
+	if (name != NULL)
+		return (name);
+
+	if (ndo->ndo_name_map != NULL &&
+	    (name = nd_name_map_lookup(ndo->ndo_name_map, NAME_MAP_IPV4,
+	    &addr, &len)) != NULL)
+		return (name_add(ndo, st, NAME_IPADDR, &addr, sizeof(addr),
+		    hash, name, len, 0));
 
 	/*
 	 * Print names unless:
@@ -306,35 +821,21 @@ ipaddr_string(netdissect_options *ndo, const u_char *ap)
 	 *	    evaluates to true)
 	 */
 	if (!ndo->ndo_nflag &&
-	    (addr & f_netmask) == f_localnet) {
-#ifdef HAVE_CASPER
-		if (capdns != NULL) {
-			hp = cap_gethostbyaddr(capdns, (char *)&addr, 4,
-			    AF_INET);
-		} else
-#endif
-			hp = gethostbyaddr((char *)&addr, 4, AF_INET);
-		if (hp) {
-			char *dotp;
+	    (addr & st->f_netmask) == st->f_localnet) {
+		switch (host_lookup(ndo, AF_INET, &addr, sizeof(addr),
+		    hname, sizeof(hname))) {
 
-			p->name = strdup(hp->h_name);
-			if (p->name == NULL)
-				(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-					"ipaddr_string: strdup(hp->h_name)");
-			if (ndo->ndo_Nflag) {
-				/* Remove domain qualifications */
-				dotp = strchr(p->name, '.');
-				if (dotp)
-					*dotp = '\0';
-			}
-			return (p->name);
+		case RESOLVER_FOUND:
+			return (name_add(ndo, st, NAME_IPADDR, &addr,
+			    sizeof(addr), hash, hname, strlen(hname), 0));
+
+		case RESOLVER_PENDING:
+			return (packet_name(ndo, intoa(addr)));
 		}
 	}
-	p->name = strdup(intoa(addr));
-	if (p->name == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				  "ipaddr_string: strdup(intoa(addr))");
-	return (p->name);
+	name = intoa(addr);
+	return (name_add(ndo, st, NAME_IPADDR, &addr, sizeof(addr), hash,
+	    name, strlen(name), 0));
 }
 
 /*
@@ -344,61 +845,44 @@ ipaddr_string(netdissect_options *ndo, const u_char *ap)
 const char *
 ip6addr_string(netdissect_options *ndo, const u_char *ap)
 {
-	struct hostent *hp;
-	union {
-		nd_ipv6 addr;
-		struct for_hash_addr {
-			char fill[14];
-			uint16_t d;
-		} addra;
-	} addr;
-	struct h6namemem *p;
+	struct addrtoname_state *st = addrtoname_state(ndo);
+	nd_ipv6 addr;
+	uint32_t hash;
 	const char *cp;
 	char ntop_buf[INET6_ADDRSTRLEN];
+	char hname[NI_MAXHOST];
+	size_t len;
 
 	memcpy(&addr, ap, sizeof(addr));
-	p = &h6nametable[addr.addra.d & (HASHNAMESIZE-1)];
-	for (; p->nxt; p = p->nxt) {
-		if (memcmp(&p->addr, &addr, sizeof(addr)) == 0)
-			return (p->name);
-	}
-	memcpy(p->addr, addr.addr, sizeof(nd_ipv6));
-	p->nxt = newh6namemem(ndo);
+	cp = name_lookup(ndo, st, NAME_IP6ADDR, &addr, sizeof(addr), &hash);
+	if (cp != NULL)
+		return (cp);
+
+	if (ndo->ndo_name_map != NULL &&
+	    (cp = nd_name_map_lookup(ndo->ndo_name_map, NAME_MAP_IPV6,
+	    &addr, &len)) != NULL)
+		return (name_add(ndo, st, NAME_IP6ADDR, &addr, sizeof(addr),
+		    hash, cp, len, 0));
 
 	/*
 	 * Do not print names if -n was given.
 	 */
 	if (!ndo->ndo_nflag) {
-#ifdef HAVE_CASPER
-		if (capdns != NULL) {
-			hp = cap_gethostbyaddr(capdns, (char *)&addr,
-			    sizeof(addr), AF_INET6);
-		} else
-#endif
-			hp = gethostbyaddr((char *)&addr, sizeof(addr),
-			    AF_INET6);
-		if (hp) {
-			char *dotp;
+		switch (host_lookup(ndo, AF_INET6, &addr, sizeof(addr),
+		    hname, sizeof(hname))) {
 
-			p->name = strdup(hp->h_name);
-			if (p->name == NULL)
-				(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-					"ip6addr_string: strdup(hp->h_name)");
-			if (ndo->ndo_Nflag) {
-				/* Remove domain qualifications */
-				dotp = strchr(p->name, '.');
-				if (dotp)
-					*dotp = '\0';
-			}
-			return (p->name);
+		case RESOLVER_FOUND:
+			return (name_add(ndo, st, NAME_IP6ADDR, &addr,
+			    sizeof(addr), hash, hname, strlen(hname), 0));
+
+		case RESOLVER_PENDING:
+			return (packet_name(ndo,
+			    addrtostr6(ap, ntop_buf, sizeof(ntop_buf))));
 		}
 	}
 	cp = addrtostr6(ap, ntop_buf, sizeof(ntop_buf));
-	p->name = strdup(cp);
-	if (p->name == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				  "ip6addr_string: strdup(cp)");
-	return (p->name);
+	return (name_add(ndo, st, NAME_IP6ADDR, &addr, sizeof(addr), hash,
+	    cp, strlen(cp), 0));
 }
 
 static const char hex[16] = {
@@ -438,193 +922,45 @@ octet_to_hex(char *cp, uint8_t octet)
 	return (cp);
 }
 
-/* Find the hash node that corresponds the ether address 'ep' */
-
-static struct enamemem *
-lookup_emem(netdissect_options *ndo, const u_char *ep)
-{
-	u_int i, j, k;
-	struct enamemem *tp;
-
-	k = (ep[0] << 8) | ep[1];
-	j = (ep[2] << 8) | ep[3];
-	i = (ep[4] << 8) | ep[5];
-
-	tp = &enametable[(i ^ j) & (HASHNAMESIZE-1)];
-	while (tp->e_nxt)
-		if (tp->e_addr0 == i &&
-		    tp->e_addr1 == j &&
-		    tp->e_addr2 == k)
-			return tp;
-		else
-			tp = tp->e_nxt;
-	tp->e_addr0 = (u_short)i;
-	tp->e_addr1 = (u_short)j;
-	tp->e_addr2 = (u_short)k;
-	tp->e_nxt = (struct enamemem *)calloc(1, sizeof(*tp));
-	if (tp->e_nxt == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC, "lookup_emem: calloc");
-
-	return tp;
-}
-
-/*
- * Find the hash node that corresponds to the bytestring 'bs'
- * with length 'nlen'
- */
-
-static struct bsnamemem *
-lookup_bytestring(netdissect_options *ndo, const u_char *bs,
-		  const unsigned int nlen)
-{
-	struct bsnamemem *tp;
-	u_int i, j, k;
-
-	if (nlen >= 6) {
-		k = (bs[0] << 8) | bs[1];
-		j = (bs[2] << 8) | bs[3];
-		i = (bs[4] << 8) | bs[5];
-	} else if (nlen >= 4) {
-		k = (bs[0] << 8) | bs[1];
-		j = (bs[2] << 8) | bs[3];
-		i = 0;
-	} else
-		i = j = k = 0;
-
-	tp = &bytestringtable[(i ^ j) & (HASHNAMESIZE-1)];
-	while (tp->bs_nxt)
-		if (nlen == tp->bs_nbytes &&
-		    tp->bs_addr0 == i &&
-		    tp->bs_addr1 == j &&
-		    tp->bs_addr2 == k &&
-		    memcmp((const char *)bs, (const char *)(tp->bs_bytes), nlen) == 0)
-			return tp;
-		else
-			tp = tp->bs_nxt;
-
-	tp->bs_addr0 = (u_short)i;
-	tp->bs_addr1 = (u_short)j;
-	tp->bs_addr2 = (u_short)k;
-
-	tp->bs_bytes = (u_char *) calloc(1, nlen);
-	if (tp->bs_bytes == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				  "lookup_bytestring: calloc");
-
-	memcpy(tp->bs_bytes, bs, nlen);
-	tp->bs_nbytes = nlen;
-	tp->bs_nxt = (struct bsnamemem *)calloc(1, sizeof(*tp));
-	if (tp->bs_nxt == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				  "lookup_bytestring: calloc");
-
-	return tp;
-}
-
-/* Find the hash node that corresponds the NSAP 'nsap' */
-
-static struct enamemem *
-lookup_nsap(netdissect_options *ndo, const u_char *nsap,
-	    u_int nsap_length)
-{
-	u_int i, j, k;
-	struct enamemem *tp;
-	const u_char *ensap;
-
-	if (nsap_length > 6) {
-		ensap = nsap + nsap_length - 6;
-		k = (ensap[0] << 8) | ensap[1];
-		j = (ensap[2] << 8) | ensap[3];
-		i = (ensap[4] << 8) | ensap[5];
-	}
-	else
-		i = j = k = 0;
-
-	tp = &nsaptable[(i ^ j) & (HASHNAMESIZE-1)];
-	while (tp->e_nxt)
-		if (nsap_length == tp->e_nsap[0] &&
-		    tp->e_addr0 == i &&
-		    tp->e_addr1 == j &&
-		    tp->e_addr2 == k &&
-		    memcmp((const char *)nsap,
-			(char *)&(tp->e_nsap[1]), nsap_length) == 0)
-			return tp;
-		else
-			tp = tp->e_nxt;
-	tp->e_addr0 = (u_short)i;
-	tp->e_addr1 = (u_short)j;
-	tp->e_addr2 = (u_short)k;
-	tp->e_nsap = (u_char *)malloc(nsap_length + 1);
-	if (tp->e_nsap == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC, "lookup_nsap: malloc");
-	tp->e_nsap[0] = (u_char)nsap_length;	/* guaranteed < ISONSAP_MAX_LENGTH */
-	memcpy((char *)&tp->e_nsap[1], (const char *)nsap, nsap_length);
-	tp->e_nxt = (struct enamemem *)calloc(1, sizeof(*tp));
-	if (tp->e_nxt == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC, "lookup_nsap: calloc");
-
-	return tp;
-}
-
-/* Find the hash node that corresponds the protoid 'pi'. */
-
-static struct protoidmem *
-lookup_protoid(netdissect_options *ndo, const u_char *pi)
-{
-	u_int i, j;
-	struct protoidmem *tp;
-
-	/* 5 octets won't be aligned */
-	i = (((pi[0] << 8) + pi[1]) << 8) + pi[2];
-	j =   (pi[3] << 8) + pi[4];
-	/* XXX should be endian-insensitive, but do big-endian testing  XXX */
-
-	tp = &protoidtable[(i ^ j) & (HASHNAMESIZE-1)];
-	while (tp->p_nxt)
-		if (tp->p_oui == i && tp->p_proto == j)
-			return tp;
-		else
-			tp = tp->p_nxt;
-	tp->p_oui = i;
-	tp->p_proto = (u_short)j;
-	tp->p_nxt = (struct protoidmem *)calloc(1, sizeof(*tp));
-	if (tp->p_nxt == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC, "lookup_protoid: calloc");
-
-	return tp;
-}
-
 const char *
 etheraddr_string(netdissect_options *ndo, const uint8_t *ep)
 {
+	struct addrtoname_state *st = addrtoname_state(ndo);
 	int i;
 	char *cp;
-	struct enamemem *tp;
+	const char *name;
+	uint32_t hash;
 	int oui;
 	char buf[BUFSIZE];
-
-	tp = lookup_emem(ndo, ep);
-	if (tp->e_name)
-		return (tp->e_name);
+	size_t len;
+
+	name = name_lookup(ndo, st, NAME_ETHERADDR, ep, MAC_ADDR_LEN, &hash);
+	if (name != NULL)
+		return (name);
+	if (ndo->ndo_name_map != NULL &&
+	    (name = nd_name_map_lookup(ndo->ndo_name_map, NAME_MAP_MAC,
+	    ep, &len)) != NULL)
+		return (name_add(ndo, st, NAME_ETHERADDR, ep, MAC_ADDR_LEN,
+		    hash, name, len, 0));
 #ifdef USE_ETHER_NTOHOST
 	if (!ndo->ndo_nflag) {
 		char buf2[BUFSIZE];
-
-		if (ether_ntohost(buf2, (const struct ether_addr *)ep) == 0) {
-			tp->e_name = strdup(buf2);
-			if (tp->e_name == NULL)
-				(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-					"etheraddr_string: strdup(buf2)");
-			return (tp->e_name);
-		}
+		int ret;
+
+		LOOKUP_LOCK();
+		ret = ether_ntohost(buf2, (const struct ether_addr *)ep);
+		LOOKUP_UNLOCK();
+		if (ret == 0)
+			return (name_add(ndo, st, NAME_ETHERADDR, ep,
+			    MAC_ADDR_LEN, hash, buf2, strlen(buf2), 0));
 	}
 #endif
 	cp = buf;
 	oui = EXTRACT_BE_U_3(ep);
-	cp = octet_to_hex(cp, *ep++);
-	for (i = 5; --i >= 0;) {
+	cp = octet_to_hex(cp, ep[0]);
+	for (i = 1; i < MAC_ADDR_LEN; i++) {
 		*cp++ = ':';
-		cp = octet_to_hex(cp, *ep++);
+		cp = octet_to_hex(cp, ep[i]);
 	}
 
 	if (!ndo->ndo_nflag) {
@@ -632,25 +968,24 @@ etheraddr_string(netdissect_options *ndo, const uint8_t *ep)
 		    tok2str(oui_values, "Unknown", oui));
 	} else
 		*cp = '\0';
-	tp->e_name = strdup(buf);
-	if (tp->e_name == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				  "etheraddr_string: strdup(buf)");
-	return (tp->e_name);
+	return (name_add(ndo, st, NAME_ETHERADDR, ep, MAC_ADDR_LEN, hash,
+	    buf, strlen(buf), 0));
 }
 
 const char *
 le64addr_string(netdissect_options *ndo, const uint8_t *ep)
 {
+	struct addrtoname_state *st = addrtoname_state(ndo);
 	const unsigned int len = 8;
 	u_int i;
 	char *cp;
-	struct bsnamemem *tp;
+	const char *name;
+	uint32_t hash;
 	char buf[BUFSIZE];
 
-	tp = lookup_bytestring(ndo, ep, len);
-	if (tp->bs_name)
-		return (tp->bs_name);
+	name = name_lookup(ndo, st, NAME_BYTESTRING, ep, len, &hash);
+	if (name != NULL)
+		return (name);
 
 	cp = buf;
 	for (i = len; i > 0 ; --i) {
@@ -661,21 +996,19 @@ le64addr_string(netdissect_options *ndo, const uint8_t *ep)
 
 	*cp = '\0';
 
-	tp->bs_name = strdup(buf);
-	if (tp->bs_name == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				  "le64addr_string: strdup(buf)");
-
-	return (tp->bs_name);
+	return (name_add(ndo, st, NAME_BYTESTRING, ep, len, hash,
+	    buf, cp - buf, 0));
 }
 
 const char *
 linkaddr_string(netdissect_options *ndo, const uint8_t *ep,
 		const unsigned int type, const unsigned int len)
 {
+	struct addrtoname_state *st;
 	u_int i;
 	char *cp;
-	struct bsnamemem *tp;
+	const char *name;
+	uint32_t hash;
 
 	if (len == 0)
 		return ("<empty>");
@@ -686,21 +1019,20 @@ linkaddr_string(netdissect_options *ndo, const uint8_t *ep,
 	if (type == LINKADDR_FRELAY)
 		return (q922_string(ndo, ep, len));
 
-	tp = lookup_bytestring(ndo, ep, len);
-	if (tp->bs_name)
-		return (tp->bs_name);
+	st = addrtoname_state(ndo);
+	name = name_lookup(ndo, st, NAME_BYTESTRING, ep, len, &hash);
+	if (name != NULL)
+		return (name);
 
-	tp->bs_name = cp = (char *)malloc(len*3);
-	if (tp->bs_name == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				  "linkaddr_string: malloc");
+	/* Format the name in the cache, "xx:" for each byte but the last */
+	name = cp = name_add(ndo, st, NAME_BYTESTRING, ep, len, hash, NULL,
+	    len*3 - 1, 0);
 	cp = octet_to_hex(cp, *ep++);
 	for (i = len-1; i > 0 ; --i) {
 		*cp++ = ':';
 		cp = octet_to_hex(cp, *ep++);
 	}
-	*cp = '\0';
-	return (tp->bs_name);
+	return (name);
 }
 
 #define ISONSAP_MAX_LENGTH 20
@@ -708,22 +1040,23 @@ const char *
 isonsap_string(netdissect_options *ndo, const uint8_t *nsap,
 	       u_int nsap_length)
 {
+	struct addrtoname_state *st;
+	const uint8_t *key = nsap;
 	u_int nsap_idx;
 	char *cp;
-	struct enamemem *tp;
+	const char *name;
+	uint32_t hash;
+	char buf[sizeof("xx.xxxx.xxxx.xxxx.xxxx.xxxx.xxxx.xxxx.xxxx.xxxx.xx")];
 
 	if (nsap_length < 1 || nsap_length > ISONSAP_MAX_LENGTH)
 		return ("isonsap_string: illegal length");
 
-	tp = lookup_nsap(ndo, nsap, nsap_length);
-	if (tp->e_name)
-		return tp->e_name;
-
-	tp->e_name = cp = (char *)malloc(sizeof("xx.xxxx.xxxx.xxxx.xxxx.xxxx.xxxx.xxxx.xxxx.xxxx.xx"));
-	if (cp == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				  "isonsap_string: malloc");
+	st = addrtoname_state(ndo);
+	name = name_lookup(ndo, st, NAME_ISONSAP, nsap, nsap_length, &hash);
+	if (name != NULL)
+		return (name);
 
+	cp = buf;
 	for (nsap_idx = 0; nsap_idx < nsap_length; nsap_idx++) {
 		cp = octet_to_hex(cp, *nsap++);
 		if (((nsap_idx & 1) == 0) &&
@@ -732,67 +1065,57 @@ isonsap_string(netdissect_options *ndo, const uint8_t *nsap,
 		}
 	}
 	*cp = '\0';
-	return (tp->e_name);
+	return (name_add(ndo, st, NAME_ISONSAP, key, nsap_length, hash,
+	    buf, cp - buf, 0));
 }
 
 const char *
 tcpport_string(netdissect_options *ndo, u_short port)
 {
-	struct hnamemem *tp;
-	uint32_t i = port;
+	struct addrtoname_state *st = addrtoname_state(ndo);
+	const char *name;
+	uint32_t hash;
 	char buf[sizeof("00000")];
 
-	for (tp = &tporttable[i & (HASHNAMESIZE-1)]; tp->nxt; tp = tp->nxt)
-		if (tp->addr == i)
-			return (tp->name);
+	name = name_lookup(ndo, st, NAME_TCPPORT, &port, sizeof(port), &hash);
+	if (name != NULL)
+		return (name);
 
-	tp->addr = i;
-	tp->nxt = newhnamemem(ndo);
-
-	(void)snprintf(buf, sizeof(buf), "%u", i);
-	tp->name = strdup(buf);
-	if (tp->name == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				  "tcpport_string: strdup(buf)");
-	return (tp->name);
+	(void)snprintf(buf, sizeof(buf), "%u", port);
+	return (name_add(ndo, st, NAME_TCPPORT, &port, sizeof(port), hash,
+	    buf, strlen(buf), 0));
 }
 
 const char *
 udpport_string(netdissect_options *ndo, u_short port)
 {
-	struct hnamemem *tp;
-	uint32_t i = port;
+	struct addrtoname_state *st = addrtoname_state(ndo);
+	const char *name;
+	uint32_t hash;
 	char buf[sizeof("00000")];
 
-	for (tp = &uporttable[i & (HASHNAMESIZE-1)]; tp->nxt; tp = tp->nxt)
-		if (tp->addr == i)
-			return (tp->name);
-
-	tp->addr = i;
-	tp->nxt = newhnamemem(ndo);
+	name = name_lookup(ndo, st, NAME_UDPPORT, &port, sizeof(port), &hash);
+	if (name != NULL)
+		return (name);
 
-	(void)snprintf(buf, sizeof(buf), "%u", i);
-	tp->name = strdup(buf);
-	if (tp->name == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				  "udpport_string: strdup(buf)");
-	return (tp->name);
+	(void)snprintf(buf, sizeof(buf), "%u", port);
+	return (name_add(ndo, st, NAME_UDPPORT, &port, sizeof(port), hash,
+	    buf, strlen(buf), 0));
 }
 
 const char *
 ipxsap_string(netdissect_options *ndo, u_short port)
 {
+	struct addrtoname_state *st = addrtoname_state(ndo);
 	char *cp;
-	struct hnamemem *tp;
-	uint32_t i = port;
+	const char *name;
+	uint32_t hash;
+	u_short key = port;
 	char buf[sizeof("0000")];
 
-	for (tp = &ipxsaptable[i & (HASHNAMESIZE-1)]; tp->nxt; tp = tp->nxt)
-		if (tp->addr == i)
-			return (tp->name);
-
-	tp->addr = i;
-	tp->nxt = newhnamemem(ndo);
+	name = name_lookup(ndo, st, NAME_IPXSAP, &key, sizeof(key), &hash);
+	if (name != NULL)
+		return (name);
 
 	cp = buf;
 	NTOHS(port);
@@ -801,138 +1124,98 @@ ipxsap_string(netdissect_options *ndo, u_short port)
 	*cp++ = hex[port >> 4 & 0xf];
 	*cp++ = hex[port & 0xf];
 	*cp++ = '\0';
-	tp->name = strdup(buf);
-	if (tp->name == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				  "ipxsap_string: strdup(buf)");
-	return (tp->name);
+	return (name_add(ndo, st, NAME_IPXSAP, &key, sizeof(key), hash,
+	    buf, 4, 0));
 }
 
+/*
+ * Add a name from init_addrtoname(), which is never discarded, unless
+ * there's already one for the key.
+ */
 static void
-init_servarray(netdissect_options *ndo)
+name_add_pinned_len(netdissect_options *ndo, u_int kind, const void *key,
+		    u_int keylen, const char *name, size_t namelen)
 {
-	struct servent *sv;
-	struct hnamemem *table;
-	int i;
-	char buf[sizeof("0000000000")];
+	struct addrtoname_state *st = addrtoname_state(ndo);
+	uint32_t hash;
 
-	while ((sv = getservent()) != NULL) {
-		int port = ntohs(sv->s_port);
-		i = port & (HASHNAMESIZE-1);
-		if (strcmp(sv->s_proto, "tcp") == 0)
-			table = &tporttable[i];
-		else if (strcmp(sv->s_proto, "udp") == 0)
-			table = &uporttable[i];
-		else
-			continue;
+	hash = name_hash(st->seed, kind, key, keylen);
+	if (name_find(st, kind, key, keylen, hash) == 0)
+		(void)name_add(ndo, st, kind, key, keylen, hash, name,
+		    namelen, 1);
+}
 
-		while (table->name)
-			table = table->nxt;
-		if (ndo->ndo_nflag) {
-			(void)snprintf(buf, sizeof(buf), "%d", port);
-			table->name = strdup(buf);
-		} else
-			table->name = strdup(sv->s_name);
-		if (table->name == NULL)
-			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-					  "init_servarray: strdup");
+static void
+name_add_pinned(netdissect_options *ndo, u_int kind, const void *key,
+		u_int keylen, const char *name)
+{
+	name_add_pinned_len(ndo, kind, key, keylen, name, strlen(name));
+}
 
-		table->addr = port;
-		table->nxt = newhnamemem(ndo);
-	}
-	endservent();
+/* Is there a name for the key in the --name-map file? */
+static int
+in_name_map(netdissect_options *ndo, u_int kind, const void *key)
+{
+	size_t len;
+
+	return (ndo->ndo_name_map != NULL &&
+	    nd_name_map_lookup(ndo->ndo_name_map, kind, key, &len) != NULL);
 }
 
-static const struct eproto {
-	const char *s;
-	u_short p;
-} eproto_db[] = {
-	{ "arp", ETHERTYPE_ARP },
-	{ "atalk", ETHERTYPE_ATALK },
-	{ "atalkarp", ETHERTYPE_AARP },
-	{ "decdns", ETHERTYPE_DECDNS },
-	{ "decdts", ETHERTYPE_DECDTS },
-	{ "decnet", ETHERTYPE_DN },
-	{ "ip", ETHERTYPE_IP },
-	{ "ip6", ETHERTYPE_IPV6 },
-	{ "lanbridge", ETHERTYPE_LANBRIDGE },
-	{ "lat", ETHERTYPE_LAT },
-	{ "loopback", ETHERTYPE_LOOPBACK },
-	{ "mopdl", ETHERTYPE_MOPDL },
-	{ "moprc", ETHERTYPE_MOPRC },
-	{ "pup", ETHERTYPE_PUP },
-	{ "rarp", ETHERTYPE_REVARP },
-	{ "sca", ETHERTYPE_SCA },
-	{ "sprite", ETHERTYPE_SPRITE },
-	{ "vexp", ETHERTYPE_VEXP },
-	{ "vprod", ETHERTYPE_VPROD },
-	{ "xns", ETHERTYPE_NS },
-	{ (char *)0, 0 }
+struct map_port_arg {
+	netdissect_options *ndo;
+	u_int kind;
 };
 
 static void
-init_eprotoarray(netdissect_options *ndo)
+add_map_port(const void *key, const char *name, size_t len, void *arg)
 {
-	int i;
-	struct hnamemem *table;
-
-	for (i = 0; eproto_db[i].s; i++) {
-		int j = htons(eproto_db[i].p) & (HASHNAMESIZE-1);
-		table = &eprototable[j];
-		while (table->name)
-			table = table->nxt;
-		table->name = eproto_db[i].s;
-		table->addr = htons(eproto_db[i].p);
-		table->nxt = newhnamemem(ndo);
-	}
-}
+	struct map_port_arg *a = arg;
 
-static const struct protoidlist {
-	const u_char protoid[5];
-	const char *name;
-} protoidlist[] = {
-	{{ 0x00, 0x00, 0x0c, 0x01, 0x07 }, "CiscoMLS" },
-	{{ 0x00, 0x00, 0x0c, 0x20, 0x00 }, "CiscoCDP" },
-	{{ 0x00, 0x00, 0x0c, 0x20, 0x01 }, "CiscoCGMP" },
-	{{ 0x00, 0x00, 0x0c, 0x20, 0x03 }, "CiscoVTP" },
-	{{ 0x00, 0xe0, 0x2b, 0x00, 0xbb }, "ExtremeEDP" },
-	{{ 0x00, 0x00, 0x00, 0x00, 0x00 }, NULL }
-};
+	name_add_pinned_len(a->ndo, a->kind, key, sizeof(u_short), name, len);
+}
 
 /*
- * SNAP proto IDs with org code 0:0:0 are actually encapsulated Ethernet
- * types.
+ * Put the ports in the --name-map file in the cache ahead of the
+ * services file, which name_add_pinned() then won't override.
  */
 static void
-init_protoidarray(netdissect_options *ndo)
+init_map_ports(netdissect_options *ndo)
 {
-	int i;
-	struct protoidmem *tp;
-	const struct protoidlist *pl;
-	u_char protoid[5];
-
-	protoid[0] = 0;
-	protoid[1] = 0;
-	protoid[2] = 0;
-	for (i = 0; eproto_db[i].s; i++) {
-		u_short etype = htons(eproto_db[i].p);
-
-		memcpy((char *)&protoid[3], (char *)&etype, 2);
-		tp = lookup_protoid(ndo, protoid);
-		tp->p_name = strdup(eproto_db[i].s);
-		if (tp->p_name == NULL)
-			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				"init_protoidarray: strdup(eproto_db[i].s)");
-	}
-	/* Hardwire some SNAP proto ID names */
-	for (pl = protoidlist; pl->name != NULL; ++pl) {
-		tp = lookup_protoid(ndo, pl->protoid);
-		/* Don't override existing name */
-		if (tp->p_name != NULL)
+	struct map_port_arg a;
+
+	a.ndo = ndo;
+	a.kind = NAME_TCPPORT;
+	nd_name_map_walk(ndo->ndo_name_map, NAME_MAP_TCP, add_map_port, &a);
+	a.kind = NAME_UDPPORT;
+	nd_name_map_walk(ndo->ndo_name_map, NAME_MAP_UDP, add_map_port, &a);
+}
+
+static void
+init_servarray(netdissect_options *ndo)
+{
+	struct servent *sv;
+	u_int kind;
+	u_short port;
+	char buf[sizeof("0000000000")];
+
+	while ((sv = getservent()) != NULL) {
+		port = ntohs(sv->s_port);
+		if (strcmp(sv->s_proto, "tcp") == 0)
+			kind = NAME_TCPPORT;
+		else if (strcmp(sv->s_proto, "udp") == 0)
+			kind = NAME_UDPPORT;
+		else
 			continue;
 
-		tp->p_name = pl->name;
+		if (ndo->ndo_nflag) {
+			(void)snprintf(buf, sizeof(buf), "%d", port);
+			name_add_pinned(ndo, kind, &port, sizeof(port), buf);
+		} else
+			name_add_pinned(ndo, kind, &port, sizeof(port),
+			    sv->s_name);
 	}
+	endservent();
 }
 
 static const struct etherlist {
@@ -961,47 +1244,48 @@ static void
 init_etherarray(netdissect_options *ndo)
 {
 	const struct etherlist *el;
-	struct enamemem *tp;
 #ifdef USE_ETHER_NTOHOST
 	char name[256];
 #else
+	struct addrtoname_state *st = addrtoname_state(ndo);
 	struct pcap_etherent *ep;
 	FILE *fp;
+	uint32_t n;
 
-	/* Suck in entire ethers file */
+	/* Suck in entire ethers file; the last name for an address wins */
 	fp = fopen(PCAP_ETHERS_FILE, "r");
 	if (fp != NULL) {
 		while ((ep = pcap_next_etherent(fp)) != NULL) {
-			tp = lookup_emem(ndo, ep->addr);
-			tp->e_name = strdup(ep->name);
-			if (tp->e_name == NULL)
-				(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-					"init_etherarray: strdup(ep->addr)");
+			if (in_name_map(ndo, NAME_MAP_MAC, ep->addr))
+				continue;
+			n = name_find(st, NAME_ETHERADDR, ep->addr,
+			    MAC_ADDR_LEN, name_hash(st->seed, NAME_ETHERADDR,
+			    ep->addr, MAC_ADDR_LEN));
+			if (n != 0)
+				name_remove(st, n);
+			name_add_pinned(ndo, NAME_ETHERADDR, ep->addr,
+			    MAC_ADDR_LEN, ep->name);
 		}
 		(void)fclose(fp);
 	}
 #endif
 
-	/* Hardwire some ethernet names */
+	/* Hardwire some ethernet names; name_add_pinned() won't override */
 	for (el = etherlist; el->name != NULL; ++el) {
-		tp = lookup_emem(ndo, el->addr);
-		/* Don't override existing name */
-		if (tp->e_name != NULL)
+		if (in_name_map(ndo, NAME_MAP_MAC, el->addr))
 			continue;
-
 #ifdef USE_ETHER_NTOHOST
 		/*
 		 * Use YP/NIS version of name if available.
 		 */
 		if (ether_ntohost(name, (const struct ether_addr *)el->addr) == 0) {
-			tp->e_name = strdup(name);
-			if (tp->e_name == NULL)
-				(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-					"init_etherarray: strdup(name)");
+			name_add_pinned(ndo, NAME_ETHERADDR, el->addr,
+			    MAC_ADDR_LEN, name);
 			continue;
 		}
 #endif
-		tp->e_name = el->name;
+		name_add_pinned(ndo, NAME_ETHERADDR, el->addr, MAC_ADDR_LEN,
+		    el->name);
 	}
 }
 
@@ -1229,16 +1513,12 @@ static void
 init_ipxsaparray(netdissect_options *ndo)
 {
 	int i;
-	struct hnamemem *table;
+	u_short port;
 
 	for (i = 0; ipxsap_db[i].s != NULL; i++) {
-		u_int j = htons(ipxsap_db[i].v) & (HASHNAMESIZE-1);
-		table = &ipxsaptable[j];
-		while (table->name)
-			table = table->nxt;
-		table->name = ipxsap_db[i].s;
-		table->addr = htons(ipxsap_db[i].v);
-		table->nxt = newhnamemem(ndo);
+		port = htons(ipxsap_db[i].v);
+		name_add_pinned(ndo, NAME_IPXSAP, &port, sizeof(port),
+		    ipxsap_db[i].s);
 	}
 }
 
@@ -1251,10 +1531,14 @@ init_ipxsaparray(netdissect_options *ndo)
 void
 init_addrtoname(netdissect_options *ndo, uint32_t localnet, uint32_t mask)
 {
+	struct addrtoname_state *st = addrtoname_state(ndo);
+
 	if (ndo->ndo_fflag) {
-		f_localnet = localnet;
-		f_netmask = mask;
+		st->f_localnet = localnet;
+		st->f_netmask = mask;
 	}
+	if (ndo->ndo_name_map != NULL)
+		init_map_ports(ndo);
 	if (ndo->ndo_nflag)
 		/*
 		 * Simplest way to suppress names.
@@ -1263,73 +1547,56 @@ init_addrtoname(netdissect_options *ndo, uint32_t localnet, uint32_t mask)
 
 	init_etherarray(ndo);
 	init_servarray(ndo);
-	init_eprotoarray(ndo);
-	init_protoidarray(ndo);
 	init_ipxsaparray(ndo);
 }
 
 const char *
 dnaddr_string(netdissect_options *ndo, u_short dnaddr)
 {
-	struct hnamemem *tp;
-
-	for (tp = &dnaddrtable[dnaddr & (HASHNAMESIZE-1)]; tp->nxt != NULL;
-	     tp = tp->nxt)
-		if (tp->addr == dnaddr)
-			return (tp->name);
-
-	tp->addr = dnaddr;
-	tp->nxt = newhnamemem(ndo);
-	tp->name = dnnum_string(ndo, dnaddr);
-
-	return(tp->name);
+	struct addrtoname_state *st = addrtoname_state(ndo);
+	const char *name;
+	char *str;
+	uint32_t hash;
+
+	name = name_lookup(ndo, st, NAME_DNADDR, &dnaddr, sizeof(dnaddr),
+	    &hash);
+	if (name != NULL)
+		return (name);
+
+	str = (char *)dnnum_string(ndo, dnaddr);
+	name = name_add(ndo, st, NAME_DNADDR, &dnaddr, sizeof(dnaddr), hash,
+	    str, strlen(str), 0);
+	free(str);
+	return (name);
 }
 
-/* Return a zero'ed hnamemem struct and cuts down on calloc() overhead */
-struct hnamemem *
-newhnamemem(netdissect_options *ndo)
+/*
+ * Free the address-to-name cache of this netdissect_options, including
+ * the entries init_addrtoname() put there.
+ */
+void
+addrtoname_free_state(netdissect_options *ndo)
 {
-	struct hnamemem *p;
-	static struct hnamemem *ptr = NULL;
-	static u_int num = 0;
-
-	if (num  <= 0) {
-		num = 64;
-		ptr = (struct hnamemem *)calloc(num, sizeof (*ptr));
-		if (ptr == NULL)
-			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-					  "newhnamemem: calloc");
-	}
-	--num;
-	p = ptr++;
-	return (p);
-}
+	struct addrtoname_state *st = ndo->ndo_addrtoname;
+	struct name_slab *s;
 
-/* Return a zero'ed h6namemem struct and cuts down on calloc() overhead */
-struct h6namemem *
-newh6namemem(netdissect_options *ndo)
-{
-	struct h6namemem *p;
-	static struct h6namemem *ptr = NULL;
-	static u_int num = 0;
-
-	if (num  <= 0) {
-		num = 64;
-		ptr = (struct h6namemem *)calloc(num, sizeof (*ptr));
-		if (ptr == NULL)
-			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-					  "newh6namemem: calloc");
+	if (st == NULL)
+		return;
+	while ((s = st->slabs) != NULL) {
+		st->slabs = s->next;
+		free(s);
 	}
-	--num;
-	p = ptr++;
-	return (p);
+	free(st->slots);
+	free(st->entries);
+	free(st);
+	ndo->ndo_addrtoname = NULL;
 }
 
 /* Represent TCI part of the 802.1Q 4-octet tag as text. */
 const char *
 ieee8021q_tci_string(const uint16_t tci)
 {
-	static char buf[128];
+	static ND_THREAD_LOCAL char buf[128];
 	snprintf(buf, sizeof(buf), "vlan %u, p %u%s",
 	         tci & 0xfff,
 	         tci >> 13,
@@ -54,8 +54,8 @@ extern const char *ip6addr_string(netdissect_options *, const u_char *);
 extern const char *intoa(uint32_t);
 
 extern void init_addrtoname(netdissect_options *, uint32_t, uint32_t);
-extern struct hnamemem *newhnamemem(netdissect_options *);
-extern struct h6namemem *newh6namemem(netdissect_options *);
+extern void nd_lookup_lock(void);
+extern void nd_lookup_unlock(void);
 extern const char * ieee8021q_tci_string(const uint16_t);
 
 /* macro(s) and inline function(s) with setjmp/longjmp logic to call
@@ -0,0 +1,679 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Chunk-parallel dissection of a savefile (--chunks).
+ *
+ * mfile_split() cuts the mapping of the savefile into chunks of about
+ * the same size, each starting with a record.  The threads take the
+ * chunks in file order, and each dissects a whole chunk, with its own
+ * copy of the netdissect_options, into a text buffer; the main thread
+ * writes the buffers to the standard output in file order.  A thread
+ * may only take a chunk within a window past the one being written, so
+ * that the text waiting to be written stays bounded.
+ *
+ * The chunks are the same whatever the number of threads, and each is
+ * dissected as if it were at the start of the file, so the output
+ * doesn't depend on the number of threads; what it loses is what the
+ * printers would have learned from the packets in earlier chunks (see
+ * nd_forget_conversations()).  Packet numbers (-#) and the time stamps
+ * relative to the previous or the first packet (-ttt, -ttttt) are
+ * fixed up here, so they are the same as without --chunks.
+ *
+ * A pcapng chunk needs the Section Header and Interface Description
+ * Blocks that came before it; each thread collects those of its chunk
+ * with mfile_scan(), and a chunk is only read once those of all the
+ * chunks before it are known, with mfile_replay().
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "netdissect.h"
+#include "addrtoname.h"
+#include "print.h"
+#include "timeval-operations.h"
+#include "mfile.h"
+#include "chunks.h"
+
+#ifdef HAVE_LIBPTHREAD
+
+#include <pthread.h>
+#include <signal.h>
+
+/* Chunks that may be dissected, or waiting to be written, per thread */
+#define WINDOW_PER_THREAD	2
+
+/* Initial size of a chunk's text buffer, and of its packet list */
+#define CHUNK_OUT_SIZE		65536
+#define CHUNK_PACKETS		1024
+
+/* How often, in packets, a thread checks whether it should stop */
+#define STOP_CHECK_PACKETS	256
+
+struct chunk_packet {
+	struct timeval ts;
+	size_t off;			/* start of its text */
+};
+
+struct chunk {
+	struct mfile *mf;		/* reader for the chunk */
+	char *out;			/* dissected text */
+	size_t outlen;
+	size_t outsize;
+	struct chunk_packet *pkts;
+	u_int npkts;
+	u_int pktsize;
+	u_int first_ts;			/* first packet with a time stamp */
+	struct timeval tv_ref;		/* ndo_tv_ref after the last packet */
+	size_t end;			/* where its last record ended */
+	int scanned;			/* mfile_scan() done */
+	int done;			/* dissected, ready to be written */
+	int failed;			/* errbuf says why */
+	char errbuf[PCAP_ERRBUF_SIZE];
+};
+
+struct chunk_thread {
+	netdissect_options ndo;		/* must be first, see chunk_printf() */
+	struct chunk *cur;		/* chunk being dissected */
+	pthread_t thread;
+};
+
+static struct chunk *chunks;
+static u_int nchunks;
+static size_t *bounds;
+static struct chunk_thread *threads;
+static int nthreads;
+static const struct bpf_program *filter;
+static struct timeval first_tv;		/* for -ttttt */
+
+static pthread_mutex_t chunk_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t space_cv = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t scan_cv = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cv = PTHREAD_COND_INITIALIZER;
+static u_int next_chunk;		/* next chunk to take */
+static u_int written;			/* next chunk to write */
+static u_int nscanned;			/* leading chunks that are scanned */
+static u_int window;
+static int stopping;
+
+static volatile sig_atomic_t break_requested;
+
+/*
+ * ndo_printf for the threads: append to the text buffer of the chunk
+ * being dissected.
+ */
+static int
+chunk_printf(netdissect_options *ndo, const char *fmt, ...)
+{
+	struct chunk_thread *t = (struct chunk_thread *)ndo;
+	struct chunk *c = t->cur;
+	va_list args;
+	int ret;
+	size_t newsize;
+	char *newout;
+
+	for (;;) {
+		va_start(args, fmt);
+		ret = vsnprintf(c->out + c->outlen, c->outsize - c->outlen,
+				fmt, args);
+		va_end(args);
+		if (ret < 0)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_WRITE_FILE,
+					  "Unable to format output: %s",
+					  strerror(errno));
+		if ((size_t)ret < c->outsize - c->outlen)
+			break;
+		newsize = c->outsize != 0 ? c->outsize * 2 : CHUNK_OUT_SIZE;
+		while (newsize - c->outlen <= (size_t)ret)
+			newsize *= 2;
+		newout = realloc(c->out, newsize);
+		if (newout == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+					  "%s: realloc", __func__);
+		c->out = newout;
+		c->outsize = newsize;
+	}
+	c->outlen += ret;
+	return (ret);
+}
+
+/* Would pretty_print_packet() print the time stamp of this packet? */
+static int
+header_valid(const struct pcap_pkthdr *h)
+{
+	return (h->caplen != 0 && h->len != 0 && h->len >= h->caplen &&
+		h->len <= MAXIMUM_SNAPLEN);
+}
+
+static void
+chunk_fail(struct chunk *c, const char *msg)
+{
+	c->failed = 1;
+	snprintf(c->errbuf, sizeof(c->errbuf), "%s", msg);
+}
+
+/*
+ * Dissect chunk "c", which is chunk "k" or stands in for it, into its
+ * text buffer, starting with no state from the packets before it.
+ */
+static void
+dissect_chunk(struct chunk_thread *t, struct chunk *c, u_int k)
+{
+	struct chunk_packet *pkts;
+	struct pcap_pkthdr *h;
+	const u_char *data;
+	u_int i;
+	int status, stop;
+
+	for (i = 0; i < k; i++) {
+		if (mfile_replay(c->mf, chunks[i].mf) == -1) {
+			chunk_fail(c, mfile_geterr(c->mf));
+			return;
+		}
+	}
+	nd_forget_conversations(&t->ndo);
+	if (t->ndo.ndo_tflag == 5)
+		t->ndo.ndo_tv_ref = first_tv;
+	t->cur = c;
+	c->first_ts = UINT_MAX;
+	for (;;) {
+		if (c->npkts % STOP_CHECK_PACKETS == 0) {
+			pthread_mutex_lock(&chunk_lock);
+			stop = stopping;
+			pthread_mutex_unlock(&chunk_lock);
+			if (stop)
+				break;
+		}
+		status = mfile_next(c->mf, &h, &data, filter);
+		if (status == -2) {
+			c->end = (size_t)mfile_tell(c->mf);
+			break;
+		}
+		if (status == -1) {
+			chunk_fail(c, mfile_geterr(c->mf));
+			break;
+		}
+		if (c->npkts == c->pktsize) {
+			pkts = realloc(c->pkts, (c->pktsize != 0 ?
+			    c->pktsize * 2 : CHUNK_PACKETS) * sizeof(*pkts));
+			if (pkts == NULL)
+				(*t->ndo.ndo_error)(&t->ndo, S_ERR_ND_MEM_ALLOC,
+						    "%s: realloc", __func__);
+			c->pkts = pkts;
+			c->pktsize = c->pktsize != 0 ? c->pktsize * 2 :
+			    CHUNK_PACKETS;
+		}
+		c->pkts[c->npkts].ts = h->ts;
+		c->pkts[c->npkts].off = c->outlen;
+		if (c->first_ts == UINT_MAX && header_valid(h))
+			c->first_ts = c->npkts;
+		c->npkts++;
+		pretty_print_packet(&t->ndo, h, data, 0);
+	}
+	c->tv_ref = t->ndo.ndo_tv_ref;
+}
+
+static void *
+chunk_thread_main(void *arg)
+{
+	struct chunk_thread *t = (struct chunk_thread *)arg;
+	struct chunk *c;
+	u_int k;
+	int status;
+
+	pthread_mutex_lock(&chunk_lock);
+	for (;;) {
+		while (!stopping && next_chunk < nchunks &&
+		    next_chunk >= written + window)
+			pthread_cond_wait(&space_cv, &chunk_lock);
+		if (stopping || next_chunk == nchunks)
+			break;
+		k = next_chunk++;
+		c = &chunks[k];
+		pthread_mutex_unlock(&chunk_lock);
+
+		status = mfile_scan(c->mf);
+
+		pthread_mutex_lock(&chunk_lock);
+		if (status == -1)
+			chunk_fail(c, mfile_geterr(c->mf));
+		c->scanned = 1;
+		while (nscanned < nchunks && chunks[nscanned].scanned)
+			nscanned++;
+		pthread_cond_broadcast(&scan_cv);
+		while (!stopping && nscanned < k)
+			pthread_cond_wait(&scan_cv, &chunk_lock);
+		pthread_mutex_unlock(&chunk_lock);
+
+		/*
+		 * The chunks before this one are all scanned; if one of
+		 * them failed, this one won't be written, but dissecting
+		 * it anyway is harmless.
+		 */
+		if (!c->failed)
+			dissect_chunk(t, c, k);
+
+		pthread_mutex_lock(&chunk_lock);
+		c->done = 1;
+		pthread_cond_signal(&done_cv);
+	}
+	pthread_mutex_unlock(&chunk_lock);
+	tok_index_free();
+	return (NULL);
+}
+
+/*
+ * Find the time stamp of the first packet that passes the filter and
+ * would have its time stamp printed, for -ttttt.
+ */
+static int
+find_first_tv(struct mfile *mf, char *errbuf, size_t errbuf_size)
+{
+	struct mfile *rf;
+	struct pcap_pkthdr *h;
+	const u_char *data;
+	int status;
+
+	rf = mfile_range(mf, bounds[0], bounds[nchunks]);
+	if (rf == NULL) {
+		snprintf(errbuf, errbuf_size, "%s", mfile_geterr(mf));
+		return (-1);
+	}
+	while ((status = mfile_next(rf, &h, &data, filter)) == 1) {
+		if (header_valid(h)) {
+			first_tv = h->ts;
+			break;
+		}
+	}
+	if (status == -1)
+		snprintf(errbuf, errbuf_size, "%s", mfile_geterr(rf));
+	mfile_close(rf);
+	return (status == -1 ? -1 : 0);
+}
+
+static void
+write_text(netdissect_options *ndo, const char *p, size_t len)
+{
+	if (len != 0 && fwrite(p, 1, len, stdout) != len)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_WRITE_FILE,
+		    "Unable to write output: %s", strerror(errno));
+}
+
+/*
+ * Format the time stamp "ts" as ts_print() would with the reference
+ * time stamp "tv_ref", into the text buffer of "scratch".
+ */
+static const char *
+format_ts(struct chunk_thread *scratch, const struct timeval *ts,
+	  const struct timeval *tv_ref, size_t *lenp)
+{
+	scratch->cur->outlen = 0;
+	scratch->ndo.ndo_tv_ref = *tv_ref;
+	ts_print(&scratch->ndo, ts);
+	*lenp = scratch->cur->outlen;
+	return (scratch->cur->out);
+}
+
+/*
+ * Write the text of a chunk, numbering its packets for -#, fixing up
+ * the -ttt time stamp of its first packet, which its thread printed as
+ * if there were no packet before it, and stopping after "cnt" packets
+ * in all if "cnt" is positive.  Return 1 if that's the last packet.
+ */
+static int
+write_chunk(netdissect_options *ndo, struct chunk_thread *scratch,
+	    struct chunk *c, int cnt, u_int *npackets, struct timeval *tv_ref)
+{
+	const char *fix, *zero;
+	size_t start, end, fixlen, zerolen;
+	u_int i;
+	int reached = 0;
+
+	if (!ndo->ndo_packet_number && cnt <= 0 &&
+	    (ndo->ndo_tflag != 3 || c->first_ts == UINT_MAX ||
+	     !netdissect_timevalisset(tv_ref))) {
+		write_text(ndo, c->out, c->outlen);
+		*npackets += c->npkts;
+	} else {
+		for (i = 0; i < c->npkts; i++) {
+			if (cnt > 0 && *npackets >= (u_int)cnt) {
+				reached = 1;
+				break;
+			}
+			start = c->pkts[i].off;
+			end = i + 1 < c->npkts ? c->pkts[i + 1].off : c->outlen;
+			(*npackets)++;
+			if (ndo->ndo_packet_number)
+				fprintf(stdout, "%5u  ", *npackets);
+			if (i == c->first_ts && ndo->ndo_tflag == 3 &&
+			    netdissect_timevalisset(tv_ref)) {
+				zero = format_ts(scratch, &c->pkts[i].ts,
+				    &c->pkts[i].ts, &zerolen);
+				if (zerolen <= end - start &&
+				    memcmp(c->out + start, zero, zerolen) == 0) {
+					fix = format_ts(scratch, &c->pkts[i].ts,
+					    tv_ref, &fixlen);
+					write_text(ndo, fix, fixlen);
+					start += zerolen;
+				}
+			}
+			write_text(ndo, c->out + start, end - start);
+		}
+		if (cnt > 0 && *npackets >= (u_int)cnt)
+			reached = 1;
+	}
+	if (netdissect_timevalisset(&c->tv_ref))
+		*tv_ref = c->tv_ref;
+	if (ndo->ndo_flush_packets)
+		fflush(stdout);
+	return (reached);
+}
+
+/*
+ * Dissect into "c", in the main thread, the records from "start" on in
+ * place of chunk "k", whose thread started at what only looked like a
+ * record, as the chunk before it ended past where it was thought to
+ * start; "ndo", "localnet" and "mask" are as for chunks_run().
+ *
+ * The threads of the chunks after it were given the sections and
+ * interfaces described in chunk "k" as its thread saw them.  If it, or
+ * what's really there, describes any, as pcapng chunks can, or if
+ * *lastp is already set, as those of a chunk thrown away before it did,
+ * they may be wrong, so everything up to the end of the file is
+ * dissected, and *lastp is set.
+ *
+ * Return -1, with a message in "errbuf", if we're out of memory.
+ */
+static int
+redo_chunk(netdissect_options *ndo, struct mfile *mf, struct chunk *c,
+	   u_int k, size_t start, int *lastp, uint32_t localnet,
+	   uint32_t mask, char *errbuf, size_t errbuf_size)
+{
+	struct chunk_thread t;
+	int status;
+
+	if (mfile_has_state(chunks[k].mf))
+		*lastp = 1;
+	memset(c, 0, sizeof(*c));
+	for (;;) {
+		c->mf = mfile_range(mf, start,
+		    bounds[*lastp ? nchunks : k + 1]);
+		if (c->mf == NULL) {
+			snprintf(errbuf, errbuf_size, "%s", mfile_geterr(mf));
+			return (-1);
+		}
+		status = mfile_scan(c->mf);
+		if (status == -1 || *lastp || !mfile_has_state(c->mf))
+			break;
+		mfile_close(c->mf);
+		*lastp = 1;
+	}
+	memset(&t, 0, sizeof(t));
+	t.ndo = *ndo;
+	t.ndo.ndo_printf = chunk_printf;
+	t.ndo.ndo_packet_info_stack = NULL;
+	t.ndo.ndo_packet_number = 0;
+	nd_init_state(&t.ndo);
+	init_addrtoname(&t.ndo, localnet, mask);
+	if (status == -1)
+		chunk_fail(c, mfile_geterr(c->mf));
+	else
+		dissect_chunk(&t, c, k);
+	nd_free_state(&t.ndo);
+	return (0);
+}
+
+static void
+free_chunk(struct chunk *c)
+{
+	if (c->mf != NULL)
+		mfile_close(c->mf);
+	free(c->out);
+	free(c->pkts);
+	c->mf = NULL;
+	c->out = NULL;
+	c->pkts = NULL;
+}
+
+static void
+stop_threads(void)
+{
+	int i;
+
+	pthread_mutex_lock(&chunk_lock);
+	stopping = 1;
+	pthread_cond_broadcast(&space_cv);
+	pthread_cond_broadcast(&scan_cv);
+	pthread_mutex_unlock(&chunk_lock);
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i].thread, NULL);
+		nd_free_state(&threads[i].ndo);
+	}
+}
+
+static void
+free_chunks(void)
+{
+	u_int k;
+
+	for (k = 0; k < nchunks; k++)
+		free_chunk(&chunks[k]);
+	free(chunks);
+	free(bounds);
+	free(threads);
+	chunks = NULL;
+	bounds = NULL;
+	threads = NULL;
+	nchunks = 0;
+	nthreads = 0;
+}
+
+/*
+ * Dissect the packets of the mapped savefile "mf" that pass "fcode",
+ * in chunks of "chunk_size" bytes, with "count" threads, and write
+ * them to the standard output, as pcap_loop() with print_packet()
+ * would, stopping after "cnt" packets if "cnt" is positive.  "ndo" is
+ * the fully set up netdissect_options of the main thread; each thread
+ * gets a copy of it, with printer state of its own set up as
+ * init_print() does with "localnet" and "mask".  The number of packets
+ * written is added to "*npackets".
+ *
+ * Each chunk must start where the records of the one before it ended;
+ * where one doesn't, because mfile_split() took something in a packet
+ * for a record, what its thread dissected is thrown away and the main
+ * thread dissects its records from where they really start.
+ *
+ * Returns 0 at the end of the file, -2 if chunks_breakloop() was
+ * called, and -1, with a message in "errbuf", on an error.
+ */
+int
+chunks_run(netdissect_options *ndo, struct mfile *mf,
+	   const struct bpf_program *fcode, int count, size_t chunk_size,
+	   int cnt, uint32_t localnet, uint32_t mask, u_int *npackets,
+	   char *errbuf, size_t errbuf_size)
+{
+	struct chunk_thread scratch;
+	struct chunk scratch_chunk, redo;
+	struct timeval tv_ref, wait_until, now;
+	struct timespec ts;
+	sigset_t all, old;
+	struct chunk *c;
+	size_t start;
+	u_int k;
+	int i, err, status = 0, last, tainted = 0;
+
+	filter = fcode;
+	next_chunk = written = nscanned = 0;
+	stopping = 0;
+	break_requested = 0;
+	memset(&first_tv, 0, sizeof(first_tv));
+
+	bounds = mfile_split(mf, chunk_size, &nchunks);
+	if (bounds == NULL) {
+		snprintf(errbuf, errbuf_size, "%s", mfile_geterr(mf));
+		return (-1);
+	}
+	chunks = calloc(nchunks, sizeof(*chunks));
+	threads = calloc(count, sizeof(*threads));
+	if (chunks == NULL || threads == NULL) {
+		snprintf(errbuf, errbuf_size, "%s: calloc", __func__);
+		free_chunks();
+		return (-1);
+	}
+	for (k = 0; k < nchunks; k++) {
+		chunks[k].mf = mfile_range(mf, bounds[k], bounds[k + 1]);
+		if (chunks[k].mf == NULL) {
+			snprintf(errbuf, errbuf_size, "%s", mfile_geterr(mf));
+			free_chunks();
+			return (-1);
+		}
+	}
+	if (ndo->ndo_tflag == 5 &&
+	    find_first_tv(mf, errbuf, errbuf_size) == -1) {
+		free_chunks();
+		return (-1);
+	}
+	window = (u_int)count * WINDOW_PER_THREAD;
+
+	/*
+	 * Signals such as SIGINT must be delivered to the main thread,
+	 * which is the one that calls chunks_breakloop(); the new
+	 * threads inherit a mask that blocks all of them.
+	 */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for (i = 0; i < count; i++) {
+		struct chunk_thread *t = &threads[i];
+
+		t->ndo = *ndo;
+		t->ndo.ndo_printf = chunk_printf;
+		t->ndo.ndo_packet_info_stack = NULL;
+		t->ndo.ndo_packet_number = 0;
+		nd_init_state(&t->ndo);
+		init_addrtoname(&t->ndo, localnet, mask);
+		err = pthread_create(&t->thread, NULL, chunk_thread_main, t);
+		if (err != 0) {
+			snprintf(errbuf, errbuf_size,
+			    "can't create chunk thread: %s", strerror(err));
+			nd_free_state(&t->ndo);
+			pthread_sigmask(SIG_SETMASK, &old, NULL);
+			stop_threads();
+			free_chunks();
+			return (-1);
+		}
+		nthreads++;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	/* For formatting time stamps when fixing up -ttt */
+	memset(&scratch_chunk, 0, sizeof(scratch_chunk));
+	scratch.ndo = *ndo;
+	scratch.ndo.ndo_printf = chunk_printf;
+	scratch.cur = &scratch_chunk;
+	memset(&tv_ref, 0, sizeof(tv_ref));
+	memset(&redo, 0, sizeof(redo));
+	start = bounds[0];
+
+	while (written < nchunks) {
+		c = &chunks[written];
+
+		/*
+		 * A signal doesn't wake us up, so don't wait for long
+		 * at a time.
+		 */
+		pthread_mutex_lock(&chunk_lock);
+		while (!c->done && !break_requested) {
+			gettimeofday(&now, NULL);
+			wait_until.tv_sec = 0;
+			wait_until.tv_usec = 100000;
+			netdissect_timevaladd(&now, &wait_until, &wait_until,
+			    0);
+			ts.tv_sec = wait_until.tv_sec;
+			ts.tv_nsec = wait_until.tv_usec * 1000;
+			pthread_cond_timedwait(&done_cv, &chunk_lock, &ts);
+		}
+		pthread_mutex_unlock(&chunk_lock);
+		if (break_requested) {
+			status = -2;
+			break;
+		}
+		last = tainted;
+		if (start != bounds[written] || tainted) {
+			/* Did the chunk before run past all of this one? */
+			if (start >= bounds[written + 1]) {
+				if (mfile_has_state(c->mf))
+					tainted = 1;
+				goto next;
+			}
+			if (redo_chunk(ndo, mf, &redo, written, start, &last,
+			    localnet, mask, errbuf, errbuf_size) == -1) {
+				status = -1;
+				break;
+			}
+			c = &redo;
+		}
+		if (write_chunk(ndo, &scratch, c, cnt, npackets, &tv_ref))
+			break;
+		if (c->failed) {
+			snprintf(errbuf, errbuf_size, "chunk at offset %zu: %s",
+			    start, c->errbuf);
+			status = -1;
+			break;
+		}
+		start = c->end;
+		if (c == &redo)
+			free_chunk(&redo);
+		else {
+			free(c->out);
+			free(c->pkts);
+			c->out = NULL;
+			c->pkts = NULL;
+		}
+		if (last)
+			break;
+
+next:
+		pthread_mutex_lock(&chunk_lock);
+		written++;
+		pthread_cond_broadcast(&space_cv);
+		pthread_mutex_unlock(&chunk_lock);
+	}
+	fflush(stdout);
+	stop_threads();
+	free(scratch_chunk.out);
+	free_chunk(&redo);
+	free_chunks();
+	return (status);
+}
+
+/*
+ * Stop chunks_run(), from a signal handler in the main thread.
+ */
+void
+chunks_breakloop(void)
+{
+	break_requested = 1;
+}
+#endif /* HAVE_LIBPTHREAD */
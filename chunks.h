@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef chunks_h
+#define chunks_h
+
+/*
+ * Chunk-parallel dissection of a savefile (--chunks).
+ *
+ * The records of a memory-mapped savefile are split into chunks, which
+ * are dissected by a number of threads, each with a netdissect_options
+ * of its own that starts each chunk knowing nothing of the packets
+ * before it; the text of the chunks is written in file order.
+ *
+ * If we don't have both <pthread.h> and the threads library, undefine
+ * HAVE_LIBPTHREAD, so that later tests are done only on HAVE_LIBPTHREAD.
+ */
+#ifndef HAVE_PTHREAD_H
+#undef HAVE_LIBPTHREAD
+#endif
+
+#ifdef HAVE_LIBPTHREAD
+struct mfile;
+
+/* Maximum number of threads accepted by --chunks */
+#define CHUNKS_MAX_THREADS	256
+
+/* Default size of a chunk, in kilobytes */
+#define CHUNKS_DEFAULT_KBYTES	16384
+
+extern int chunks_run(netdissect_options *, struct mfile *,
+    const struct bpf_program *, int, size_t, int, uint32_t, uint32_t,
+    u_int *, char *, size_t);
+extern void chunks_breakloop(void);
+#endif /* HAVE_LIBPTHREAD */
+
+#endif /* chunks_h */
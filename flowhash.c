@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include "netdissect.h"
+#include "extract.h"
+#include "ethertype.h"
+#include "ipproto.h"
+#include "flowhash.h"
+
+static u_int
+hash_bytes(u_int h, const u_char *p, u_int len)
+{
+	while (len-- != 0) {
+		h ^= *p++;
+		h *= 16777619U;
+	}
+	return (h);
+}
+
+/*
+ * Hash of one end of a conversation: its address, and its port if
+ * "port" isn't NULL.
+ */
+static u_int
+end_hash(const u_char *addr, u_int len, const u_char *port)
+{
+	u_int h = 2166136261U;	/* FNV-1a */
+
+	h = hash_bytes(h, addr, len);
+	if (port != NULL)
+		h = hash_bytes(h, port, 2);
+	return (h);
+}
+
+u_int
+flow_hash(int linktype, const struct pcap_pkthdr *h, const u_char *sp,
+	  int ports)
+{
+	const u_char *p = sp;
+	u_int caplen = h->caplen;
+	u_int type, hlen, proto;
+
+	switch (linktype) {
+
+	case DLT_EN10MB:
+		if (caplen < 14)
+			return (0);
+		type = EXTRACT_BE_U_2(p + 12);
+		p += 14;
+		caplen -= 14;
+		while (type == ETHERTYPE_8021Q || type == ETHERTYPE_8021QinQ ||
+		       type == ETHERTYPE_8021Q9100) {
+			if (caplen < 4)
+				return (0);
+			type = EXTRACT_BE_U_2(p + 2);
+			p += 4;
+			caplen -= 4;
+		}
+		break;
+
+#ifdef DLT_LINUX_SLL
+	case DLT_LINUX_SLL:
+		if (caplen < 16)
+			return (0);
+		type = EXTRACT_BE_U_2(p + 14);
+		p += 16;
+		caplen -= 16;
+		break;
+#endif
+
+#ifdef DLT_LINUX_SLL2
+	case DLT_LINUX_SLL2:
+		if (caplen < 20)
+			return (0);
+		type = EXTRACT_BE_U_2(p);
+		p += 20;
+		caplen -= 20;
+		break;
+#endif
+
+	case DLT_RAW:
+#ifdef DLT_IPV4
+	case DLT_IPV4:
+#endif
+#ifdef DLT_IPV6
+	case DLT_IPV6:
+#endif
+		if (caplen < 1)
+			return (0);
+		type = EXTRACT_U_1(p) >> 4;
+		if (type == 4)
+			type = ETHERTYPE_IP;
+		else if (type == 6)
+			type = ETHERTYPE_IPV6;
+		break;
+
+	default:
+		return (0);
+	}
+
+	if (type == ETHERTYPE_IP && caplen >= 20) {
+		hlen = (EXTRACT_U_1(p) & 0x0f) * 4;
+		proto = EXTRACT_U_1(p + 9);
+		/* Only the first fragment has the ports; use none */
+		if (!ports || hlen < 20 || caplen < hlen + 4 ||
+		    (EXTRACT_BE_U_2(p + 6) & 0x3fff) != 0)
+			return (end_hash(p + 12, 4, NULL) +
+			    end_hash(p + 16, 4, NULL));
+	} else if (type == ETHERTYPE_IPV6 && caplen >= 40) {
+		hlen = 40;
+		proto = EXTRACT_U_1(p + 6);
+		if (!ports || caplen < hlen + 4)
+			return (end_hash(p + 8, 16, NULL) +
+			    end_hash(p + 24, 16, NULL));
+	} else
+		return (0);
+
+	switch (proto) {
+
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+	case IPPROTO_SCTP:
+	case IPPROTO_DCCP:
+		if (type == ETHERTYPE_IP)
+			return ((end_hash(p + 12, 4, p + hlen) +
+			    end_hash(p + 16, 4, p + hlen + 2)) ^ proto);
+		return ((end_hash(p + 8, 16, p + hlen) +
+		    end_hash(p + 24, 16, p + hlen + 2)) ^ proto);
+
+	default:
+		if (type == ETHERTYPE_IP)
+			return ((end_hash(p + 12, 4, NULL) +
+			    end_hash(p + 16, 4, NULL)) ^ proto);
+		return ((end_hash(p + 8, 16, NULL) +
+		    end_hash(p + 24, 16, NULL)) ^ proto);
+	}
+}
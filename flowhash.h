@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef flowhash_h
+#define flowhash_h
+
+/*
+ * Flow hashes of captured packets, for --workers and --sample-flows.
+ *
+ * flow_hash() hashes the IPv4 or IPv6 source and destination addresses
+ * of a packet and, if asked to, its protocol and TCP, UDP, SCTP or DCCP
+ * ports, symmetrically, so that both directions of a conversation get
+ * the same hash.  It looks at the link-layer header types that packets
+ * are usually captured with, and returns 0 for packets it can't parse.
+ */
+
+extern u_int flow_hash(int, const struct pcap_pkthdr *, const u_char *, int);
+
+#endif /* flowhash_h */
@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Reassembly of IPv4 and IPv6 fragments.
+ *
+ * Each incomplete datagram has a buffer its fragments are copied into,
+ * grown as fragments further into it come in, and a bitmap of the
+ * 8-byte blocks (fragment offsets are in units of 8 bytes) received so
+ * far; it's complete once the last fragment is in and every block up
+ * to it has been received.  The datagrams are in a hash table on their
+ * key, and in a list, oldest first, from which they're given up on
+ * when they time out or when the memory they take is over the limit.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "netdissect.h"
+#include "netdissect-alloc.h"
+#include "ipreasm.h"
+
+#define REASM_BLOCK		8
+#define REASM_BLOCKS(len)	(((len) + REASM_BLOCK - 1) / REASM_BLOCK)
+#define REASM_HASH_MIN		64
+
+struct reasm_dgram {
+	struct reasm_dgram *hnext;	/* next in the hash chain */
+	struct reasm_dgram *prev;	/* older */
+	struct reasm_dgram *next;	/* newer */
+	u_int ver;
+	u_char src[16];
+	u_char dst[16];
+	uint32_t id;
+	u_int key_proto;	/* IPv4 protocol; 0 for IPv6 */
+	u_int proto;		/* protocol from the fragment at offset 0 */
+	struct timeval first_ts;	/* time stamp of the first fragment */
+	int have_last;		/* the last fragment is in */
+	u_int total;		/* length of the datagram, once it is */
+	u_int maxend;		/* end of the data furthest in */
+	u_int nfrags;
+	u_int nset;		/* blocks received */
+	u_char *data;
+	u_int size;		/* bytes allocated for data */
+	u_char *blocks;		/* bitmap of the blocks received */
+	u_int blocks_size;	/* bytes allocated for it */
+};
+
+struct ipreasm_state {
+	struct reasm_dgram **hash;
+	u_int hash_size;	/* a power of 2 */
+	u_int count;
+	struct reasm_dgram *oldest;
+	struct reasm_dgram *newest;
+	struct nd_reasm_stats stats;
+};
+
+static struct ipreasm_state *
+ipreasm_state(netdissect_options *ndo)
+{
+	struct ipreasm_state *st = ndo->ndo_ipreasm;
+
+	if (st == NULL) {
+		st = calloc(1, sizeof(*st));
+		if (st == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+			    "ipreasm_state: calloc");
+		ndo->ndo_ipreasm = st;
+		st->hash_size = REASM_HASH_MIN;
+		st->hash = calloc(st->hash_size, sizeof(*st->hash));
+		if (st->hash == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+			    "ipreasm_state: calloc");
+		st->stats.bytes = sizeof(*st) +
+		    st->hash_size * sizeof(*st->hash);
+	}
+	return st;
+}
+
+static u_int
+dgram_hash(u_int ver, const u_char *src, const u_char *dst, uint32_t id,
+    u_int key_proto)
+{
+	u_int alen = ver == 6 ? 16 : 4;
+	uint32_t h = 2166136261U ^ id ^ (key_proto << 24);
+	u_int i;
+
+	for (i = 0; i < alen; i++)
+		h = (h ^ src[i]) * 16777619U;
+	for (i = 0; i < alen; i++)
+		h = (h ^ dst[i]) * 16777619U;
+	return h;
+}
+
+static size_t
+dgram_bytes(const struct reasm_dgram *d)
+{
+	return sizeof(*d) + d->size + d->blocks_size;
+}
+
+static void
+hash_grow(netdissect_options *ndo, struct ipreasm_state *st)
+{
+	struct reasm_dgram **hash, *d;
+	u_int size, b;
+
+	size = st->hash_size * 2;
+	hash = calloc(size, sizeof(*hash));
+	if (hash == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC, "hash_grow: calloc");
+	for (d = st->oldest; d != NULL; d = d->next) {
+		b = dgram_hash(d->ver, d->src, d->dst, d->id, d->key_proto) &
+		    (size - 1);
+		d->hnext = hash[b];
+		hash[b] = d;
+	}
+	free(st->hash);
+	st->stats.bytes += (size - st->hash_size) * sizeof(*hash);
+	st->hash = hash;
+	st->hash_size = size;
+}
+
+static void
+dgram_free(struct ipreasm_state *st, struct reasm_dgram *d)
+{
+	struct reasm_dgram **dp;
+
+	dp = &st->hash[dgram_hash(d->ver, d->src, d->dst, d->id,
+	    d->key_proto) & (st->hash_size - 1)];
+	while (*dp != d)
+		dp = &(*dp)->hnext;
+	*dp = d->hnext;
+	if (d->prev != NULL)
+		d->prev->next = d->next;
+	else
+		st->oldest = d->next;
+	if (d->next != NULL)
+		d->next->prev = d->prev;
+	else
+		st->newest = d->prev;
+	st->count--;
+	st->stats.bytes -= dgram_bytes(d);
+	free(d->data);
+	free(d->blocks);
+	free(d);
+}
+
+/* Give up on the datagrams whose first fragment is too old */
+static void
+expire(netdissect_options *ndo, struct ipreasm_state *st)
+{
+	u_int timeout;
+	struct reasm_dgram *d;
+	time_t secs;
+
+	timeout = ndo->ndo_reasm_timeout != 0 ?
+	    ndo->ndo_reasm_timeout : REASM_TIMEOUT_DEFAULT;
+	while ((d = st->oldest) != NULL) {
+		secs = ndo->ndo_ts.tv_sec - d->first_ts.tv_sec;
+		if (secs < (time_t)timeout || (secs == (time_t)timeout &&
+		    ndo->ndo_ts.tv_usec <= d->first_ts.tv_usec))
+			break;
+		st->stats.timed_out++;
+		dgram_free(st, d);
+	}
+}
+
+static struct reasm_dgram *
+dgram_find(netdissect_options *ndo, struct ipreasm_state *st,
+    const struct ipreasm_frag *f)
+{
+	u_int alen = f->ver == 6 ? 16 : 4;
+	u_int key_proto = f->ver == 6 ? 0 : f->proto;
+	struct reasm_dgram *d;
+	u_int b;
+
+	b = dgram_hash(f->ver, f->src, f->dst, f->id, key_proto) &
+	    (st->hash_size - 1);
+	for (d = st->hash[b]; d != NULL; d = d->hnext) {
+		if (d->ver == f->ver && d->id == f->id &&
+		    d->key_proto == key_proto &&
+		    memcmp(d->src, f->src, alen) == 0 &&
+		    memcmp(d->dst, f->dst, alen) == 0)
+			return d;
+	}
+
+	d = calloc(1, sizeof(*d));
+	if (d == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC, "dgram_find: calloc");
+	d->ver = f->ver;
+	memcpy(d->src, f->src, alen);
+	memcpy(d->dst, f->dst, alen);
+	d->id = f->id;
+	d->key_proto = key_proto;
+	d->proto = key_proto;
+	d->first_ts = ndo->ndo_ts;
+	d->hnext = st->hash[b];
+	st->hash[b] = d;
+	d->prev = st->newest;
+	if (st->newest != NULL)
+		st->newest->next = d;
+	else
+		st->oldest = d;
+	st->newest = d;
+	st->count++;
+	st->stats.bytes += dgram_bytes(d);
+	if (st->count > st->hash_size)
+		hash_grow(ndo, st);
+	return d;
+}
+
+/* Make room for the data up to "end", and the bitmap of its blocks */
+static int
+dgram_grow(struct ipreasm_state *st, struct reasm_dgram *d, u_int end,
+    u_int maxlen)
+{
+	u_int size, bsize;
+	u_char *p;
+
+	if (end <= d->size)
+		return 1;
+	size = d->size * 2;
+	if (size < end)
+		size = end;
+	if (size > maxlen)
+		size = maxlen;
+	p = realloc(d->data, size);
+	if (p == NULL)
+		return 0;
+	d->data = p;
+	st->stats.bytes += size - d->size;
+	d->size = size;
+
+	bsize = (REASM_BLOCKS(size) + 7) / 8;
+	if (bsize > d->blocks_size) {
+		p = realloc(d->blocks, bsize);
+		if (p == NULL)
+			return 0;
+		memset(p + d->blocks_size, 0, bsize - d->blocks_size);
+		d->blocks = p;
+		st->stats.bytes += bsize - d->blocks_size;
+		d->blocks_size = bsize;
+	}
+	return 1;
+}
+
+#define BLOCK_SET(d, b)	((d)->blocks[(b) / 8] & (1 << ((b) % 8)))
+
+/*
+ * Add a fragment to its datagram.  If that completes the datagram,
+ * return a buffer, freed with the rest of the packet's memory, holding
+ * the fragment's headers followed by the datagram, and set *lenp to
+ * its length, *nfragsp to the number of fragments and *protop to the
+ * protocol of the fragment at offset 0; otherwise return NULL.
+ */
+u_char *
+ipreasm_add(netdissect_options *ndo, const struct ipreasm_frag *f,
+    u_int *lenp, u_int *nfragsp, u_int *protop)
+{
+	struct ipreasm_state *st = ipreasm_state(ndo);
+	struct reasm_dgram *d;
+	size_t max;
+	u_int end, b, first, last, boff, bend;
+	int overlap;
+	u_char *buf;
+
+	expire(ndo, st);
+	st->stats.fragments++;
+	d = dgram_find(ndo, st, f);
+
+	/*
+	 * Every fragment but the last must be a whole number of blocks,
+	 * and no data can be past the end of the datagram, or past the
+	 * largest datagram there can be.
+	 */
+	end = f->off + f->len;
+	if (end > f->maxlen || (f->more && f->len % REASM_BLOCK != 0) ||
+	    (!f->more && d->have_last && end != d->total) ||
+	    (!f->more && d->maxend > end) ||
+	    (f->more && d->have_last && end > d->total))
+		goto discard;
+	if (!f->more) {
+		d->have_last = 1;
+		d->total = end;
+	}
+	if (end > d->maxend)
+		d->maxend = end;
+	if (!dgram_grow(st, d, end, f->maxlen))
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+		    "ipreasm_add: realloc");
+
+	first = f->off / REASM_BLOCK;
+	last = REASM_BLOCKS(end);
+	overlap = 0;
+	for (b = first; b < last; b++) {
+		if (BLOCK_SET(d, b)) {
+			overlap = 1;
+			break;
+		}
+	}
+	if (overlap) {
+		st->stats.overlaps++;
+		if (ndo->ndo_reasm_overlap == REASM_OVERLAP_DROP)
+			goto discard;
+	}
+	for (b = first; b < last; b++) {
+		if (BLOCK_SET(d, b)) {
+			if (ndo->ndo_reasm_overlap != REASM_OVERLAP_LAST)
+				continue;
+		} else {
+			d->blocks[b / 8] |= 1 << (b % 8);
+			d->nset++;
+		}
+		boff = b * REASM_BLOCK;
+		bend = boff + REASM_BLOCK < end ? boff + REASM_BLOCK : end;
+		memcpy(d->data + boff, f->data + (boff - f->off), bend - boff);
+	}
+	if (f->off == 0 &&
+	    (!overlap || ndo->ndo_reasm_overlap == REASM_OVERLAP_LAST))
+		d->proto = f->proto;
+	d->nfrags++;
+
+	/* Stay within the limit, giving up on the oldest datagrams */
+	max = ndo->ndo_reasm_max != 0 ? ndo->ndo_reasm_max : REASM_MAX_DEFAULT;
+	if (st->stats.bytes > st->stats.peak_bytes)
+		st->stats.peak_bytes = st->stats.bytes;
+	while (st->stats.bytes > max && st->oldest != NULL) {
+		st->stats.evicted++;
+		if (st->oldest == d) {
+			dgram_free(st, d);
+			return NULL;
+		}
+		dgram_free(st, st->oldest);
+	}
+
+	if (!d->have_last || d->nset != REASM_BLOCKS(d->total))
+		return NULL;
+
+	buf = nd_malloc(ndo, f->hdrlen + d->total);
+	if (buf == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+		    "ipreasm_add: nd_malloc");
+	memcpy(buf, f->hdr, f->hdrlen);
+	memcpy(buf + f->hdrlen, d->data, d->total);
+	*lenp = f->hdrlen + d->total;
+	*nfragsp = d->nfrags;
+	*protop = d->proto;
+	st->stats.datagrams++;
+	dgram_free(st, d);
+	return buf;
+
+discard:
+	st->stats.discarded++;
+	dgram_free(st, d);
+	return NULL;
+}
+
+void
+nd_get_reasm_stats(netdissect_options *ndo, struct nd_reasm_stats *stats)
+{
+	struct ipreasm_state *st = ndo->ndo_ipreasm;
+
+	if (st == NULL) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+	*stats = st->stats;
+	stats->pending = st->count;
+}
+
+void
+ipreasm_free_state(netdissect_options *ndo)
+{
+	struct ipreasm_state *st = ndo->ndo_ipreasm;
+
+	if (st == NULL)
+		return;
+	while (st->oldest != NULL)
+		dgram_free(st, st->oldest);
+	free(st->hash);
+	free(st);
+	ndo->ndo_ipreasm = NULL;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef netdissect_ipreasm_h
+#define netdissect_ipreasm_h
+
+/*
+ * Reassembly of IPv4 and IPv6 fragments (--reassemble).
+ *
+ * ip_print() and ip6_print() hand each fragment to ipreasm_add(); the
+ * fragments of a datagram, with the same source and destination, ID
+ * and, for IPv4, protocol, are kept until the last one comes in, and
+ * the printer then dissects the whole datagram.  Datagrams still
+ * incomplete ndo_reasm_timeout seconds, in packet time stamps, after
+ * their first fragment, and the oldest datagrams when the fragments
+ * take more than ndo_reasm_max bytes, are given up on.
+ */
+
+/* What to do with data in a fragment that's already been received */
+#define REASM_OVERLAP_FIRST	0	/* keep the data received first */
+#define REASM_OVERLAP_LAST	1	/* keep the data received last */
+#define REASM_OVERLAP_DROP	2	/* drop the datagram (RFC 5722) */
+
+#define REASM_MAX_DEFAULT	(4 * 1024 * 1024)
+#define REASM_TIMEOUT_DEFAULT	30
+
+struct ipreasm_frag {
+	u_int ver;		/* 4 or 6 */
+	const u_char *src;	/* addresses, 4 or 16 bytes */
+	const u_char *dst;
+	uint32_t id;
+	u_int proto;		/* IPv4 protocol, IPv6 Fragment header's next header */
+	u_int off;		/* offset of the data in the datagram, in bytes */
+	int more;		/* more fragments follow */
+	const u_char *data;
+	u_int len;
+	u_int maxlen;		/* longest the datagram can be */
+	const u_char *hdr;	/* headers to put in front of the datagram */
+	u_int hdrlen;
+};
+
+extern u_char *ipreasm_add(netdissect_options *, const struct ipreasm_frag *,
+    u_int *, u_int *, u_int *);
+
+#endif /* netdissect_ipreasm_h */
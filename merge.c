@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Merging savefiles in time stamp order.
+ *
+ * Each input has the record it would return next read ahead, and the
+ * inputs are kept in a binary heap ordered by the time stamps of those
+ * records, ties going to the input given first, so that the top of the
+ * heap is the input whose record comes next.  Returning that record
+ * and reading the input's next one takes only a walk down the heap,
+ * so merging k savefiles costs log k comparisons a packet.  An input's
+ * record isn't replaced until the call after the one that returned
+ * it, as libpcap and the mapping keep only the last record read.
+ *
+ * All the inputs are read with the same time stamp precision, so their
+ * time stamps can be compared as they are.  The records of each input
+ * come out in the order they're in the savefile, even if their time
+ * stamps aren't in order.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include <pcap.h>
+
+#include "netdissect.h"
+#include "mfile.h"
+#include "merge.h"
+
+struct merge_input {
+	pcap_t *pd;
+	struct mfile *mf;		/* if the savefile is mapped */
+	const struct bpf_program *fcode;	/* for the mapped savefile */
+	struct pcap_pkthdr *h;		/* the next record */
+	const u_char *data;
+};
+
+struct merge {
+	u_int ninputs;
+	struct merge_input *inputs;
+	u_int *heap;		/* indices of the inputs with records left */
+	u_int nheap;
+	u_int nstarted;		/* inputs whose first record has been read */
+	int started;		/* ... and the heap has been made of them */
+	int pending;		/* the top's record has been returned */
+	volatile sig_atomic_t break_loop;
+	char errbuf[PCAP_ERRBUF_SIZE];
+};
+
+/* Does input a's next record come before input b's? */
+static int
+before(const struct merge *m, u_int a, u_int b)
+{
+	const struct pcap_pkthdr *ha = m->inputs[a].h;
+	const struct pcap_pkthdr *hb = m->inputs[b].h;
+
+	if (ha->ts.tv_sec != hb->ts.tv_sec)
+		return (ha->ts.tv_sec < hb->ts.tv_sec);
+	if (ha->ts.tv_usec != hb->ts.tv_usec)
+		return (ha->ts.tv_usec < hb->ts.tv_usec);
+	return (a < b);
+}
+
+/* Move the input at position i of the heap down to where it belongs */
+static void
+sift_down(struct merge *m, u_int i)
+{
+	u_int child, in = m->heap[i];
+
+	while ((child = 2 * i + 1) < m->nheap) {
+		if (child + 1 < m->nheap &&
+		    before(m, m->heap[child + 1], m->heap[child]))
+			child++;
+		if (!before(m, m->heap[child], in))
+			break;
+		m->heap[i] = m->heap[child];
+		i = child;
+	}
+	m->heap[i] = in;
+}
+
+/*
+ * Read input i's next record; return 1 if there is one, 0 at the end
+ * of the savefile and -1, with the error in errbuf, on an error.
+ */
+static int
+read_input(struct merge *m, u_int i)
+{
+	struct merge_input *in = &m->inputs[i];
+	int r;
+
+	if (in->mf != NULL)
+		r = mfile_next(in->mf, &in->h, &in->data, in->fcode);
+	else
+		r = pcap_next_ex(in->pd, &in->h, &in->data);
+	if (r == 1)
+		return (1);
+	if (r == -2)
+		return (0);
+	strlcpy(m->errbuf, in->mf != NULL ? mfile_geterr(in->mf) :
+	    pcap_geterr(in->pd), sizeof(m->errbuf));
+	return (-1);
+}
+
+struct merge *
+merge_new(u_int ninputs)
+{
+	struct merge *m;
+
+	m = (struct merge *)calloc(1, sizeof(*m));
+	if (m == NULL)
+		return (NULL);
+	m->ninputs = ninputs;
+	m->inputs = (struct merge_input *)calloc(ninputs,
+	    sizeof(*m->inputs));
+	m->heap = (u_int *)calloc(ninputs, sizeof(*m->heap));
+	if (m->inputs == NULL || m->heap == NULL) {
+		merge_free(m);
+		return (NULL);
+	}
+	return (m);
+}
+
+void
+merge_set_input(struct merge *m, u_int i, pcap_t *pd, struct mfile *mf,
+    const struct bpf_program *fcode)
+{
+	m->inputs[i].pd = pd;
+	m->inputs[i].mf = mf;
+	m->inputs[i].fcode = fcode;
+}
+
+/*
+ * Get the next packet; return 1, with the input it came from, if
+ * there is one, 0 if all the inputs have been read, -2 if
+ * merge_breakloop() was called and -1 on an error reading an input.
+ * The input with the error is given, and is read no further; the
+ * others can still be read.
+ */
+int
+merge_next(struct merge *m, struct pcap_pkthdr **hp, const u_char **datap,
+    u_int *inputp)
+{
+	u_int i;
+	int r;
+
+	if (m->break_loop) {
+		m->break_loop = 0;
+		return (-2);
+	}
+	if (!m->started) {
+		/*
+		 * Read the first record of each input; any errors are
+		 * reported one per call.
+		 */
+		while (m->nstarted < m->ninputs) {
+			i = m->nstarted++;
+			r = read_input(m, i);
+			if (r == 1)
+				m->heap[m->nheap++] = i;
+			else if (r == -1) {
+				*inputp = i;
+				return (-1);
+			}
+		}
+		for (i = m->nheap / 2; i-- > 0;)
+			sift_down(m, i);
+		m->started = 1;
+	} else if (m->pending) {
+		m->pending = 0;
+		i = m->heap[0];
+		r = read_input(m, i);
+		if (r != 1) {
+			m->heap[0] = m->heap[--m->nheap];
+			if (m->nheap != 0)
+				sift_down(m, 0);
+			if (r == -1) {
+				*inputp = i;
+				return (-1);
+			}
+		} else
+			sift_down(m, 0);
+	}
+	if (m->nheap == 0)
+		return (0);
+	i = m->heap[0];
+	*hp = m->inputs[i].h;
+	*datap = m->inputs[i].data;
+	*inputp = i;
+	m->pending = 1;
+	return (1);
+}
+
+void
+merge_breakloop(struct merge *m)
+{
+	m->break_loop = 1;
+}
+
+const char *
+merge_geterr(struct merge *m)
+{
+	return (m->errbuf);
+}
+
+void
+merge_free(struct merge *m)
+{
+	free(m->heap);
+	free(m->inputs);
+	free(m);
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef merge_h
+#define merge_h
+
+/*
+ * Merging savefiles in time stamp order (--merge).
+ *
+ * merge_new() makes a merge of a number of inputs, each a savefile that
+ * has been opened, with its filter set, and, if it's mapped, its
+ * mapping; merge_next() then returns the packets of all of them, the
+ * one with the earliest time stamp first, and says which input each
+ * came from.  A packet stays valid until the next call.
+ */
+
+struct merge;
+struct mfile;
+
+extern struct merge *merge_new(u_int);
+extern void merge_set_input(struct merge *, u_int, pcap_t *, struct mfile *,
+    const struct bpf_program *);
+extern int merge_next(struct merge *, struct pcap_pkthdr **, const u_char **,
+    u_int *);
+extern void merge_breakloop(struct merge *);
+extern const char *merge_geterr(struct merge *);
+extern void merge_free(struct merge *);
+
+#endif /* merge_h */
@@ -0,0 +1,1099 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Memory-mapped savefiles.
+ *
+ * The whole savefile is mapped, and its records are read in place: each
+ * packet handed to the callback is a pointer into the mapping, with a
+ * pcap_pkthdr made from its record header.  The kernel is told that the
+ * mapping will be read sequentially, so that it reads ahead of the page
+ * faults, further the further we get, as it does for read(); asking it
+ * to read ahead with MADV_WILLNEED as well made reading a savefile not
+ * in the page cache slower, not faster.  The part of the mapping that's
+ * been read is dropped, so that the pages of a savefile of many
+ * gigabytes aren't all counted as ours.
+ *
+ * libpcap has already opened the savefile and read its header, so the
+ * link-layer header type and snapshot length are taken from it; the
+ * records are read as libpcap would read them, with the time stamps
+ * scaled to the precision asked of it and the captured lengths cut to
+ * the snapshot length, and the filter is applied with
+ * pcap_offline_filter().
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+#include "netdissect.h"
+#include "extract.h"
+#include "mfile.h"
+
+#if defined(HAVE_MMAP) && defined(HAVE_PCAP_OFFLINE_FILTER)
+
+/* pcap */
+#define PCAP_MAGIC		0xa1b2c3d4	/* microsecond time stamps */
+#define PCAP_NSEC_MAGIC		0xa1b23c4d	/* nanosecond time stamps */
+#define PCAP_FILE_HDRLEN	24
+#define PCAP_REC_HDRLEN		16
+
+/* pcapng */
+#define PCAPNG_BT_SHB		0x0A0D0D0A	/* Section Header Block */
+#define PCAPNG_BT_IDB		1		/* Interface Description Block */
+#define PCAPNG_BT_PB		2		/* Packet Block (obsolete) */
+#define PCAPNG_BT_SPB		3		/* Simple Packet Block */
+#define PCAPNG_BT_NRB		4		/* Name Resolution Block */
+#define PCAPNG_BT_ISB		5		/* Interface Statistics Block */
+#define PCAPNG_BT_EPB		6		/* Enhanced Packet Block */
+#define PCAPNG_BT_SJE		9		/* systemd Journal Export Block */
+#define PCAPNG_BT_DSB		10		/* Decryption Secrets Block */
+#define PCAPNG_BT_CB_COPY	0x00000BAD	/* Custom Block */
+#define PCAPNG_BT_CB_NOCOPY	0x40000BAD	/* Custom Block, not to copy */
+#define PCAPNG_BYTE_ORDER_MAGIC	0x1A2B3C4D
+#define PCAPNG_OPT_ENDOFOPT	0
+#define PCAPNG_IF_TSRESOL	9
+#define PCAPNG_IF_TSOFFSET	14
+
+/* How much of the mapping that's been read is dropped at a time */
+#define MFILE_DROP_SIZE		(8 * 1024 * 1024)
+
+/*
+ * How many records in a row must look right for mfile_split() to take
+ * the first of them as the start of a record
+ */
+#define MFILE_SYNC_RECORDS	8
+
+/* Most seconds apart two of those records' time stamps can be */
+#define MFILE_SYNC_SECONDS	86400
+
+#define MF_PCAP		0
+#define MF_PCAPNG	1
+
+struct mf_iface {
+	uint64_t tsresol;	/* time stamp units per second */
+	int tsresol_binary;	/* tsresol is a power of 2 */
+	int64_t tsoffset;	/* seconds to add to the time stamps */
+};
+
+struct mfile {
+	const u_char *base;
+	size_t size;		/* of the mapping */
+	size_t end;		/* of the range, for mfile_range(), or size */
+	size_t first;		/* offset of the first record or block */
+	size_t off;		/* of the next record or block */
+	size_t dropped;		/* dropped from the mapping up to here */
+	int shared;		/* the mapping is another mfile's */
+	int format;		/* MF_PCAP or MF_PCAPNG */
+	int be;			/* the file (or section) is big-endian */
+	int linktype;
+	u_int snaplen;
+	uint64_t user_tsresol;	/* time stamp units per second wanted */
+
+	/* pcap */
+	uint64_t file_tsresol;
+
+	/* pcapng */
+	int swap_fixups;	/* libpcap would fix up swapped packets */
+	struct mf_iface *ifaces;
+	u_int nifaces;
+	u_int ifaces_size;
+	int have_first;		/* the first interface has been seen */
+	u_int first_linktype;
+	u_int first_snaplen;
+	size_t *state_blocks;	/* SHBs and IDBs in the range, from mfile_scan() */
+	u_int nstate_blocks;
+	u_int state_blocks_size;
+
+	struct pcap_pkthdr hdr;	/* of the record mfile_next() returned */
+	volatile sig_atomic_t break_loop;
+	char errbuf[PCAP_ERRBUF_SIZE];
+};
+
+static uint16_t
+mf_get16(const struct mfile *mf, const u_char *p)
+{
+	return (mf->be ? EXTRACT_BE_U_2(p) : EXTRACT_LE_U_2(p));
+}
+
+static uint32_t
+mf_get32(const struct mfile *mf, const u_char *p)
+{
+	return (mf->be ? EXTRACT_BE_U_4(p) : EXTRACT_LE_U_4(p));
+}
+
+static uint64_t
+mf_get64(const struct mfile *mf, const u_char *p)
+{
+	return (mf->be ? EXTRACT_BE_U_8(p) : EXTRACT_LE_U_8(p));
+}
+
+static int
+host_is_big_endian(void)
+{
+	static const uint16_t one = 1;
+
+	return (*(const u_char *)&one == 0);
+}
+
+/*
+ * Does libpcap change the packets of this link-layer header type as it
+ * reads them, when the savefile's byte order isn't ours?  (See
+ * swap_pseudo_headers() in libpcap.)
+ */
+static int
+needs_swap_fixups(int linktype)
+{
+	switch (linktype) {
+#ifdef DLT_LINUX_SLL
+	case DLT_LINUX_SLL:
+#endif
+#ifdef DLT_LINUX_SLL2
+	case DLT_LINUX_SLL2:
+#endif
+#ifdef DLT_USB_LINUX
+	case DLT_USB_LINUX:
+#endif
+#ifdef DLT_NFLOG
+	case DLT_NFLOG:
+#endif
+		return (1);
+	}
+	return (0);
+}
+
+/*
+ * Work out the savefile's format from its header; return 0 if it's
+ * one we leave to libpcap.
+ */
+static int
+mf_header(struct mfile *mf)
+{
+	const u_char *p = mf->base;
+	uint32_t magic;
+
+	magic = EXTRACT_BE_U_4(p);
+	if (magic == PCAPNG_BT_SHB) {
+		if (mf->size < 12)
+			return (0);
+		mf->format = MF_PCAPNG;
+		mf->be = (EXTRACT_BE_U_4(p + 8) == PCAPNG_BYTE_ORDER_MAGIC);
+		mf->first = 0;
+	} else {
+		if (magic == PCAP_MAGIC || magic == PCAP_NSEC_MAGIC)
+			mf->be = 1;
+		else {
+			magic = EXTRACT_LE_U_4(p);
+			if (magic != PCAP_MAGIC && magic != PCAP_NSEC_MAGIC)
+				return (0);
+			mf->be = 0;
+		}
+		/* Older versions may have their lengths swapped */
+		if (mf_get16(mf, p + 4) != 2 || mf_get16(mf, p + 6) != 4)
+			return (0);
+		mf->format = MF_PCAP;
+		mf->file_tsresol = magic == PCAP_NSEC_MAGIC ?
+		    1000000000 : 1000000;
+		mf->first = PCAP_FILE_HDRLEN;
+	}
+	mf->off = mf->first;
+
+#ifdef DLT_USB_LINUX_MMAPPED
+	/* libpcap fixes up the lengths of these whatever the byte order */
+	if (mf->linktype == DLT_USB_LINUX_MMAPPED)
+		return (0);
+#endif
+	mf->swap_fixups = needs_swap_fixups(mf->linktype);
+	if (mf->swap_fixups && mf->be != host_is_big_endian())
+		return (0);
+	return (1);
+}
+
+/*
+ * Drop the part of the mapping well behind the record being read; the
+ * pages stay in the page cache, and would just be mapped again if they
+ * were looked at again.
+ */
+static void
+mf_drop_behind(struct mfile *mf)
+{
+	if (mf->off >= mf->dropped + 2 * MFILE_DROP_SIZE) {
+#ifdef MADV_DONTNEED
+		(void)madvise((void *)(mf->base + mf->dropped),
+		    MFILE_DROP_SIZE, MADV_DONTNEED);
+#endif
+		mf->dropped += MFILE_DROP_SIZE;
+	}
+}
+
+static int
+mf_next_pcap(struct mfile *mf, struct pcap_pkthdr *h, const u_char **data)
+{
+	const u_char *p = mf->base + mf->off;
+	size_t left = mf->size - mf->off;
+	uint32_t caplen, frac;
+
+	/* A record that starts in the range is read, even if it ends past it */
+	if (mf->off >= mf->end)
+		return (0);
+	if (left < PCAP_REC_HDRLEN) {
+		snprintf(mf->errbuf, sizeof(mf->errbuf),
+		    "truncated dump file; tried to read %u header bytes, only got %lu",
+		    PCAP_REC_HDRLEN, (u_long)left);
+		return (-1);
+	}
+	caplen = mf_get32(mf, p + 8);
+	if (caplen > mf->snaplen && caplen > MAXIMUM_SNAPLEN) {
+		snprintf(mf->errbuf, sizeof(mf->errbuf),
+		    "invalid packet capture length %u, bigger than maximum of %u",
+		    caplen, mf->snaplen > MAXIMUM_SNAPLEN ?
+		    mf->snaplen : MAXIMUM_SNAPLEN);
+		return (-1);
+	}
+	if (caplen > left - PCAP_REC_HDRLEN) {
+		snprintf(mf->errbuf, sizeof(mf->errbuf),
+		    "truncated dump file; tried to read %u captured bytes, only got %lu",
+		    caplen, (u_long)(left - PCAP_REC_HDRLEN));
+		return (-1);
+	}
+
+	h->ts.tv_sec = mf_get32(mf, p);
+	frac = mf_get32(mf, p + 4);
+	if (mf->file_tsresol > mf->user_tsresol)
+		frac /= 1000;
+	else if (mf->file_tsresol < mf->user_tsresol)
+		frac *= 1000;
+	h->ts.tv_usec = frac;
+	h->caplen = caplen < mf->snaplen ? caplen : mf->snaplen;
+	h->len = mf_get32(mf, p + 12);
+	*data = p + PCAP_REC_HDRLEN;
+	mf->off += PCAP_REC_HDRLEN + caplen;
+	return (1);
+}
+
+/* Enter an interface from its Interface Description Block */
+static int
+mf_add_iface(struct mfile *mf, const u_char *body, size_t bodylen)
+{
+	struct mf_iface *ifp;
+	u_int linktype, snaplen, code, len, shift;
+	size_t off;
+
+	if (bodylen < 8) {
+		snprintf(mf->errbuf, sizeof(mf->errbuf),
+		    "Interface Description Block in pcapng dump file is too short");
+		return (-1);
+	}
+	linktype = mf_get16(mf, body);
+	snaplen = mf_get32(mf, body + 4);
+	if (!mf->have_first) {
+		mf->have_first = 1;
+		mf->first_linktype = linktype;
+		mf->first_snaplen = snaplen;
+	} else if (linktype != mf->first_linktype) {
+		snprintf(mf->errbuf, sizeof(mf->errbuf),
+		    "an interface has a type %u different from the type of the first interface",
+		    linktype);
+		return (-1);
+	} else if (snaplen != mf->first_snaplen) {
+		snprintf(mf->errbuf, sizeof(mf->errbuf),
+		    "an interface has a snapshot length %u different from the snapshot length of the first interface",
+		    snaplen);
+		return (-1);
+	}
+
+	if (mf->nifaces == mf->ifaces_size) {
+		u_int size = mf->ifaces_size != 0 ? mf->ifaces_size * 2 : 4;
+
+		ifp = realloc(mf->ifaces, size * sizeof(*ifp));
+		if (ifp == NULL) {
+			snprintf(mf->errbuf, sizeof(mf->errbuf),
+			    "out of memory for interfaces");
+			return (-1);
+		}
+		mf->ifaces = ifp;
+		mf->ifaces_size = size;
+	}
+	ifp = &mf->ifaces[mf->nifaces];
+	ifp->tsresol = 1000000;
+	ifp->tsresol_binary = 0;
+	ifp->tsoffset = 0;
+
+	off = 8;
+	while (bodylen - off >= 4) {
+		code = mf_get16(mf, body + off);
+		len = mf_get16(mf, body + off + 2);
+		off += 4;
+		if (code == PCAPNG_OPT_ENDOFOPT)
+			break;
+		if (len > bodylen - off) {
+			snprintf(mf->errbuf, sizeof(mf->errbuf),
+			    "option length %u in an Interface Description Block is bigger than the remaining length",
+			    len);
+			return (-1);
+		}
+		if (code == PCAPNG_IF_TSRESOL && len == 1) {
+			shift = body[off] & 0x7f;
+			if (body[off] & 0x80) {
+				if (shift > 63) {
+					snprintf(mf->errbuf,
+					    sizeof(mf->errbuf),
+					    "Interface Description Block if_tsresol option resolution 2^-%u is too high",
+					    shift);
+					return (-1);
+				}
+				ifp->tsresol = (uint64_t)1 << shift;
+				ifp->tsresol_binary = 1;
+			} else {
+				if (shift > 19) {
+					snprintf(mf->errbuf,
+					    sizeof(mf->errbuf),
+					    "Interface Description Block if_tsresol option resolution 10^-%u is too high",
+					    shift);
+					return (-1);
+				}
+				ifp->tsresol = 1;
+				while (shift-- != 0)
+					ifp->tsresol *= 10;
+			}
+		} else if (code == PCAPNG_IF_TSOFFSET && len == 8)
+			ifp->tsoffset = (int64_t)mf_get64(mf, body + off);
+		/* Options are padded to 4 bytes, except perhaps the last */
+		if (((len + 3) & ~3U) > bodylen - off)
+			break;
+		off += (len + 3) & ~3U;
+	}
+	mf->nifaces++;
+	return (0);
+}
+
+static int
+mf_next_pcapng(struct mfile *mf, struct pcap_pkthdr *h, const u_char **data)
+{
+	const struct mf_iface *ifp;
+	const u_char *p, *body;
+	size_t left, bodylen;
+	uint32_t type, total, ifid, caplen, len;
+	uint64_t t, frac;
+
+	for (;;) {
+		if (mf->off >= mf->end)
+			return (0);
+		left = mf->size - mf->off;
+		p = mf->base + mf->off;
+		if (left < 12) {
+			snprintf(mf->errbuf, sizeof(mf->errbuf),
+			    "truncated pcapng dump file; tried to read 12 bytes, only got %lu",
+			    (u_long)left);
+			return (-1);
+		}
+		type = mf_get32(mf, p);
+		if (type == PCAPNG_BT_SHB) {
+			/* A new section, perhaps in the other byte order */
+			if (EXTRACT_BE_U_4(p + 8) == PCAPNG_BYTE_ORDER_MAGIC)
+				mf->be = 1;
+			else if (EXTRACT_LE_U_4(p + 8) ==
+			    PCAPNG_BYTE_ORDER_MAGIC)
+				mf->be = 0;
+			else {
+				snprintf(mf->errbuf, sizeof(mf->errbuf),
+				    "unknown byte-order magic in pcapng section header");
+				return (-1);
+			}
+			if (mf->swap_fixups &&
+			    mf->be != host_is_big_endian()) {
+				snprintf(mf->errbuf, sizeof(mf->errbuf),
+				    "a section is in the other byte order; read the file without --mmap");
+				return (-1);
+			}
+			mf->nifaces = 0;
+		}
+		total = mf_get32(mf, p + 4);
+		if (total < 12 || total % 4 != 0) {
+			snprintf(mf->errbuf, sizeof(mf->errbuf),
+			    "block in pcapng dump file has a length of %u, which isn't a multiple of 4 of at least 12",
+			    total);
+			return (-1);
+		}
+		if (total > left) {
+			snprintf(mf->errbuf, sizeof(mf->errbuf),
+			    "truncated pcapng dump file; tried to read %u bytes, only got %lu",
+			    total, (u_long)left);
+			return (-1);
+		}
+		mf->off += total;
+		body = p + 8;
+		bodylen = total - 12;
+
+		switch (type) {
+
+		case PCAPNG_BT_SHB:
+			if (bodylen < 16 || mf_get16(mf, body + 4) != 1) {
+				snprintf(mf->errbuf, sizeof(mf->errbuf),
+				    "unsupported pcapng section header");
+				return (-1);
+			}
+			continue;
+
+		case PCAPNG_BT_IDB:
+			if (mf_add_iface(mf, body, bodylen) < 0)
+				return (-1);
+			continue;
+
+		case PCAPNG_BT_EPB:
+			if (bodylen < 20)
+				goto short_block;
+			ifid = mf_get32(mf, body);
+			t = (uint64_t)mf_get32(mf, body + 4) << 32 |
+			    mf_get32(mf, body + 8);
+			caplen = mf_get32(mf, body + 12);
+			len = mf_get32(mf, body + 16);
+			if (caplen > bodylen - 20)
+				goto short_block;
+			*data = body + 20;
+			break;
+
+		case PCAPNG_BT_SPB:
+			if (bodylen < 4)
+				goto short_block;
+			ifid = 0;
+			t = 0;
+			len = mf_get32(mf, body);
+			caplen = len < bodylen - 4 ? len : (uint32_t)(bodylen - 4);
+			*data = body + 4;
+			break;
+
+		case PCAPNG_BT_PB:
+			if (bodylen < 20)
+				goto short_block;
+			ifid = mf_get16(mf, body);
+			t = (uint64_t)mf_get32(mf, body + 4) << 32 |
+			    mf_get32(mf, body + 8);
+			caplen = mf_get32(mf, body + 12);
+			len = mf_get32(mf, body + 16);
+			if (caplen > bodylen - 20)
+				goto short_block;
+			*data = body + 20;
+			break;
+
+		default:
+			/* Nothing we need */
+			continue;
+		}
+
+		if (ifid >= mf->nifaces) {
+			snprintf(mf->errbuf, sizeof(mf->errbuf),
+			    "a packet arrived on interface %u, but there's no Interface Description Block for that interface",
+			    ifid);
+			return (-1);
+		}
+		ifp = &mf->ifaces[ifid];
+		frac = t % ifp->tsresol;
+		if (ifp->tsresol_binary) {
+			frac *= mf->user_tsresol;
+			frac /= ifp->tsresol;
+		} else if (ifp->tsresol > mf->user_tsresol)
+			frac /= ifp->tsresol / mf->user_tsresol;
+		else if (ifp->tsresol < mf->user_tsresol)
+			frac *= mf->user_tsresol / ifp->tsresol;
+		h->ts.tv_sec = (time_t)(t / ifp->tsresol + ifp->tsoffset);
+		h->ts.tv_usec = (suseconds_t)frac;
+		h->caplen = caplen < mf->snaplen ? caplen : mf->snaplen;
+		h->len = len;
+		return (1);
+	}
+
+short_block:
+	snprintf(mf->errbuf, sizeof(mf->errbuf),
+	    "packet block in pcapng dump file is too short for its captured length");
+	return (-1);
+}
+
+/* Does the filter accept every packet? */
+static int
+accepts_all(const struct bpf_program *fcode)
+{
+	return (fcode->bf_len == 1 &&
+	    fcode->bf_insns[0].code == (BPF_RET|BPF_K) &&
+	    fcode->bf_insns[0].k != 0);
+}
+
+/*
+ * Open a savefile that libpcap has opened as "pd", on descriptor "fd",
+ * to be read from a mapping.  Return NULL if it can't be, with a
+ * message in errbuf if that's because something failed, or with an
+ * empty one if it's a savefile to leave to libpcap.
+ */
+struct mfile *
+mfile_open(pcap_t *pd, int fd, char *errbuf, size_t errbuf_size)
+{
+	struct mfile *mf;
+	struct stat st;
+	void *base;
+
+	errbuf[0] = '\0';
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) ||
+	    st.st_size < PCAP_FILE_HDRLEN ||
+	    (uint64_t)st.st_size > SIZE_MAX)
+		return (NULL);
+	base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (base == MAP_FAILED) {
+		snprintf(errbuf, errbuf_size, "mmap: %s", strerror(errno));
+		return (NULL);
+	}
+	mf = calloc(1, sizeof(*mf));
+	if (mf == NULL) {
+		(void)munmap(base, (size_t)st.st_size);
+		snprintf(errbuf, errbuf_size, "out of memory");
+		return (NULL);
+	}
+	mf->base = base;
+	mf->size = (size_t)st.st_size;
+	mf->end = mf->size;
+	mf->linktype = pcap_datalink(pd);
+	mf->snaplen = (u_int)pcap_snapshot(pd);
+	mf->user_tsresol = 1000000;
+#ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
+	if (pcap_get_tstamp_precision(pd) == PCAP_TSTAMP_PRECISION_NANO)
+		mf->user_tsresol = 1000000000;
+#endif
+	if (!mf_header(mf)) {
+		mfile_close(mf);
+		return (NULL);
+	}
+#ifdef MADV_SEQUENTIAL
+	(void)madvise(base, mf->size, MADV_SEQUENTIAL);
+#endif
+	return (mf);
+}
+
+/*
+ * Hand the packets that pass the filter, up to "cnt" of them if it's
+ * positive, to the callback, as pcap_loop() does; return 0 at the end
+ * of the file or once "cnt" packets have been handed over, -1 on an
+ * error and -2 if mfile_breakloop() was called.
+ */
+int
+mfile_loop(struct mfile *mf, int cnt, pcap_handler callback, u_char *user,
+    const struct bpf_program *fcode)
+{
+	struct pcap_pkthdr *h;
+	const u_char *data;
+	int n, r;
+
+	if (fcode != NULL && (fcode->bf_insns == NULL || accepts_all(fcode)))
+		fcode = NULL;
+	for (n = 0;;) {
+		if (mf->break_loop) {
+			mf->break_loop = 0;
+			return (-2);
+		}
+		r = mfile_next(mf, &h, &data, fcode);
+		if (r != 1)
+			return (r == -2 ? 0 : r);
+		(*callback)(user, h, data);
+		if (cnt > 0 && ++n >= cnt)
+			return (0);
+	}
+}
+
+/*
+ * Get the next packet that passes the filter, as pcap_next_ex() does;
+ * return 1 if there is one, -2 at the end of the file and -1 on an
+ * error.  The packet is in the mapping, and stays there until the
+ * mapping is closed; its header is overwritten by the next call.
+ */
+int
+mfile_next(struct mfile *mf, struct pcap_pkthdr **hp, const u_char **datap,
+    const struct bpf_program *fcode)
+{
+	int r;
+
+	if (fcode != NULL && (fcode->bf_insns == NULL || accepts_all(fcode)))
+		fcode = NULL;
+	for (;;) {
+		mf_drop_behind(mf);
+		if (mf->format == MF_PCAP)
+			r = mf_next_pcap(mf, &mf->hdr, datap);
+		else
+			r = mf_next_pcapng(mf, &mf->hdr, datap);
+		if (r <= 0)
+			return (r == 0 ? -2 : -1);
+		if (fcode == NULL ||
+		    pcap_offline_filter(fcode, &mf->hdr, *datap) != 0)
+			break;
+	}
+	*hp = &mf->hdr;
+	return (1);
+}
+
+/*
+ * Does a pcapng block of a known type, whose length agrees with the
+ * copy of it at its end, start at "off"?  If so, set *nextp to the
+ * offset of the block after it.
+ */
+static int
+mf_block_ok(const struct mfile *mf, size_t off, size_t *nextp)
+{
+	const u_char *p = mf->base + off;
+	size_t left = mf->size - off;
+	uint32_t type, total;
+	int be = mf->be;
+
+	if (left < 12)
+		return (0);
+	type = EXTRACT_BE_U_4(p);
+	if (type == PCAPNG_BT_SHB) {
+		if (left < 28)
+			return (0);
+		if (EXTRACT_BE_U_4(p + 8) == PCAPNG_BYTE_ORDER_MAGIC)
+			be = 1;
+		else if (EXTRACT_LE_U_4(p + 8) == PCAPNG_BYTE_ORDER_MAGIC)
+			be = 0;
+		else
+			return (0);
+	} else {
+		type = mf_get32(mf, p);
+		switch (type) {
+
+		case PCAPNG_BT_IDB:
+		case PCAPNG_BT_PB:
+		case PCAPNG_BT_SPB:
+		case PCAPNG_BT_NRB:
+		case PCAPNG_BT_ISB:
+		case PCAPNG_BT_EPB:
+		case PCAPNG_BT_SJE:
+		case PCAPNG_BT_DSB:
+		case PCAPNG_BT_CB_COPY:
+		case PCAPNG_BT_CB_NOCOPY:
+			break;
+
+		default:
+			return (0);
+		}
+	}
+	total = be ? EXTRACT_BE_U_4(p + 4) : EXTRACT_LE_U_4(p + 4);
+	if (total < 12 || total % 4 != 0 || total > left)
+		return (0);
+	if ((be ? EXTRACT_BE_U_4(p + total - 4) :
+	    EXTRACT_LE_U_4(p + total - 4)) != total)
+		return (0);
+	*nextp = off + total;
+	return (1);
+}
+
+/*
+ * Does a plausible pcap record start at "off"?  If so, set *nextp to
+ * the offset of the record after it and *secp and *fracp to its time
+ * stamp.  Records with no data are rejected, even though libpcap would
+ * read them, so that runs of zeroes in the packet data don't look like
+ * records.
+ */
+static int
+mf_record_ok(const struct mfile *mf, size_t off, size_t *nextp,
+    uint32_t *secp, uint32_t *fracp)
+{
+	const u_char *p = mf->base + off;
+	size_t left = mf->size - off;
+	uint32_t caplen, len;
+
+	if (left < PCAP_REC_HDRLEN)
+		return (0);
+	caplen = mf_get32(mf, p + 8);
+	len = mf_get32(mf, p + 12);
+	if (mf_get32(mf, p + 4) >= mf->file_tsresol ||
+	    (caplen > mf->snaplen && caplen > MAXIMUM_SNAPLEN) ||
+	    caplen == 0 || caplen > len || len > MAXIMUM_SNAPLEN ||
+	    caplen > left - PCAP_REC_HDRLEN)
+		return (0);
+	*nextp = off + PCAP_REC_HDRLEN + caplen;
+	*secp = mf_get32(mf, p);
+	*fracp = mf_get32(mf, p + 4);
+	return (1);
+}
+
+/*
+ * Find the first offset from "off" on where a record starts, by looking
+ * for MFILE_SYNC_RECORDS records in a row that look right, in the byte
+ * order of the start of the file; return (size_t)-1 if there's none
+ * before "limit".  The last few records of the file are never found,
+ * as a chain that runs into the end of the file is too short to trust,
+ * nor are pcap records whose time stamps are all the same, as repeated
+ * patterns in the packet data can look like those.
+ */
+static size_t
+mf_sync(const struct mfile *mf, size_t off, size_t limit)
+{
+	size_t next, at;
+	uint32_t sec, frac, prev_sec = 0, first_frac = 0;
+	int i, differ;
+
+	if (mf->format == MF_PCAPNG)
+		off = (off + 3) & ~(size_t)3;
+	for (; off < limit; off += mf->format == MF_PCAPNG ? 4 : 1) {
+		differ = mf->format == MF_PCAPNG;
+		for (i = 0, at = off; i < MFILE_SYNC_RECORDS;
+		    i++, at = next) {
+			if (mf->format == MF_PCAPNG) {
+				if (!mf_block_ok(mf, at, &next))
+					break;
+				continue;
+			}
+			if (!mf_record_ok(mf, at, &next, &sec, &frac))
+				break;
+			if (i == 0)
+				first_frac = frac;
+			else if ((sec > prev_sec ? sec - prev_sec :
+			    prev_sec - sec) > MFILE_SYNC_SECONDS)
+				break;
+			else if (sec != prev_sec || frac != first_frac)
+				differ = 1;
+			prev_sec = sec;
+		}
+		if (i == MFILE_SYNC_RECORDS && differ)
+			return (off);
+	}
+	return ((size_t)-1);
+}
+
+/*
+ * Split the records of the savefile into chunks of about "chunk_size"
+ * bytes or more, each of which can be read with a reader of its own
+ * from mfile_range().  Return an array of the offsets at which the
+ * chunks start, followed by the offset of the end of the file, and set
+ * *nchunksp to the number of chunks; return NULL, with a message for
+ * mfile_geterr(), if we're out of memory.
+ *
+ * The chunks start at records found by looking at what follows the
+ * point each should start at, so a chunk can be larger if no record
+ * is found soon enough after that.  A record can be found where there's
+ * none, as in the data of a packet that carries a savefile; the reader
+ * of the chunk before it then reads past the end of its range, and
+ * mfile_tell() on it says where the next chunk really starts.
+ */
+size_t *
+mfile_split(struct mfile *mf, size_t chunk_size, u_int *nchunksp)
+{
+	size_t *bounds, *newb, at, next;
+	u_int n, size;
+
+	if (chunk_size == 0)
+		chunk_size = 1;
+	size = 16;
+	bounds = malloc(size * sizeof(*bounds));
+	if (bounds == NULL)
+		goto nomem;
+	bounds[0] = mf->first;
+	n = 1;
+	at = mf->first;
+	while (mf->size - at > chunk_size) {
+		next = mf_sync(mf, at + chunk_size, mf->size);
+		if (next == (size_t)-1)
+			break;
+		if (n + 1 >= size) {
+			size *= 2;
+			newb = realloc(bounds, size * sizeof(*bounds));
+			if (newb == NULL) {
+				free(bounds);
+				goto nomem;
+			}
+			bounds = newb;
+		}
+		bounds[n++] = next;
+		at = next;
+	}
+	bounds[n] = mf->size;
+	*nchunksp = n;
+	return (bounds);
+
+nomem:
+	snprintf(mf->errbuf, sizeof(mf->errbuf), "out of memory for chunks");
+	return (NULL);
+}
+
+/*
+ * Make a reader for the records from "start" to "end" of a savefile
+ * being read from a mapping, sharing the mapping; the last record it
+ * reads is the last that starts before "end".  The mapping must
+ * stay open until the reader is closed.  For pcapng, the reader knows
+ * only the interfaces described in the range, unless it's given those
+ * described before it with mfile_replay().  Return NULL, with a message
+ * for mfile_geterr() on "mf", if we're out of memory.
+ */
+struct mfile *
+mfile_range(struct mfile *mf, size_t start, size_t end)
+{
+	struct mfile *r;
+
+	r = calloc(1, sizeof(*r));
+	if (r == NULL) {
+		snprintf(mf->errbuf, sizeof(mf->errbuf),
+		    "out of memory for chunks");
+		return (NULL);
+	}
+	r->base = mf->base;
+	r->size = mf->size;
+	r->end = end;
+	r->first = start;
+	r->off = start;
+	r->dropped = start - start % MFILE_DROP_SIZE;
+	r->shared = 1;
+	r->format = mf->format;
+	r->be = mf->be;
+	r->linktype = mf->linktype;
+	r->snaplen = mf->snaplen;
+	r->user_tsresol = mf->user_tsresol;
+	r->file_tsresol = mf->file_tsresol;
+	r->swap_fixups = mf->swap_fixups;
+	return (r);
+}
+
+/*
+ * Note where the Section Header Blocks and Interface Description
+ * Blocks are in the range of a pcapng reader from mfile_range(),
+ * without reading the packets, for mfile_replay(); return -1 if the
+ * blocks aren't all there.  This does nothing for pcap.
+ */
+int
+mfile_scan(struct mfile *mf)
+{
+	const u_char *p;
+	size_t off, next, *blocks;
+	uint32_t type;
+	int be = mf->be;
+
+	if (mf->format != MF_PCAPNG)
+		return (0);
+	for (off = mf->first; off < mf->end; off = next) {
+		p = mf->base + off;
+		if (mf->size - off < 12)
+			goto bad;
+		type = be ? EXTRACT_BE_U_4(p) : EXTRACT_LE_U_4(p);
+		if (type == PCAPNG_BT_SHB) {
+			if (EXTRACT_BE_U_4(p + 8) == PCAPNG_BYTE_ORDER_MAGIC)
+				be = 1;
+			else if (EXTRACT_LE_U_4(p + 8) ==
+			    PCAPNG_BYTE_ORDER_MAGIC)
+				be = 0;
+			else
+				goto bad;
+		}
+		next = be ? EXTRACT_BE_U_4(p + 4) : EXTRACT_LE_U_4(p + 4);
+		if (next < 12 || next % 4 != 0 || next > mf->size - off)
+			goto bad;
+		next += off;
+		if (type != PCAPNG_BT_SHB && type != PCAPNG_BT_IDB)
+			continue;
+		if (mf->nstate_blocks == mf->state_blocks_size) {
+			u_int size = mf->state_blocks_size != 0 ?
+			    mf->state_blocks_size * 2 : 4;
+
+			blocks = realloc(mf->state_blocks,
+			    size * sizeof(*blocks));
+			if (blocks == NULL) {
+				snprintf(mf->errbuf, sizeof(mf->errbuf),
+				    "out of memory for interfaces");
+				return (-1);
+			}
+			mf->state_blocks = blocks;
+			mf->state_blocks_size = size;
+		}
+		mf->state_blocks[mf->nstate_blocks++] = off;
+	}
+	return (0);
+
+bad:
+	snprintf(mf->errbuf, sizeof(mf->errbuf),
+	    "bad pcapng block at offset %lu", (u_long)off);
+	return (-1);
+}
+
+/*
+ * Give a pcapng reader from mfile_range() the sections and interfaces
+ * described in the range of "earlier", which mfile_scan() has been
+ * called on; called for each of the ranges before the reader's, in
+ * order, it gives the reader what it would have known had it read the
+ * savefile from the start.  Return -1 on an error.
+ */
+int
+mfile_replay(struct mfile *mf, const struct mfile *earlier)
+{
+	const u_char *p;
+	u_int i;
+
+	for (i = 0; i < earlier->nstate_blocks; i++) {
+		p = mf->base + earlier->state_blocks[i];
+		if (EXTRACT_BE_U_4(p) == PCAPNG_BT_SHB) {
+			mf->be = EXTRACT_BE_U_4(p + 8) ==
+			    PCAPNG_BYTE_ORDER_MAGIC;
+			mf->nifaces = 0;
+		} else if (mf_add_iface(mf, p + 8,
+		    mf_get32(mf, p + 4) - 12) < 0)
+			return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Did mfile_scan() find any Section Header or Interface Description
+ * Blocks in the range of the reader?
+ */
+int
+mfile_has_state(const struct mfile *mf)
+{
+	return (mf->nstate_blocks != 0);
+}
+
+/*
+ * Go on reading a pcap savefile from the record at "off", which must
+ * be between the first record and the end of the file; pcapng files,
+ * whose packets depend on blocks before them, can't be read that way.
+ * Return -1 if we can't.
+ */
+int
+mfile_seek(struct mfile *mf, uint64_t off)
+{
+	if (mf->format != MF_PCAP || off < mf->first || off > mf->size)
+		return (-1);
+	mf->off = (size_t)off;
+	mf->dropped = mf->off - mf->off % MFILE_DROP_SIZE;
+	return (0);
+}
+
+/* The offset of the record after the one last read */
+uint64_t
+mfile_tell(const struct mfile *mf)
+{
+	return (mf->off);
+}
+
+void
+mfile_breakloop(struct mfile *mf)
+{
+	mf->break_loop = 1;
+}
+
+const char *
+mfile_geterr(struct mfile *mf)
+{
+	return (mf->errbuf);
+}
+
+void
+mfile_close(struct mfile *mf)
+{
+	if (!mf->shared)
+		(void)munmap((void *)mf->base, mf->size);
+	free(mf->ifaces);
+	free(mf->state_blocks);
+	free(mf);
+}
+
+#else /* defined(HAVE_MMAP) && defined(HAVE_PCAP_OFFLINE_FILTER) */
+
+struct mfile *
+mfile_open(pcap_t *pd _U_, int fd _U_, char *errbuf, size_t errbuf_size)
+{
+	snprintf(errbuf, errbuf_size,
+	    "memory-mapped savefiles aren't supported on this platform");
+	return (NULL);
+}
+
+int
+mfile_loop(struct mfile *mf _U_, int cnt _U_, pcap_handler callback _U_,
+    u_char *user _U_, const struct bpf_program *fcode _U_)
+{
+	return (-1);
+}
+
+int
+mfile_next(struct mfile *mf _U_, struct pcap_pkthdr **hp _U_,
+    const u_char **datap _U_, const struct bpf_program *fcode _U_)
+{
+	return (-1);
+}
+
+size_t *
+mfile_split(struct mfile *mf _U_, size_t chunk_size _U_, u_int *nchunksp _U_)
+{
+	return (NULL);
+}
+
+struct mfile *
+mfile_range(struct mfile *mf _U_, size_t start _U_, size_t end _U_)
+{
+	return (NULL);
+}
+
+int
+mfile_scan(struct mfile *mf _U_)
+{
+	return (-1);
+}
+
+int
+mfile_replay(struct mfile *mf _U_, const struct mfile *earlier _U_)
+{
+	return (-1);
+}
+
+int
+mfile_has_state(const struct mfile *mf _U_)
+{
+	return (0);
+}
+
+int
+mfile_seek(struct mfile *mf _U_, uint64_t off _U_)
+{
+	return (-1);
+}
+
+uint64_t
+mfile_tell(const struct mfile *mf _U_)
+{
+	return (0);
+}
+
+void
+mfile_breakloop(struct mfile *mf _U_)
+{
+}
+
+const char *
+mfile_geterr(struct mfile *mf _U_)
+{
+	return ("memory-mapped savefiles aren't supported on this platform");
+}
+
+void
+mfile_close(struct mfile *mf _U_)
+{
+}
+
+#endif /* defined(HAVE_MMAP) && defined(HAVE_PCAP_OFFLINE_FILTER) */
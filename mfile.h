@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef mfile_h
+#define mfile_h
+
+/*
+ * Memory-mapped savefiles (--mmap).
+ *
+ * mfile_open() maps a pcap or pcapng savefile that libpcap has opened,
+ * and mfile_loop() then does what pcap_loop() would, walking the
+ * records in the mapping and handing the callback pointers into it
+ * rather than copies of the packets; mfile_next() gets them one at a
+ * time, as pcap_next_ex() would.  Savefiles it can't read that way
+ * - those that aren't regular files, and those whose packets libpcap
+ * would have to change as it reads them - are left to libpcap.
+ *
+ * mfile_split() finds where a mapped savefile can be cut into chunks
+ * that each start with a record, and mfile_range() makes a reader for
+ * each chunk, so that they can be read in parallel (--chunks).
+ *
+ * mfile_seek() goes on reading a pcap savefile from a record that a
+ * savefile index says is where the packets wanted start, and
+ * mfile_tell() says where the reading has got to.
+ */
+
+struct mfile;
+
+extern struct mfile *mfile_open(pcap_t *, int, char *, size_t);
+extern int mfile_loop(struct mfile *, int, pcap_handler, u_char *,
+    const struct bpf_program *);
+extern int mfile_next(struct mfile *, struct pcap_pkthdr **, const u_char **,
+    const struct bpf_program *);
+extern size_t *mfile_split(struct mfile *, size_t, u_int *);
+extern struct mfile *mfile_range(struct mfile *, size_t, size_t);
+extern int mfile_scan(struct mfile *);
+extern int mfile_replay(struct mfile *, const struct mfile *);
+extern int mfile_has_state(const struct mfile *);
+extern int mfile_seek(struct mfile *, uint64_t);
+extern uint64_t mfile_tell(const struct mfile *);
+extern void mfile_breakloop(struct mfile *);
+extern const char *mfile_geterr(struct mfile *);
+extern void mfile_close(struct mfile *);
+
+#endif /* mfile_h */
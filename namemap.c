@@ -0,0 +1,497 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Loading and looking up name map files.
+ *
+ * The file is mapped into memory (or, without mmap(), read into it)
+ * and parsed in one pass; the names aren't copied, but referred to by
+ * their offset in the file.  Each kind of key has a table, an array of
+ * fixed-size entries holding the key, in network byte order, and the
+ * length and offset of the name, sorted by key, and by offset for the
+ * same key, so that a binary search finds the first name in the file.
+ * The tables are only sorted if the file wasn't already in order.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "netdissect.h"
+#include "netdissect-ctype.h"
+#include "namemap.h"
+#include "strtoaddr.h"
+
+#define NAME_MAP_KEY_MAX	64	/* longest address or port text */
+#define NAME_MAP_NAME_MAX	1024	/* longest name */
+
+struct map_table {
+	u_char *entries;
+	u_int n;		/* entries used */
+	u_int size;		/* entries allocated */
+	int sorted;		/* entries added so far are in order */
+};
+
+struct nd_name_map {
+	const char *base;	/* the file's contents */
+	size_t size;
+	int mapped;		/* base was mmap()ed, not malloc()ed */
+	struct map_table tables[NAME_MAP_KINDS];
+};
+
+/*
+ * An entry is the key, the uint16_t length of the name right after it,
+ * then, 4-byte aligned, the uint32_t offset of the name.
+ */
+static const u_int map_keylen[NAME_MAP_KINDS] = { 4, 16, 6, 2, 2 };
+
+#define MAP_LEN_AT(kind)	(map_keylen[kind])
+#define MAP_OFF_AT(kind)	((map_keylen[kind] + 2 + 3) & ~3U)
+#define MAP_ESIZE(kind)		(MAP_OFF_AT(kind) + 4)
+
+static int
+map_cmp(const u_char *a, const u_char *b, u_int kind)
+{
+	uint32_t oa, ob;
+	int r;
+
+	r = memcmp(a, b, map_keylen[kind]);
+	if (r != 0)
+		return (r);
+	memcpy(&oa, a + MAP_OFF_AT(kind), 4);
+	memcpy(&ob, b + MAP_OFF_AT(kind), 4);
+	return (oa < ob ? -1 : oa > ob);
+}
+
+/* qsort() comparison functions, one per key length */
+static int
+map_cmp_ipv4(const void *a, const void *b)
+{
+	return (map_cmp(a, b, NAME_MAP_IPV4));
+}
+
+static int
+map_cmp_ipv6(const void *a, const void *b)
+{
+	return (map_cmp(a, b, NAME_MAP_IPV6));
+}
+
+static int
+map_cmp_mac(const void *a, const void *b)
+{
+	return (map_cmp(a, b, NAME_MAP_MAC));
+}
+
+static int
+map_cmp_port(const void *a, const void *b)
+{
+	return (map_cmp(a, b, NAME_MAP_TCP));
+}
+
+static int (* const map_cmp_func[NAME_MAP_KINDS])(const void *, const void *) = {
+	map_cmp_ipv4, map_cmp_ipv6, map_cmp_mac, map_cmp_port, map_cmp_port
+};
+
+static int
+map_add(struct nd_name_map *map, u_int kind, const u_char *key,
+	uint32_t off, uint16_t len)
+{
+	struct map_table *t = &map->tables[kind];
+	u_int esize = MAP_ESIZE(kind);
+	u_char *e;
+
+	if (t->n == t->size) {
+		u_int size = t->size != 0 ? 2 * t->size : 1024;
+
+		e = realloc(t->entries, (size_t)size * esize);
+		if (e == NULL)
+			return (-1);
+		t->entries = e;
+		t->size = size;
+	}
+	e = t->entries + (size_t)t->n * esize;
+	memset(e, 0, esize);
+	memcpy(e, key, map_keylen[kind]);
+	memcpy(e + MAP_LEN_AT(kind), &len, 2);
+	memcpy(e + MAP_OFF_AT(kind), &off, 4);
+	if (t->n == 0)
+		t->sorted = 1;
+	else if (t->sorted && memcmp(e - esize, e, map_keylen[kind]) > 0)
+		t->sorted = 0;
+	t->n++;
+	return (0);
+}
+
+static int
+hexdigit(int c)
+{
+	if (c >= '0' && c <= '9')
+		return (c - '0');
+	if (c >= 'a' && c <= 'f')
+		return (c - 'a' + 10);
+	if (c >= 'A' && c <= 'F')
+		return (c - 'A' + 10);
+	return (-1);
+}
+
+/* "xx:xx:xx:xx:xx:xx", or with '-' */
+static int
+parse_mac(const char *s, u_char *mac)
+{
+	int i, hi, lo;
+
+	if (strlen(s) != 17)
+		return (0);
+	for (i = 0; i < 6; i++) {
+		hi = hexdigit(s[3 * i]);
+		lo = hexdigit(s[3 * i + 1]);
+		if (hi < 0 || lo < 0)
+			return (0);
+		if (i < 5 && s[3 * i + 2] != ':' && s[3 * i + 2] != '-')
+			return (0);
+		mac[i] = (u_char)(hi << 4 | lo);
+	}
+	return (1);
+}
+
+/* "port/tcp" or "port/udp"; the key is the port in network byte order */
+static int
+parse_port(const char *s, u_int *kindp, u_char *key)
+{
+	u_long port;
+	char *end;
+
+	if (!ND_ASCII_ISDIGIT(*s))
+		return (0);
+	port = strtoul(s, &end, 10);
+	if (*end != '/' || port > 65535)
+		return (0);
+	if (strcmp(end + 1, "tcp") == 0)
+		*kindp = NAME_MAP_TCP;
+	else if (strcmp(end + 1, "udp") == 0)
+		*kindp = NAME_MAP_UDP;
+	else
+		return (0);
+	key[0] = (u_char)(port >> 8);
+	key[1] = (u_char)port;
+	return (1);
+}
+
+static int
+parse_key(const char *s, u_int *kindp, u_char *key)
+{
+	if (strchr(s, '/') != NULL)
+		return (parse_port(s, kindp, key));
+	if (parse_mac(s, key)) {
+		*kindp = NAME_MAP_MAC;
+		return (1);
+	}
+	if (strchr(s, ':') != NULL) {
+		*kindp = NAME_MAP_IPV6;
+		return (strtoaddr6(s, key));
+	}
+	*kindp = NAME_MAP_IPV4;
+	return (strtoaddr(s, key));
+}
+
+#define IS_BLANK(c)	((c) == ' ' || (c) == '\t' || (c) == '\r')
+#define IS_SEP(c)	(IS_BLANK(c) || (c) == ',')
+#define IS_END(c)	((c) == '\n' || (c) == '#')
+
+static int
+map_parse(struct nd_name_map *map, const char *file, char *errbuf,
+	  size_t errbuf_size)
+{
+	const char *p = map->base, *end = map->base + map->size;
+	const char *k, *name, *nl;
+	char keybuf[NAME_MAP_KEY_MAX + 1];
+	u_char key[16];
+	size_t klen, nlen;
+	u_int kind, line;
+
+	for (line = 1; p < end; line++, p = nl + 1) {
+		nl = memchr(p, '\n', end - p);
+		if (nl == NULL)
+			nl = end;
+
+		while (p < nl && IS_BLANK(*p))
+			p++;
+		if (p == nl || *p == '#')
+			continue;
+		k = p;
+		while (p < nl && !IS_SEP(*p) && !IS_END(*p))
+			p++;
+		klen = p - k;
+
+		while (p < nl && IS_SEP(*p))
+			p++;
+		if (p < nl && *p == '"') {
+			name = ++p;
+			while (p < nl && *p != '"')
+				p++;
+			nlen = p - name;
+		} else {
+			name = p;
+			while (p < nl && !IS_SEP(*p) && !IS_END(*p))
+				p++;
+			nlen = p - name;
+		}
+
+		if (klen > NAME_MAP_KEY_MAX) {
+			snprintf(errbuf, errbuf_size,
+			    "%s, line %u: address too long", file, line);
+			return (-1);
+		}
+		memcpy(keybuf, k, klen);
+		keybuf[klen] = '\0';
+		if (!parse_key(keybuf, &kind, key)) {
+			snprintf(errbuf, errbuf_size,
+			    "%s, line %u: invalid address or port \"%s\"",
+			    file, line, keybuf);
+			return (-1);
+		}
+		if (nlen == 0 || nlen > NAME_MAP_NAME_MAX) {
+			snprintf(errbuf, errbuf_size,
+			    "%s, line %u: %s name for \"%s\"", file, line,
+			    nlen == 0 ? "no" : "too long a", keybuf);
+			return (-1);
+		}
+		if (map_add(map, kind, key, (uint32_t)(name - map->base),
+		    (uint16_t)nlen) < 0) {
+			snprintf(errbuf, errbuf_size, "%s: out of memory",
+			    file);
+			return (-1);
+		}
+	}
+	return (0);
+}
+
+/*
+ * Get the contents of the file into map->base: mapped if we can, read
+ * into memory otherwise.
+ */
+static int
+map_read(struct nd_name_map *map, const char *file, char *errbuf,
+	 size_t errbuf_size)
+{
+	struct stat st;
+	char *buf;
+	size_t nread;
+	ssize_t r;
+	int fd;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		snprintf(errbuf, errbuf_size, "%s: %s", file,
+		    strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return (-1);
+	}
+	/* Names are referred to by a 32-bit offset */
+	if ((uint64_t)st.st_size > UINT32_MAX) {
+		snprintf(errbuf, errbuf_size, "%s: too big", file);
+		close(fd);
+		return (-1);
+	}
+	map->size = (size_t)st.st_size;
+	if (map->size == 0) {
+		close(fd);
+		return (0);
+	}
+#ifdef HAVE_MMAP
+	buf = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (buf != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+		(void)madvise(buf, map->size, MADV_SEQUENTIAL);
+#endif
+		close(fd);
+		map->base = buf;
+		map->mapped = 1;
+		return (0);
+	}
+	/* Not a regular file, perhaps; read it. */
+#endif
+	buf = malloc(map->size);
+	if (buf == NULL) {
+		snprintf(errbuf, errbuf_size, "%s: out of memory", file);
+		close(fd);
+		return (-1);
+	}
+	for (nread = 0; nread < map->size; nread += r) {
+		r = read(fd, buf + nread, map->size - nread);
+		if (r <= 0) {
+			snprintf(errbuf, errbuf_size, "%s: %s", file,
+			    r == 0 ? "file changed while being read" :
+			    strerror(errno));
+			free(buf);
+			close(fd);
+			return (-1);
+		}
+	}
+	close(fd);
+	map->base = buf;
+	return (0);
+}
+
+/*
+ * Load a name map file.  Returns NULL, with a message in errbuf, if it
+ * can't be read or has a line that can't be parsed.
+ */
+struct nd_name_map *
+nd_name_map_load(const char *file, char *errbuf, size_t errbuf_size)
+{
+	struct nd_name_map *map;
+	struct map_table *t;
+	u_int kind;
+
+	map = calloc(1, sizeof(*map));
+	if (map == NULL) {
+		snprintf(errbuf, errbuf_size, "%s: out of memory", file);
+		return (NULL);
+	}
+	if (map_read(map, file, errbuf, errbuf_size) < 0 ||
+	    map_parse(map, file, errbuf, errbuf_size) < 0) {
+		nd_name_map_free(map);
+		return (NULL);
+	}
+	for (kind = 0; kind < NAME_MAP_KINDS; kind++) {
+		t = &map->tables[kind];
+		if (t->n != 0 && !t->sorted)
+			qsort(t->entries, t->n, MAP_ESIZE(kind),
+			    map_cmp_func[kind]);
+	}
+	return (map);
+}
+
+/*
+ * Look up the name of an address or port, a key of the given kind;
+ * returns a pointer to it, with its length in *lenp, or NULL.  The
+ * name isn't null-terminated.
+ */
+const char *
+nd_name_map_lookup(const struct nd_name_map *map, u_int kind,
+		   const void *key, size_t *lenp)
+{
+	const struct map_table *t = &map->tables[kind];
+	u_int esize = MAP_ESIZE(kind), keylen = map_keylen[kind];
+	const u_char *e;
+	u_char port[2];
+	u_int lo, hi, mid;
+	uint32_t off;
+	uint16_t len;
+
+	if (kind == NAME_MAP_TCP || kind == NAME_MAP_UDP) {
+		u_short p = *(const u_short *)key;
+
+		port[0] = (u_char)(p >> 8);
+		port[1] = (u_char)p;
+		key = port;
+	}
+	/* Find the first entry for the key */
+	lo = 0;
+	hi = t->n;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (memcmp(t->entries + (size_t)mid * esize, key, keylen) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == t->n)
+		return (NULL);
+	e = t->entries + (size_t)lo * esize;
+	if (memcmp(e, key, keylen) != 0)
+		return (NULL);
+	memcpy(&len, e + MAP_LEN_AT(kind), 2);
+	memcpy(&off, e + MAP_OFF_AT(kind), 4);
+	*lenp = len;
+	return (map->base + off);
+}
+
+/*
+ * Call func with each key of the given kind, in order, and its name;
+ * ports are passed as a u_short in host byte order.
+ */
+void
+nd_name_map_walk(const struct nd_name_map *map, u_int kind,
+		 nd_name_map_walk_func func, void *arg)
+{
+	const struct map_table *t = &map->tables[kind];
+	u_int esize = MAP_ESIZE(kind), keylen = map_keylen[kind];
+	const u_char *e, *prev = NULL;
+	uint32_t off;
+	uint16_t len;
+	u_short port;
+	u_int i;
+
+	for (i = 0; i < t->n; i++) {
+		e = t->entries + (size_t)i * esize;
+		/* Only the first name for each key */
+		if (prev != NULL && memcmp(prev, e, keylen) == 0)
+			continue;
+		prev = e;
+		memcpy(&len, e + MAP_LEN_AT(kind), 2);
+		memcpy(&off, e + MAP_OFF_AT(kind), 4);
+		if (kind == NAME_MAP_TCP || kind == NAME_MAP_UDP) {
+			port = (u_short)(e[0] << 8 | e[1]);
+			(*func)(&port, map->base + off, len, arg);
+		} else
+			(*func)(e, map->base + off, len, arg);
+	}
+}
+
+/* Number of entries of the given kind, counting duplicates */
+u_int
+nd_name_map_count(const struct nd_name_map *map, u_int kind)
+{
+	return (map->tables[kind].n);
+}
+
+void
+nd_name_map_free(struct nd_name_map *map)
+{
+	u_int kind;
+
+	if (map == NULL)
+		return;
+	for (kind = 0; kind < NAME_MAP_KINDS; kind++)
+		free(map->tables[kind].entries);
+	if (map->base != NULL) {
+#ifdef HAVE_MMAP
+		if (map->mapped)
+			(void)munmap((void *)(uintptr_t)map->base, map->size);
+		else
+#endif
+			free((void *)(uintptr_t)map->base);
+	}
+	free(map);
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef netdissect_namemap_h
+#define netdissect_namemap_h
+
+/*
+ * Static maps of addresses and ports to names (--name-map).
+ *
+ * A name map file has a line for each name, with the address or port
+ * and then the name, separated by white space or a comma, as in a
+ * hosts file or a CSV file:
+ *
+ *	192.0.2.1	gateway
+ *	2001:db8::1,"web server"
+ *	00:00:5e:00:53:01 router-mac
+ *	8080/tcp	proxy
+ *
+ * Anything after the name, and anything after a '#', is ignored.  If an
+ * address or port is in the file more than once, the first name wins.
+ *
+ * ipaddr_string(), ip6addr_string(), etheraddr_string(), tcpport_string()
+ * and udpport_string() use the names in the map of their
+ * netdissect_options ahead of any others, and even with -n; the map is
+ * only read once loaded, so the --workers threads share it.
+ */
+
+enum nd_name_map_kind {
+	NAME_MAP_IPV4,		/* 4-byte address, network byte order */
+	NAME_MAP_IPV6,		/* 16-byte address */
+	NAME_MAP_MAC,		/* 6-byte address */
+	NAME_MAP_TCP,		/* u_short port, host byte order */
+	NAME_MAP_UDP,		/* u_short port, host byte order */
+	NAME_MAP_KINDS
+};
+
+struct nd_name_map;
+
+typedef void (*nd_name_map_walk_func)(const void *, const char *, size_t,
+    void *);
+
+extern struct nd_name_map *nd_name_map_load(const char *, char *, size_t);
+extern const char *nd_name_map_lookup(const struct nd_name_map *, u_int,
+    const void *, size_t *);
+extern void nd_name_map_walk(const struct nd_name_map *, u_int,
+    nd_name_map_walk_func, void *);
+extern u_int nd_name_map_count(const struct nd_name_map *, u_int);
+extern void nd_name_map_free(struct nd_name_map *);
+
+#endif /* netdissect_namemap_h */
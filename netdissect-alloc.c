@@ -19,44 +19,131 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
+
 #include "netdissect-alloc.h"
 
 /*
- * nd_free_all() is intended to be used after a packet printing
+ * Memory that's only needed while a packet is being dissected comes
+ * from a per-netdissect_options arena: a list of slabs, handed out by
+ * bumping an offset.  nd_free_all(), called after each packet, just
+ * rewinds to the first slab; the slabs are kept for the next packet.
+ * Allocations bigger than ND_ARENA_SLAB_SIZE get a slab of their own
+ * size, which is also kept.
  */
+#define ND_ARENA_SLAB_SIZE	32768
+#define ND_ARENA_ALIGN		16
+#define ND_ARENA_ROUNDUP(n)	(((n) + ND_ARENA_ALIGN - 1) & ~(size_t)(ND_ARENA_ALIGN - 1))
 
-/* Add a memory chunk in allocation linked list */
-void
-nd_add_alloc_list(netdissect_options *ndo, nd_mem_chunk_t *chunkp)
-{
-	if (ndo->ndo_last_mem_p == NULL)	/* first memory allocation */
-		chunkp->prev_mem_p = NULL;
-	else					/* previous memory allocation */
-		chunkp->prev_mem_p = ndo->ndo_last_mem_p;
-	ndo->ndo_last_mem_p = chunkp;
-}
+struct nd_arena_slab {
+	struct nd_arena_slab *next;
+	size_t size;			/* usable bytes after the header */
+};
+
+#define ND_ARENA_SLAB_HDR	ND_ARENA_ROUNDUP(sizeof(struct nd_arena_slab))
+#define ND_ARENA_SLAB_DATA(slab)	((u_char *)(slab) + ND_ARENA_SLAB_HDR)
+
+struct nd_arena {
+	struct nd_arena_slab *first;
+	struct nd_arena_slab *cur;	/* slab being allocated from */
+	size_t off;			/* bytes used in cur */
+	size_t in_use;			/* bytes handed out for this packet */
+	struct nd_alloc_stats stats;
+};
 
-/* malloc replacement, with tracking in a linked list */
+/* malloc replacement, freed by nd_free_all() */
 void *
 nd_malloc(netdissect_options *ndo, size_t size)
 {
-	nd_mem_chunk_t *chunkp = malloc(sizeof(nd_mem_chunk_t) + size);
-	if (chunkp == NULL)
-		return NULL;
-	nd_add_alloc_list(ndo, chunkp);
-	return chunkp + 1;
+	struct nd_arena *arena = ndo->ndo_arena;
+	struct nd_arena_slab *slab;
+	size_t slabsize;
+	void *p;
+
+	if (arena == NULL) {
+		arena = calloc(1, sizeof(struct nd_arena));
+		if (arena == NULL)
+			return NULL;
+		ndo->ndo_arena = arena;
+	}
+	size = ND_ARENA_ROUNDUP(size);
+	if (size == 0)
+		size = ND_ARENA_ALIGN;
+
+	if (arena->cur == NULL || size > arena->cur->size - arena->off) {
+		/*
+		 * Move on to the next slab if it's big enough; otherwise
+		 * put a new one in front of it.
+		 */
+		slab = arena->cur != NULL ? arena->cur->next : arena->first;
+		if (slab == NULL || size > slab->size) {
+			slabsize = size > ND_ARENA_SLAB_SIZE ?
+			    size : ND_ARENA_SLAB_SIZE;
+			slab = malloc(ND_ARENA_SLAB_HDR + slabsize);
+			if (slab == NULL)
+				return NULL;
+			slab->size = slabsize;
+			if (arena->cur != NULL) {
+				slab->next = arena->cur->next;
+				arena->cur->next = slab;
+			} else {
+				slab->next = arena->first;
+				arena->first = slab;
+			}
+			arena->stats.slabs++;
+			arena->stats.slab_bytes += slabsize;
+		}
+		arena->cur = slab;
+		arena->off = 0;
+	}
+
+	p = ND_ARENA_SLAB_DATA(arena->cur) + arena->off;
+	arena->off += size;
+	arena->in_use += size;
+	if (arena->in_use > arena->stats.high_water)
+		arena->stats.high_water = arena->in_use;
+	return p;
 }
 
-/* Free chunks in allocation linked list from last to first */
+/* Release everything nd_malloc() handed out for the current packet */
 void
 nd_free_all(netdissect_options *ndo)
 {
-	nd_mem_chunk_t *current, *previous;
-	current = ndo->ndo_last_mem_p;
-	while (current != NULL) {
-		previous = current->prev_mem_p;
-		free(current);
-		current = previous;
+	struct nd_arena *arena = ndo->ndo_arena;
+
+	if (arena == NULL)
+		return;
+	arena->cur = NULL;
+	arena->off = 0;
+	arena->in_use = 0;
+}
+
+/* Free the arena itself */
+void
+nd_free_arena(netdissect_options *ndo)
+{
+	struct nd_arena *arena = ndo->ndo_arena;
+	struct nd_arena_slab *slab, *next;
+
+	if (arena == NULL)
+		return;
+	for (slab = arena->first; slab != NULL; slab = next) {
+		next = slab->next;
+		free(slab);
 	}
-	ndo->ndo_last_mem_p = NULL;
+	free(arena);
+	ndo->ndo_arena = NULL;
+}
+
+/*
+ * Get the arena counters: the most bytes used for one packet, and the
+ * slabs allocated to hold them.
+ */
+void
+nd_get_alloc_stats(netdissect_options *ndo, struct nd_alloc_stats *stats)
+{
+	if (ndo->ndo_arena == NULL)
+		memset(stats, 0, sizeof(*stats));
+	else
+		*stats = ndo->ndo_arena->stats;
 }
@@ -21,13 +21,8 @@
 #include "netdissect-stdinc.h"
 #include "netdissect.h"
 
-typedef struct nd_mem_chunk {
-	void *prev_mem_p;
-	/* variable size data */
-} nd_mem_chunk_t;
-
-void nd_add_alloc_list(netdissect_options *, nd_mem_chunk_t *);
 void * nd_malloc(netdissect_options *, size_t);
 void nd_free_all(netdissect_options *);
+void nd_free_arena(netdissect_options *);
 
 #endif /* netdissect_alloc_h */
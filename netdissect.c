@@ -28,6 +28,7 @@
 
 #include "netdissect-stdinc.h"
 #include "netdissect.h"
+#include "netdissect-alloc.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -81,11 +82,14 @@ nd_init(char *errbuf, size_t errbuf_size)
 }
 
 /*
- * Clean up anything that ndo_init() did.
+ * Clean up anything that ndo_init() did, and free the calling thread's
+ * tok2str() indexes.
  */
 void
 nd_cleanup(void)
 {
+	tok_index_free();
+
 #ifdef USE_LIBSMI
 	/*
 	 * This appears, in libsmi 0.4.8, to do nothing if smiInit()
@@ -146,6 +150,71 @@ nd_smi_version_string(void)
 #endif
 }
 
+/*
+ * Set up a netdissect_options, e.g. one that's a copy of another
+ * netdissect_options, to have no per-context state of its own yet;
+ * the printers allocate it as needed.
+ */
+void
+nd_init_state(netdissect_options *ndo)
+{
+	ndo->ndo_addrtoname = NULL;
+	ndo->ndo_atalk = NULL;
+	ndo->ndo_esp = NULL;
+	ndo->ndo_ipreasm = NULL;
+	ndo->ndo_rpctable = NULL;
+	ndo->ndo_sl = NULL;
+	ndo->ndo_tcp = NULL;
+	ndo->ndo_tcpreasm = NULL;
+	ndo->ndo_output = NULL;
+	ndo->ndo_arena = NULL;
+	ndo->ndo_protostats = NULL;
+	ndo->ndo_tv_ref.tv_sec = 0;
+	ndo->ndo_tv_ref.tv_usec = 0;
+	ndo->ndo_ts_cache.len = 0;
+}
+
+/*
+ * Free the state the printers kept between packets for this
+ * netdissect_options, including the tables set up by init_print(),
+ * after writing any output still buffered by the default ndo_printf().
+ * It can be used again afterwards, after another init_print().
+ */
+void
+nd_free_state(netdissect_options *ndo)
+{
+	addrtoname_free_state(ndo);
+	atalk_free_state(ndo);
+	esp_free_state(ndo);
+	ipreasm_free_state(ndo);
+	output_free_state(ndo);
+	protostats_free_state(ndo);
+	rpctable_free_state(ndo);
+	sl_free_state(ndo);
+	tcp_free_state(ndo);
+	tcpreasm_free_state(ndo);
+	nd_free_arena(ndo);
+	nd_init_state(ndo);
+}
+
+/*
+ * Forget what the printers have learned about the conversations seen so
+ * far - relative TCP sequence numbers, fragments and segments waiting
+ * to be reassembled, requests waiting for their replies, compressed
+ * SLIP headers, and the time stamp of the previous packet - as if no
+ * packets had been seen, keeping the name tables and ESP secrets.
+ */
+void
+nd_forget_conversations(netdissect_options *ndo)
+{
+	ipreasm_free_state(ndo);
+	rpctable_free_state(ndo);
+	sl_free_state(ndo);
+	tcp_free_state(ndo);
+	tcpreasm_free_state(ndo);
+	ndo->ndo_tv_ref.tv_sec = 0;
+	ndo->ndo_tv_ref.tv_usec = 0;
+}
 
 int
 nd_push_buffer(netdissect_options *ndo, u_char *new_buffer,
@@ -153,7 +222,7 @@ nd_push_buffer(netdissect_options *ndo, u_char *new_buffer,
 {
 	struct netdissect_saved_packet_info *ndspi;
 
-	ndspi = (struct netdissect_saved_packet_info *)malloc(sizeof(struct netdissect_saved_packet_info));
+	ndspi = (struct netdissect_saved_packet_info *)nd_malloc(ndo, sizeof(struct netdissect_saved_packet_info));
 	if (ndspi == NULL)
 		return (0);	/* fail */
 	ndspi->ndspi_buffer = new_buffer;
@@ -177,7 +246,7 @@ nd_push_snapend(netdissect_options *ndo, const u_char *new_snapend)
 {
 	struct netdissect_saved_packet_info *ndspi;
 
-	ndspi = (struct netdissect_saved_packet_info *)malloc(sizeof(struct netdissect_saved_packet_info));
+	ndspi = (struct netdissect_saved_packet_info *)nd_malloc(ndo, sizeof(struct netdissect_saved_packet_info));
 	if (ndspi == NULL)
 		return (0);	/* fail */
 	ndspi->ndspi_buffer = NULL;	/* no new buffer */
@@ -224,8 +293,7 @@ nd_pop_packet_info(netdissect_options *ndo)
 	ndo->ndo_snapend = ndspi->ndspi_snapend;
 	ndo->ndo_packet_info_stack = ndspi->ndspi_prev;
 
-	free(ndspi->ndspi_buffer);
-	free(ndspi);
+	/* The buffer and the stack entry are freed by nd_free_all(). */
 }
 
 void
@@ -145,6 +145,7 @@ extern const char *tok2strbuf(const struct tok *, const char *, u_int,
 extern const char *tok2str(const struct tok *, const char *, u_int);
 extern char *bittok2str(const struct tok *, const char *, u_int);
 extern char *bittok2str_nosep(const struct tok *, const char *, u_int);
+extern void tok_index_free(void);
 
 /* Initialize netdissect. */
 extern int nd_init(char *, size_t);
@@ -181,8 +182,9 @@ typedef union {
  *
  * We keep a stack of those buffers; when we allocate a new buffer, we
  * push the current one onto a stack, and when we're done with the new
- * buffer, we free the current buffer and pop the previous one off the
- * stack.
+ * buffer, we pop the previous one off the stack.  The new buffer must
+ * come from nd_malloc(); it, and the stack entries, are freed when the
+ * packet has been dissected.
  *
  * A buffer has a beginnning and end pointer, and a link to the previous
  * buffer on the stack.
@@ -190,16 +192,30 @@ typedef union {
  * In other cases, we temporarily adjust the snapshot end to reflect a
  * packet-length field in the packet data and, when finished dissecting
  * that part of the packet, restore the old snapshot end.  We keep that
- * on the stack with null buffer pointer, meaning there's nothing to
- * free.
+ * on the stack with null buffer pointer.
  */
 struct netdissect_saved_packet_info {
-  u_char *ndspi_buffer;					/* pointer to allocated buffer data */
+  u_char *ndspi_buffer;					/* pointer to nd_malloc()ed buffer data */
   const u_char *ndspi_packetp;				/* saved beginning of data */
   const u_char *ndspi_snapend;				/* saved end of data */
   struct netdissect_saved_packet_info *ndspi_prev;	/* previous buffer on the stack */
 };
 
+enum date_flag { WITHOUT_DATE = 0, WITH_DATE = 1 };
+enum time_flag { UTC_TIME = 0, LOCAL_TIME = 1 };
+
+/*
+ * The seconds part of the last time stamp ts_print() formatted as a
+ * date and/or time of day, "HH:MM:SS" or "YYYY-MM-DD HH:MM:SS".
+ */
+struct nd_ts_cache {
+  time_t sec;			/* the seconds formatted */
+  enum date_flag date_flag;	/* with the date? */
+  enum time_flag time_flag;	/* local time or UTC? */
+  u_int len;			/* length of str; 0 if nothing's cached */
+  char str[32];
+};
+
 struct netdissect_options {
   int ndo_bflag;		/* print 4 byte ASes in ASDOT notation */
   int ndo_eflag;		/* print ethernet header */
@@ -220,30 +236,70 @@ struct netdissect_options {
   int ndo_Hflag;		/* dissect 802.11s draft mesh standard */
   const char *ndo_protocol;	/* protocol */
   jmp_buf ndo_truncated;	/* jmp_buf for setjmp()/longjmp() */
-  void *ndo_last_mem_p;		/* pointer to the last allocated memory chunk */
   int ndo_packet_number;	/* print a packet number in the beginning of line */
   int ndo_suppress_default_print; /* don't use default_print() for unknown packet types */
   int ndo_tstamp_precision;	/* requested time stamp precision */
   const char *program_name;	/* Name of the program using the library */
 
   char *ndo_espsecret;
-  struct sa_list *ndo_sa_list_head;  /* used by print-esp.c */
-  struct sa_list *ndo_sa_default;
 
   char *ndo_sigsecret;		/* Signature verification secret key */
 
   int   ndo_packettype;	/* as specified by -T */
 
+  /* port to printer tables with --decode-as ports, or NULL (portdispatch.c) */
+  struct port_table *ndo_udp_ports;
+  struct port_table *ndo_tcp_ports;
+
   int   ndo_snaplen;
+  size_t ndo_name_cache_max;	/* bytes of cached names; 0 for no limit */
+  struct nd_name_map *ndo_name_map;	/* --name-map, or NULL */
+  int   ndo_reassemble;	/* --reassemble: put IP fragments back together */
+  size_t ndo_reasm_max;	/* bytes of fragments kept; 0 for the default */
+  u_int ndo_reasm_timeout;	/* seconds fragments are kept; 0 for the default */
+  int   ndo_reasm_overlap;	/* REASM_OVERLAP_ policy for overlapping data */
+  int   ndo_tcp_reassemble;	/* --reassemble-tcp: join TCP segments */
+  size_t ndo_tcp_reasm_max;	/* bytes of segments kept; 0 for the default */
+  size_t ndo_tcp_reasm_flow_max;	/* the same, per direction of a connection */
+  u_int ndo_tcp_seq_max;	/* TCP conversations remembered; 0 for the default */
+  u_int ndo_tcp_seq_timeout;	/* seconds one is remembered idle; 0 for the default,
+				   ND_TCP_SEQ_NO_TIMEOUT for ever */
+  u_int ndo_rpc_table_max;	/* requests remembered; 0 for the default */
+  u_int ndo_rpc_table_timeout;	/* seconds one is remembered idle; 0 for the default */
+  int   ndo_proto_stats;	/* --protocol-stats: count, don't print */
+  u_int ndo_proto_stats_interval;	/* seconds between reports; 0 for one */
   int   ndo_ll_header_length;	/* link-layer header length */
 
   /*global pointers to beginning and end of current packet (during printing) */
   const u_char *ndo_packetp;
   const u_char *ndo_snapend;
+  struct timeval ndo_ts;	/* time stamp of the packet being printed */
 
   /* stack of saved packet boundary and buffer information */
   struct netdissect_saved_packet_info *ndo_packet_info_stack;
 
+  /*
+   * State kept from one packet to the next, so that a program can
+   * dissect with several netdissect_options at the same time, e.g. one
+   * per thread.  The printers allocate it when they first need it;
+   * nd_free_state() frees it.
+   */
+  struct addrtoname_state *ndo_addrtoname;	/* used by addrtoname.c */
+  struct atalk_state *ndo_atalk;	/* used by print-atalk.c */
+  struct esp_state *ndo_esp;		/* used by print-esp.c */
+  struct ipreasm_state *ndo_ipreasm;	/* used by ipreasm.c */
+  struct rpctable_state *ndo_rpctable;	/* used by rpctable.c */
+  struct sl_state *ndo_sl;		/* used by print-sl.c */
+  struct tcp_state *ndo_tcp;		/* used by print-tcp.c */
+  struct tcpreasm_state *ndo_tcpreasm;	/* used by tcpreasm.c */
+  struct timeval ndo_tv_ref;		/* used by ts_print() */
+  struct nd_ts_cache ndo_ts_cache;	/* used by ts_print() */
+  struct nd_output *ndo_output;	/* used by the default ndo_printf() */
+  struct nd_arena *ndo_arena;		/* used by nd_malloc() */
+  struct protostats_state *ndo_protostats;	/* used by protostats.c */
+
+  int ndo_flush_packets;	/* write the output after each packet */
+
   /* pointer to the uint_if_printer or the void_if_printer function */
   if_printer_t ndo_if_printer;
   int ndo_void_printer; /* void_if_printer ? (FALSE/TRUE) */
@@ -274,6 +330,142 @@ extern void nd_change_snapend(netdissect_options *, const u_char *);
 extern void nd_pop_packet_info(netdissect_options *);
 extern void nd_pop_all_packet_info(netdissect_options *);
 
+extern void nd_init_state(netdissect_options *);
+extern void nd_free_state(netdissect_options *);
+extern void nd_forget_conversations(netdissect_options *);
+extern void nd_flush_output(netdissect_options *);
+
+/*
+ * Counters for the per-packet memory arena used by nd_malloc().
+ */
+struct nd_alloc_stats {
+  size_t high_water;	/* most bytes allocated while dissecting one packet */
+  size_t slab_bytes;	/* bytes in the slabs the arena holds */
+  u_int slabs;		/* number of those slabs */
+};
+
+extern void nd_get_alloc_stats(netdissect_options *, struct nd_alloc_stats *);
+
+/*
+ * Counters for the cache of names for addresses and ports kept by
+ * addrtoname.c.
+ */
+struct nd_name_cache_stats {
+  uint64_t hits;	/* lookups that found a name */
+  uint64_t misses;	/* lookups that had to make one */
+  uint64_t evictions;	/* names discarded to stay within ndo_name_cache_max */
+  u_int names;		/* names cached */
+  size_t bytes;		/* memory the cache takes */
+};
+
+extern void nd_get_name_cache_stats(netdissect_options *,
+    struct nd_name_cache_stats *);
+
+/*
+ * Counters for the reassembly of IP fragments (--reassemble) by
+ * ipreasm.c.
+ */
+struct nd_reasm_stats {
+  uint64_t fragments;	/* fragments added to a datagram */
+  uint64_t datagrams;	/* datagrams reassembled */
+  uint64_t timed_out;	/* datagrams given up on after ndo_reasm_timeout */
+  uint64_t evicted;	/* datagrams given up on to stay within ndo_reasm_max */
+  uint64_t overlaps;	/* fragments overlapping data already received */
+  uint64_t discarded;	/* datagrams dropped for overlaps or bad lengths */
+  u_int pending;	/* datagrams still incomplete */
+  size_t bytes;		/* memory the fragments take */
+  size_t peak_bytes;	/* most memory they took */
+};
+
+extern void nd_get_reasm_stats(netdissect_options *, struct nd_reasm_stats *);
+
+/*
+ * Counters for the reassembly of TCP streams (--reassemble-tcp) by
+ * tcpreasm.c.
+ */
+struct nd_tcp_reasm_stats {
+  uint64_t segments;	/* segments with data looked at */
+  uint64_t delivered;	/* bytes handed to the printers */
+  uint64_t retransmitted;	/* segments with no new data */
+  uint64_t out_of_order;	/* segments kept for data still missing */
+  uint64_t held;	/* segments kept for the rest of their PDU */
+  uint64_t gaps;	/* times data was skipped to stay within the limits */
+  uint64_t timed_out;	/* streams forgotten after ndo_reasm_timeout */
+  uint64_t evicted;	/* streams forgotten to stay within ndo_tcp_reasm_max */
+  u_int streams;	/* directions of connections being followed */
+  size_t bytes;		/* memory the streams take */
+  size_t peak_bytes;	/* most memory they took */
+};
+
+extern void nd_get_tcp_reasm_stats(netdissect_options *,
+    struct nd_tcp_reasm_stats *);
+
+/* ndo_tcp_seq_timeout for never forgetting an idle conversation */
+#define ND_TCP_SEQ_NO_TIMEOUT	0xffffffffU
+
+/*
+ * Counters for the table of TCP conversations print-tcp.c keeps for
+ * printing relative sequence numbers.
+ */
+struct nd_tcp_seq_stats {
+  uint64_t lookups;	/* conversations looked up */
+  uint64_t probes;	/* hash chain entries looked at for them */
+  uint64_t closed;	/* forgotten after a RST or a FIN each way */
+  uint64_t timed_out;	/* forgotten after ndo_tcp_seq_timeout idle */
+  uint64_t evicted;	/* forgotten to stay within ndo_tcp_seq_max */
+  u_int flows;		/* conversations remembered */
+  u_int longest_chain;	/* longest hash chain looked through */
+  size_t bytes;		/* memory the table takes */
+};
+
+extern void nd_get_tcp_seq_stats(netdissect_options *,
+    struct nd_tcp_seq_stats *);
+
+/*
+ * Counters for the table of requests rpctable.c keeps for the NFS, AFS
+ * Rx and ISAKMP printers; the per-kind ones are indexed by RPCTABLE_NFS,
+ * RPCTABLE_RX and RPCTABLE_ISAKMP.
+ */
+#define ND_RPC_KINDS	3
+
+struct nd_rpc_table_stats {
+  uint64_t entered[ND_RPC_KINDS];	/* requests entered */
+  uint64_t hits[ND_RPC_KINDS];	/* lookups that found a request */
+  uint64_t misses[ND_RPC_KINDS];	/* lookups that didn't */
+  uint64_t lookups;	/* lookups, including those for entering */
+  uint64_t probes;	/* hash chain entries looked at for them */
+  uint64_t timed_out;	/* forgotten after ndo_rpc_table_timeout idle */
+  uint64_t evicted;	/* forgotten to stay within ndo_rpc_table_max */
+  u_int entries;	/* requests remembered */
+  u_int longest_chain;	/* longest hash chain looked through */
+  size_t bytes;		/* memory the table takes */
+};
+
+extern void nd_get_rpc_table_stats(netdissect_options *,
+    struct nd_rpc_table_stats *);
+
+extern int nd_decode_as(netdissect_options *, u_int, const char *, char *,
+    size_t);
+
+/*
+ * Protocol statistics (--protocol-stats): with ndo_proto_stats set,
+ * pretty_print_packet() prints nothing, and instead counts the packets
+ * and bytes of each protocol path, such as EN10MB/IPv4/UDP/domain, that
+ * the printers' demultiplexing goes down.  The printers name each layer
+ * with ND_STATS_LAYER() as they hand the packet on to the next one.
+ */
+#define ND_STATS_LAYER(ndo, name) \
+	do { \
+		if ((ndo)->ndo_proto_stats) \
+			protostats_layer((ndo), (name)); \
+	} while (0)
+
+extern void protostats_layer(netdissect_options *, const char *);
+extern void protostats_packet(netdissect_options *, const struct pcap_pkthdr *,
+    const u_char *);
+extern void nd_set_proto_stats_linktype(netdissect_options *, int);
+extern void nd_print_proto_stats(netdissect_options *);
+
 #define PT_VAT		1	/* Visual Audio Tool */
 #define PT_WB		2	/* distributed White Board */
 #define PT_RPC		3	/* Remote Procedure Call */
@@ -390,6 +582,8 @@ extern void nd_pop_all_packet_info(netdissect_options *);
 #define ND_DEFAULTPRINT(ap, length) (*ndo->ndo_default_print)(ndo, ap, length)
 
 extern void ts_print(netdissect_options *, const struct timeval *);
+extern struct tm *nd_localtime(const time_t *, struct tm *);
+extern struct tm *nd_gmtime(const time_t *, struct tm *);
 extern void signed_relts_print(netdissect_options *, int32_t);
 extern void unsigned_relts_print(netdissect_options *, uint32_t);
 
@@ -711,6 +905,9 @@ extern void zmtp1_print(netdissect_options *, const u_char *, u_int);
 extern void zmtp1_datagram_print(netdissect_options *, const u_char *, const u_int);
 extern void someip_print(netdissect_options *, const u_char *, const u_int);
 
+/* UDP and TCP port dispatch tables */
+extern void init_port_tables(void);
+
 /* checksum routines */
 extern void init_checksum(void);
 extern uint16_t verify_crc10_cksum(uint16_t, const u_char *, int);
@@ -745,6 +942,19 @@ extern const char *dnnum_string(netdissect_options *, u_short);
 extern int decode_prefix4(netdissect_options *, const u_char *, u_int, char *, size_t);
 extern int decode_prefix6(netdissect_options *, const u_char *, u_int, char *, size_t);
 
+/* Free the state kept between packets by a printer */
+extern void addrtoname_free_state(netdissect_options *);
+extern void addrtoname_trim(netdissect_options *);
+extern void atalk_free_state(netdissect_options *);
+extern void esp_free_state(netdissect_options *);
+extern void ipreasm_free_state(netdissect_options *);
+extern void output_free_state(netdissect_options *);
+extern void protostats_free_state(netdissect_options *);
+extern void rpctable_free_state(netdissect_options *);
+extern void sl_free_state(netdissect_options *);
+extern void tcp_free_state(netdissect_options *);
+extern void tcpreasm_free_state(netdissect_options *);
+
 extern void esp_decodesecret_print(netdissect_options *);
 extern int esp_decrypt_buffer_by_ikev2_print(netdissect_options *, int,
 					     const u_char spii[8],
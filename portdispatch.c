@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/* \summary: UDP and TCP port to printer dispatch tables */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netdissect.h"
+#include "ascii_strcasecmp.h"
+#include "portdispatch.h"
+
+#define PORT_TABLE_SIZE	65536
+
+/*
+ * The tables hold ranks, 1-based positions in the rank[] array, so
+ * that a port can be looked up as a source and as a destination port
+ * and the entry with the smaller rank wins, as the earlier test in an
+ * if/else chain would.
+ */
+#define PORT_RANK_MAX	255
+#define DECODE_AS_MAX	32	/* --decode-as ports per protocol */
+
+struct port_table {
+	const struct port_printer *registry;
+	const struct port_printer *rank[PORT_RANK_MAX];	/* [0] unused */
+	u_int nranks;
+	struct port_printer user[DECODE_AS_MAX];	/* from nd_decode_as() */
+	u_int nuser;
+	uint8_t src[PORT_TABLE_SIZE];	/* rank by source port */
+	uint8_t dst[PORT_TABLE_SIZE];	/* rank by destination port */
+};
+
+static struct port_table udp_ports;
+static struct port_table tcp_ports;
+
+static void
+port_table_fill(uint8_t *table, const struct port_printer *p, uint8_t r)
+{
+	u_int port;
+
+	for (port = p->lo; port <= p->hi; port++)
+		table[port] = r;
+}
+
+/*
+ * (Re)build a table; the ports given with nd_decode_as() come first,
+ * the most recently given one first of all, then the registry.
+ */
+static void
+port_table_build(struct port_table *t)
+{
+	const struct port_printer *p;
+	u_int i, r;
+
+	t->nranks = 0;
+	for (i = t->nuser; i != 0; i--)
+		t->rank[++t->nranks] = &t->user[i - 1];
+	for (p = t->registry; p->print != NULL; p++) {
+		if (p->match == 0)
+			continue;
+		if (t->nranks + 1 >= PORT_RANK_MAX)
+			break;	/* can't happen; nd_decode_as() checks */
+		t->rank[++t->nranks] = p;
+	}
+
+	memset(t->src, 0, sizeof(t->src));
+	memset(t->dst, 0, sizeof(t->dst));
+	for (r = t->nranks; r != 0; r--) {
+		p = t->rank[r];
+		if (p->match & PORT_MATCH_SRC)
+			port_table_fill(t->src, p, (uint8_t)r);
+		if (p->match & PORT_MATCH_DST)
+			port_table_fill(t->dst, p, (uint8_t)r);
+	}
+}
+
+static u_int
+port_registry_count(const struct port_printer *p)
+{
+	u_int n;
+
+	for (n = 0; p->print != NULL; p++)
+		if (p->match != 0)
+			n++;
+	return n;
+}
+
+static int
+port_matches(const struct port_printer *p, const struct port_payload *pl)
+{
+	return ((p->match & PORT_MATCH_SRC) &&
+		pl->sport >= p->lo && pl->sport <= p->hi) ||
+	       ((p->match & PORT_MATCH_DST) &&
+		pl->dport >= p->lo && pl->dport <= p->hi);
+}
+
+static const struct port_printer *
+port_table_lookup(netdissect_options *ndo, const struct port_table *t,
+    const struct port_payload *pl)
+{
+	const struct port_printer *p;
+	u_int r, rd;
+
+	r = t->src[pl->sport];
+	rd = t->dst[pl->dport];
+	if (r == 0 || (rd != 0 && rd < r))
+		r = rd;
+	while (r != 0) {
+		p = t->rank[r];
+		if (p->check == NULL || p->check(ndo, pl))
+			return p;
+		/*
+		 * The printer didn't want it; look for the next one
+		 * down that claims either port.
+		 */
+		for (r++; r <= t->nranks; r++)
+			if (port_matches(t->rank[r], pl))
+				break;
+		if (r > t->nranks)
+			break;
+	}
+	return NULL;
+}
+
+/*
+ * Return the printer for a UDP payload, or NULL if there's none.
+ */
+const struct port_printer *
+udp_port_printer(netdissect_options *ndo, const struct port_payload *pl)
+{
+	return port_table_lookup(ndo,
+	    ndo->ndo_udp_ports != NULL ? ndo->ndo_udp_ports : &udp_ports, pl);
+}
+
+/*
+ * Return the printer for a TCP payload, or NULL if there's none.
+ */
+const struct port_printer *
+tcp_port_printer(netdissect_options *ndo, const struct port_payload *pl)
+{
+	return port_table_lookup(ndo,
+	    ndo->ndo_tcp_ports != NULL ? ndo->ndo_tcp_ports : &tcp_ports, pl);
+}
+
+/* Build the default tables; called once, by init_print() */
+void
+init_port_tables(void)
+{
+	if (udp_ports.registry != NULL)
+		return;
+	udp_ports.registry = udp_port_printers;
+	port_table_build(&udp_ports);
+	tcp_ports.registry = tcp_port_printers;
+	port_table_build(&tcp_ports);
+}
+
+static int
+decode_as_add(struct port_table **tp, const struct port_table *deflt,
+    u_int port, const char *proto, char *errbuf, size_t errbuf_size)
+{
+	const struct port_printer *p;
+	struct port_printer *u;
+	struct port_table *t;
+
+	for (p = deflt->registry; p->print != NULL; p++)
+		if (ascii_strcasecmp(p->name, proto) == 0)
+			break;
+	if (p->print == NULL)
+		return (0);	/* not one of ours */
+
+	t = *tp;
+	if (t == NULL) {
+		t = (struct port_table *)malloc(sizeof(*t));
+		if (t == NULL) {
+			snprintf(errbuf, errbuf_size, "%s: malloc", __func__);
+			return (-1);
+		}
+		memcpy(t, deflt, sizeof(*t));
+		*tp = t;
+	}
+	if (t->nuser == DECODE_AS_MAX ||
+	    port_registry_count(t->registry) + t->nuser + 1 >= PORT_RANK_MAX) {
+		snprintf(errbuf, errbuf_size, "too many ports to decode as");
+		return (-1);
+	}
+	u = &t->user[t->nuser++];
+	*u = *p;
+	u->lo = u->hi = (uint16_t)port;
+	u->match = PORT_MATCH_ANY|PORT_MATCH_USER;
+	u->check = NULL;
+	port_table_build(t);
+	return (1);
+}
+
+/*
+ * Have UDP and TCP traffic to or from a port dissected by the printer
+ * named proto, whichever of the two has a printer by that name,
+ * before anything else claiming the port.  Returns 0 on success, -1
+ * with a message in errbuf on failure.
+ *
+ * The netdissect_options gets its own copy of the tables; it's kept,
+ * like the rest of its configuration, in copies of it made afterwards.
+ */
+int
+nd_decode_as(netdissect_options *ndo, u_int port, const char *proto,
+    char *errbuf, size_t errbuf_size)
+{
+	int udp, tcp;
+
+	if (port > 65535) {
+		snprintf(errbuf, errbuf_size, "invalid port %u", port);
+		return (-1);
+	}
+	init_port_tables();
+	udp = decode_as_add(&ndo->ndo_udp_ports, &udp_ports, port, proto,
+	    errbuf, errbuf_size);
+	if (udp < 0)
+		return (-1);
+	tcp = decode_as_add(&ndo->ndo_tcp_ports, &tcp_ports, port, proto,
+	    errbuf, errbuf_size);
+	if (tcp < 0)
+		return (-1);
+	if (udp == 0 && tcp == 0) {
+		snprintf(errbuf, errbuf_size,
+		    "unknown protocol \"%s\" to decode as", proto);
+		return (-1);
+	}
+	return (0);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef netdissect_portdispatch_h
+#define netdissect_portdispatch_h
+
+/*
+ * Choosing the printer for a UDP or TCP payload by port number.
+ *
+ * print-udp.c and print-tcp.c each have a registry, an array of
+ * struct port_printer listing the ports (or port ranges) each printer
+ * owns, in order of precedence, ending with an entry with a null
+ * print function.  From a registry, init_port_tables() builds two
+ * 65536-entry tables, one indexed by source port and one by
+ * destination port, each holding the position in the registry of the
+ * first printer claiming that port, so that finding the printer for a
+ * packet is two lookups.
+ *
+ * A printer that also has to look at the payload to decide, such as
+ * the AppleTalk-over-UDP one, has a check function; if it rejects the
+ * payload, the search carries on down the registry.
+ *
+ * nd_decode_as() adds ports to a netdissect_options' own copy of the
+ * tables, ahead of the registry.
+ */
+
+/*
+ * What a printer gets handed: the transport-layer payload, with the
+ * ports and the network-layer header it came with.
+ */
+struct port_payload {
+	const u_char *bp;	/* beginning of the payload */
+	u_int length;		/* length of the payload */
+	const u_char *bp2;	/* IPv4 or IPv6 header */
+	uint16_t sport;		/* source port */
+	uint16_t dport;		/* destination port */
+	int fragmented;		/* non-zero if IP fragmented (UDP only) */
+	u_int ttl_hl;		/* IPv4 TTL or IPv6 hop limit (UDP only) */
+};
+
+typedef void (*port_print_t)(netdissect_options *, const struct port_payload *);
+typedef int (*port_check_t)(netdissect_options *, const struct port_payload *);
+
+#define PORT_MATCH_SRC	0x01	/* printer owns the ports as source ports */
+#define PORT_MATCH_DST	0x02	/* printer owns the ports as destination ports */
+#define PORT_MATCH_ANY	(PORT_MATCH_SRC|PORT_MATCH_DST)
+#define PORT_MATCH_USER	0x04	/* added by nd_decode_as() */
+
+struct port_printer {
+	const char *name;	/* name for --decode-as */
+	uint16_t lo;		/* first port */
+	uint16_t hi;		/* last port */
+	u_int match;		/* PORT_MATCH_ flags; 0 for --decode-as only */
+	port_check_t check;	/* heuristic check, or NULL */
+	port_print_t print;
+};
+
+extern const struct port_printer udp_port_printers[];
+extern const struct port_printer tcp_port_printers[];
+
+extern const struct port_printer *udp_port_printer(netdissect_options *,
+    const struct port_payload *);
+extern const struct port_printer *tcp_port_printer(netdissect_options *,
+    const struct port_payload *);
+
+#endif /* netdissect_portdispatch_h */
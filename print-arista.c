@@ -34,11 +34,11 @@ arista_print_date_hms_time(netdissect_options *ndo, uint32_t seconds,
 		uint32_t nanoseconds)
 {
 	time_t ts;
-	struct tm *tm;
+	struct tm tmbuf, *tm;
 	char buf[BUFSIZE];
 
 	ts = seconds + (nanoseconds / 1000000000);
-	if (NULL == (tm = gmtime(&ts)))
+	if (NULL == (tm = nd_gmtime(&ts, &tmbuf)))
 		ND_PRINT(": gmtime() error");
 	else if (0 == strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", tm))
 		ND_PRINT(": strftime() error");
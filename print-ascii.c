@@ -45,25 +45,105 @@
 #include "netdissect-stdinc.h"
 
 #include <stdio.h>
+#include <string.h>
 
 #include "netdissect-ctype.h"
 
 #include "netdissect.h"
 #include "extract.h"
 
-#define ASCII_LINELENGTH 300
 #define HEXDUMP_BYTES_PER_LINE 16
 #define HEXDUMP_SHORTS_PER_LINE (HEXDUMP_BYTES_PER_LINE / 2)
 #define HEXDUMP_HEXSTUFF_PER_SHORT 5 /* 4 hex digits and a space */
 #define HEXDUMP_HEXSTUFF_PER_LINE \
 		(HEXDUMP_HEXSTUFF_PER_SHORT * HEXDUMP_SHORTS_PER_LINE)
+/* "0xOOOOOOOO: ", the hex, "  " and the ASCII, not counting the ident */
+#define HEXDUMP_LINE_MAX \
+		(12 + HEXDUMP_HEXSTUFF_PER_LINE + 2 + HEXDUMP_BYTES_PER_LINE)
 
-static void hex_and_ascii_print_with_offset(netdissect_options *, const char *, const u_char *, u_int, u_int);
+/*
+ * The dumps are formatted a line at a time into a dump_buf, and printed
+ * with one ND_PRINT() whenever it fills up, rather than with an
+ * ND_PRINT() or two for every byte.
+ */
+#define DUMP_BUFSIZE	4096
+
+struct dump_buf {
+	char buf[DUMP_BUFSIZE];
+	size_t len;
+	const char *ident;	/* what every line starts with */
+	size_t identlen;
+};
+
+static const char hex[] = "0123456789abcdef";
+
+static void
+dump_flush(netdissect_options *ndo, struct dump_buf *db)
+{
+	if (db->len != 0) {
+		db->buf[db->len] = '\0';
+		ND_PRINT("%s", db->buf);
+		db->len = 0;
+	}
+}
+
+/*
+ * Make room for a line, start it with the ident and the offset, and
+ * return where the rest of the line goes.
+ */
+static char *
+dump_line_start(netdissect_options *ndo, struct dump_buf *db, u_int oset)
+{
+	char *p;
+	u_int ndigits;
+
+	if (db->len + db->identlen + HEXDUMP_LINE_MAX >= sizeof(db->buf)) {
+		dump_flush(ndo, db);
+		/* An ident too long to fit is printed by itself */
+		if (db->identlen + HEXDUMP_LINE_MAX >= sizeof(db->buf))
+			ND_PRINT("%s", db->ident);
+	}
+	p = db->buf + db->len;
+	if (db->identlen + HEXDUMP_LINE_MAX < sizeof(db->buf)) {
+		memcpy(p, db->ident, db->identlen);
+		p += db->identlen;
+	}
+
+	/* "0x%04x: " */
+	for (ndigits = 4; ndigits < 8 && (oset >> (4 * ndigits)) != 0;
+	    ndigits++)
+		;
+	*p++ = '0';
+	*p++ = 'x';
+	while (ndigits != 0) {
+		ndigits--;
+		*p++ = hex[(oset >> (4 * ndigits)) & 0xf];
+	}
+	*p++ = ':';
+	*p++ = ' ';
+	return (p);
+}
+
+/* " %02x%02x" for each pair of bytes, " %02x" for an odd one at the end */
+static char *
+dump_hex(char *p, const u_char *cp, u_int n)
+{
+	u_int i;
+
+	for (i = 0; i < n; i++) {
+		if ((i & 1) == 0)
+			*p++ = ' ';
+		*p++ = hex[cp[i] >> 4];
+		*p++ = hex[cp[i] & 0xf];
+	}
+	return (p);
+}
 
 void
 ascii_print(netdissect_options *ndo,
             const u_char *cp, u_int length)
 {
+	struct dump_buf db;
 	u_int caplength;
 	u_char s;
 
@@ -72,8 +152,12 @@ ascii_print(netdissect_options *ndo,
 	if (length > caplength)
 		length = caplength;
 	ND_PRINT("\n");
+	db.len = 0;
+	/* The bytes up to "length" were captured, so need no GET_U_1() */
 	while (length > 0) {
-		s = GET_U_1(cp);
+		if (db.len >= sizeof(db.buf) - 1)
+			dump_flush(ndo, &db);
+		s = *cp;
 		cp++;
 		length--;
 		if (s == '\r') {
@@ -86,71 +170,53 @@ ascii_print(netdissect_options *ndo,
 			 *
 			 * In the middle of a line, just print a '.'.
 			 */
-			if (length > 1 && GET_U_1(cp) != '\n')
-				ND_PRINT(".");
+			if (length > 1 && *cp != '\n')
+				db.buf[db.len++] = '.';
 		} else {
 			if (!ND_ASCII_ISGRAPH(s) &&
 			    (s != '\t' && s != ' ' && s != '\n'))
-				ND_PRINT(".");
+				db.buf[db.len++] = '.';
 			else
-				ND_PRINT("%c", s);
+				db.buf[db.len++] = (char)s;
 		}
 	}
+	dump_flush(ndo, &db);
 }
 
 static void
 hex_and_ascii_print_with_offset(netdissect_options *ndo, const char *ident,
     const u_char *cp, u_int length, u_int oset)
 {
+	struct dump_buf db;
 	u_int caplength;
-	u_int i;
-	u_int s1, s2;
-	u_int nshorts;
-	char hexstuff[HEXDUMP_SHORTS_PER_LINE*HEXDUMP_HEXSTUFF_PER_SHORT+1], *hsp;
-	char asciistuff[ASCII_LINELENGTH+1], *asp;
+	u_int i, n, hexlen;
+	char *p;
 
 	caplength = (ndo->ndo_snapend > cp) ? ND_BYTES_AVAILABLE_AFTER(cp) : 0;
 	if (length > caplength)
 		length = caplength;
-	nshorts = length / sizeof(u_short);
-	i = 0;
-	hsp = hexstuff; asp = asciistuff;
-	while (nshorts != 0) {
-		s1 = GET_U_1(cp);
-		cp++;
-		s2 = GET_U_1(cp);
-		cp++;
-		(void)snprintf(hsp, sizeof(hexstuff) - (hsp - hexstuff),
-		    " %02x%02x", s1, s2);
-		hsp += HEXDUMP_HEXSTUFF_PER_SHORT;
-		*(asp++) = (char)(ND_ASCII_ISGRAPH(s1) ? s1 : '.');
-		*(asp++) = (char)(ND_ASCII_ISGRAPH(s2) ? s2 : '.');
-		i++;
-		if (i >= HEXDUMP_SHORTS_PER_LINE) {
-			*hsp = *asp = '\0';
-			ND_PRINT("%s0x%04x: %-*s  %s",
-			    ident, oset, HEXDUMP_HEXSTUFF_PER_LINE,
-			    hexstuff, asciistuff);
-			i = 0; hsp = hexstuff; asp = asciistuff;
-			oset += HEXDUMP_BYTES_PER_LINE;
-		}
-		nshorts--;
-	}
-	if (length & 1) {
-		s1 = GET_U_1(cp);
-		cp++;
-		(void)snprintf(hsp, sizeof(hexstuff) - (hsp - hexstuff),
-		    " %02x", s1);
-		hsp += 3;
-		*(asp++) = (char)(ND_ASCII_ISGRAPH(s1) ? s1 : '.');
-		++i;
-	}
-	if (i > 0) {
-		*hsp = *asp = '\0';
-		ND_PRINT("%s0x%04x: %-*s  %s",
-		     ident, oset, HEXDUMP_HEXSTUFF_PER_LINE,
-		     hexstuff, asciistuff);
+	db.len = 0;
+	db.ident = ident;
+	db.identlen = strlen(ident);
+	/* The bytes up to "length" were captured, so need no GET_U_1() */
+	while (length != 0) {
+		n = min(length, HEXDUMP_BYTES_PER_LINE);
+		p = dump_line_start(ndo, &db, oset);
+
+		/* "%-*s  %s", the hex padded out, then the ASCII */
+		hexlen = (n / 2) * HEXDUMP_HEXSTUFF_PER_SHORT + (n & 1) * 3;
+		p = dump_hex(p, cp, n);
+		memset(p, ' ', HEXDUMP_HEXSTUFF_PER_LINE - hexlen + 2);
+		p += HEXDUMP_HEXSTUFF_PER_LINE - hexlen + 2;
+		for (i = 0; i < n; i++)
+			*p++ = (char)(ND_ASCII_ISGRAPH(cp[i]) ? cp[i] : '.');
+
+		db.len = p - db.buf;
+		cp += n;
+		length -= n;
+		oset += HEXDUMP_BYTES_PER_LINE;
 	}
+	dump_flush(ndo, &db);
 }
 
 void
@@ -168,31 +234,28 @@ hex_print_with_offset(netdissect_options *ndo,
                       const char *ident, const u_char *cp, u_int length,
 		      u_int oset)
 {
+	struct dump_buf db;
 	u_int caplength;
-	u_int i, s;
-	u_int nshorts;
+	u_int n;
+	char *p;
 
 	caplength = (ndo->ndo_snapend > cp) ? ND_BYTES_AVAILABLE_AFTER(cp) : 0;
 	if (length > caplength)
 		length = caplength;
-	nshorts = length / sizeof(u_short);
-	i = 0;
-	while (nshorts != 0) {
-		if ((i++ % 8) == 0) {
-			ND_PRINT("%s0x%04x: ", ident, oset);
-			oset += HEXDUMP_BYTES_PER_LINE;
-		}
-		s = GET_U_1(cp);
-		cp++;
-		ND_PRINT(" %02x%02x", s, GET_U_1(cp));
-		cp++;
-		nshorts--;
-	}
-	if (length & 1) {
-		if ((i % 8) == 0)
-			ND_PRINT("%s0x%04x: ", ident, oset);
-		ND_PRINT(" %02x", GET_U_1(cp));
+	db.len = 0;
+	db.ident = ident;
+	db.identlen = strlen(ident);
+	/* The bytes up to "length" were captured, so need no GET_U_1() */
+	while (length != 0) {
+		n = min(length, HEXDUMP_BYTES_PER_LINE);
+		p = dump_line_start(ndo, &db, oset);
+		p = dump_hex(p, cp, n);
+		db.len = p - db.buf;
+		cp += n;
+		length -= n;
+		oset += HEXDUMP_BYTES_PER_LINE;
 	}
+	dump_flush(ndo, &db);
 }
 
 /*
@@ -28,6 +28,7 @@
 #include "netdissect-stdinc.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "netdissect.h"
@@ -581,16 +582,72 @@ struct hnamemem {
 	struct hnamemem *nxt;
 };
 
-static struct hnamemem hnametable[HASHNAMESIZE];
+/* AppleTalk name cache of a netdissect_options */
+struct atalk_state {
+	struct hnamemem hnametable[HASHNAMESIZE];
+	int first;
+};
+
+static struct atalk_state *
+atalk_state(netdissect_options *ndo)
+{
+	if (ndo->ndo_atalk == NULL) {
+		ndo->ndo_atalk = calloc(1, sizeof(struct atalk_state));
+		if (ndo->ndo_atalk == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+					  "atalk_state: calloc");
+		ndo->ndo_atalk->first = 1;
+	}
+	return ndo->ndo_atalk;
+}
+
+void
+atalk_free_state(netdissect_options *ndo)
+{
+	struct atalk_state *st = ndo->ndo_atalk;
+	struct hnamemem *tp, *next;
+	u_int i;
+
+	if (st == NULL)
+		return;
+	for (i = 0; i < HASHNAMESIZE; i++) {
+		tp = &st->hnametable[i];
+		free(tp->name);
+		for (tp = tp->nxt; tp != NULL; tp = next) {
+			next = tp->nxt;
+			free(tp->name);
+			free(tp);
+		}
+	}
+	free(st);
+	ndo->ndo_atalk = NULL;
+}
+
+/*
+ * Unlike the tables in addrtoname.c, the entries are allocated
+ * one by one, so that atalk_free_state() can free them on its own.
+ */
+static struct hnamemem *
+newatnamemem(netdissect_options *ndo)
+{
+	struct hnamemem *p;
+
+	p = calloc(1, sizeof(struct hnamemem));
+	if (p == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+				  "newatnamemem: calloc");
+	return (p);
+}
 
 static const char *
 ataddr_string(netdissect_options *ndo,
               u_short atnet, u_char athost)
 {
+	struct atalk_state *st = atalk_state(ndo);
+	struct hnamemem *hnametable = st->hnametable;
 	struct hnamemem *tp, *tp2;
 	u_int i = (atnet << 8) | athost;
 	char nambuf[256+1];
-	static int first = 1;
 	FILE *fp;
 
 	/*
@@ -601,11 +658,11 @@ ataddr_string(netdissect_options *ndo,
 		 * Yes.  Have we tried to open and read an AppleTalk
 		 * number to name map file?
 		 */
-		if (!first) {
+		if (!st->first) {
 			/*
 			 * No; try to do so.
 			 */
-			first = 0;
+			st->first = 0;
 			fp = fopen("/etc/atalk.names", "r");
 			if (fp != NULL) {
 				char line[256];
@@ -630,7 +687,7 @@ ataddr_string(netdissect_options *ndo,
 					     tp->nxt; tp = tp->nxt)
 						;
 					tp->addr = i2;
-					tp->nxt = newhnamemem(ndo);
+					tp->nxt = newatnamemem(ndo);
 					tp->name = strdup(nambuf);
 					if (tp->name == NULL)
 						(*ndo->ndo_error)(ndo,
@@ -654,7 +711,7 @@ ataddr_string(netdissect_options *ndo,
 	for (tp2 = &hnametable[i & (HASHNAMESIZE-1)]; tp2->nxt; tp2 = tp2->nxt)
 		if (tp2->addr == i) {
 			tp->addr = (atnet << 8) | athost;
-			tp->nxt = newhnamemem(ndo);
+			tp->nxt = newatnamemem(ndo);
 			(void)snprintf(nambuf, sizeof(nambuf), "%s.%u",
 			    tp2->name, athost);
 			tp->name = strdup(nambuf);
@@ -665,7 +722,7 @@ ataddr_string(netdissect_options *ndo,
 		}
 
 	tp->addr = (atnet << 8) | athost;
-	tp->nxt = newhnamemem(ndo);
+	tp->nxt = newatnamemem(ndo);
 	if (athost != 255)
 		(void)snprintf(nambuf, sizeof(nambuf), "%u.%u", atnet, athost);
 	else
@@ -690,7 +747,7 @@ static const char *
 ddpskt_string(netdissect_options *ndo,
               u_int skt)
 {
-	static char buf[8];
+	static ND_THREAD_LOCAL char buf[8];
 
 	if (ndo->ndo_nflag) {
 		(void)snprintf(buf, sizeof(buf), "%u", skt);
@@ -557,7 +557,7 @@ static const struct tok bgp_add_path_recvsend[] = {
     { 0, NULL },
 };
 
-static char astostr[20];
+static ND_THREAD_LOCAL char astostr[20];
 
 /*
  * as_printf
@@ -679,7 +679,7 @@ bgp_vpn_ip_print(netdissect_options *ndo,
 {
 
     /* worst case string is s fully formatted v6 address */
-    static char addr[sizeof("1234:5678:89ab:cdef:1234:5678:89ab:cdef")];
+    static ND_THREAD_LOCAL char addr[sizeof("1234:5678:89ab:cdef:1234:5678:89ab:cdef")];
     char *pos = addr;
 
     switch(addr_length) {
@@ -769,7 +769,7 @@ bgp_vpn_rd_print(netdissect_options *ndo,
                  const u_char *pptr)
 {
     /* allocate space for the largest possible string */
-    static char rd[sizeof("xxxxxxxxxx:xxxxx (xxx.xxx.xxx.xxx:xxxxx)")];
+    static ND_THREAD_LOCAL char rd[sizeof("xxxxxxxxxx:xxxxx (xxx.xxx.xxx.xxx:xxxxx)")];
     char *pos = rd;
 
     /* ok lets load the RD format */
@@ -924,7 +924,7 @@ bgp_rt_prefix_print(netdissect_options *ndo,
     /* allocate space for the largest possible string */
     char rtc_prefix_in_hex[20] = "";
     u_int rtc_prefix_in_hex_len = 0;
-    static char output[61]; /* max response string */
+    static ND_THREAD_LOCAL char output[61]; /* max response string */
     uint16_t ec_type = 0;
     u_int octet_count;
     u_int i;
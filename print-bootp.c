@@ -1097,7 +1097,7 @@ trunc:
 static char *
 client_fqdn_flags(u_int flags)
 {
-	static char buf[8+1];
+	static ND_THREAD_LOCAL char buf[8+1];
 	int i = 0;
 
 	if (flags & CLIENT_FQDN_FLAGS_S)
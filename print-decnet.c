@@ -1222,7 +1222,7 @@ dnnum_string(netdissect_options *ndo, u_short dnaddr)
 	u_int area = (u_short)(dnaddr & AREAMASK) >> AREASHIFT;
 	u_int node = dnaddr & NODEMASK;
 
-	/* malloc() return used by the 'dnaddrtable' hash table: do not free() */
+	/* malloc() return copied into the name cache by dnaddr_string(), and freed */
 	str = (char *)malloc(siz = sizeof("00.0000"));
 	if (str == NULL)
 		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC, "dnnum_string: malloc");
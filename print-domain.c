@@ -53,7 +53,7 @@ static const char *ns_resp[] = {
 
 static const char *
 ns_rcode(u_int rcode) {
-	static char buf[sizeof(" Resp4095")];
+	static ND_THREAD_LOCAL char buf[sizeof(" Resp4095")];
 
 	if (rcode < sizeof(ns_resp)/sizeof(ns_resp[0])) {
 		return (ns_resp[rcode]);
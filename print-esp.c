@@ -31,6 +31,9 @@
 
 #include <string.h>
 #include <stdlib.h>
+#if defined(HAVE_LIBCRYPTO) && defined(HAVE_LIBPTHREAD)
+#include <pthread.h>
+#endif
 
 /* Any code in this file that depends on HAVE_LIBCRYPTO depends on
  * HAVE_OPENSSL_EVP_H too. Undefining the former when the latter isn't defined
@@ -45,6 +48,7 @@
 #endif
 
 #include "netdissect.h"
+#include "netdissect-alloc.h"
 #include "extract.h"
 
 #ifdef HAVE_LIBCRYPTO
@@ -106,7 +110,8 @@ union inaddr_u {
 };
 struct sa_list {
 	struct sa_list	*next;
-	u_int		daddr_version;
+	struct sa_list	*hnext;       /* next in the hash chain */
+	u_int		daddr_version; /* if == 0, then keyed on spii/spir */
 	union inaddr_u	daddr;
 	uint32_t	spi;          /* if == 0, then IKEv2 */
 	int             initiator;
@@ -119,8 +124,109 @@ struct sa_list {
 	int             authsecret_len;
 	u_char		secret[256];  /* is that big enough for all secrets? */
 	int		secretlen;
+	EVP_CIPHER_CTX	*ctx;         /* keyed with secret on first use */
+};
+
+/*
+ * The SAs read from the -E secrets, newest first, with a hash table of
+ * them on SPI and destination address, or, for IKEv2, on the SPIs of
+ * the initiator and responder, and the buffer the ESP payload is
+ * decrypted into.
+ */
+struct esp_state {
+	int		secrets_read;
+	struct sa_list	*sa_list_head;
+	struct sa_list	*sa_default;
+	struct sa_list	**sa_hash;
+	u_int		sa_hash_mask;
+	u_char		*ptbuf;
+	u_int		ptbufsize;
 };
 
+static struct esp_state *
+esp_state(netdissect_options *ndo)
+{
+	if (ndo->ndo_esp == NULL) {
+		ndo->ndo_esp = calloc(1, sizeof(struct esp_state));
+		if (ndo->ndo_esp == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+					  "esp_state: calloc");
+	}
+	return ndo->ndo_esp;
+}
+
+/* FNV-1a over the key of an SA, starting from the SPI */
+static u_int
+sa_hash_key(uint32_t spi, const u_char *key, u_int keylen)
+{
+	uint32_t h = 2166136261U ^ spi;
+	u_int i;
+
+	for (i = 0; i < keylen; i++)
+		h = (h ^ key[i]) * 16777619U;
+	return h;
+}
+
+static u_int
+sa_hash_esp(uint32_t spi, u_int version, const u_char *daddr)
+{
+	return sa_hash_key(spi, daddr,
+	    version == 6 ? sizeof(nd_ipv6) : sizeof(nd_ipv4));
+}
+
+static u_int
+sa_hash_ikev2(int initiator, const u_char spii[8], const u_char spir[8])
+{
+	u_char key[16];
+
+	memcpy(key, spii, 8);
+	memcpy(key + 8, spir, 8);
+	return sa_hash_key(initiator, key, sizeof(key));
+}
+
+static u_int
+sa_hash(const struct sa_list *sa)
+{
+	if (sa->daddr_version != 0)
+		return sa_hash_esp(sa->spi, sa->daddr_version,
+		    (const u_char *)&sa->daddr);
+	return sa_hash_ikev2(sa->initiator, sa->spii, sa->spir);
+}
+
+/*
+ * Hash the SAs, once they've all been read, keeping the newest first
+ * in each chain, as in the list, so that it's still the one found.
+ */
+static void
+esp_hash_sas(netdissect_options *ndo)
+{
+	struct esp_state *st = ndo->ndo_esp;
+	struct sa_list *sa, **tails;
+	u_int count, size, b;
+
+	count = 0;
+	for (sa = st->sa_list_head; sa != NULL; sa = sa->next)
+		count++;
+	for (size = 16; size < count * 2; size *= 2)
+		;
+	st->sa_hash = calloc(size, sizeof(*st->sa_hash));
+	tails = calloc(size, sizeof(*tails));
+	if (st->sa_hash == NULL || tails == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+				  "esp_hash_sas: calloc");
+	st->sa_hash_mask = size - 1;
+	for (sa = st->sa_list_head; sa != NULL; sa = sa->next) {
+		b = sa_hash(sa) & st->sa_hash_mask;
+		sa->hnext = NULL;
+		if (tails[b] == NULL)
+			st->sa_hash[b] = sa;
+		else
+			tails[b]->hnext = sa;
+		tails[b] = sa;
+	}
+	free(tails);
+}
+
 #ifndef HAVE_EVP_CIPHER_CTX_NEW
 /*
  * Allocate an EVP_CIPHER_CTX.
@@ -180,37 +286,72 @@ set_cipher_parameters(EVP_CIPHER_CTX *ctx, const EVP_CIPHER *cipher,
 }
 #endif
 
+/*
+ * Get a buffer for the plaintext.  The ESP payload is decrypted into
+ * the same buffer for every packet, unless that buffer is still being
+ * dissected, as it is for ESP within ESP; it's then allocated with the
+ * rest of the packet's memory, and freed by nd_free_all().
+ */
+static u_char *
+plaintext_buffer(netdissect_options *ndo, unsigned int ptlen)
+{
+	struct esp_state *st = esp_state(ndo);
+	struct netdissect_saved_packet_info *ndspi;
+	u_char *pt;
+
+	for (ndspi = ndo->ndo_packet_info_stack; ndspi != NULL;
+	    ndspi = ndspi->ndspi_prev) {
+		if (st->ptbuf != NULL && ndspi->ndspi_buffer == st->ptbuf)
+			return (u_char *)nd_malloc(ndo, ptlen);
+	}
+	if (ptlen > st->ptbufsize) {
+		pt = realloc(st->ptbuf, ptlen);
+		if (pt == NULL)
+			return NULL;
+		st->ptbuf = pt;
+		st->ptbufsize = ptlen;
+	}
+	return st->ptbuf;
+}
+
 static u_char *
 do_decrypt(netdissect_options *ndo, const char *caller, struct sa_list *sa,
     const u_char *iv, const u_char *ct, unsigned int ctlen)
 {
 	EVP_CIPHER_CTX *ctx;
 	unsigned int block_size;
-	unsigned int ptlen;
 	u_char *pt;
 	int len;
 
-	ctx = EVP_CIPHER_CTX_new();
+	/*
+	 * Key the SA's cipher context the first time it's used; after
+	 * that, only the IV changes from one packet to the next.
+	 */
+	ctx = sa->ctx;
 	if (ctx == NULL) {
-		/*
-		 * Failed to initialize the cipher context.
-		 * From a look at the OpenSSL code, this appears to
-		 * mean "couldn't allocate memory for the cipher context";
-		 * note that we're not passing any parameters, so there's
-		 * not much else it can mean.
-		 */
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-		    "%s: can't allocate memory for cipher context", caller);
-		return NULL;
-	}
-
-	if (set_cipher_parameters(ctx, sa->evp, sa->secret, NULL) < 0) {
-		EVP_CIPHER_CTX_free(ctx);
-		(*ndo->ndo_warning)(ndo, "%s: espkey init failed", caller);
-		return NULL;
+		ctx = EVP_CIPHER_CTX_new();
+		if (ctx == NULL) {
+			/*
+			 * Failed to initialize the cipher context.
+			 * From a look at the OpenSSL code, this appears to
+			 * mean "couldn't allocate memory for the cipher
+			 * context"; note that we're not passing any
+			 * parameters, so there's not much else it can mean.
+			 */
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+			    "%s: can't allocate memory for cipher context",
+			    caller);
+			return NULL;
+		}
+		if (set_cipher_parameters(ctx, sa->evp, sa->secret, NULL) < 0) {
+			EVP_CIPHER_CTX_free(ctx);
+			(*ndo->ndo_warning)(ndo, "%s: espkey init failed",
+			    caller);
+			return NULL;
+		}
+		sa->ctx = ctx;
 	}
 	if (set_cipher_parameters(ctx, NULL, NULL, iv) < 0) {
-		EVP_CIPHER_CTX_free(ctx);
 		(*ndo->ndo_warning)(ndo, "%s: IV init failed", caller);
 		return NULL;
 	}
@@ -224,7 +365,6 @@ do_decrypt(netdissect_options *ndo, const char *caller, struct sa_list *sa,
 	 */
 	block_size = (unsigned int)EVP_CIPHER_CTX_block_size(ctx);
 	if ((ctlen % block_size) != 0) {
-		EVP_CIPHER_CTX_free(ctx);
 		(*ndo->ndo_warning)(ndo,
 		    "%s: ciphertext size %u is not a multiple of the cipher block size %u",
 		    caller, ctlen, block_size);
@@ -232,13 +372,11 @@ do_decrypt(netdissect_options *ndo, const char *caller, struct sa_list *sa,
 	}
 
 	/*
-	 * Attempt to allocate a buffer for the decrypted data, because
-	 * we can't decrypt on top of the input buffer.
+	 * Get a buffer for the decrypted data, because we can't decrypt
+	 * on top of the input buffer.
 	 */
-	ptlen = ctlen;
-	pt = (u_char *)malloc(ptlen);
+	pt = plaintext_buffer(ndo, ctlen);
 	if (pt == NULL) {
-		EVP_CIPHER_CTX_free(ctx);
 		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
 		    "%s: can't allocate memory for decryption buffer", caller);
 		return NULL;
@@ -249,20 +387,15 @@ do_decrypt(netdissect_options *ndo, const char *caller, struct sa_list *sa,
 	 * cipher block size, so we don't need to worry about padding.
 	 */
 	if (!EVP_CIPHER_CTX_set_padding(ctx, 0)) {
-		free(pt);
-		EVP_CIPHER_CTX_free(ctx);
 		(*ndo->ndo_warning)(ndo,
 		    "%s: EVP_CIPHER_CTX_set_padding failed", caller);
 		return NULL;
 	}
 	if (!EVP_DecryptUpdate(ctx, pt, &len, ct, ctlen)) {
-		free(pt);
-		EVP_CIPHER_CTX_free(ctx);
 		(*ndo->ndo_warning)(ndo, "%s: EVP_DecryptUpdate failed",
 		    caller);
 		return NULL;
 	}
-	EVP_CIPHER_CTX_free(ctx);
 	return pt;
 }
 
@@ -276,7 +409,8 @@ do_decrypt(netdissect_options *ndo, const char *caller, struct sa_list *sa,
  *
  * Our caller must pop the buffer off the stack when it's finished
  * dissecting anything in it and before it does any dissection of
- * anything in the old buffer.  That will free the new buffer.
+ * anything in the old buffer.  The new buffer itself is freed after
+ * the packet has been dissected.
  */
 USES_APPLE_DEPRECATED_API
 int esp_decrypt_buffer_by_ikev2_print(netdissect_options *ndo,
@@ -285,18 +419,25 @@ int esp_decrypt_buffer_by_ikev2_print(netdissect_options *ndo,
 				      const u_char spir[8],
 				      const u_char *buf, const u_char *end)
 {
+	struct esp_state *st = ndo->ndo_esp;
 	struct sa_list *sa;
 	const u_char *iv;
 	const u_char *ct;
 	unsigned int ctlen;
 	u_char *pt;
 
+	if (st == NULL || st->sa_hash == NULL)
+		return 0;
+
 	/* initiator arg is any non-zero value */
 	if(initiator) initiator=1;
 
 	/* see if we can find the SA, and if so, decode it */
-	for (sa = ndo->ndo_sa_list_head; sa != NULL; sa = sa->next) {
-		if (sa->spi == 0
+	sa = st->sa_hash[sa_hash_ikev2(initiator, spii, spir) &
+	    st->sa_hash_mask];
+	for (; sa != NULL; sa = sa->hnext) {
+		if (sa->daddr_version == 0
+		    && sa->spi == 0
 		    && initiator == sa->initiator
 		    && memcmp(spii, sa->spii, 8) == 0
 		    && memcmp(spir, sa->spir, 8) == 0)
@@ -324,13 +465,10 @@ int esp_decrypt_buffer_by_ikev2_print(netdissect_options *ndo,
 
 	/*
 	 * Switch to the output buffer for dissection, and save it
-	 * on the buffer stack so it can be freed; our caller must
-	 * pop it when done.
+	 * on the buffer stack; our caller must pop it when done.
 	 */
-	if (!nd_push_buffer(ndo, pt, pt, pt + ctlen)) {
-		free(pt);
+	if (!nd_push_buffer(ndo, pt, pt, pt + ctlen))
 		return 0;
-	}
 
 	return 1;
 }
@@ -341,21 +479,23 @@ static void esp_print_addsa(netdissect_options *ndo,
 {
 	/* copy the "sa" */
 
+	struct esp_state *st = esp_state(ndo);
 	struct sa_list *nsa;
 
-	/* malloc() return used in a 'struct sa_list': do not free() */
+	/* freed by esp_free_state() */
 	nsa = (struct sa_list *)malloc(sizeof(struct sa_list));
 	if (nsa == NULL)
 		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
 				  "esp_print_addsa: malloc");
 
 	*nsa = *sa;
+	nsa->ctx = NULL;
 
 	if (sa_def)
-		ndo->ndo_sa_default = nsa;
+		st->sa_default = nsa;
 
-	nsa->next = ndo->ndo_sa_list_head;
-	ndo->ndo_sa_list_head = nsa;
+	nsa->next = st->sa_list_head;
+	st->sa_list_head = nsa;
 }
 
 
@@ -547,6 +687,7 @@ static void esp_print_decode_ikeline(netdissect_options *ndo, char *line,
 		return;
 	}
 
+	memset(&sa1, 0, sizeof(struct sa_list));
 	sa1.spi = 0;
 	sa1.initiator = (init[0] == 'I');
 	if(espprint_decode_hex(ndo, sa1.spii, sizeof(sa1.spii), icookie+2)!=8)
@@ -671,7 +812,7 @@ static void esp_print_decode_onesecret(netdissect_options *ndo, char *line,
 }
 
 USES_APPLE_DEPRECATED_API
-static void esp_init(netdissect_options *ndo _U_)
+static void esp_init(void)
 {
 	/*
 	 * 0.9.6 doesn't appear to define OPENSSL_API_COMPAT, so
@@ -685,18 +826,45 @@ static void esp_init(netdissect_options *ndo _U_)
 }
 USES_APPLE_RST
 
+/*
+ * Read the SAs from the secrets, the first time it's called for a
+ * netdissect_options.  The secrets are parsed from a copy, so that
+ * other netdissect_options can read them too.
+ */
 void esp_decodesecret_print(netdissect_options *ndo)
 {
+	struct esp_state *st;
 	char *line;
-	char *p;
+	char *p, *secrets;
+#ifdef HAVE_LIBPTHREAD
+	static pthread_once_t initialized = PTHREAD_ONCE_INIT;
+#else
 	static int initialized = 0;
+#endif
 
+	st = esp_state(ndo);
+	if (st->secrets_read)
+		return;
+	st->secrets_read = 1;
+
+	/*
+	 * esp_init() changes OpenSSL's table of cipher names, which the
+	 * printers in other threads may be reading.
+	 */
+#ifdef HAVE_LIBPTHREAD
+	pthread_once(&initialized, esp_init);
+#else
 	if (!initialized) {
-		esp_init(ndo);
+		esp_init();
 		initialized = 1;
 	}
+#endif
 
-	p = ndo->ndo_espsecret;
+	secrets = strdup(ndo->ndo_espsecret);
+	if (secrets == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+				  "esp_decodesecret_print: strdup");
+	p = secrets;
 
 	while (p && p[0] != '\0') {
 		/* pick out the first line or first thing until a comma */
@@ -707,12 +875,36 @@ void esp_decodesecret_print(netdissect_options *ndo)
 
 		esp_print_decode_onesecret(ndo, line, "cmdline", 0);
 	}
+	free(secrets);
 
-	ndo->ndo_espsecret = NULL;
+	if (st->sa_list_head != NULL)
+		esp_hash_sas(ndo);
 }
 
 #endif
 
+void
+esp_free_state(netdissect_options *ndo)
+{
+#ifdef HAVE_LIBCRYPTO
+	struct esp_state *st = ndo->ndo_esp;
+	struct sa_list *sa, *next;
+
+	if (st == NULL)
+		return;
+	for (sa = st->sa_list_head; sa != NULL; sa = next) {
+		next = sa->next;
+		if (sa->ctx != NULL)
+			EVP_CIPHER_CTX_free(sa->ctx);
+		free(sa);
+	}
+	free(st->sa_hash);
+	free(st->ptbuf);
+	free(st);
+#endif
+	ndo->ndo_esp = NULL;
+}
+
 #ifdef HAVE_LIBCRYPTO
 #define USED_IF_LIBCRYPTO
 #else
@@ -734,8 +926,10 @@ esp_print(netdissect_options *ndo,
 	const u_char *ep;
 #ifdef HAVE_LIBCRYPTO
 	const struct ip *ip;
+	struct esp_state *st;
 	struct sa_list *sa = NULL;
 	const struct ip6_hdr *ip6 = NULL;
+	uint32_t spi;
 	const u_char *iv;
 	u_int ivlen;
 	u_int payloadlen;
@@ -761,15 +955,15 @@ esp_print(netdissect_options *ndo,
 
 #ifdef HAVE_LIBCRYPTO
 	/* initiailize SAs */
-	if (ndo->ndo_sa_list_head == NULL) {
-		if (!ndo->ndo_espsecret)
-			return;
+	if (!ndo->ndo_espsecret)
+		return;
 
-		esp_decodesecret_print(ndo);
-	}
+	esp_decodesecret_print(ndo);
 
-	if (ndo->ndo_sa_list_head == NULL)
+	st = ndo->ndo_esp;
+	if (st->sa_list_head == NULL)
 		return;
+	spi = GET_BE_U_4(esp->esp_spi);
 
 	ip = (const struct ip *)bp2;
 	switch (ver) {
@@ -782,8 +976,10 @@ esp_print(netdissect_options *ndo,
 		/* if we can't get nexthdr, we do not need to decrypt it */
 
 		/* see if we can find the SA, and if so, decode it */
-		for (sa = ndo->ndo_sa_list_head; sa != NULL; sa = sa->next) {
-			if (sa->spi == GET_BE_U_4(esp->esp_spi) &&
+		sa = st->sa_hash[sa_hash_esp(spi, 6,
+		    (const u_char *)&ip6->ip6_dst) & st->sa_hash_mask];
+		for (; sa != NULL; sa = sa->hnext) {
+			if (sa->spi == spi &&
 			    sa->daddr_version == 6 &&
 			    UNALIGNED_MEMCMP(&sa->daddr.in6, &ip6->ip6_dst,
 				   sizeof(nd_ipv6)) == 0) {
@@ -797,8 +993,10 @@ esp_print(netdissect_options *ndo,
 			return;
 
 		/* see if we can find the SA, and if so, decode it */
-		for (sa = ndo->ndo_sa_list_head; sa != NULL; sa = sa->next) {
-			if (sa->spi == GET_BE_U_4(esp->esp_spi) &&
+		sa = st->sa_hash[sa_hash_esp(spi, 4,
+		    (const u_char *)&ip->ip_dst) & st->sa_hash_mask];
+		for (; sa != NULL; sa = sa->hnext) {
+			if (sa->spi == spi &&
 			    sa->daddr_version == 4 &&
 			    UNALIGNED_MEMCMP(&sa->daddr.in4, &ip->ip_dst,
 				   sizeof(nd_ipv4)) == 0) {
@@ -814,7 +1012,7 @@ esp_print(netdissect_options *ndo,
 	 * an unspecified one.
 	 */
 	if (sa == NULL)
-		sa = ndo->ndo_sa_default;
+		sa = st->sa_default;
 
 	/* if not found fail */
 	if (sa == NULL)
@@ -874,11 +1072,10 @@ esp_print(netdissect_options *ndo,
 
 	/*
 	 * Switch to the output buffer for dissection, and
-	 * save it on the buffer stack so it can be freed.
+	 * save it on the buffer stack.
 	 */
 	ep = pt + payloadlen;
 	if (!nd_push_buffer(ndo, pt, pt, ep)) {
-		free(pt);
 		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
 			"esp_print: can't push buffer on buffer stack");
 	}
@@ -907,7 +1104,7 @@ esp_print(netdissect_options *ndo,
 	ip_demux_print(ndo, pt, payloadlen - (padlen + 2), ver, fragmented,
 	    ttl_hl, nh, bp2);
 
-	/* Pop the buffer, freeing it. */
+	/* Pop the buffer. */
 	nd_pop_packet_info(ndo);
 #endif
 }
@@ -277,6 +277,8 @@ recurse:
 			ND_PRINT("%s, ", ieee8021q_tci_string(tag));
 		}
 
+		ND_STATS_LAYER(ndo, tok2str(ethertype_values, "0x%04x",
+		    length_type));
 		length_type = GET_BE_U_2(p + 2);
 		p += 4;
 		length -= 4;
@@ -524,6 +526,7 @@ ethertype_print(netdissect_options *ndo,
 		u_int length, u_int caplen,
 		const struct lladdr_info *src, const struct lladdr_info *dst)
 {
+	ND_STATS_LAYER(ndo, tok2str(ethertype_values, "0x%04x", ether_type));
 	switch (ether_type) {
 
 	case ETHERTYPE_IP:
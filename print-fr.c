@@ -145,9 +145,9 @@ const char *
 q922_string(netdissect_options *ndo, const u_char *p, u_int length)
 {
 
-    static u_int dlci, addr_len;
-    static uint32_t flags;
-    static char buffer[sizeof("DLCI xxxxxxxxxx")];
+    static ND_THREAD_LOCAL u_int dlci, addr_len;
+    static ND_THREAD_LOCAL uint32_t flags;
+    static ND_THREAD_LOCAL char buffer[sizeof("DLCI xxxxxxxxxx")];
     memset(buffer, 0, sizeof(buffer));
 
     if (parse_q922_header(ndo, p, &dlci, &addr_len, &flags, length) == 1){
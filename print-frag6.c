@@ -61,10 +61,7 @@ frag6_print(netdissect_options *ndo, const u_char *bp, const u_char *bp2)
 	if ((GET_BE_U_2(dp->ip6f_offlg) & IP6F_OFF_MASK) != 0)
 		return -1;
 	else
-	{
-		ND_PRINT(" ");
 		return sizeof(struct ip6_frag);
-	}
 trunc:
 	nd_print_trunc(ndo);
 	return -1;
@@ -48,6 +48,7 @@ ip_demux_print(netdissect_options *ndo,
 	advance = 0;
 
 again:
+	ND_STATS_LAYER(ndo, tok2str(ipproto_values, "proto %u", nh));
 	switch (nh) {
 
 	case IPPROTO_AH:
@@ -35,6 +35,7 @@
 
 #include "ip.h"
 #include "ipproto.h"
+#include "ipreasm.h"
 
 
 static const struct tok ip_option_values[] = {
@@ -330,6 +331,74 @@ static const struct tok ip_frag_values[] = {
         { 0,            NULL }
 };
 
+/*
+ * With --reassemble, add a fragment to its datagram and, if that
+ * completes it, print the datagram, behind this fragment's header
+ * changed to say it's not a fragment; otherwise, say what fragment of
+ * what it is.
+ */
+static void
+ip_reasm_print(netdissect_options *ndo, const struct ip *ip, u_int hlen,
+	       u_int len, u_int off)
+{
+	struct ipreasm_frag frag;
+	u_char *dgram = NULL;
+	const struct ip *rip;
+	u_int dlen, nfrags, proto;
+	const char *p_name;
+
+	frag.ver = 4;
+	frag.src = ip->ip_src;
+	frag.dst = ip->ip_dst;
+	frag.id = GET_BE_U_2(ip->ip_id);
+	frag.proto = GET_U_1(ip->ip_p);
+	frag.off = (off & IP_OFFMASK) * 8;
+	frag.more = (off & IP_MF) != 0;
+	frag.data = (const u_char *)ip + hlen;
+	frag.len = len;
+	frag.maxlen = 65535 - hlen;
+	frag.hdr = (const u_char *)ip;
+	frag.hdrlen = hlen;
+
+	/* A fragment cut short by the snapshot length is no use */
+	if (ND_TTEST_LEN(frag.data, len))
+		dgram = ipreasm_add(ndo, &frag, &dlen, &nfrags, &proto);
+	if (dgram == NULL) {
+		if (ndo->ndo_qflag > 1)
+			return;
+		ND_PRINT("%s > %s:", GET_IPADDR_STRING(ip->ip_src),
+			 GET_IPADDR_STRING(ip->ip_dst));
+		if (!ndo->ndo_nflag &&
+		    (p_name = netdb_protoname(frag.proto)) != NULL)
+			ND_PRINT(" %s", p_name);
+		else
+			ND_PRINT(" ip-proto-%u", frag.proto);
+		ND_PRINT(" (frag %u:%u@%u%s)", frag.id, len, frag.off,
+			 frag.more ? "+" : "");
+		return;
+	}
+
+	/* Clear MF and the offset, and set the length of the datagram */
+	dgram[2] = (u_char)(dlen >> 8);
+	dgram[3] = (u_char)dlen;
+	dgram[6] &= (IP_RES | IP_DF) >> 8;
+	dgram[7] = 0;
+	if (!nd_push_buffer(ndo, dgram, dgram, dgram + dlen)) {
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+			"ip_reasm_print: can't push buffer on buffer stack");
+	}
+	rip = (const struct ip *)dgram;
+
+	ND_PRINT("(reassembled %u fragments, %u bytes) ", nfrags, dlen - hlen);
+	if (proto != IPPROTO_TCP && proto != IPPROTO_UDP &&
+	    proto != IPPROTO_SCTP && proto != IPPROTO_DCCP) {
+		ND_PRINT("%s > %s: ", GET_IPADDR_STRING(rip->ip_src),
+			 GET_IPADDR_STRING(rip->ip_dst));
+	}
+	ip_demux_print(ndo, dgram + hlen, dlen - hlen, 4, 0,
+	    GET_U_1(rip->ip_ttl), (uint8_t)proto, dgram);
+	nd_pop_packet_info(ndo);
+}
 
 /*
  * print an IP datagram.
@@ -350,6 +419,7 @@ ip_print(netdissect_options *ndo,
 	int truncated = 0;
 
 	ndo->ndo_protocol = "ip";
+	ND_STATS_LAYER(ndo, "IPv4");
 	ip = (const struct ip *)bp;
 	if (IP_V(ip) != 4) { /* print version and fail if != 4 */
 	    if (IP_V(ip) == 6)
@@ -476,6 +546,12 @@ ip_print(netdissect_options *ndo,
 	    }
 	}
 
+	if (ndo->ndo_reassemble && (off & (IP_MF|IP_OFFMASK)) != 0) {
+		ip_reasm_print(ndo, ip, hlen, len, off);
+		nd_pop_packet_info(ndo);
+		return;
+	}
+
 	/*
 	 * If this is fragment zero, hand it to the next higher
 	 * level protocol.  Let them know whether there are more
@@ -35,6 +35,7 @@
 
 #include "ip6.h"
 #include "ipproto.h"
+#include "ipreasm.h"
 
 /*
  * If routing headers are presend and valid, set dst to the final destination.
@@ -221,6 +222,58 @@ nextproto6_cksum(netdissect_options *ndo,
         return in_cksum(vec, 2);
 }
 
+/*
+ * With --reassemble, add the fragment whose Fragment header is at "cp",
+ * with "len" bytes from there to the end of the packet, to its datagram.
+ * If that completes the datagram, return a buffer holding this
+ * fragment's headers, with the Fragment header changed to say it's the
+ * only fragment, followed by the datagram, and set *dlenp to its length
+ * and *nfragsp to the number of fragments; otherwise return NULL.
+ */
+static u_char *
+ip6_reasm(netdissect_options *ndo, const u_char *bp, const u_char *cp,
+	  u_int len, u_int *dlenp, u_int *nfragsp)
+{
+	const struct ip6_hdr *ip6 = (const struct ip6_hdr *)bp;
+	const struct ip6_frag *fh = (const struct ip6_frag *)cp;
+	struct ipreasm_frag frag;
+	u_char *dgram;
+	u_int hlen, offlg, proto;
+
+	if (len < sizeof(struct ip6_frag) ||
+	    !ND_TTEST_LEN(cp, sizeof(struct ip6_frag)))
+		return NULL;
+	hlen = ND_BYTES_BETWEEN(cp, bp) + sizeof(struct ip6_frag);
+	offlg = GET_BE_U_2(fh->ip6f_offlg);
+	frag.ver = 6;
+	frag.src = ip6->ip6_src;
+	frag.dst = ip6->ip6_dst;
+	frag.id = GET_BE_U_4(fh->ip6f_ident);
+	frag.proto = GET_U_1(fh->ip6f_nxt);
+	frag.off = offlg & IP6F_OFF_MASK;
+	frag.more = (offlg & IP6F_MORE_FRAG) != 0;
+	frag.data = cp + sizeof(struct ip6_frag);
+	frag.len = len - sizeof(struct ip6_frag);
+	frag.maxlen = 65535 + sizeof(struct ip6_hdr) - hlen;
+	frag.hdr = bp;
+	frag.hdrlen = hlen;
+
+	/* A fragment cut short by the snapshot length is no use */
+	if (!ND_TTEST_LEN(frag.data, frag.len))
+		return NULL;
+	dgram = ipreasm_add(ndo, &frag, dlenp, nfragsp, &proto);
+	if (dgram == NULL)
+		return NULL;
+
+	/* Set the payload length, and make the fragment the only one */
+	dgram[4] = (u_char)((*dlenp - sizeof(struct ip6_hdr)) >> 8);
+	dgram[5] = (u_char)(*dlenp - sizeof(struct ip6_hdr));
+	dgram[hlen - sizeof(struct ip6_frag)] = (u_char)proto;
+	dgram[hlen - sizeof(struct ip6_frag) + 2] = 0;
+	dgram[hlen - sizeof(struct ip6_frag) + 3] = 0;
+	return dgram;
+}
+
 /*
  * print an IP6 datagram.
  */
@@ -240,6 +293,7 @@ ip6_print(netdissect_options *ndo, const u_char *bp, u_int length)
 	int found_jumbo;
 
 	ndo->ndo_protocol = "ip6";
+	ND_STATS_LAYER(ndo, "IPv6");
 	ip6 = (const struct ip6_hdr *)bp;
 
 	ND_TCHECK_SIZE(ip6);
@@ -361,10 +415,51 @@ ip6_print(netdissect_options *ndo, const u_char *bp, u_int length)
 
 		case IPPROTO_FRAGMENT:
 			advance = frag6_print(ndo, cp, (const u_char *)ip6);
+			/*
+			 * Atomic fragments, with offset 0 and no more
+			 * fragments, are printed as they are (RFC 6946).
+			 */
+			if (ndo->ndo_reassemble &&
+			    ND_TTEST_SIZE((const struct ip6_frag *)cp) &&
+			    (GET_BE_U_2(((const struct ip6_frag *)cp)->ip6f_offlg) &
+			     (IP6F_OFF_MASK|IP6F_MORE_FRAG)) != 0) {
+				u_char *dgram;
+				u_int dlen, nfrags;
+
+				dgram = ip6_reasm(ndo, bp, cp, len, &dlen,
+				    &nfrags);
+				if (dgram == NULL) {
+					nd_pop_packet_info(ndo);
+					return;
+				}
+
+				/*
+				 * Carry on with the datagram in place of
+				 * the packet, from its Fragment header.
+				 */
+				cp = dgram + ND_BYTES_BETWEEN(cp, bp);
+				len = dlen - ND_BYTES_BETWEEN(cp, dgram);
+				nd_pop_packet_info(ndo);
+				if (!nd_push_buffer(ndo, dgram, dgram,
+				    dgram + dlen)) {
+					(*ndo->ndo_error)(ndo,
+					    S_ERR_ND_MEM_ALLOC,
+					    "ip6_print: can't push buffer on buffer stack");
+				}
+				bp = dgram;
+				ip6 = (const struct ip6_hdr *)dgram;
+				advance = sizeof(struct ip6_frag);
+				ND_PRINT(" (reassembled %u fragments, %u bytes) ",
+				    nfrags, len - advance);
+				found_extension_header = 1;
+				nh = GET_U_1(cp);
+				break;
+			}
 			if (advance < 0 || ndo->ndo_snapend <= cp + advance) {
 				nd_pop_packet_info(ndo);
 				return;
 			}
+			ND_PRINT(" ");
 			found_extension_header = 1;
 			nh = GET_U_1(cp);
 			fragmented = 1;
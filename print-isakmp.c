@@ -45,6 +45,7 @@
 
 #include "netdissect-stdinc.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "netdissect-ctype.h"
@@ -56,6 +57,7 @@
 #include "ip.h"
 #include "ip6.h"
 #include "ipproto.h"
+#include "rpctable.h"
 
 typedef nd_byte cookie_t[8];
 typedef nd_byte msgid_t[4];
@@ -634,18 +636,18 @@ ikev1_print(netdissect_options *ndo,
 	    const u_char *bp,  u_int length,
 	    const u_char *bp2, const struct isakmp *base);
 
-#define MAXINITIATORS	20
-static int ninitiator = 0;
+/*
+ * The initiators, kept in the table of requests under their cookie
+ */
 union inaddr_u {
 	nd_ipv4 in4;
 	nd_ipv6 in6;
 };
-static struct {
-	cookie_t initiator;
+struct cookie_entry {
 	u_int version;
 	union inaddr_u iaddr;
 	union inaddr_u raddr;
-} cookiecache[MAXINITIATORS];
+};
 
 /* protocol id */
 static const char *protoidstr[] = {
@@ -753,61 +755,49 @@ iszero(const u_char *p, size_t l)
 }
 
 /* find cookie from initiator cache */
-static int
-cookie_find(const cookie_t *in)
+static const struct cookie_entry *
+cookie_find(netdissect_options *ndo, const cookie_t *in)
 {
-	int i;
-
-	for (i = 0; i < MAXINITIATORS; i++) {
-		if (memcmp(in, &cookiecache[i].initiator, sizeof(*in)) == 0)
-			return i;
-	}
-
-	return -1;
+	return rpctable_find(ndo, RPCTABLE_ISAKMP, in, sizeof(*in));
 }
 
 /* record initiator */
 static void
 cookie_record(netdissect_options *ndo, const cookie_t *in, const u_char *bp2)
 {
-	int i;
+	struct cookie_entry *ce;
 	const struct ip *ip;
 	const struct ip6_hdr *ip6;
 
-	i = cookie_find(in);
-	if (0 <= i) {
-		ninitiator = (i + 1) % MAXINITIATORS;
-		return;
-	}
-
 	ip = (const struct ip *)bp2;
 	switch (IP_V(ip)) {
 	case 4:
-		cookiecache[ninitiator].version = 4;
-		UNALIGNED_MEMCPY(&cookiecache[ninitiator].iaddr.in4,
-				 ip->ip_src, sizeof(nd_ipv4));
-		UNALIGNED_MEMCPY(&cookiecache[ninitiator].raddr.in4,
-				 ip->ip_dst, sizeof(nd_ipv4));
+		ce = rpctable_enter(ndo, RPCTABLE_ISAKMP, in, sizeof(*in));
+		if (ce == NULL)
+			return;
+		ce->version = 4;
+		UNALIGNED_MEMCPY(&ce->iaddr.in4, ip->ip_src, sizeof(nd_ipv4));
+		UNALIGNED_MEMCPY(&ce->raddr.in4, ip->ip_dst, sizeof(nd_ipv4));
 		break;
 	case 6:
 		ip6 = (const struct ip6_hdr *)bp2;
-		cookiecache[ninitiator].version = 6;
-		UNALIGNED_MEMCPY(&cookiecache[ninitiator].iaddr.in6,
-				 ip6->ip6_src, sizeof(nd_ipv6));
-		UNALIGNED_MEMCPY(&cookiecache[ninitiator].raddr.in6,
-				 ip6->ip6_dst, sizeof(nd_ipv6));
+		ce = rpctable_enter(ndo, RPCTABLE_ISAKMP, in, sizeof(*in));
+		if (ce == NULL)
+			return;
+		ce->version = 6;
+		UNALIGNED_MEMCPY(&ce->iaddr.in6, ip6->ip6_src, sizeof(nd_ipv6));
+		UNALIGNED_MEMCPY(&ce->raddr.in6, ip6->ip6_dst, sizeof(nd_ipv6));
 		break;
 	default:
 		return;
 	}
-	UNALIGNED_MEMCPY(&cookiecache[ninitiator].initiator, in, sizeof(*in));
-	ninitiator = (ninitiator + 1) % MAXINITIATORS;
 }
 
 #define cookie_isinitiator(ndo, x, y)	cookie_sidecheck(ndo, (x), (y), 1)
 #define cookie_isresponder(ndo, x, y)	cookie_sidecheck(ndo, (x), (y), 0)
 static int
-cookie_sidecheck(netdissect_options *ndo, int i, const u_char *bp2, int initiator)
+cookie_sidecheck(netdissect_options *ndo, const struct cookie_entry *ce,
+		 const u_char *bp2, int initiator)
 {
 	const struct ip *ip;
 	const struct ip6_hdr *ip6;
@@ -815,25 +805,25 @@ cookie_sidecheck(netdissect_options *ndo, int i, const u_char *bp2, int initiato
 	ip = (const struct ip *)bp2;
 	switch (IP_V(ip)) {
 	case 4:
-		if (cookiecache[i].version != 4)
+		if (ce->version != 4)
 			return 0;
 		if (initiator) {
-			if (UNALIGNED_MEMCMP(ip->ip_src, &cookiecache[i].iaddr.in4, sizeof(nd_ipv4)) == 0)
+			if (UNALIGNED_MEMCMP(ip->ip_src, &ce->iaddr.in4, sizeof(nd_ipv4)) == 0)
 				return 1;
 		} else {
-			if (UNALIGNED_MEMCMP(ip->ip_src, &cookiecache[i].raddr.in4, sizeof(nd_ipv4)) == 0)
+			if (UNALIGNED_MEMCMP(ip->ip_src, &ce->raddr.in4, sizeof(nd_ipv4)) == 0)
 				return 1;
 		}
 		break;
 	case 6:
-		if (cookiecache[i].version != 6)
+		if (ce->version != 6)
 			return 0;
 		ip6 = (const struct ip6_hdr *)bp2;
 		if (initiator) {
-			if (UNALIGNED_MEMCMP(ip6->ip6_src, &cookiecache[i].iaddr.in6, sizeof(nd_ipv6)) == 0)
+			if (UNALIGNED_MEMCMP(ip6->ip6_src, &ce->iaddr.in6, sizeof(nd_ipv6)) == 0)
 				return 1;
 		} else {
-			if (UNALIGNED_MEMCMP(ip6->ip6_src, &cookiecache[i].raddr.in6, sizeof(nd_ipv6)) == 0)
+			if (UNALIGNED_MEMCMP(ip6->ip6_src, &ce->raddr.in6, sizeof(nd_ipv6)) == 0)
 				return 1;
 		}
 		break;
@@ -2821,7 +2811,7 @@ trunc:
 static char *
 numstr(u_int x)
 {
-	static char buf[20];
+	static ND_THREAD_LOCAL char buf[20];
 	snprintf(buf, sizeof(buf), "#%u", x);
 	return buf;
 }
@@ -2835,7 +2825,7 @@ ikev1_print(netdissect_options *ndo,
 	const u_char *ep;
 	u_int flags;
 	u_char np;
-	int i;
+	const struct cookie_entry *ce;
 	u_int phase;
 
 	p = (const struct isakmp *)bp;
@@ -2847,8 +2837,10 @@ ikev1_print(netdissect_options *ndo,
 	else
 		ND_PRINT(" phase %u/others", phase);
 
-	i = cookie_find(&base->i_ck);
-	if (i < 0) {
+	if (iszero((const u_char *)&base->i_ck, sizeof(base->i_ck))) {
+		/* no initiator cookie to tell the sides apart by */
+		ND_PRINT(" ?");
+	} else if ((ce = cookie_find(ndo, &base->i_ck)) == NULL) {
 		if (iszero((const u_char *)&base->r_ck, sizeof(base->r_ck))) {
 			/* the first packet */
 			ND_PRINT(" I");
@@ -2857,9 +2849,9 @@ ikev1_print(netdissect_options *ndo,
 		} else
 			ND_PRINT(" ?");
 	} else {
-		if (bp2 && cookie_isinitiator(ndo, i, bp2))
+		if (bp2 && cookie_isinitiator(ndo, ce, bp2))
 			ND_PRINT(" I");
-		else if (bp2 && cookie_isresponder(ndo, i, bp2))
+		else if (bp2 && cookie_isresponder(ndo, ce, bp2))
 			ND_PRINT(" R");
 		else
 			ND_PRINT(" ?");
@@ -3057,10 +3049,8 @@ isakmp_print(netdissect_options *ndo,
 	ndo->ndo_protocol = "isakmp";
 #ifdef HAVE_LIBCRYPTO
 	/* initialize SAs */
-	if (ndo->ndo_sa_list_head == NULL) {
-		if (ndo->ndo_espsecret)
-			esp_decodesecret_print(ndo);
-	}
+	if (ndo->ndo_espsecret)
+		esp_decodesecret_print(ndo);
 #endif
 
 	p = (const struct isakmp *)bp;
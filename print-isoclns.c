@@ -1768,7 +1768,7 @@ static char *
 isis_print_id(netdissect_options *ndo, const uint8_t *cp, u_int id_len)
 {
     u_int i;
-    static char id[sizeof("xxxx.xxxx.xxxx.yy-zz")];
+    static ND_THREAD_LOCAL char id[sizeof("xxxx.xxxx.xxxx.yy-zz")];
     char *pos = id;
     u_int sysid_len;
 
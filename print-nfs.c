@@ -28,6 +28,7 @@
 #include "netdissect-stdinc.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 
@@ -42,6 +43,7 @@
 #include "ip6.h"
 #include "rpc_auth.h"
 #include "rpc_msg.h"
+#include "rpctable.h"
 
 
 static void nfs_printfh(netdissect_options *, const uint32_t *, const u_int);
@@ -948,74 +950,75 @@ nfs_printfh(netdissect_options *ndo,
 }
 
 /*
- * Maintain a small cache of recent client.XID.server/proc pairs, to allow
- * us to match up replies with requests and thus to know how to parse
- * the reply.
+ * Remember the client.XID.server/proc of the calls in the table of
+ * requests, to allow us to match up replies with requests and thus to
+ * know how to parse the reply.
  */
 
-struct xid_map_entry {
+struct xid_map_key {
 	uint32_t	xid;		/* transaction ID (net order) */
-	int ipver;			/* IP version (4 or 6) */
+	uint32_t	ipver;		/* IP version (4 or 6) */
 	nd_ipv6	client;			/* client IP address (net order) */
 	nd_ipv6	server;			/* server IP address (net order) */
+};
+
+struct xid_map_entry {
 	uint32_t	proc;		/* call proc number (host order) */
 	uint32_t	vers;		/* program version (host order) */
 };
 
 /*
- * Map entries are kept in an array that we manage as a ring;
- * new entries are always added at the tail of the ring.  Initially,
- * all the entries are zero and hence don't match anything.
+ * Fill in the key of a call, given its client and server addresses,
+ * or return 0 if it's not over IPv4 or IPv6.
  */
+static int
+xid_map_key(netdissect_options *ndo, struct xid_map_key *key,
+	    const struct sunrpc_msg *rp, const u_char *bp, int reply)
+{
+	const struct ip *ip = (const struct ip *)bp;
+	const struct ip6_hdr *ip6 = (const struct ip6_hdr *)bp;
 
-#define	XIDMAPSIZE	64
-
-static struct xid_map_entry xid_map[XIDMAPSIZE];
-
-static int xid_map_next = 0;
-static int xid_map_hint = 0;
+	memset(key, 0, sizeof(*key));
+	UNALIGNED_MEMCPY(&key->xid, &rp->rm_xid, sizeof(key->xid));
+	switch (IP_V(ip)) {
+	case 4:
+		key->ipver = 4;
+		UNALIGNED_MEMCPY(&key->client,
+				 reply ? ip->ip_dst : ip->ip_src,
+				 sizeof(ip->ip_src));
+		UNALIGNED_MEMCPY(&key->server,
+				 reply ? ip->ip_src : ip->ip_dst,
+				 sizeof(ip->ip_dst));
+		return (1);
+	case 6:
+		key->ipver = 6;
+		UNALIGNED_MEMCPY(&key->client,
+				 reply ? ip6->ip6_dst : ip6->ip6_src,
+				 sizeof(ip6->ip6_src));
+		UNALIGNED_MEMCPY(&key->server,
+				 reply ? ip6->ip6_src : ip6->ip6_dst,
+				 sizeof(ip6->ip6_dst));
+		return (1);
+	default:
+		return (0);
+	}
+}
 
 static int
 xid_map_enter(netdissect_options *ndo,
               const struct sunrpc_msg *rp, const u_char *bp)
 {
-	const struct ip *ip = NULL;
-	const struct ip6_hdr *ip6 = NULL;
+	struct xid_map_key key;
 	struct xid_map_entry *xmep;
 
 	if (!ND_TTEST_4(rp->rm_call.cb_proc))
 		return (0);
-	switch (IP_V((const struct ip *)bp)) {
-	case 4:
-		ip = (const struct ip *)bp;
-		break;
-	case 6:
-		ip6 = (const struct ip6_hdr *)bp;
-		break;
-	default:
+	if (!xid_map_key(ndo, &key, rp, bp, 0))
 		return (1);
-	}
 
-	xmep = &xid_map[xid_map_next];
-
-	if (++xid_map_next >= XIDMAPSIZE)
-		xid_map_next = 0;
-
-	UNALIGNED_MEMCPY(&xmep->xid, &rp->rm_xid, sizeof(xmep->xid));
-	if (ip) {
-		xmep->ipver = 4;
-		UNALIGNED_MEMCPY(&xmep->client, ip->ip_src,
-				 sizeof(ip->ip_src));
-		UNALIGNED_MEMCPY(&xmep->server, ip->ip_dst,
-				 sizeof(ip->ip_dst));
-	}
-	else if (ip6) {
-		xmep->ipver = 6;
-		UNALIGNED_MEMCPY(&xmep->client, ip6->ip6_src,
-				 sizeof(ip6->ip6_src));
-		UNALIGNED_MEMCPY(&xmep->server, ip6->ip6_dst,
-				 sizeof(ip6->ip6_dst));
-	}
+	xmep = rpctable_enter(ndo, RPCTABLE_NFS, &key, sizeof(key));
+	if (xmep == NULL)
+		return (1);
 	xmep->proc = GET_BE_U_4(&rp->rm_call.cb_proc);
 	xmep->vers = GET_BE_U_4(&rp->rm_call.cb_vers);
 	return (1);
@@ -1029,56 +1032,17 @@ static int
 xid_map_find(netdissect_options *ndo, const struct sunrpc_msg *rp,
 	     const u_char *bp, uint32_t *proc, uint32_t *vers)
 {
-	int i;
-	struct xid_map_entry *xmep;
-	uint32_t xid;
-	const struct ip *ip = (const struct ip *)bp;
-	const struct ip6_hdr *ip6 = (const struct ip6_hdr *)bp;
-	int cmp;
-
-	UNALIGNED_MEMCPY(&xid, &rp->rm_xid, sizeof(xmep->xid));
-	/* Start searching from where we last left off */
-	i = xid_map_hint;
-	do {
-		xmep = &xid_map[i];
-		cmp = 1;
-		if (xmep->ipver != IP_V(ip) || xmep->xid != xid)
-			goto nextitem;
-		switch (xmep->ipver) {
-		case 4:
-			if (UNALIGNED_MEMCMP(ip->ip_src, &xmep->server,
-					     sizeof(ip->ip_src)) != 0 ||
-			    UNALIGNED_MEMCMP(ip->ip_dst, &xmep->client,
-					     sizeof(ip->ip_dst)) != 0) {
-				cmp = 0;
-			}
-			break;
-		case 6:
-			if (UNALIGNED_MEMCMP(ip6->ip6_src, &xmep->server,
-					     sizeof(ip6->ip6_src)) != 0 ||
-			    UNALIGNED_MEMCMP(ip6->ip6_dst, &xmep->client,
-					     sizeof(ip6->ip6_dst)) != 0) {
-				cmp = 0;
-			}
-			break;
-		default:
-			cmp = 0;
-			break;
-		}
-		if (cmp) {
-			/* match */
-			xid_map_hint = i;
-			*proc = xmep->proc;
-			*vers = xmep->vers;
-			return 0;
-		}
-	nextitem:
-		if (++i >= XIDMAPSIZE)
-			i = 0;
-	} while (i != xid_map_hint);
-
-	/* search failed */
-	return (-1);
+	struct xid_map_key key;
+	const struct xid_map_entry *xmep;
+
+	if (!xid_map_key(ndo, &key, rp, bp, 1))
+		return (-1);
+	xmep = rpctable_find(ndo, RPCTABLE_NFS, &key, sizeof(key));
+	if (xmep == NULL)
+		return (-1);
+	*proc = xmep->proc;
+	*vers = xmep->vers;
+	return (0);
 }
 
 /*
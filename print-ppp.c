@@ -1417,7 +1417,6 @@ ppp_hdlc(netdissect_options *ndo,
 	u_char *b, *t, c;
 	const u_char *s;
 	u_int i, proto;
-	const void *se;
 
 	if (caplen == 0)
 		return;
@@ -1448,10 +1447,10 @@ ppp_hdlc(netdissect_options *ndo,
 	}
 
 	/*
-	 * Change the end pointer, so bounds checks work.
+	 * Switch to the unescaped buffer, so bounds checks work.
 	 */
-	se = ndo->ndo_snapend;
-	ndo->ndo_snapend = t;
+	if (!nd_push_buffer(ndo, b, b, t))
+		return;
 	length = ND_BYTES_AVAILABLE_AFTER(b);
 
         /* now lets guess about the payload codepoint format */
@@ -1487,11 +1486,11 @@ ppp_hdlc(netdissect_options *ndo,
         }
 
 cleanup:
-	ndo->ndo_snapend = se;
+	nd_pop_packet_info(ndo);
         return;
 
 trunc:
-	ndo->ndo_snapend = se;
+	nd_pop_packet_info(ndo);
 	nd_print_trunc(ndo);
 }
 
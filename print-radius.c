@@ -768,7 +768,7 @@ print_attr_num(netdissect_options *ndo,
                           /* This attribute has standard values */
    if (attr_type[attr_code].siz_subtypes)
    {
-      static const char **table;
+      const char **table;
       uint32_t data_value;
       table = attr_type[attr_code].subtypes;
 
@@ -1008,6 +1008,7 @@ print_attr_time(netdissect_options *ndo,
                 const u_char *data, u_int length, u_short attr_code _U_)
 {
    time_t attr_time;
+   struct tm tmbuf, *tm;
    char string[26];
 
    if (length != 4)
@@ -1019,9 +1020,14 @@ print_attr_time(netdissect_options *ndo,
    ND_TCHECK_4(data);
 
    attr_time = GET_BE_U_4(data);
-   strlcpy(string, ctime(&attr_time), sizeof(string));
-   /* Get rid of the newline */
-   string[24] = '\0';
+   tm = nd_localtime(&attr_time, &tmbuf);
+   if (tm == NULL)
+   {
+       ND_PRINT("(Can't convert time)");
+       return;
+   }
+   /* ctime() format, without its static buffer or the newline */
+   strftime(string, sizeof(string), "%a %b %e %H:%M:%S %Y", tm);
    ND_PRINT("%.24s", string);
    return;
 
@@ -49,6 +49,7 @@
 #include "extract.h"
 
 #include "ip.h"
+#include "rpctable.h"
 
 #define FS_RX_PORT	7000
 #define CB_RX_PORT	7001
@@ -475,25 +476,25 @@ static const struct tok rx_ack_reasons[] = {
 };
 
 /*
- * Cache entries we keep around so we can figure out the RX opcode
- * numbers for replies.  This allows us to make sense of RX reply packets.
+ * Calls we keep around in the table of requests so we can figure out
+ * the RX opcode numbers for replies.  This allows us to make sense of
+ * RX reply packets.
  */
 
-struct rx_cache_entry {
-	uint32_t	callnum;	/* Call number (net order) */
+struct rx_cache_key {
+	uint32_t	epoch;		/* Connection epoch (host order) */
+	uint32_t	cid;		/* Connection and channel (host order) */
+	uint32_t	callnum;	/* Call number (host order) */
 	uint32_t	client;		/* client IP address (net order) */
 	uint32_t	server;		/* server IP address (net order) */
-	u_int		dport;		/* server port (host order) */
+	uint16_t	dport;		/* server port (host order) */
 	uint16_t	serviceId;	/* Service identifier (net order) */
-	uint32_t	opcode;		/* RX opcode (host order) */
 };
 
-#define RX_CACHE_SIZE	64
-
-static struct rx_cache_entry	rx_cache[RX_CACHE_SIZE];
+struct rx_cache_entry {
+	uint32_t	opcode;		/* RX opcode (host order) */
+};
 
-static uint32_t	rx_cache_next = 0;
-static uint32_t	rx_cache_hint = 0;
 static void	rx_cache_insert(netdissect_options *, const u_char *, const struct ip *, u_int);
 static int	rx_cache_find(netdissect_options *, const struct rx_header *,
 			      const struct ip *, uint32_t, uint32_t *);
@@ -687,23 +688,25 @@ static void
 rx_cache_insert(netdissect_options *ndo,
                 const u_char *bp, const struct ip *ip, u_int dport)
 {
+	struct rx_cache_key key;
 	struct rx_cache_entry *rxent;
 	const struct rx_header *rxh = (const struct rx_header *) bp;
 
 	if (!ND_TTEST_4(bp + sizeof(struct rx_header)))
 		return;
 
-	rxent = &rx_cache[rx_cache_next];
-
-	if (++rx_cache_next >= RX_CACHE_SIZE)
-		rx_cache_next = 0;
-
-	rxent->callnum = GET_BE_U_4(rxh->callNumber);
-	rxent->client = GET_IPV4_TO_NETWORK_ORDER(ip->ip_src);
-	rxent->server = GET_IPV4_TO_NETWORK_ORDER(ip->ip_dst);
-	rxent->dport = dport;
-	rxent->serviceId = GET_BE_U_2(rxh->serviceId);
-	rxent->opcode = GET_BE_U_4(bp + sizeof(struct rx_header));
+	memset(&key, 0, sizeof(key));
+	key.epoch = GET_BE_U_4(rxh->epoch);
+	key.cid = GET_BE_U_4(rxh->cid);
+	key.callnum = GET_BE_U_4(rxh->callNumber);
+	key.client = GET_IPV4_TO_NETWORK_ORDER(ip->ip_src);
+	key.server = GET_IPV4_TO_NETWORK_ORDER(ip->ip_dst);
+	key.dport = (uint16_t)dport;
+	key.serviceId = GET_BE_U_2(rxh->serviceId);
+
+	rxent = rpctable_enter(ndo, RPCTABLE_RX, &key, sizeof(key));
+	if (rxent != NULL)
+		rxent->opcode = GET_BE_U_4(bp + sizeof(struct rx_header));
 }
 
 /*
@@ -717,37 +720,23 @@ static int
 rx_cache_find(netdissect_options *ndo, const struct rx_header *rxh,
 	      const struct ip *ip, u_int sport, uint32_t *opcode)
 {
-	uint32_t i;
-	struct rx_cache_entry *rxent;
-	uint32_t clip;
-	uint32_t sip;
-
-	clip = GET_IPV4_TO_NETWORK_ORDER(ip->ip_dst);
-	sip = GET_IPV4_TO_NETWORK_ORDER(ip->ip_src);
-
-	/* Start the search where we last left off */
-
-	i = rx_cache_hint;
-	do {
-		rxent = &rx_cache[i];
-		if (rxent->callnum == GET_BE_U_4(rxh->callNumber) &&
-		    rxent->client == clip &&
-		    rxent->server == sip &&
-		    rxent->serviceId == GET_BE_U_2(rxh->serviceId) &&
-		    rxent->dport == sport) {
-
-			/* We got a match! */
-
-			rx_cache_hint = i;
-			*opcode = rxent->opcode;
-			return(1);
-		}
-		if (++i >= RX_CACHE_SIZE)
-			i = 0;
-	} while (i != rx_cache_hint);
-
-	/* Our search failed */
-	return(0);
+	struct rx_cache_key key;
+	const struct rx_cache_entry *rxent;
+
+	memset(&key, 0, sizeof(key));
+	key.epoch = GET_BE_U_4(rxh->epoch);
+	key.cid = GET_BE_U_4(rxh->cid);
+	key.callnum = GET_BE_U_4(rxh->callNumber);
+	key.client = GET_IPV4_TO_NETWORK_ORDER(ip->ip_dst);
+	key.server = GET_IPV4_TO_NETWORK_ORDER(ip->ip_src);
+	key.dport = (uint16_t)sport;
+	key.serviceId = GET_BE_U_2(rxh->serviceId);
+
+	rxent = rpctable_find(ndo, RPCTABLE_RX, &key, sizeof(key));
+	if (rxent == NULL)
+		return(0);
+	*opcode = rxent->opcode;
+	return(1);
 }
 
 /*
@@ -799,11 +788,11 @@ rx_cache_find(netdissect_options *ndo, const struct rx_header *rxh,
 			ND_PRINT(" %" PRIu64, _i); \
 		}
 
-#define DATEOUT() { time_t _t; struct tm *tm; char str[256]; \
+#define DATEOUT() { time_t _t; struct tm tmbuf, *tm; char str[256]; \
 			ND_TCHECK_4(bp); \
 			_t = (time_t) GET_BE_S_4(bp); \
 			bp += sizeof(int32_t); \
-			tm = localtime(&_t); \
+			tm = nd_localtime(&_t, &tmbuf); \
 			strftime(str, 256, "%Y/%m/%d %H:%M:%S", tm); \
 			ND_PRINT(" %s", str); \
 		}
@@ -27,6 +27,8 @@
 
 #include "netdissect-stdinc.h"
 
+#include <stdlib.h>
+
 #include "netdissect.h"
 #include "extract.h"
 
@@ -48,8 +50,11 @@
 #define SLIPDIR_OUT 1
 
 
-static u_int lastlen[2][256];
-static u_int lastconn = 255;
+/* Compressed SLIP connection state of a netdissect_options */
+struct sl_state {
+	u_int lastlen[2][256];
+	u_int lastconn;
+};
 
 static int sliplink_print(netdissect_options *, const u_char *, const struct ip *, u_int);
 static int compressed_sl_print(netdissect_options *, const u_char *, const struct ip *, u_int, int);
@@ -125,11 +130,32 @@ sl_bsdos_if_print(netdissect_options *ndo,
 	return;
 }
 
+static struct sl_state *
+sl_state(netdissect_options *ndo)
+{
+	if (ndo->ndo_sl == NULL) {
+		ndo->ndo_sl = calloc(1, sizeof(struct sl_state));
+		if (ndo->ndo_sl == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+					  "sl_state: calloc");
+		ndo->ndo_sl->lastconn = 255;
+	}
+	return ndo->ndo_sl;
+}
+
+void
+sl_free_state(netdissect_options *ndo)
+{
+	free(ndo->ndo_sl);
+	ndo->ndo_sl = NULL;
+}
+
 static int
 sliplink_print(netdissect_options *ndo,
                const u_char *p, const struct ip *ip,
                u_int length)
 {
+	struct sl_state *st = sl_state(ndo);
 	int dir;
 	u_int hlen;
 
@@ -161,8 +187,8 @@ sliplink_print(netdissect_options *ndo,
 		 * Get it from the link layer since sl_uncompress_tcp()
 		 * has restored the IP header copy to IPPROTO_TCP.
 		 */
-		lastconn = GET_U_1(((const struct ip *)(p + SLX_CHDR))->ip_p);
-		ND_PRINT("utcp %u: ", lastconn);
+		st->lastconn = GET_U_1(((const struct ip *)(p + SLX_CHDR))->ip_p);
+		ND_PRINT("utcp %u: ", st->lastconn);
 		if (dir == -1) {
 			/* Direction is bogus, don't use it */
 			return 0;
@@ -171,7 +197,7 @@ sliplink_print(netdissect_options *ndo,
 		hlen = IP_HL(ip);
 		ND_TCHECK_SIZE((const struct tcphdr *)&((const int *)ip)[hlen]);
 		hlen += TH_OFF((const struct tcphdr *)&((const int *)ip)[hlen]);
-		lastlen[dir][lastconn] = length - (hlen << 2);
+		st->lastlen[dir][st->lastconn] = length - (hlen << 2);
 		break;
 
 	default:
@@ -230,15 +256,16 @@ compressed_sl_print(netdissect_options *ndo,
                     const u_char *chdr, const struct ip *ip,
                     u_int length, int dir)
 {
+	struct sl_state *st = sl_state(ndo);
 	const u_char *cp = chdr;
 	u_int flags, hlen;
 
 	flags = GET_U_1(cp);
 	cp++;
 	if (flags & NEW_C) {
-		lastconn = GET_U_1(cp);
+		st->lastconn = GET_U_1(cp);
 		cp++;
-		ND_PRINT("ctcp %u", lastconn);
+		ND_PRINT("ctcp %u", st->lastconn);
 	} else
 		ND_PRINT("ctcp *");
 
@@ -247,11 +274,11 @@ compressed_sl_print(netdissect_options *ndo,
 
 	switch (flags & SPECIALS_MASK) {
 	case SPECIAL_I:
-		ND_PRINT(" *SA+%u", lastlen[dir][lastconn]);
+		ND_PRINT(" *SA+%u", st->lastlen[dir][st->lastconn]);
 		break;
 
 	case SPECIAL_D:
-		ND_PRINT(" *S+%u", lastlen[dir][lastconn]);
+		ND_PRINT(" *S+%u", st->lastlen[dir][st->lastconn]);
 		break;
 
 	default:
@@ -277,8 +304,8 @@ compressed_sl_print(netdissect_options *ndo,
 	hlen = IP_HL(ip);
 	ND_TCHECK_SIZE((const struct tcphdr *)&((const int32_t *)ip)[hlen]);
 	hlen += TH_OFF((const struct tcphdr *)&((const int32_t *)ip)[hlen]);
-	lastlen[dir][lastconn] = length - (hlen << 2);
-	ND_PRINT(" %u (%ld)", lastlen[dir][lastconn], (long)(cp - chdr));
+	st->lastlen[dir][st->lastconn] = length - (hlen << 2);
+	ND_PRINT(" %u (%ld)", st->lastlen[dir][st->lastconn], (long)(cp - chdr));
 	return 0;
 trunc:
 	return -1;
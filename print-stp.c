@@ -89,7 +89,7 @@ static const struct tok rstp_obj_port_role_values[] = {
 static char *
 stp_print_bridge_id(netdissect_options *ndo, const u_char *p)
 {
-    static char bridge_id_str[sizeof("pppp.aa:bb:cc:dd:ee:ff")];
+    static ND_THREAD_LOCAL char bridge_id_str[sizeof("pppp.aa:bb:cc:dd:ee:ff")];
 
     snprintf(bridge_id_str, sizeof(bridge_id_str),
              "%.2x%.2x.%.2x:%.2x:%.2x:%.2x:%.2x:%.2x",
@@ -231,19 +231,20 @@ progstr(uint32_t prog)
 #if defined(HAVE_GETRPCBYNUMBER) && defined(HAVE_RPC_RPC_H)
 	struct rpcent *rp;
 #endif
-	static char buf[32];
-	static uint32_t lastprog = 0;
+	static ND_THREAD_LOCAL char buf[32];
+	static ND_THREAD_LOCAL uint32_t lastprog = 0;
 
 	if (lastprog != 0 && prog == lastprog)
 		return (buf);
 #if defined(HAVE_GETRPCBYNUMBER) && defined(HAVE_RPC_RPC_H)
+	/* getrpcbynumber() isn't reentrant */
+	nd_lookup_lock();
 	rp = getrpcbynumber(prog);
+	if (rp != NULL)
+		strlcpy(buf, rp->r_name, sizeof(buf));
+	nd_lookup_unlock();
 	if (rp == NULL)
 #endif
 		(void) snprintf(buf, sizeof(buf), "#%u", prog);
-#if defined(HAVE_GETRPCBYNUMBER) && defined(HAVE_RPC_RPC_H)
-	else
-		strlcpy(buf, rp->r_name, sizeof(buf));
-#endif
 	return (buf);
 }
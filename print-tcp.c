@@ -50,6 +50,8 @@ __RCSID("$NetBSD: print-tcp.c,v 1.8 2007/07/24 11:53:48 drochner Exp $");
 #include "ipproto.h"
 #include "rpc_auth.h"
 #include "rpc_msg.h"
+#include "portdispatch.h"
+#include "tcpreasm.h"
 
 #ifdef HAVE_LIBCRYPTO
 #include <openssl/md5.h>
@@ -61,45 +63,321 @@ static int tcp_verify_signature(netdissect_options *ndo,
 #endif
 
 static void print_tcp_rst_data(netdissect_options *, const u_char *sp, u_int length);
+static void tcp_reasm_print(netdissect_options *, const struct port_printer *,
+                            struct port_payload *, uint32_t, u_char);
 static void print_tcp_fastopen_option(netdissect_options *ndo, const u_char *cp,
                                       u_int datalen, int exp);
 
 #define MAX_RST_DATA_LEN	30
 
 
-struct tha {
-        nd_ipv4 src;
-        nd_ipv4 dst;
+/*
+ * The conversations whose initial sequence numbers are known, for
+ * printing relative sequence numbers.  Each is keyed by its addresses
+ * and ports in an arbitrary collating order, so that there's only one
+ * entry for both directions, and is in a hash table, grown as needed,
+ * and in one of two lists, least recently used first: one of open
+ * conversations, forgotten after ndo_tcp_seq_timeout seconds idle, or
+ * the oldest of them when there are more than ndo_tcp_seq_max, and one
+ * of those closed by a RST or a FIN each way, forgotten once the last
+ * segments have had TCP_SEQ_LINGER seconds to go by.  The times are
+ * those of the packets.
+ */
+struct tcp_seq_key {
+        u_int ver;
+        nd_ipv6 src;		/* IPv4 addresses in the first 4 bytes */
+        nd_ipv6 dst;
         u_int port;
 };
 
-struct tcp_seq_hash {
-        struct tcp_seq_hash *nxt;
-        struct tha addr;
+struct tcp_seq_flow {
+        struct tcp_seq_flow *hnext;	/* next in the hash chain */
+        struct tcp_seq_flow *prev;	/* used less recently */
+        struct tcp_seq_flow *next;	/* used more recently */
+        struct tcp_seq_key addr;
+        struct timeval last_ts;
         uint32_t seq;
         uint32_t ack;
+        u_int fins;		/* directions a FIN has been seen in */
+        int closed;		/* on the closed list */
 };
 
-struct tha6 {
-        nd_ipv6 src;
-        nd_ipv6 dst;
-        u_int port;
-};
-
-struct tcp_seq_hash6 {
-        struct tcp_seq_hash6 *nxt;
-        struct tha6 addr;
-        uint32_t seq;
-        uint32_t ack;
+struct tcp_seq_list {
+        struct tcp_seq_flow *oldest;
+        struct tcp_seq_flow *newest;
 };
 
-#define TSEQ_HASHSIZE 919
+#define TSEQ_HASH_MIN		256
+#define TCP_SEQ_MAX_DEFAULT	1048576
+#define TCP_SEQ_TIMEOUT_DEFAULT	600	/* seconds */
+#define TCP_SEQ_LINGER		2	/* seconds */
 
 /* These tcp options do not have the size octet */
 #define ZEROLENOPT(o) ((o) == TCPOPT_EOL || (o) == TCPOPT_NOP)
 
-static struct tcp_seq_hash tcp_seq_hash4[TSEQ_HASHSIZE];
-static struct tcp_seq_hash6 tcp_seq_hash6[TSEQ_HASHSIZE];
+/* The relative sequence number table of a netdissect_options */
+struct tcp_state {
+        struct tcp_seq_flow **hash;
+        u_int hash_size;	/* a power of 2 */
+        struct tcp_seq_list open;
+        struct tcp_seq_list closed;
+        struct nd_tcp_seq_stats stats;
+};
+
+static struct tcp_state *
+tcp_state(netdissect_options *ndo)
+{
+        struct tcp_state *st = ndo->ndo_tcp;
+
+        if (st == NULL) {
+                st = calloc(1, sizeof(struct tcp_state));
+                if (st == NULL)
+                        (*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+                                          "tcp_state: calloc");
+                ndo->ndo_tcp = st;
+                st->hash_size = TSEQ_HASH_MIN;
+                st->hash = calloc(st->hash_size, sizeof(*st->hash));
+                if (st->hash == NULL)
+                        (*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+                                          "tcp_state: calloc");
+                st->stats.bytes = sizeof(*st) +
+                    st->hash_size * sizeof(*st->hash);
+        }
+        return st;
+}
+
+static u_int
+tcp_seq_hash(const struct tcp_seq_key *key)
+{
+        const u_char *p = (const u_char *)key;
+        uint32_t h = 2166136261U;
+        size_t i;
+
+        for (i = 0; i < sizeof(*key); i++)
+                h = (h ^ p[i]) * 16777619U;
+        return h;
+}
+
+static void
+tcp_seq_unlink(struct tcp_seq_list *l, struct tcp_seq_flow *th)
+{
+        if (th->prev != NULL)
+                th->prev->next = th->next;
+        else
+                l->oldest = th->next;
+        if (th->next != NULL)
+                th->next->prev = th->prev;
+        else
+                l->newest = th->prev;
+}
+
+static void
+tcp_seq_link(struct tcp_seq_list *l, struct tcp_seq_flow *th)
+{
+        th->next = NULL;
+        th->prev = l->newest;
+        if (l->newest != NULL)
+                l->newest->next = th;
+        else
+                l->oldest = th;
+        l->newest = th;
+}
+
+static void
+tcp_seq_free(struct tcp_state *st, struct tcp_seq_flow *th)
+{
+        struct tcp_seq_flow **tp;
+
+        tp = &st->hash[tcp_seq_hash(&th->addr) & (st->hash_size - 1)];
+        while (*tp != th)
+                tp = &(*tp)->hnext;
+        *tp = th->hnext;
+        tcp_seq_unlink(th->closed ? &st->closed : &st->open, th);
+        st->stats.flows--;
+        st->stats.bytes -= sizeof(*th);
+        free(th);
+}
+
+static int
+tcp_seq_idle(netdissect_options *ndo, const struct tcp_seq_flow *th,
+             u_int timeout)
+{
+        time_t secs;
+
+        secs = ndo->ndo_ts.tv_sec - th->last_ts.tv_sec;
+        return secs > (time_t)timeout || (secs == (time_t)timeout &&
+            ndo->ndo_ts.tv_usec > th->last_ts.tv_usec);
+}
+
+/* Forget the conversations that are over or have been idle too long */
+static void
+tcp_seq_expire(netdissect_options *ndo, struct tcp_state *st)
+{
+        u_int timeout;
+
+        while (st->closed.oldest != NULL &&
+               tcp_seq_idle(ndo, st->closed.oldest, TCP_SEQ_LINGER)) {
+                st->stats.closed++;
+                tcp_seq_free(st, st->closed.oldest);
+        }
+        timeout = ndo->ndo_tcp_seq_timeout != 0 ?
+            ndo->ndo_tcp_seq_timeout : TCP_SEQ_TIMEOUT_DEFAULT;
+        if (timeout == ND_TCP_SEQ_NO_TIMEOUT)
+                return;
+        while (st->open.oldest != NULL &&
+               tcp_seq_idle(ndo, st->open.oldest, timeout)) {
+                st->stats.timed_out++;
+                tcp_seq_free(st, st->open.oldest);
+        }
+}
+
+static void
+tcp_seq_grow(netdissect_options *ndo, struct tcp_state *st)
+{
+        struct tcp_seq_flow **hash, *th, *thnxt;
+        u_int size, b, i;
+
+        size = st->hash_size * 2;
+        hash = calloc(size, sizeof(*hash));
+        if (hash == NULL)
+                (*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+                                  "tcp_seq_grow: calloc");
+        for (i = 0; i < st->hash_size; i++) {
+                for (th = st->hash[i]; th != NULL; th = thnxt) {
+                        thnxt = th->hnext;
+                        b = tcp_seq_hash(&th->addr) & (size - 1);
+                        th->hnext = hash[b];
+                        hash[b] = th;
+                }
+        }
+        free(st->hash);
+        st->stats.bytes += (size - st->hash_size) * sizeof(*hash);
+        st->hash = hash;
+        st->hash_size = size;
+}
+
+/*
+ * Find the conversation with the given key, making it the most recently
+ * used; if there's none, add it, with the sequence numbers to be filled
+ * in, and set *newp.
+ */
+static struct tcp_seq_flow *
+tcp_seq_find(netdissect_options *ndo, const struct tcp_seq_key *key,
+             int *newp)
+{
+        struct tcp_state *st = tcp_state(ndo);
+        struct tcp_seq_flow *th;
+        u_int b, chain, max;
+
+        tcp_seq_expire(ndo, st);
+        b = tcp_seq_hash(key) & (st->hash_size - 1);
+        st->stats.lookups++;
+        chain = 0;
+        for (th = st->hash[b]; th != NULL; th = th->hnext) {
+                chain++;
+                if (memcmp(&th->addr, key, sizeof(*key)) == 0)
+                        break;
+        }
+        st->stats.probes += chain;
+        if (chain > st->stats.longest_chain)
+                st->stats.longest_chain = chain;
+        if (th != NULL) {
+                if (th->closed) {
+                        tcp_seq_unlink(&st->closed, th);
+                        tcp_seq_link(&st->closed, th);
+                } else {
+                        tcp_seq_unlink(&st->open, th);
+                        tcp_seq_link(&st->open, th);
+                }
+                th->last_ts = ndo->ndo_ts;
+                *newp = 0;
+                return th;
+        }
+
+        /* Stay within the limit, forgetting the idlest conversations */
+        max = ndo->ndo_tcp_seq_max != 0 ?
+            ndo->ndo_tcp_seq_max : TCP_SEQ_MAX_DEFAULT;
+        while (st->stats.flows >= max) {
+                if (st->closed.oldest != NULL) {
+                        st->stats.closed++;
+                        tcp_seq_free(st, st->closed.oldest);
+                } else {
+                        st->stats.evicted++;
+                        tcp_seq_free(st, st->open.oldest);
+                }
+        }
+
+        /* calloc() return used by the hash table: freed by tcp_free_state() */
+        th = (struct tcp_seq_flow *)calloc(1, sizeof(*th));
+        if (th == NULL)
+                (*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+                                  "tcp_seq_find: calloc");
+        th->addr = *key;
+        th->last_ts = ndo->ndo_ts;
+        th->hnext = st->hash[b];
+        st->hash[b] = th;
+        tcp_seq_link(&st->open, th);
+        st->stats.flows++;
+        st->stats.bytes += sizeof(*th);
+        if (st->stats.flows > st->hash_size)
+                tcp_seq_grow(ndo, st);
+        *newp = 1;
+        return th;
+}
+
+/*
+ * Note a SYN, FIN or RST; a conversation is over after a RST, or a FIN
+ * each way, and a SYN starts a new one.
+ */
+static void
+tcp_seq_flags(netdissect_options *ndo, struct tcp_seq_flow *th,
+              u_char flags, int rev)
+{
+        struct tcp_state *st = ndo->ndo_tcp;
+
+        if (flags & TH_SYN) {
+                th->fins = 0;
+                if (th->closed) {
+                        tcp_seq_unlink(&st->closed, th);
+                        tcp_seq_link(&st->open, th);
+                        th->closed = 0;
+                }
+                return;
+        }
+        if (flags & TH_FIN)
+                th->fins |= rev ? 2 : 1;
+        if (!th->closed && ((flags & TH_RST) || th->fins == 3)) {
+                tcp_seq_unlink(&st->open, th);
+                tcp_seq_link(&st->closed, th);
+                th->closed = 1;
+        }
+}
+
+void
+nd_get_tcp_seq_stats(netdissect_options *ndo, struct nd_tcp_seq_stats *stats)
+{
+        if (ndo->ndo_tcp == NULL) {
+                memset(stats, 0, sizeof(*stats));
+                return;
+        }
+        *stats = ndo->ndo_tcp->stats;
+}
+
+void
+tcp_free_state(netdissect_options *ndo)
+{
+        struct tcp_state *st = ndo->ndo_tcp;
+
+        if (st == NULL)
+                return;
+        while (st->open.oldest != NULL)
+                tcp_seq_free(st, st->open.oldest);
+        while (st->closed.oldest != NULL)
+                tcp_seq_free(st, st->closed.oldest);
+        free(st->hash);
+        free(st);
+        ndo->ndo_tcp = NULL;
+}
 
 static const struct tok tcp_flag_values[] = {
         { TH_FIN, "F" },
@@ -156,6 +434,396 @@ tcp6_cksum(netdissect_options *ndo,
                                 IPPROTO_TCP);
 }
 
+/*
+ * Printers for the registry below, taking a struct port_payload.
+ */
+static void
+tcp_telnet_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        telnet_print(ndo, pl->bp, pl->length);
+}
+
+static void
+tcp_smtp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        ND_PRINT(": ");
+        smtp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+tcp_whois_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        ND_PRINT(": ");
+        ndo->ndo_protocol = "whois";	/* needed by txtproto_print() */
+        txtproto_print(ndo, pl->bp, pl->length, NULL, 0); /* RFC 3912 */
+}
+
+static void
+tcp_bgp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        bgp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+tcp_pptp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        pptp_print(ndo, pl->bp);
+}
+
+static void
+tcp_resp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        resp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+tcp_ssh_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        ssh_print(ndo, pl->bp, pl->length);
+}
+
+#ifdef ENABLE_SMB
+static void
+tcp_nbt_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        nbt_tcp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+tcp_smb_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        smb_tcp_print(ndo, pl->bp, pl->length);
+}
+#endif
+
+static void
+tcp_beep_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        beep_print(ndo, pl->bp, pl->length);
+}
+
+static void
+tcp_openflow_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        openflow_print(ndo, pl->bp, pl->length);
+}
+
+static void
+tcp_ftp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        ND_PRINT(": ");
+        ftp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+tcp_http_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        ND_PRINT(": ");
+        http_print(ndo, pl->bp, pl->length);
+}
+
+static void
+tcp_rtsp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        ND_PRINT(": ");
+        rtsp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+tcp_domain_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        /* over_tcp: TRUE, is_mdns: FALSE */
+        domain_print(ndo, pl->bp, pl->length, TRUE, FALSE);
+}
+
+static void
+tcp_msdp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        msdp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+tcp_rpki_rtr_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        rpki_rtr_print(ndo, pl->bp, pl->length);
+}
+
+static void
+tcp_ldp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        ldp_print(ndo, pl->bp, pl->length);
+}
+
+/*
+ * If data present, header length valid, and NFS port used,
+ * assume NFS.
+ */
+static int
+tcp_nfs_check(netdissect_options *ndo, const struct port_payload *pl)
+{
+        return pl->length >= 4 && ND_TTEST_4(pl->bp);
+}
+
+static void
+tcp_nfs_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        uint32_t fraglen;
+        const struct sunrpc_msg *rp;
+        enum sunrpc_msg_type direction;
+
+        /*
+         * Pass offset of data plus 4 bytes for RPC TCP msg length
+         * to NFS print routines.
+         */
+        fraglen = GET_BE_U_4(pl->bp) & 0x7FFFFFFF;
+        if (fraglen > (pl->length) - 4)
+                fraglen = (pl->length) - 4;
+        rp = (const struct sunrpc_msg *)(pl->bp + 4);
+        if (ND_TTEST_4(rp->rm_direction)) {
+                direction = (enum sunrpc_msg_type) GET_BE_U_4(rp->rm_direction);
+                if (pl->dport == NFS_PORT && direction == SUNRPC_CALL) {
+                        ND_PRINT(": NFS request xid %u ",
+                                 GET_BE_U_4(rp->rm_xid));
+                        nfsreq_noaddr_print(ndo, (const u_char *)rp, fraglen, pl->bp2);
+                        return;
+                }
+                if (pl->sport == NFS_PORT && direction == SUNRPC_REPLY) {
+                        ND_PRINT(": NFS reply xid %u ",
+                                 GET_BE_U_4(rp->rm_xid));
+                        nfsreply_noaddr_print(ndo, (const u_char *)rp, fraglen, pl->bp2);
+                        return;
+                }
+        }
+}
+
+static void
+tcp_zmtp1_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+        zmtp1_print(ndo, pl->bp, pl->length);
+}
+
+/*
+ * The TCP ports we know printers for, in order of precedence: if the
+ * source port is claimed by one printer and the destination port by
+ * another, the one listed first is used.  Entries with no ports are
+ * only there for --decode-as.
+ */
+const struct port_printer tcp_port_printers[] = {
+        { "telnet",	TELNET_PORT, TELNET_PORT, PORT_MATCH_ANY, NULL, tcp_telnet_print },
+        { "smtp",	SMTP_PORT, SMTP_PORT, PORT_MATCH_ANY, NULL, tcp_smtp_print },
+        { "whois",	WHOIS_PORT, WHOIS_PORT, PORT_MATCH_ANY, NULL, tcp_whois_print },
+        { "bgp",	BGP_PORT, BGP_PORT, PORT_MATCH_ANY, NULL, tcp_bgp_print },
+        { "pptp",	PPTP_PORT, PPTP_PORT, PORT_MATCH_ANY, NULL, tcp_pptp_print },
+        { "resp",	REDIS_PORT, REDIS_PORT, PORT_MATCH_ANY, NULL, tcp_resp_print },
+        { "ssh",	SSH_PORT, SSH_PORT, PORT_MATCH_ANY, NULL, tcp_ssh_print },
+#ifdef ENABLE_SMB
+        { "netbios-ssn", NETBIOS_SSN_PORT, NETBIOS_SSN_PORT, PORT_MATCH_ANY, NULL, tcp_nbt_print },
+        { "smb",	SMB_PORT, SMB_PORT, PORT_MATCH_ANY, NULL, tcp_smb_print },
+#endif
+        { "beep",	BEEP_PORT, BEEP_PORT, PORT_MATCH_ANY, NULL, tcp_beep_print },
+        { "openflow",	OPENFLOW_PORT_OLD, OPENFLOW_PORT_OLD, PORT_MATCH_ANY, NULL, tcp_openflow_print },
+        { "openflow",	OPENFLOW_PORT_IANA, OPENFLOW_PORT_IANA, PORT_MATCH_ANY, NULL, tcp_openflow_print },
+        { "ftp",	FTP_PORT, FTP_PORT, PORT_MATCH_ANY, NULL, tcp_ftp_print },
+        { "http",	HTTP_PORT, HTTP_PORT, PORT_MATCH_ANY, NULL, tcp_http_print },
+        { "http",	HTTP_PORT_ALT, HTTP_PORT_ALT, PORT_MATCH_ANY, NULL, tcp_http_print },
+        { "rtsp",	RTSP_PORT, RTSP_PORT, PORT_MATCH_ANY, NULL, tcp_rtsp_print },
+        { "rtsp",	RTSP_PORT_ALT, RTSP_PORT_ALT, PORT_MATCH_ANY, NULL, tcp_rtsp_print },
+        { "domain",	NAMESERVER_PORT, NAMESERVER_PORT, PORT_MATCH_ANY, NULL, tcp_domain_print },
+        { "msdp",	MSDP_PORT, MSDP_PORT, PORT_MATCH_ANY, NULL, tcp_msdp_print },
+        { "rpki-rtr",	RPKI_RTR_PORT, RPKI_RTR_PORT, PORT_MATCH_ANY, NULL, tcp_rpki_rtr_print },
+        { "ldp",	LDP_PORT, LDP_PORT, PORT_MATCH_ANY, NULL, tcp_ldp_print },
+        { "nfs",	NFS_PORT, NFS_PORT, PORT_MATCH_ANY, tcp_nfs_check, tcp_nfs_print },
+        { "zmtp1",	0, 0, 0, NULL, tcp_zmtp1_print },
+        { NULL,		0, 0, 0, NULL, NULL }
+};
+
+/*
+ * With --reassemble-tcp, where the PDUs end, for the printers that
+ * expect whole PDUs; the data for the others is handed on as soon as
+ * it's in order.
+ */
+#define TCP_LINE_MAX	4096	/* longest line held back for its end */
+#define TCP_RPC_FRAG_MAX	(1U << 24)	/* longest RPC fragment believed */
+#define TCP_RPKI_RTR_MAX	65536	/* longest rpki-rtr PDU believed */
+
+static u_int
+tcp_line_pdu_len(const u_char *p, u_int len)
+{
+        const u_char *nl;
+
+        nl = memchr(p, '\n', len);
+        if (nl != NULL)
+                return (u_int)(nl - p) + 1;
+        return len >= TCP_LINE_MAX ? len : TCP_PDU_MORE;
+}
+
+static u_int
+tcp_bgp_pdu_len(const u_char *p, u_int len)
+{
+        u_int i, plen;
+
+        if (len < 19)
+                return TCP_PDU_MORE;
+        for (i = 0; i < 16; i++)
+                if (p[i] != 0xff)
+                        return TCP_PDU_BAD;
+        plen = EXTRACT_BE_U_2(p + 16);
+        return plen < 19 ? TCP_PDU_BAD : plen;
+}
+
+static u_int
+tcp_pptp_pdu_len(const u_char *p, u_int len)
+{
+        u_int plen;
+
+        if (len < 2)
+                return TCP_PDU_MORE;
+        plen = EXTRACT_BE_U_2(p);
+        return plen < 2 ? TCP_PDU_BAD : plen;
+}
+
+#ifdef ENABLE_SMB
+/*
+ * NetBIOS session message; the length has 17 bits and the other flag
+ * bits are reserved (RFC 1002)
+ */
+static u_int
+tcp_nbt_pdu_len(const u_char *p, u_int len)
+{
+        u_int type;
+
+        if (len < 4)
+                return TCP_PDU_MORE;
+        type = EXTRACT_U_1(p);
+        if ((type != 0x00 && (type < 0x81 || type > 0x85)) ||
+            (EXTRACT_U_1(p + 1) & 0xFE) != 0)
+                return TCP_PDU_BAD;
+        return 4 + ((EXTRACT_U_1(p + 1) & 0x01) << 16 | EXTRACT_BE_U_2(p + 2));
+}
+
+/* Direct-hosted SMB, with a 24-bit length */
+static u_int
+tcp_smb_pdu_len(const u_char *p, u_int len)
+{
+        if (len < 4)
+                return TCP_PDU_MORE;
+        if (EXTRACT_U_1(p) != 0)
+                return TCP_PDU_BAD;
+        return 4 + EXTRACT_BE_U_3(p + 1);
+}
+#endif
+
+static u_int
+tcp_openflow_pdu_len(const u_char *p, u_int len)
+{
+        u_int plen;
+
+        if (len < 8)
+                return TCP_PDU_MORE;
+        plen = EXTRACT_BE_U_2(p + 2);
+        return plen < 8 ? TCP_PDU_BAD : plen;
+}
+
+/* A DNS message over TCP has a 2-byte length in front (RFC 1035) */
+static u_int
+tcp_domain_pdu_len(const u_char *p, u_int len)
+{
+        u_int plen;
+
+        if (len < 2)
+                return TCP_PDU_MORE;
+        plen = EXTRACT_BE_U_2(p);
+        return plen < 12 ? TCP_PDU_BAD : 2 + plen;	/* the header */
+}
+
+static u_int
+tcp_msdp_pdu_len(const u_char *p, u_int len)
+{
+        u_int plen;
+
+        if (len < 3)
+                return TCP_PDU_MORE;
+        plen = EXTRACT_BE_U_2(p + 1);
+        return plen < 3 ? TCP_PDU_BAD : plen;
+}
+
+static u_int
+tcp_rpki_rtr_pdu_len(const u_char *p, u_int len)
+{
+        u_int plen;
+
+        if (len < 8)
+                return TCP_PDU_MORE;
+        plen = EXTRACT_BE_U_4(p + 4);
+        return plen < 8 || plen > TCP_RPKI_RTR_MAX ? TCP_PDU_BAD : plen;
+}
+
+static u_int
+tcp_ldp_pdu_len(const u_char *p, u_int len)
+{
+        if (len < 4)
+                return TCP_PDU_MORE;
+        if (EXTRACT_BE_U_2(p) != 1)	/* version */
+                return TCP_PDU_BAD;
+        return 4 + EXTRACT_BE_U_2(p + 2);
+}
+
+/*
+ * A fragment of an RPC record, with its record mark (RFC 5531); there's
+ * no limit on a fragment's length, but any sender keeps them far shorter
+ * than 2GB, and an empty one is only sensible as the last.
+ */
+static u_int
+tcp_nfs_pdu_len(const u_char *p, u_int len)
+{
+        uint32_t mark, fraglen;
+
+        if (len < 4)
+                return TCP_PDU_MORE;
+        mark = EXTRACT_BE_U_4(p);
+        fraglen = mark & 0x7FFFFFFF;
+        if (fraglen > TCP_RPC_FRAG_MAX ||
+            (fraglen == 0 && !(mark & 0x80000000)))
+                return TCP_PDU_BAD;
+        return 4 + fraglen;
+}
+
+static const struct {
+        port_print_t print;
+        tcp_pdu_len_t pdu_len;
+} tcp_pdu_framers[] = {
+        { tcp_smtp_print,	tcp_line_pdu_len },
+        { tcp_whois_print,	tcp_line_pdu_len },
+        { tcp_bgp_print,	tcp_bgp_pdu_len },
+        { tcp_pptp_print,	tcp_pptp_pdu_len },
+        { tcp_resp_print,	tcp_line_pdu_len },
+#ifdef ENABLE_SMB
+        { tcp_nbt_print,	tcp_nbt_pdu_len },
+        { tcp_smb_print,	tcp_smb_pdu_len },
+#endif
+        { tcp_beep_print,	tcp_line_pdu_len },
+        { tcp_openflow_print,	tcp_openflow_pdu_len },
+        { tcp_ftp_print,	tcp_line_pdu_len },
+        { tcp_http_print,	tcp_line_pdu_len },
+        { tcp_rtsp_print,	tcp_line_pdu_len },
+        { tcp_domain_print,	tcp_domain_pdu_len },
+        { tcp_msdp_print,	tcp_msdp_pdu_len },
+        { tcp_rpki_rtr_print,	tcp_rpki_rtr_pdu_len },
+        { tcp_ldp_print,	tcp_ldp_pdu_len },
+        { tcp_nfs_print,	tcp_nfs_pdu_len },
+};
+
+static tcp_pdu_len_t
+tcp_pdu_framer(const struct port_printer *printer)
+{
+        u_int i;
+
+        for (i = 0; i < sizeof(tcp_pdu_framers) / sizeof(tcp_pdu_framers[0]); i++)
+                if (tcp_pdu_framers[i].print == printer->print)
+                        return tcp_pdu_framers[i].pdu_len;
+        return NULL;
+}
+
 void
 tcp_print(netdissect_options *ndo,
           const u_char *bp, u_int length,
@@ -167,11 +835,13 @@ tcp_print(netdissect_options *ndo,
         u_int hlen;
         char ch;
         uint16_t sport, dport, win, urp;
-        uint32_t seq, ack, thseq, thack;
+        uint32_t seq, ack, thseq, thack, rawseq;
         u_int utoval;
         uint16_t magic;
         int rev;
         const struct ip6_hdr *ip6;
+        struct port_payload pl;
+        const struct port_printer *printer;
 
         ndo->ndo_protocol = "tcp";
         tp = (const struct tcphdr *)bp;
@@ -233,6 +903,7 @@ tcp_print(netdissect_options *ndo,
         }
 
         seq = GET_BE_U_4(tp->th_seq);
+        rawseq = seq;
         ack = GET_BE_U_4(tp->th_ack);
         win = GET_BE_U_2(tp->th_win);
         urp = GET_BE_U_2(tp->th_urp);
@@ -250,129 +921,64 @@ tcp_print(netdissect_options *ndo,
         ND_PRINT("Flags [%s]", bittok2str_nosep(tcp_flag_values, "none", flags));
 
         if (!ndo->ndo_Sflag && (flags & TH_ACK)) {
+                struct tcp_seq_flow *th;
+                struct tcp_seq_key tha;
+                const u_char *src, *dst;
+                u_int alen;
+                int new;
+
                 /*
                  * Find (or record) the initial sequence numbers for
                  * this conversation.  (we pick an arbitrary
                  * collating order so there's only one entry for
                  * both directions).
                  */
-                rev = 0;
+                memset(&tha, 0, sizeof(tha));
                 if (ip6) {
-                        struct tcp_seq_hash6 *th;
-                        struct tcp_seq_hash6 *tcp_seq_hash;
-                        const void *src, *dst;
-                        struct tha6 tha;
-
-                        tcp_seq_hash = tcp_seq_hash6;
-                        src = (const void *)ip6->ip6_src;
-                        dst = (const void *)ip6->ip6_dst;
-                        if (sport > dport)
-                                rev = 1;
-                        else if (sport == dport) {
-                                if (UNALIGNED_MEMCMP(src, dst, sizeof(ip6->ip6_dst)) > 0)
-                                        rev = 1;
-                        }
-                        if (rev) {
-                                UNALIGNED_MEMCPY(&tha.src, dst, sizeof(ip6->ip6_dst));
-                                UNALIGNED_MEMCPY(&tha.dst, src, sizeof(ip6->ip6_src));
-                                tha.port = ((u_int)dport) << 16 | sport;
-                        } else {
-                                UNALIGNED_MEMCPY(&tha.dst, dst, sizeof(ip6->ip6_dst));
-                                UNALIGNED_MEMCPY(&tha.src, src, sizeof(ip6->ip6_src));
-                                tha.port = ((u_int)sport) << 16 | dport;
-                        }
-
-                        for (th = &tcp_seq_hash[tha.port % TSEQ_HASHSIZE];
-                             th->nxt; th = th->nxt)
-                                if (memcmp((char *)&tha, (char *)&th->addr,
-                                           sizeof(th->addr)) == 0)
-                                        break;
-
-                        if (!th->nxt || (flags & TH_SYN)) {
-                                /* didn't find it or new conversation */
-                                /* calloc() return used by the 'tcp_seq_hash6'
-                                   hash table: do not free() */
-                                if (th->nxt == NULL) {
-                                        th->nxt = (struct tcp_seq_hash6 *)
-                                                calloc(1, sizeof(*th));
-                                        if (th->nxt == NULL)
-                                                (*ndo->ndo_error)(ndo,
-                                                        S_ERR_ND_MEM_ALLOC,
-                                                        "tcp_print: calloc");
-                                }
-                                th->addr = tha;
-                                if (rev)
-                                        th->ack = seq, th->seq = ack - 1;
-                                else
-                                        th->seq = seq, th->ack = ack - 1;
-                        } else {
-                                if (rev)
-                                        seq -= th->ack, ack -= th->seq;
-                                else
-                                        seq -= th->seq, ack -= th->ack;
-                        }
-
-                        thseq = th->seq;
-                        thack = th->ack;
+                        tha.ver = 6;
+                        src = ip6->ip6_src;
+                        dst = ip6->ip6_dst;
+                        alen = sizeof(ip6->ip6_src);
                 } else {
-                        struct tcp_seq_hash *th;
-                        struct tcp_seq_hash *tcp_seq_hash;
-                        struct tha tha;
-
-                        tcp_seq_hash = tcp_seq_hash4;
-                        if (sport > dport)
+                        tha.ver = 4;
+                        src = ip->ip_src;
+                        dst = ip->ip_dst;
+                        alen = sizeof(ip->ip_src);
+                }
+                rev = 0;
+                if (sport > dport)
+                        rev = 1;
+                else if (sport == dport) {
+                        if (UNALIGNED_MEMCMP(src, dst, alen) > 0)
                                 rev = 1;
-                        else if (sport == dport) {
-                                if (UNALIGNED_MEMCMP(ip->ip_src, ip->ip_dst, sizeof(ip->ip_dst)) > 0)
-                                        rev = 1;
-                        }
-                        if (rev) {
-                                UNALIGNED_MEMCPY(&tha.src, ip->ip_dst,
-                                                 sizeof(ip->ip_dst));
-                                UNALIGNED_MEMCPY(&tha.dst, ip->ip_src,
-                                                 sizeof(ip->ip_src));
-                                tha.port = ((u_int)dport) << 16 | sport;
-                        } else {
-                                UNALIGNED_MEMCPY(&tha.dst, ip->ip_dst,
-                                                 sizeof(ip->ip_dst));
-                                UNALIGNED_MEMCPY(&tha.src, ip->ip_src,
-                                                 sizeof(ip->ip_src));
-                                tha.port = ((u_int)sport) << 16 | dport;
-                        }
-
-                        for (th = &tcp_seq_hash[tha.port % TSEQ_HASHSIZE];
-                             th->nxt; th = th->nxt)
-                                if (memcmp((char *)&tha, (char *)&th->addr,
-                                           sizeof(th->addr)) == 0)
-                                        break;
-
-                        if (!th->nxt || (flags & TH_SYN)) {
-                                /* didn't find it or new conversation */
-                                /* calloc() return used by the 'tcp_seq_hash4'
-                                   hash table: do not free() */
-                                if (th->nxt == NULL) {
-                                        th->nxt = (struct tcp_seq_hash *)
-                                                calloc(1, sizeof(*th));
-                                        if (th->nxt == NULL)
-                                                (*ndo->ndo_error)(ndo,
-                                                        S_ERR_ND_MEM_ALLOC,
-                                                        "tcp_print: calloc");
-                                }
-                                th->addr = tha;
-                                if (rev)
-                                        th->ack = seq, th->seq = ack - 1;
-                                else
-                                        th->seq = seq, th->ack = ack - 1;
-                        } else {
-                                if (rev)
-                                        seq -= th->ack, ack -= th->seq;
-                                else
-                                        seq -= th->seq, ack -= th->ack;
-                        }
+                }
+                if (rev) {
+                        UNALIGNED_MEMCPY(&tha.src, dst, alen);
+                        UNALIGNED_MEMCPY(&tha.dst, src, alen);
+                        tha.port = ((u_int)dport) << 16 | sport;
+                } else {
+                        UNALIGNED_MEMCPY(&tha.dst, dst, alen);
+                        UNALIGNED_MEMCPY(&tha.src, src, alen);
+                        tha.port = ((u_int)sport) << 16 | dport;
+                }
 
-                        thseq = th->seq;
-                        thack = th->ack;
+                th = tcp_seq_find(ndo, &tha, &new);
+                if (new || (flags & TH_SYN)) {
+                        /* didn't find it or new conversation */
+                        if (rev)
+                                th->ack = seq, th->seq = ack - 1;
+                        else
+                                th->seq = seq, th->ack = ack - 1;
+                } else {
+                        if (rev)
+                                seq -= th->ack, ack -= th->seq;
+                        else
+                                seq -= th->seq, ack -= th->ack;
                 }
+                tcp_seq_flags(ndo, th, flags, rev);
+
+                thseq = th->seq;
+                thack = th->ack;
         } else {
                 /*fool gcc*/
                 thseq = thack = rev = 0;
@@ -682,7 +1288,12 @@ tcp_print(netdissect_options *ndo,
          */
         ND_PRINT(", length %u", length);
 
-        if (length <= 0)
+        /*
+         * With --reassemble-tcp, segments with no data still say
+         * where a connection starts and ends.
+         */
+        if (length <= 0 &&
+            !(ndo->ndo_tcp_reassemble && (flags & (TH_SYN|TH_FIN|TH_RST))))
                 return;
 
         /*
@@ -690,11 +1301,14 @@ tcp_print(netdissect_options *ndo,
          */
         bp += TH_OFF(tp) * 4;
         if ((flags & TH_RST) && ndo->ndo_vflag) {
-                print_tcp_rst_data(ndo, bp, length);
+                if (length > 0)
+                        print_tcp_rst_data(ndo, bp, length);
                 return;
         }
 
         if (ndo->ndo_packettype) {
+                if (length <= 0)
+                        return;
                 switch (ndo->ndo_packettype) {
                 case PT_ZMTP1:
                         zmtp1_print(ndo, bp, length);
@@ -710,83 +1324,22 @@ tcp_print(netdissect_options *ndo,
                 return;
         }
 
-        if (IS_SRC_OR_DST_PORT(TELNET_PORT)) {
-                telnet_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(SMTP_PORT)) {
-                ND_PRINT(": ");
-                smtp_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(WHOIS_PORT)) {
-                ND_PRINT(": ");
-                ndo->ndo_protocol = "whois";	/* needed by txtproto_print() */
-                txtproto_print(ndo, bp, length, NULL, 0); /* RFC 3912 */
-        } else if (IS_SRC_OR_DST_PORT(BGP_PORT))
-                bgp_print(ndo, bp, length);
-        else if (IS_SRC_OR_DST_PORT(PPTP_PORT))
-                pptp_print(ndo, bp);
-        else if (IS_SRC_OR_DST_PORT(REDIS_PORT))
-                resp_print(ndo, bp, length);
-        else if (IS_SRC_OR_DST_PORT(SSH_PORT))
-                ssh_print(ndo, bp, length);
-#ifdef ENABLE_SMB
-        else if (IS_SRC_OR_DST_PORT(NETBIOS_SSN_PORT))
-                nbt_tcp_print(ndo, bp, length);
-        else if (IS_SRC_OR_DST_PORT(SMB_PORT))
-                smb_tcp_print(ndo, bp, length);
-#endif
-        else if (IS_SRC_OR_DST_PORT(BEEP_PORT))
-                beep_print(ndo, bp, length);
-        else if (IS_SRC_OR_DST_PORT(OPENFLOW_PORT_OLD) || IS_SRC_OR_DST_PORT(OPENFLOW_PORT_IANA))
-                openflow_print(ndo, bp, length);
-        else if (IS_SRC_OR_DST_PORT(FTP_PORT)) {
-                ND_PRINT(": ");
-                ftp_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(HTTP_PORT) || IS_SRC_OR_DST_PORT(HTTP_PORT_ALT)) {
-                ND_PRINT(": ");
-                http_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(RTSP_PORT) || IS_SRC_OR_DST_PORT(RTSP_PORT_ALT)) {
-                ND_PRINT(": ");
-                rtsp_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(NAMESERVER_PORT)) {
-                /* over_tcp: TRUE, is_mdns: FALSE */
-                domain_print(ndo, bp, length, TRUE, FALSE);
-        } else if (IS_SRC_OR_DST_PORT(MSDP_PORT)) {
-                msdp_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(RPKI_RTR_PORT)) {
-                rpki_rtr_print(ndo, bp, length);
-        } else if (length > 0 && (IS_SRC_OR_DST_PORT(LDP_PORT))) {
-                ldp_print(ndo, bp, length);
-        } else if ((IS_SRC_OR_DST_PORT(NFS_PORT)) &&
-                 length >= 4 && ND_TTEST_4(bp)) {
-                /*
-                 * If data present, header length valid, and NFS port used,
-                 * assume NFS.
-                 * Pass offset of data plus 4 bytes for RPC TCP msg length
-                 * to NFS print routines.
-                 */
-                uint32_t fraglen;
-                const struct sunrpc_msg *rp;
-                enum sunrpc_msg_type direction;
-
-                fraglen = GET_BE_U_4(bp) & 0x7FFFFFFF;
-                if (fraglen > (length) - 4)
-                        fraglen = (length) - 4;
-                rp = (const struct sunrpc_msg *)(bp + 4);
-                if (ND_TTEST_4(rp->rm_direction)) {
-                        direction = (enum sunrpc_msg_type) GET_BE_U_4(rp->rm_direction);
-                        if (dport == NFS_PORT && direction == SUNRPC_CALL) {
-                                ND_PRINT(": NFS request xid %u ",
-                                         GET_BE_U_4(rp->rm_xid));
-                                nfsreq_noaddr_print(ndo, (const u_char *)rp, fraglen, (const u_char *)ip);
-                                return;
-                        }
-                        if (sport == NFS_PORT && direction == SUNRPC_REPLY) {
-                                ND_PRINT(": NFS reply xid %u ",
-                                         GET_BE_U_4(rp->rm_xid));
-                                nfsreply_noaddr_print(ndo, (const u_char *)rp, fraglen, (const u_char *)ip);
-                                return;
-                        }
-                }
-        }
+        pl.bp = bp;
+        pl.length = length;
+        pl.bp2 = bp2;
+        pl.sport = sport;
+        pl.dport = dport;
+        pl.fragmented = fragmented;
+        pl.ttl_hl = 0;
+        printer = tcp_port_printer(ndo, &pl);
+        if (printer == NULL)
+                return;
+        if (length > 0)
+                ND_STATS_LAYER(ndo, printer->name);
+        if (ndo->ndo_tcp_reassemble && !fragmented)
+                tcp_reasm_print(ndo, printer, &pl, rawseq, flags);
+        else if (length > 0)
+                printer->print(ndo, &pl);
 
         return;
 bad:
@@ -800,6 +1353,77 @@ trunc:
                 ND_PRINT(">");
 }
 
+/*
+ * With --reassemble-tcp, hand the segment to tcpreasm_add() and print
+ * the data it hands back, if any.
+ */
+static void
+tcp_reasm_print(netdissect_options *ndo, const struct port_printer *printer,
+                struct port_payload *pl, uint32_t seq, u_char flags)
+{
+        const struct ip *ip = (const struct ip *)pl->bp2;
+        const struct ip6_hdr *ip6;
+        struct tcpreasm_seg seg;
+        const u_char *data;
+        u_int len, status;
+        int pushed;
+
+        if (IP_V(ip) == 6) {
+                ip6 = (const struct ip6_hdr *)pl->bp2;
+                seg.ver = 6;
+                seg.src = ip6->ip6_src;
+                seg.dst = ip6->ip6_dst;
+        } else {
+                seg.ver = 4;
+                seg.src = ip->ip_src;
+                seg.dst = ip->ip_dst;
+        }
+        seg.sport = pl->sport;
+        seg.dport = pl->dport;
+        seg.seq = seq;
+        seg.syn = (flags & TH_SYN) != 0;
+        seg.fin = (flags & TH_FIN) != 0;
+        seg.rst = (flags & TH_RST) != 0;
+        /* Data cut short by the snapshot length can't be kept */
+        seg.data = ND_TTEST_LEN(pl->bp, pl->length) ? pl->bp : NULL;
+        seg.len = pl->length;
+        seg.pdu_len = tcp_pdu_framer(printer);
+
+        data = tcpreasm_add(ndo, &seg, &len, &status);
+        if (status & TCP_REASM_RETRANS)
+                ND_PRINT(" [retransmission]");
+        if (status & TCP_REASM_OUT_OF_ORDER)
+                ND_PRINT(" [out of order]");
+        if (status & TCP_REASM_GAP)
+                ND_PRINT(" [reassembly gap]");
+        if (seg.data == NULL) {
+                /* Print what there is of it, as without reassembly */
+                if (pl->length > 0)
+                        printer->print(ndo, pl);
+                return;
+        }
+        if (data == NULL) {
+                if (status & TCP_REASM_HELD)
+                        ND_PRINT(" [segment of a PDU]");
+                return;
+        }
+        if (status & TCP_REASM_JOINED)
+                ND_PRINT(" [reassembled %u bytes]", len);
+
+        pushed = 0;
+        if (data != pl->bp) {
+                if (!nd_push_buffer(ndo, (u_char *)data, data, data + len))
+                        (*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+                                "tcp_reasm_print: can't push buffer on buffer stack");
+                pushed = 1;
+        }
+        pl->bp = data;
+        pl->length = len;
+        printer->print(ndo, pl);
+        if (pushed)
+                nd_pop_packet_info(ndo);
+}
+
 /*
  * RFC1122 says the following on data in RST segments:
  *
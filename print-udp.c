@@ -41,6 +41,7 @@
 #include "rpc_msg.h"
 
 #include "nfs.h"
+#include "portdispatch.h"
 
 
 struct rtcphdr {
@@ -381,6 +382,449 @@ udpipaddr_print(netdissect_options *ndo, const struct ip *ip, int sport, int dpo
 	}
 }
 
+/*
+ * Printers for the registry below, taking a struct port_payload.
+ */
+static void
+udp_domain_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	/* over_tcp: FALSE, is_mdns: FALSE */
+	domain_print(ndo, pl->bp, pl->length, FALSE, FALSE);
+}
+
+static void
+udp_mdns_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	/* over_tcp: FALSE, is_mdns: TRUE */
+	domain_print(ndo, pl->bp, pl->length, FALSE, TRUE);
+}
+
+static void
+udp_timed_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	timed_print(ndo, pl->bp);
+}
+
+static void
+udp_tftp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	tftp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_bootp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	bootp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_rip_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	rip_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_aodv_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	aodv_print(ndo, pl->bp, pl->length,
+	    IP_V((const struct ip *)pl->bp2) == 6);
+}
+
+static void
+udp_isakmp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	isakmp_print(ndo, pl->bp, pl->length, pl->bp2);
+}
+
+static void
+udp_isakmp_natt_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	isakmp_rfc3948_print(ndo, pl->bp, pl->length, pl->bp2,
+	    IP_V((const struct ip *)pl->bp2), pl->fragmented, pl->ttl_hl);
+}
+
+static void
+udp_snmp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	snmp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_ntp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	ntp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_krb_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	krb_print(ndo, pl->bp);
+}
+
+static void
+udp_l2tp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	l2tp_print(ndo, pl->bp, pl->length);
+}
+
+#ifdef ENABLE_SMB
+static void
+udp_nbt_ns_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	nbt_udp137_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_nbt_dgram_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	nbt_udp138_print(ndo, pl->bp, pl->length);
+}
+#endif
+
+static void
+udp_vat_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	vat_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_zephyr_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	zephyr_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_rx_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	rx_print(ndo, pl->bp, pl->length, pl->sport, pl->dport, pl->bp2);
+}
+
+static void
+udp_ripng_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	ripng_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_dhcp6_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	dhcp6_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_ahcp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	ahcp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_babel_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	babel_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_hncp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	hncp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_wb_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	wb_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_cisco_autorp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	cisco_autorp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_radius_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	radius_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_hsrp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	hsrp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_lwres_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	lwres_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_ldp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	ldp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_olsr_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	olsr_print(ndo, pl->bp, pl->length,
+	    (IP_V((const struct ip *)pl->bp2) == 6) ? 1 : 0);
+}
+
+static void
+udp_lspping_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	lspping_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_bcm_li_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	bcm_li_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_bfd_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	bfd_print(ndo, pl->bp, pl->length, pl->dport);
+}
+
+static void
+udp_lmp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	lmp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_vqp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	vqp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_sflow_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	sflow_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_lwapp_control_to_print(netdissect_options *ndo,
+    const struct port_payload *pl)
+{
+	lwapp_control_print(ndo, pl->bp, pl->length, 1);
+}
+
+static void
+udp_lwapp_control_from_print(netdissect_options *ndo,
+    const struct port_payload *pl)
+{
+	lwapp_control_print(ndo, pl->bp, pl->length, 0);
+}
+
+static void
+udp_lwapp_data_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	lwapp_data_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_sip_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	sip_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_syslog_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	syslog_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_otv_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	otv_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_vxlan_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	vxlan_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_geneve_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	geneve_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_lisp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	lisp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_vxlan_gpe_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	vxlan_gpe_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_zep_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	zep_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_mpls_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	mpls_print(ndo, pl->bp, pl->length);
+}
+
+/* AppleTalk in UDP, if it starts with a DDP LAP header */
+static int
+udp_kip_check(netdissect_options *ndo, const struct port_payload *pl)
+{
+	const struct LAP *lp = (const struct LAP *)pl->bp;
+
+	return ND_TTEST_1(lp->type) && GET_U_1(lp->type) == lapDDP;
+}
+
+static void
+udp_kip_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	if (ndo->ndo_vflag)
+		ND_PRINT("kip ");
+	llap_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_ptp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	ptp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_someip_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	someip_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_rtp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	rtp_print(ndo, pl->bp, pl->length);
+}
+
+static void
+udp_rtcp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	const u_char *cp = pl->bp;
+
+	while (cp < ndo->ndo_snapend)
+		cp = rtcp_print(ndo, cp, ndo->ndo_snapend);
+}
+
+static void
+udp_cnfp_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	cnfp_print(ndo, pl->bp);
+}
+
+static void
+udp_pgm_print(netdissect_options *ndo, const struct port_payload *pl)
+{
+	pgm_print(ndo, pl->bp, pl->length, pl->bp2);
+}
+
+/*
+ * The UDP ports we know printers for, in order of precedence: if the
+ * source port is claimed by one printer and the destination port by
+ * another, the one listed first is used.  Entries with no ports are
+ * only there for --decode-as.
+ */
+const struct port_printer udp_port_printers[] = {
+	{ "domain",	NAMESERVER_PORT, NAMESERVER_PORT, PORT_MATCH_ANY, NULL, udp_domain_print },
+	{ "mdns",	MULTICASTDNS_PORT, MULTICASTDNS_PORT, PORT_MATCH_ANY, NULL, udp_mdns_print },
+	{ "timed",	TIMED_PORT, TIMED_PORT, PORT_MATCH_ANY, NULL, udp_timed_print },
+	{ "tftp",	TFTP_PORT, TFTP_PORT, PORT_MATCH_ANY, NULL, udp_tftp_print },
+	{ "bootp",	BOOTPC_PORT, BOOTPC_PORT, PORT_MATCH_ANY, NULL, udp_bootp_print },
+	{ "bootp",	BOOTPS_PORT, BOOTPS_PORT, PORT_MATCH_ANY, NULL, udp_bootp_print },
+	{ "rip",	RIP_PORT, RIP_PORT, PORT_MATCH_ANY, NULL, udp_rip_print },
+	{ "aodv",	AODV_PORT, AODV_PORT, PORT_MATCH_ANY, NULL, udp_aodv_print },
+	{ "isakmp",	ISAKMP_PORT, ISAKMP_PORT, PORT_MATCH_ANY, NULL, udp_isakmp_print },
+	{ "isakmp-natt", ISAKMP_PORT_NATT, ISAKMP_PORT_NATT, PORT_MATCH_ANY, NULL, udp_isakmp_natt_print },
+	{ "isakmp",	ISAKMP_PORT_USER1, ISAKMP_PORT_USER1, PORT_MATCH_ANY, NULL, udp_isakmp_print },
+	{ "isakmp",	ISAKMP_PORT_USER2, ISAKMP_PORT_USER2, PORT_MATCH_ANY, NULL, udp_isakmp_print },
+	{ "snmp",	SNMP_PORT, SNMP_PORT, PORT_MATCH_ANY, NULL, udp_snmp_print },
+	{ "snmp",	SNMPTRAP_PORT, SNMPTRAP_PORT, PORT_MATCH_ANY, NULL, udp_snmp_print },
+	{ "ntp",	NTP_PORT, NTP_PORT, PORT_MATCH_ANY, NULL, udp_ntp_print },
+	{ "krb",	KERBEROS_PORT, KERBEROS_PORT, PORT_MATCH_ANY, NULL, udp_krb_print },
+	{ "krb",	KERBEROS_SEC_PORT, KERBEROS_SEC_PORT, PORT_MATCH_ANY, NULL, udp_krb_print },
+	{ "l2tp",	L2TP_PORT, L2TP_PORT, PORT_MATCH_ANY, NULL, udp_l2tp_print },
+#ifdef ENABLE_SMB
+	{ "netbios-ns",	NETBIOS_NS_PORT, NETBIOS_NS_PORT, PORT_MATCH_ANY, NULL, udp_nbt_ns_print },
+	{ "netbios-dgm", NETBIOS_DGRAM_PORT, NETBIOS_DGRAM_PORT, PORT_MATCH_ANY, NULL, udp_nbt_dgram_print },
+#endif
+	{ "vat",	VAT_PORT, VAT_PORT, PORT_MATCH_DST, NULL, udp_vat_print },
+	{ "zephyr",	ZEPHYR_SRV_PORT, ZEPHYR_SRV_PORT, PORT_MATCH_ANY, NULL, udp_zephyr_print },
+	{ "zephyr",	ZEPHYR_CLT_PORT, ZEPHYR_CLT_PORT, PORT_MATCH_ANY, NULL, udp_zephyr_print },
+	{ "rx",		RX_PORT_LOW, RX_PORT_HIGH, PORT_MATCH_ANY, NULL, udp_rx_print },
+	{ "ripng",	RIPNG_PORT, RIPNG_PORT, PORT_MATCH_ANY, NULL, udp_ripng_print },
+	{ "dhcp6",	DHCP6_SERV_PORT, DHCP6_SERV_PORT, PORT_MATCH_ANY, NULL, udp_dhcp6_print },
+	{ "dhcp6",	DHCP6_CLI_PORT, DHCP6_CLI_PORT, PORT_MATCH_ANY, NULL, udp_dhcp6_print },
+	{ "ahcp",	AHCP_PORT, AHCP_PORT, PORT_MATCH_ANY, NULL, udp_ahcp_print },
+	{ "babel",	BABEL_PORT, BABEL_PORT, PORT_MATCH_ANY, NULL, udp_babel_print },
+	{ "babel",	BABEL_PORT_OLD, BABEL_PORT_OLD, PORT_MATCH_ANY, NULL, udp_babel_print },
+	{ "hncp",	HNCP_PORT, HNCP_PORT, PORT_MATCH_ANY, NULL, udp_hncp_print },
+	{ "wb",		WB_PORT, WB_PORT, PORT_MATCH_DST, NULL, udp_wb_print },
+	{ "autorp",	CISCO_AUTORP_PORT, CISCO_AUTORP_PORT, PORT_MATCH_ANY, NULL, udp_cisco_autorp_print },
+	{ "radius",	RADIUS_PORT, RADIUS_PORT, PORT_MATCH_ANY, NULL, udp_radius_print },
+	{ "radius",	RADIUS_NEW_PORT, RADIUS_NEW_PORT, PORT_MATCH_ANY, NULL, udp_radius_print },
+	{ "radius",	RADIUS_ACCOUNTING_PORT, RADIUS_ACCOUNTING_PORT, PORT_MATCH_ANY, NULL, udp_radius_print },
+	{ "radius",	RADIUS_NEW_ACCOUNTING_PORT, RADIUS_NEW_ACCOUNTING_PORT, PORT_MATCH_ANY, NULL, udp_radius_print },
+	{ "radius",	RADIUS_CISCO_COA_PORT, RADIUS_CISCO_COA_PORT, PORT_MATCH_ANY, NULL, udp_radius_print },
+	{ "radius",	RADIUS_COA_PORT, RADIUS_COA_PORT, PORT_MATCH_ANY, NULL, udp_radius_print },
+	{ "hsrp",	HSRP_PORT, HSRP_PORT, PORT_MATCH_DST, NULL, udp_hsrp_print },
+	{ "lwres",	LWRES_PORT, LWRES_PORT, PORT_MATCH_ANY, NULL, udp_lwres_print },
+	{ "ldp",	LDP_PORT, LDP_PORT, PORT_MATCH_ANY, NULL, udp_ldp_print },
+	{ "olsr",	OLSR_PORT, OLSR_PORT, PORT_MATCH_ANY, NULL, udp_olsr_print },
+	{ "lspping",	MPLS_LSP_PING_PORT, MPLS_LSP_PING_PORT, PORT_MATCH_ANY, NULL, udp_lspping_print },
+	{ "bcm-li",	BCM_LI_PORT, BCM_LI_PORT, PORT_MATCH_SRC, NULL, udp_bcm_li_print },
+	{ "bfd",	BFD_CONTROL_PORT, BFD_CONTROL_PORT, PORT_MATCH_DST, NULL, udp_bfd_print },
+	{ "bfd",	BFD_MULTIHOP_PORT, BFD_MULTIHOP_PORT, PORT_MATCH_DST, NULL, udp_bfd_print },
+	{ "bfd",	BFD_LAG_PORT, BFD_LAG_PORT, PORT_MATCH_DST, NULL, udp_bfd_print },
+	{ "bfd",	BFD_ECHO_PORT, BFD_ECHO_PORT, PORT_MATCH_DST, NULL, udp_bfd_print },
+	{ "lmp",	LMP_PORT, LMP_PORT, PORT_MATCH_ANY, NULL, udp_lmp_print },
+	{ "vqp",	VQP_PORT, VQP_PORT, PORT_MATCH_ANY, NULL, udp_vqp_print },
+	{ "sflow",	SFLOW_PORT, SFLOW_PORT, PORT_MATCH_ANY, NULL, udp_sflow_print },
+	{ "lwapp-control", LWAPP_CONTROL_PORT, LWAPP_CONTROL_PORT, PORT_MATCH_DST, NULL, udp_lwapp_control_to_print },
+	{ "lwapp-control", LWAPP_CONTROL_PORT, LWAPP_CONTROL_PORT, PORT_MATCH_SRC, NULL, udp_lwapp_control_from_print },
+	{ "lwapp-data",	LWAPP_DATA_PORT, LWAPP_DATA_PORT, PORT_MATCH_ANY, NULL, udp_lwapp_data_print },
+	{ "sip",	SIP_PORT, SIP_PORT, PORT_MATCH_ANY, NULL, udp_sip_print },
+	{ "syslog",	SYSLOG_PORT, SYSLOG_PORT, PORT_MATCH_ANY, NULL, udp_syslog_print },
+	{ "otv",	OTV_PORT, OTV_PORT, PORT_MATCH_ANY, NULL, udp_otv_print },
+	{ "vxlan",	VXLAN_PORT, VXLAN_PORT, PORT_MATCH_ANY, NULL, udp_vxlan_print },
+	{ "geneve",	GENEVE_PORT, GENEVE_PORT, PORT_MATCH_ANY, NULL, udp_geneve_print },
+	{ "lisp",	LISP_CONTROL_PORT, LISP_CONTROL_PORT, PORT_MATCH_ANY, NULL, udp_lisp_print },
+	{ "vxlan-gpe",	VXLAN_GPE_PORT, VXLAN_GPE_PORT, PORT_MATCH_ANY, NULL, udp_vxlan_gpe_print },
+	{ "zep",	ZEP_PORT, ZEP_PORT, PORT_MATCH_ANY, NULL, udp_zep_print },
+	{ "mpls",	MPLS_PORT, MPLS_PORT, PORT_MATCH_ANY, NULL, udp_mpls_print },
+	/* see atalk_port() */
+	{ "kip",	200, 327, PORT_MATCH_ANY, udp_kip_check, udp_kip_print },
+	{ "kip",	768, 895, PORT_MATCH_ANY, udp_kip_check, udp_kip_print },
+	{ "kip",	16512, 16639, PORT_MATCH_ANY, udp_kip_check, udp_kip_print },
+	{ "ptp",	PTP_EVENT_PORT, PTP_EVENT_PORT, PORT_MATCH_ANY, NULL, udp_ptp_print },
+	{ "ptp",	PTP_GENERAL_PORT, PTP_GENERAL_PORT, PORT_MATCH_ANY, NULL, udp_ptp_print },
+	{ "someip",	SOMEIP_PORT, SOMEIP_PORT, PORT_MATCH_ANY, NULL, udp_someip_print },
+	{ "rtp",	0, 0, 0, NULL, udp_rtp_print },
+	{ "rtcp",	0, 0, 0, NULL, udp_rtcp_print },
+	{ "cnfp",	0, 0, 0, NULL, udp_cnfp_print },
+	{ "pgm",	0, 0, 0, NULL, udp_pgm_print },
+	{ NULL,		0, 0, 0, NULL, NULL }
+};
+
 void
 udp_print(netdissect_options *ndo, const u_char *bp, u_int length,
 	  const u_char *bp2, int fragmented, u_int ttl_hl)
@@ -392,6 +836,8 @@ udp_print(netdissect_options *ndo, const u_char *bp, u_int length,
 	uint16_t sport, dport;
 	u_int ulen;
 	const struct ip6_hdr *ip6;
+	struct port_payload pl;
+	const struct port_printer *printer;
 
 	ndo->ndo_protocol = "udp";
 	up = (const struct udphdr *)bp;
@@ -538,14 +984,27 @@ udp_print(netdissect_options *ndo, const u_char *bp, u_int length,
 	}
 
 	udpipaddr_print(ndo, ip, sport, dport);
+	printer = NULL;
 	if (!ndo->ndo_qflag) {
 		const struct sunrpc_msg *rp;
 		enum sunrpc_msg_type direction;
 
+		pl.bp = cp;
+		pl.length = length;
+		pl.bp2 = bp2;
+		pl.sport = sport;
+		pl.dport = dport;
+		pl.fragmented = fragmented;
+		pl.ttl_hl = ttl_hl;
+		printer = udp_port_printer(ndo, &pl);
+
+		/* Unless --decode-as says otherwise, check for NFS. */
 		rp = (const struct sunrpc_msg *)cp;
-		if (ND_TTEST_4(rp->rm_direction)) {
+		if ((printer == NULL || !(printer->match & PORT_MATCH_USER)) &&
+		    ND_TTEST_4(rp->rm_direction)) {
 			direction = (enum sunrpc_msg_type) GET_BE_U_4(rp->rm_direction);
 			if (dport == NFS_PORT && direction == SUNRPC_CALL) {
+				ND_STATS_LAYER(ndo, "nfs");
 				ND_PRINT("NFS request xid %u ",
 					 GET_BE_U_4(rp->rm_xid));
 				nfsreq_noaddr_print(ndo, (const u_char *)rp, length,
@@ -553,6 +1012,7 @@ udp_print(netdissect_options *ndo, const u_char *bp, u_int length,
 				return;
 			}
 			if (sport == NFS_PORT && direction == SUNRPC_REPLY) {
+				ND_STATS_LAYER(ndo, "nfs");
 				ND_PRINT("NFS reply xid %u ",
 					 GET_BE_U_4(rp->rm_xid));
 				nfsreply_noaddr_print(ndo, (const u_char *)rp, length,
@@ -609,146 +1069,9 @@ udp_print(netdissect_options *ndo, const u_char *bp, u_int length,
 		}
 	}
 
-	if (!ndo->ndo_qflag) {
-		if (IS_SRC_OR_DST_PORT(NAMESERVER_PORT))
-			/* over_tcp: FALSE, is_mdns: FALSE */
-			domain_print(ndo, cp, length, FALSE, FALSE);
-		else if (IS_SRC_OR_DST_PORT(MULTICASTDNS_PORT))
-			/* over_tcp: FALSE, is_mdns: TRUE */
-			domain_print(ndo, cp, length, FALSE, TRUE);
-		else if (IS_SRC_OR_DST_PORT(TIMED_PORT))
-			timed_print(ndo, (const u_char *)cp);
-		else if (IS_SRC_OR_DST_PORT(TFTP_PORT))
-			tftp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(BOOTPC_PORT) || IS_SRC_OR_DST_PORT(BOOTPS_PORT))
-			bootp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(RIP_PORT))
-			rip_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(AODV_PORT))
-			aodv_print(ndo, cp, length,
-			    ip6 != NULL);
-		else if (IS_SRC_OR_DST_PORT(ISAKMP_PORT))
-			 isakmp_print(ndo, cp, length, bp2);
-		else if (IS_SRC_OR_DST_PORT(ISAKMP_PORT_NATT))
-			 isakmp_rfc3948_print(ndo, cp, length, bp2, IP_V(ip), fragmented, ttl_hl);
-		else if (IS_SRC_OR_DST_PORT(ISAKMP_PORT_USER1) || IS_SRC_OR_DST_PORT(ISAKMP_PORT_USER2))
-			isakmp_print(ndo, cp, length, bp2);
-		else if (IS_SRC_OR_DST_PORT(SNMP_PORT) || IS_SRC_OR_DST_PORT(SNMPTRAP_PORT))
-			snmp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(NTP_PORT))
-			ntp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(KERBEROS_PORT) || IS_SRC_OR_DST_PORT(KERBEROS_SEC_PORT))
-			krb_print(ndo, (const u_char *)cp);
-		else if (IS_SRC_OR_DST_PORT(L2TP_PORT))
-			l2tp_print(ndo, cp, length);
-#ifdef ENABLE_SMB
-		else if (IS_SRC_OR_DST_PORT(NETBIOS_NS_PORT))
-			nbt_udp137_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(NETBIOS_DGRAM_PORT))
-			nbt_udp138_print(ndo, cp, length);
-#endif
-		else if (dport == VAT_PORT)
-			vat_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(ZEPHYR_SRV_PORT) || IS_SRC_OR_DST_PORT(ZEPHYR_CLT_PORT))
-			zephyr_print(ndo, cp, length);
-		/*
-		 * Since there are 10 possible ports to check, I think
-		 * a <> test would be more efficient
-		 */
-		else if ((sport >= RX_PORT_LOW && sport <= RX_PORT_HIGH) ||
-			 (dport >= RX_PORT_LOW && dport <= RX_PORT_HIGH))
-			rx_print(ndo, cp, length, sport, dport,
-				 (const u_char *) ip);
-		else if (IS_SRC_OR_DST_PORT(RIPNG_PORT))
-			ripng_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(DHCP6_SERV_PORT) || IS_SRC_OR_DST_PORT(DHCP6_CLI_PORT))
-			dhcp6_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(AHCP_PORT))
-			ahcp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(BABEL_PORT) || IS_SRC_OR_DST_PORT(BABEL_PORT_OLD))
-			babel_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(HNCP_PORT))
-			hncp_print(ndo, cp, length);
-		/*
-		 * Kludge in test for whiteboard packets.
-		 */
-		else if (dport == WB_PORT)
-			wb_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(CISCO_AUTORP_PORT))
-			cisco_autorp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(RADIUS_PORT) ||
-			 IS_SRC_OR_DST_PORT(RADIUS_NEW_PORT) ||
-			 IS_SRC_OR_DST_PORT(RADIUS_ACCOUNTING_PORT) ||
-			 IS_SRC_OR_DST_PORT(RADIUS_NEW_ACCOUNTING_PORT) ||
-			 IS_SRC_OR_DST_PORT(RADIUS_CISCO_COA_PORT) ||
-			 IS_SRC_OR_DST_PORT(RADIUS_COA_PORT) )
-			radius_print(ndo, (const u_char *)(up+1), length);
-		else if (dport == HSRP_PORT)
-			hsrp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(LWRES_PORT))
-			lwres_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(LDP_PORT))
-			ldp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(OLSR_PORT))
-			olsr_print(ndo, cp, length,
-					(IP_V(ip) == 6) ? 1 : 0);
-		else if (IS_SRC_OR_DST_PORT(MPLS_LSP_PING_PORT))
-			lspping_print(ndo, cp, length);
-		else if (sport == BCM_LI_PORT)
-			bcm_li_print(ndo, (const u_char *)(up+1), length);
-		else if (dport == BFD_CONTROL_PORT ||
-			 dport == BFD_MULTIHOP_PORT ||
-			 dport == BFD_LAG_PORT ||
-			 dport == BFD_ECHO_PORT )
-			bfd_print(ndo, (const u_char *)(up+1), length, dport);
-		else if (IS_SRC_OR_DST_PORT(LMP_PORT))
-			lmp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(VQP_PORT))
-			vqp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(SFLOW_PORT))
-			sflow_print(ndo, cp, length);
-		else if (dport == LWAPP_CONTROL_PORT)
-			lwapp_control_print(ndo, cp, length, 1);
-		else if (sport == LWAPP_CONTROL_PORT)
-			lwapp_control_print(ndo, cp, length, 0);
-		else if (IS_SRC_OR_DST_PORT(LWAPP_DATA_PORT))
-			lwapp_data_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(SIP_PORT))
-			sip_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(SYSLOG_PORT))
-			syslog_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(OTV_PORT))
-			otv_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(VXLAN_PORT))
-			vxlan_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(GENEVE_PORT))
-			geneve_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(LISP_CONTROL_PORT))
-			lisp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(VXLAN_GPE_PORT))
-			vxlan_gpe_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(ZEP_PORT))
-			zep_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(MPLS_PORT))
-			mpls_print(ndo, cp, length);
-		else if (ND_TTEST_1(((const struct LAP *)cp)->type) &&
-			 GET_U_1(((const struct LAP *)cp)->type) == lapDDP &&
-			 (atalk_port(sport) || atalk_port(dport))) {
-			if (ndo->ndo_vflag)
-				ND_PRINT("kip ");
-			llap_print(ndo, cp, length);
-		} else if (IS_SRC_OR_DST_PORT(PTP_EVENT_PORT) ||
-			IS_SRC_OR_DST_PORT(PTP_GENERAL_PORT)) {
-			ptp_print(ndo, cp, length);
-		} else if (IS_SRC_OR_DST_PORT(SOMEIP_PORT))
-			someip_print(ndo, cp, length);
-		else {
-			if (ulen > length && !fragmented)
-				ND_PRINT("UDP, bad length %u > %u",
-				    ulen, length);
-			else
-				ND_PRINT("UDP, length %u", ulen);
-		}
+	if (printer != NULL) {
+		ND_STATS_LAYER(ndo, printer->name);
+		printer->print(ndo, &pl);
 	} else {
 		if (ulen > length && !fragmented)
 			ND_PRINT("UDP, bad length %u > %u",
@@ -29,12 +29,17 @@
 #include <config.h>
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <setjmp.h>
 
 #include "netdissect-stdinc.h"
 
+#ifdef HAVE_WRITEV
+#include <sys/uio.h>
+#endif
+
 #include "netdissect.h"
 #include "addrtoname.h"
 #include "print.h"
@@ -47,6 +52,30 @@ struct uint_printer {
 	int type;
 };
 
+/*
+ * The default ndo_printf() formats the text of each packet into a
+ * buffer of its own; complete packets are written to the standard
+ * output together, with one writev(), once there are ND_OUTPUT_PACKETS
+ * of them or ND_OUTPUT_BATCH bytes, when nd_flush_output() is called,
+ * or at the end of each packet if ndo_flush_packets is set.
+ */
+#define ND_OUTPUT_PACKETS	256
+#define ND_OUTPUT_BATCH		32768
+#define ND_OUTPUT_INITSIZE	256	/* initial size of a packet buffer */
+#define ND_OUTPUT_RESERVE	128	/* room made before formatting */
+
+struct nd_output_packet {
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+struct nd_output {
+	struct nd_output_packet pkt[ND_OUTPUT_PACKETS];
+	u_int npkts;		/* complete packets; pkt[npkts] is current */
+	size_t pending;		/* bytes in the complete packets */
+};
+
 struct void_printer {
 	void_if_printer f;
 	int type;
@@ -272,6 +301,9 @@ static void	ndo_warning(netdissect_options *ndo,
 static int	ndo_printf(netdissect_options *ndo,
 		     FORMAT_STRING(const char *fmt), ...)
 		     PRINTFLIKE(2, 3);
+static void	output_write(netdissect_options *ndo, struct nd_output *out,
+		    u_int npkts, size_t extra);
+static void	output_packet_end(netdissect_options *ndo);
 
 void
 init_print(netdissect_options *ndo, uint32_t localnet, uint32_t mask)
@@ -279,6 +311,7 @@ init_print(netdissect_options *ndo, uint32_t localnet, uint32_t mask)
 
 	init_addrtoname(ndo, localnet, mask);
 	init_checksum();
+	init_port_tables();
 }
 
 uint_if_printer
@@ -394,6 +427,11 @@ pretty_print_packet(netdissect_options *ndo, const struct pcap_pkthdr *h,
 	u_int hdrlen;
 	int invalid_header = 0;
 
+	if (ndo->ndo_proto_stats) {
+		protostats_packet(ndo, h, sp);
+		return;
+	}
+
 	if (ndo->ndo_packet_number)
 		ND_PRINT("%5u  ", packets_captured);
 
@@ -435,6 +473,7 @@ pretty_print_packet(netdissect_options *ndo, const struct pcap_pkthdr *h,
 	}
 	if (invalid_header) {
 		ND_PRINT("]\n");
+		output_packet_end(ndo);
 		return;
 	}
 
@@ -451,6 +490,7 @@ pretty_print_packet(netdissect_options *ndo, const struct pcap_pkthdr *h,
 	 */
 
 	ts_print(ndo, &h->ts);
+	ndo->ndo_ts = h->ts;
 
 	/*
 	 * Printers must check that they're not walking off the end of
@@ -548,6 +588,8 @@ pretty_print_packet(netdissect_options *ndo, const struct pcap_pkthdr *h,
 
 	ND_PRINT("\n");
 	nd_free_all(ndo);
+	addrtoname_trim(ndo);
+	output_packet_end(ndo);
 }
 
 /*
@@ -564,8 +606,20 @@ static void
 ndo_error(netdissect_options *ndo, status_exit_codes_t status,
 	  const char *fmt, ...)
 {
+	struct nd_output *out;
 	va_list ap;
 
+	/*
+	 * Write what was printed before the error, as stdio would
+	 * have done on exit.  Detach the buffers first, in case it's
+	 * writing them that failed.
+	 */
+	out = ndo->ndo_output;
+	if (out != NULL) {
+		ndo->ndo_output = NULL;
+		output_write(ndo, out, out->npkts, out->pkt[out->npkts].len);
+	}
+
 	if (ndo->program_name)
 		(void)fprintf(stderr, "%s: ", ndo->program_name);
 	va_start(ap, fmt);
@@ -600,19 +654,353 @@ ndo_warning(netdissect_options *ndo, const char *fmt, ...)
 	}
 }
 
+static struct nd_output *
+output_state(netdissect_options *ndo)
+{
+	if (ndo->ndo_output == NULL) {
+		ndo->ndo_output = calloc(1, sizeof(struct nd_output));
+		if (ndo->ndo_output == NULL)
+			ndo_error(ndo, S_ERR_ND_MEM_ALLOC,
+				  "output_state: calloc");
+	}
+	return (ndo->ndo_output);
+}
+
+/*
+ * Write the first "npkts" packet buffers, and the "extra" bytes of
+ * the one after them, to the standard output.
+ */
+static void
+output_write(netdissect_options *ndo, struct nd_output *out, u_int npkts,
+	     size_t extra)
+{
+#ifdef HAVE_WRITEV
+	struct iovec iov[ND_OUTPUT_PACKETS];
+	struct iovec *iovp;
+	u_int i, niov;
+	ssize_t n;
+
+	niov = 0;
+	for (i = 0; i < npkts; i++) {
+		if (out->pkt[i].len == 0)
+			continue;
+		iov[niov].iov_base = out->pkt[i].buf;
+		iov[niov].iov_len = out->pkt[i].len;
+		niov++;
+	}
+	if (extra != 0) {
+		iov[niov].iov_base = out->pkt[npkts].buf;
+		iov[niov].iov_len = extra;
+		niov++;
+	}
+
+	/* Anything written with stdio must come out first. */
+	(void)fflush(stdout);
+	iovp = iov;
+	while (niov != 0) {
+		n = writev(fileno(stdout), iovp, niov);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			ndo_error(ndo, S_ERR_ND_WRITE_FILE,
+				  "Unable to write output: %s",
+				  pcap_strerror(errno));
+		}
+		while (niov != 0 && (size_t)n >= iovp->iov_len) {
+			n -= iovp->iov_len;
+			iovp++;
+			niov--;
+		}
+		if (niov != 0) {
+			iovp->iov_base = (char *)iovp->iov_base + n;
+			iovp->iov_len -= n;
+		}
+	}
+#else
+	u_int i;
+
+	for (i = 0; i < npkts; i++) {
+		if (out->pkt[i].len != 0 &&
+		    fwrite(out->pkt[i].buf, out->pkt[i].len, 1, stdout) != 1)
+			ndo_error(ndo, S_ERR_ND_WRITE_FILE,
+				  "Unable to write output: %s",
+				  pcap_strerror(errno));
+	}
+	if (extra != 0 &&
+	    fwrite(out->pkt[npkts].buf, extra, 1, stdout) != 1)
+		ndo_error(ndo, S_ERR_ND_WRITE_FILE,
+			  "Unable to write output: %s", pcap_strerror(errno));
+	if (fflush(stdout) == EOF)
+		ndo_error(ndo, S_ERR_ND_WRITE_FILE,
+			  "Unable to write output: %s", pcap_strerror(errno));
+#endif
+}
+
+/*
+ * Called at the end of each packet.
+ */
+static void
+output_packet_end(netdissect_options *ndo)
+{
+	struct nd_output *out = ndo->ndo_output;
+	u_int i;
+
+	if (out == NULL || out->pkt[out->npkts].len == 0)
+		return;
+	out->pending += out->pkt[out->npkts].len;
+	out->npkts++;
+	if (ndo->ndo_flush_packets || out->npkts == ND_OUTPUT_PACKETS ||
+	    out->pending >= ND_OUTPUT_BATCH) {
+		output_write(ndo, out, out->npkts, 0);
+		for (i = 0; i < out->npkts; i++)
+			out->pkt[i].len = 0;
+		out->npkts = 0;
+		out->pending = 0;
+	}
+}
+
+/*
+ * Write all the output buffered by the default ndo_printf(), including
+ * that of a packet not yet finished.
+ */
+void
+nd_flush_output(netdissect_options *ndo)
+{
+	struct nd_output *out = ndo->ndo_output;
+	u_int i;
+
+	if (out == NULL)
+		return;
+	output_write(ndo, out, out->npkts, out->pkt[out->npkts].len);
+	for (i = 0; i <= out->npkts; i++)
+		out->pkt[i].len = 0;
+	out->npkts = 0;
+	out->pending = 0;
+}
+
+void
+output_free_state(netdissect_options *ndo)
+{
+	struct nd_output *out = ndo->ndo_output;
+	u_int i;
+
+	if (out == NULL)
+		return;
+	nd_flush_output(ndo);
+	for (i = 0; i < ND_OUTPUT_PACKETS; i++)
+		free(out->pkt[i].buf);
+	free(out);
+	ndo->ndo_output = NULL;
+}
+
+/*
+ * Make room for at least "len" more bytes, and a terminating NUL, in
+ * the buffer of the packet being printed, and return it.
+ */
+static struct nd_output_packet *
+output_reserve(netdissect_options *ndo, size_t len)
+{
+	struct nd_output_packet *p;
+	size_t newsize;
+	char *newbuf;
+
+	p = &output_state(ndo)->pkt[ndo->ndo_output->npkts];
+	if (len < p->size - p->len)
+		return (p);
+	newsize = p->size != 0 ? p->size * 2 : ND_OUTPUT_INITSIZE;
+	while (len >= newsize - p->len)
+		newsize *= 2;
+	newbuf = realloc(p->buf, newsize);
+	if (newbuf == NULL)
+		ndo_error(ndo, S_ERR_ND_MEM_ALLOC, "output_reserve: realloc");
+	p->buf = newbuf;
+	p->size = newsize;
+	return (p);
+}
+
+/*
+ * Format "fmt" into the buffer of the packet being printed, if it uses
+ * only the conversions the printers use most: %s, %c, %%, and %d, %u,
+ * %x and %X with an optional "l" or "ll" and an optional width, which
+ * may have a leading "0".  Return the number of characters added, or
+ * -1, having added nothing, if "fmt" uses anything else.
+ */
+static int
+output_format(netdissect_options *ndo, const char *fmt, va_list args)
+{
+	static const char lower[] = "0123456789abcdef";
+	static const char upper[] = "0123456789ABCDEF";
+	struct nd_output_packet *p;
+	size_t start, len, width;
+	const char *str, *digits;
+	char num[24], *np;
+	int zero, lflag, negative;
+	u_int base;
+	unsigned long long v;
+
+	p = output_reserve(ndo, 0);
+	start = p->len;
+	for (;;) {
+		/* Copy the text up to the next conversion. */
+		str = fmt;
+		while (*fmt != '%' && *fmt != '\0')
+			fmt++;
+		len = fmt - str;
+		if (len != 0) {
+			p = output_reserve(ndo, len);
+			memcpy(p->buf + p->len, str, len);
+			p->len += len;
+		}
+		if (*fmt == '\0')
+			break;
+		fmt++;
+
+		zero = 0;
+		if (*fmt == '0') {
+			zero = 1;
+			fmt++;
+		}
+		width = 0;
+		while (*fmt >= '0' && *fmt <= '9')
+			width = width * 10 + (*fmt++ - '0');
+		lflag = 0;
+		while (*fmt == 'l' && lflag < 2) {
+			lflag++;
+			fmt++;
+		}
+
+		switch (*fmt++) {
+
+		case 's':
+			if (zero || lflag)
+				goto unsupported;
+			str = va_arg(args, const char *);
+			if (str == NULL)
+				str = "(null)";
+			len = strlen(str);
+			p = output_reserve(ndo, len + width);
+			while (width > len) {
+				p->buf[p->len++] = ' ';
+				width--;
+			}
+			memcpy(p->buf + p->len, str, len);
+			p->len += len;
+			continue;
+
+		case 'c':
+			if (zero || lflag || width > 1)
+				goto unsupported;
+			p = output_reserve(ndo, 1);
+			p->buf[p->len++] = (char)va_arg(args, int);
+			continue;
+
+		case '%':
+			if (zero || lflag || width != 0)
+				goto unsupported;
+			p = output_reserve(ndo, 1);
+			p->buf[p->len++] = '%';
+			continue;
+
+		case 'd':
+			switch (lflag) {
+			case 0:
+				v = (long long)va_arg(args, int);
+				break;
+			case 1:
+				v = (long long)va_arg(args, long);
+				break;
+			default:
+				v = va_arg(args, long long);
+				break;
+			}
+			negative = (long long)v < 0;
+			if (negative)
+				v = -v;
+			base = 10;
+			digits = lower;
+			break;
+
+		case 'u':
+		case 'x':
+		case 'X':
+			switch (lflag) {
+			case 0:
+				v = va_arg(args, u_int);
+				break;
+			case 1:
+				v = va_arg(args, unsigned long);
+				break;
+			default:
+				v = va_arg(args, unsigned long long);
+				break;
+			}
+			negative = 0;
+			base = fmt[-1] == 'u' ? 10 : 16;
+			digits = fmt[-1] == 'X' ? upper : lower;
+			break;
+
+		default:
+			goto unsupported;
+		}
+
+		/* Format the number backwards, then pad and copy it. */
+		np = num + sizeof(num);
+		do {
+			*--np = digits[v % base];
+			v /= base;
+		} while (v != 0);
+		len = num + sizeof(num) - np;
+		p = output_reserve(ndo, len + width + 1);
+		if (negative) {
+			if (zero)
+				p->buf[p->len++] = '-';
+			len++;
+		}
+		while (width > len) {
+			p->buf[p->len++] = zero ? '0' : ' ';
+			width--;
+		}
+		if (negative && !zero)
+			p->buf[p->len++] = '-';
+		len = num + sizeof(num) - np;
+		memcpy(p->buf + p->len, np, len);
+		p->len += len;
+	}
+	p->buf[p->len] = '\0';
+	return ((int)(p->len - start));
+
+unsupported:
+	p->len = start;
+	return (-1);
+}
+
 static int
 ndo_printf(netdissect_options *ndo, const char *fmt, ...)
 {
+	struct nd_output_packet *p;
 	va_list args;
 	int ret;
 
 	va_start(args, fmt);
-	ret = vfprintf(stdout, fmt, args);
+	ret = output_format(ndo, fmt, args);
 	va_end(args);
+	if (ret >= 0)
+		return (ret);
 
+	p = output_reserve(ndo, ND_OUTPUT_RESERVE);
+	va_start(args, fmt);
+	ret = vsnprintf(p->buf + p->len, p->size - p->len, fmt, args);
+	va_end(args);
 	if (ret < 0)
 		ndo_error(ndo, S_ERR_ND_WRITE_FILE,
-			  "Unable to write output: %s", pcap_strerror(errno));
+			  "Unable to format output: %s", pcap_strerror(errno));
+	if ((size_t)ret >= p->size - p->len) {
+		p = output_reserve(ndo, ret);
+		va_start(args, fmt);
+		(void)vsnprintf(p->buf + p->len, p->size - p->len, fmt, args);
+		va_end(args);
+	}
+	p->len += ret;
 	return (ret);
 }
 
@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Protocol statistics (--protocol-stats).
+ *
+ * The protocol paths seen are kept as a tree, with a node for each
+ * link-layer header type under the root, a node for each protocol
+ * carried in it under that, and so on.  While a packet is dissected,
+ * the printers' output is thrown away rather than formatted, and each
+ * ND_STATS_LAYER() moves down the tree from the node the packet has got
+ * to, adding the packet to the counts of each node it goes through.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netdissect.h"
+#include "netdissect-alloc.h"
+
+/* Layers of a protocol path counted; deeper ones are counted there */
+#define PROTOSTATS_MAX_DEPTH	16
+
+/* Width of the protocol column of the report */
+#define PROTOSTATS_NAME_WIDTH	32
+
+struct ps_node {
+	char *name;
+	uint64_t packets;
+	uint64_t bytes;
+	struct ps_node *child;		/* first protocol carried in it */
+	struct ps_node *next;		/* next one carried in its parent */
+};
+
+struct protostats_state {
+	struct ps_node root;
+	struct ps_node *cur;		/* where the packet has got to */
+	u_int depth;			/* how far down that is */
+	u_int len;			/* length of the packet */
+	const char *link;		/* name of its link-layer header type */
+	char linkbuf[16];
+	time_t next_report;		/* time of the next periodic report */
+};
+
+static struct protostats_state *
+protostats_state(netdissect_options *ndo)
+{
+	struct protostats_state *st = ndo->ndo_protostats;
+
+	if (st == NULL) {
+		st = calloc(1, sizeof(*st));
+		if (st == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+			    "protostats_state: calloc");
+		st->link = "unknown";
+		ndo->ndo_protostats = st;
+	}
+	return st;
+}
+
+/*
+ * Set the link-layer header type of the packets to come, whose name is
+ * the first layer of their protocol paths.
+ */
+void
+nd_set_proto_stats_linktype(netdissect_options *ndo, int dlt)
+{
+	struct protostats_state *st = protostats_state(ndo);
+
+	st->link = pcap_datalink_val_to_name(dlt);
+	if (st->link == NULL) {
+		snprintf(st->linkbuf, sizeof(st->linkbuf), "DLT %d", dlt);
+		st->link = st->linkbuf;
+	}
+}
+
+/*
+ * Add the packet being dissected to the counts of "name", carried in
+ * the protocol it has got to.  A layer with the same name as the one
+ * it's carried in, as when IPv4 is named both by its Ethernet type and
+ * by ip_print(), is the same layer.
+ */
+void
+protostats_layer(netdissect_options *ndo, const char *name)
+{
+	struct protostats_state *st = ndo->ndo_protostats;
+	struct ps_node *n, **pp;
+
+	if (st == NULL || st->cur == NULL ||
+	    st->depth >= PROTOSTATS_MAX_DEPTH ||
+	    (st->cur->name != NULL && strcmp(st->cur->name, name) == 0))
+		return;
+	for (pp = &st->cur->child; (n = *pp) != NULL; pp = &n->next) {
+		if (strcmp(n->name, name) == 0) {
+			/* Move it to the front; paths repeat */
+			*pp = n->next;
+			break;
+		}
+	}
+	if (n == NULL) {
+		n = calloc(1, sizeof(*n));
+		if (n == NULL || (n->name = strdup(name)) == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+			    "protostats_layer: malloc");
+	}
+	n->next = st->cur->child;
+	st->cur->child = n;
+	n->packets++;
+	n->bytes += st->len;
+	st->cur = n;
+	st->depth++;
+}
+
+/* The printers' output, thrown away */
+static int
+protostats_printf(netdissect_options *ndo _U_, const char *fmt _U_, ...)
+{
+	return (0);
+}
+
+/*
+ * Count a packet, instead of printing it; called by
+ * pretty_print_packet().
+ */
+void
+protostats_packet(netdissect_options *ndo, const struct pcap_pkthdr *h,
+    const u_char *sp)
+{
+	struct protostats_state *st = protostats_state(ndo);
+	int (*saved_printf)(netdissect_options *, const char *, ...);
+	u_int interval = ndo->ndo_proto_stats_interval;
+
+	if (interval != 0) {
+		if (st->next_report == 0)
+			st->next_report = h->ts.tv_sec - h->ts.tv_sec % interval +
+			    interval;
+		else if (h->ts.tv_sec >= st->next_report) {
+			struct timeval tv;
+
+			tv.tv_sec = st->next_report;
+			tv.tv_usec = 0;
+			ts_print(ndo, &tv);
+			ND_PRINT("protocol statistics so far:\n");
+			nd_print_proto_stats(ndo);
+			st->next_report = h->ts.tv_sec -
+			    h->ts.tv_sec % interval + interval;
+		}
+	}
+
+	st->root.packets++;
+	st->root.bytes += h->len;
+	st->cur = &st->root;
+	st->depth = 0;
+	st->len = h->len;
+	protostats_layer(ndo, st->link);
+
+	/* Only dissect packets pretty_print_packet() would have */
+	if (h->caplen == 0 || h->len == 0 || h->len < h->caplen ||
+	    h->caplen > MAXIMUM_SNAPLEN || h->len > MAXIMUM_SNAPLEN) {
+		st->cur = NULL;
+		return;
+	}
+
+	ndo->ndo_ts = h->ts;
+	ndo->ndo_snapend = sp + h->caplen;
+	ndo->ndo_protocol = "";
+	ndo->ndo_ll_header_length = 0;
+	saved_printf = ndo->ndo_printf;
+	ndo->ndo_printf = protostats_printf;
+	if (setjmp(ndo->ndo_truncated) == 0) {
+		if (ndo->ndo_void_printer == TRUE)
+			(ndo->ndo_if_printer.void_printer)(ndo, h, sp);
+		else
+			(void)(ndo->ndo_if_printer.uint_printer)(ndo, h, sp);
+	}
+	ndo->ndo_printf = saved_printf;
+	/* Not st, which a longjmp() could have clobbered */
+	ndo->ndo_protostats->cur = NULL;
+
+	nd_pop_all_packet_info(ndo);
+	ndo->ndo_snapend = sp + h->caplen;
+	nd_free_all(ndo);
+	addrtoname_trim(ndo);
+}
+
+/* Most packets first, then by name */
+static int
+ps_node_cmp(const void *a, const void *b)
+{
+	const struct ps_node *na = *(const struct ps_node * const *)a;
+	const struct ps_node *nb = *(const struct ps_node * const *)b;
+
+	if (na->packets != nb->packets)
+		return (na->packets > nb->packets ? -1 : 1);
+	return (strcmp(na->name, nb->name));
+}
+
+static void
+ps_print_children(netdissect_options *ndo, const struct ps_node *parent,
+    u_int depth, uint64_t total)
+{
+	const struct ps_node **sorted, *n;
+	u_int count, i, width;
+
+	count = 0;
+	for (n = parent->child; n != NULL; n = n->next)
+		count++;
+	if (count == 0)
+		return;
+	sorted = malloc(count * sizeof(*sorted));
+	if (sorted == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+		    "ps_print_children: malloc");
+	for (i = 0, n = parent->child; n != NULL; n = n->next)
+		sorted[i++] = n;
+	qsort(sorted, count, sizeof(*sorted), ps_node_cmp);
+
+	for (i = 0; i < count; i++) {
+		n = sorted[i];
+		width = 2 * depth < PROTOSTATS_NAME_WIDTH ?
+		    PROTOSTATS_NAME_WIDTH - 2 * depth : 0;
+		ND_PRINT("%*s%-*s %12" PRIu64 " %15" PRIu64 " %6.2f%%\n",
+		    (int)(2 * depth), "", (int)width, n->name, n->packets,
+		    n->bytes, 100.0 * n->packets / total);
+		ps_print_children(ndo, n, depth + 1, total);
+	}
+	free(sorted);
+}
+
+/*
+ * Print the counts of each protocol path seen so far, as a tree, each
+ * protocol indented under the one carrying it.
+ */
+void
+nd_print_proto_stats(netdissect_options *ndo)
+{
+	struct protostats_state *st = protostats_state(ndo);
+
+	ND_PRINT("%-*s %12s %15s %7s\n", PROTOSTATS_NAME_WIDTH, "protocol",
+	    "packets", "bytes", "%");
+	ps_print_children(ndo, &st->root, 0,
+	    st->root.packets != 0 ? st->root.packets : 1);
+	ND_PRINT("%-*s %12" PRIu64 " %15" PRIu64 "\n", PROTOSTATS_NAME_WIDTH,
+	    "total", st->root.packets, st->root.bytes);
+}
+
+static void
+ps_free(struct ps_node *n)
+{
+	struct ps_node *next;
+
+	for (; n != NULL; n = next) {
+		next = n->next;
+		ps_free(n->child);
+		free(n->name);
+		free(n);
+	}
+}
+
+void
+protostats_free_state(netdissect_options *ndo)
+{
+	struct protostats_state *st = ndo->ndo_protostats;
+
+	if (st == NULL)
+		return;
+	ps_free(st->root.child);
+	free(st);
+	ndo->ndo_protostats = NULL;
+}
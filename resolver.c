@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Background address to name resolution.
+ *
+ * Addresses are looked up by a fixed number of threads, so no more than
+ * that many lookups are ever outstanding.  The addresses waiting for a
+ * thread are in a bounded queue; if it's full, an address isn't queued,
+ * and is tried again the next time it's seen.
+ *
+ * Each address queued gets an entry in a hash table, which then holds
+ * the result: the name, or that there's none.  Failures are kept like
+ * names, so an address with no name is only looked up once.  An address
+ * still unresolved after the timeout is treated as having no name; if
+ * it's still waiting for a thread, it's never looked up, and if it's
+ * being looked up, the answer is kept if it comes, for the lookups
+ * that haven't given up on it yet.  When all the entries are in use,
+ * the oldest finished ones are reused.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netdissect.h"
+#include "resolver.h"
+
+int nd_resolver_running;	/* nd_resolver_start() was called */
+
+#ifdef HAVE_LIBPTHREAD
+
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#define RESOLVER_ENTRIES	16384	/* results kept */
+#define RESOLVER_BUCKETS	32768	/* hash chains; a power of 2 */
+#define RESOLVER_QUEUE_MAX	1024	/* addresses waiting for a thread */
+#define RESOLVER_REUSE_SCAN	64	/* entries tried when reusing one */
+
+enum res_state {
+	RES_QUEUED,		/* waiting for, or being looked up by, a thread */
+	RES_FOUND,		/* name is the name */
+	RES_NONE		/* no name, or none in time */
+};
+
+struct res_entry {
+	uint32_t next;		/* next in the hash chain; 0 if none */
+	uint8_t af;		/* AF_INET or AF_INET6; 0 if unused */
+	uint8_t state;		/* enum res_state */
+	uint8_t busy;		/* a thread is looking it up */
+	u_char addr[16];
+	uint64_t deadline;	/* when to give up, in ms */
+	char *name;		/* if RES_FOUND */
+};
+
+/*
+ * Entries are referred to by number, their index in entries[] plus 1,
+ * so that 0 can mean none.  Everything is protected by res_lock.
+ */
+static pthread_mutex_t res_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t res_cv = PTHREAD_COND_INITIALIZER;
+static struct res_entry *entries;
+static uint32_t *buckets;
+static u_int nmade;			/* entries used so far */
+static u_int reuse;			/* where to look for one to reuse */
+static uint32_t queue[RESOLVER_QUEUE_MAX];
+static u_int qhead, qtail;
+static uint32_t seed;
+static u_int timeout_ms;
+static nd_resolve_func resolve;
+static void *resolve_arg;
+static struct nd_resolver_stats stats;
+
+static uint64_t
+now_ms(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+		return ((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+#endif
+	return ((uint64_t)time(NULL) * 1000);
+}
+
+static u_int
+addr_len(int af)
+{
+	return (af == AF_INET6 ? 16 : 4);
+}
+
+static uint32_t
+res_hash(int af, const u_char *addr)
+{
+	uint64_t h, w;
+	uint32_t w4;
+
+	h = seed ^ (uint64_t)af;
+	if (af == AF_INET6) {
+		memcpy(&w, addr, 8);
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+		memcpy(&w, addr + 8, 8);
+		h ^= w;
+	} else {
+		memcpy(&w4, addr, 4);
+		h ^= w4;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return ((uint32_t)h & (RESOLVER_BUCKETS - 1));
+}
+
+static uint32_t
+res_find(int af, const u_char *addr, uint32_t bucket)
+{
+	const struct res_entry *e;
+	uint32_t n;
+
+	for (n = buckets[bucket]; n != 0; n = e->next) {
+		e = &entries[n - 1];
+		if (e->af == af && memcmp(e->addr, addr, addr_len(af)) == 0)
+			return (n);
+	}
+	return (0);
+}
+
+/*
+ * Get an entry for a new address: an unused one, or else the first
+ * finished one found after the last one reused.  Returns 0 if there's
+ * none to be had.
+ */
+static uint32_t
+res_alloc(void)
+{
+	struct res_entry *e;
+	uint32_t n, *np;
+	u_int i;
+
+	if (nmade < RESOLVER_ENTRIES)
+		return (++nmade);
+	for (i = 0; i < RESOLVER_REUSE_SCAN; i++) {
+		n = reuse + 1;
+		reuse = (reuse + 1) % RESOLVER_ENTRIES;
+		e = &entries[n - 1];
+		if (e->state == RES_QUEUED || e->busy)
+			continue;
+		for (np = &buckets[res_hash(e->af, e->addr)]; *np != n;
+		     np = &entries[*np - 1].next)
+			;
+		*np = e->next;
+		free(e->name);
+		e->name = NULL;
+		return (n);
+	}
+	return (0);
+}
+
+static void *
+resolver_main(void *arg _U_)
+{
+	struct res_entry *e;
+	char name[NI_MAXHOST];
+	u_char addr[16];
+	uint32_t n;
+	char *copy;
+	int af, r;
+
+	pthread_mutex_lock(&res_lock);
+	for (;;) {
+		while (qhead == qtail)
+			pthread_cond_wait(&res_cv, &res_lock);
+		n = queue[qhead % RESOLVER_QUEUE_MAX];
+		qhead++;
+		e = &entries[n - 1];
+		/*
+		 * It may have given up waiting, and even been reused for
+		 * an address that's queued again, or being looked up.
+		 */
+		if (e->state != RES_QUEUED || e->busy)
+			continue;
+		if (now_ms() >= e->deadline) {
+			e->state = RES_NONE;
+			stats.timed_out++;
+			continue;
+		}
+		e->busy = 1;
+		af = e->af;
+		memcpy(addr, e->addr, addr_len(af));
+		pthread_mutex_unlock(&res_lock);
+
+		r = (*resolve)(af, addr, name, sizeof(name), resolve_arg);
+		copy = r == 0 ? strdup(name) : NULL;
+
+		pthread_mutex_lock(&res_lock);
+		e->busy = 0;
+		if (e->state == RES_QUEUED) {
+			if (copy != NULL)
+				stats.found++;
+			else
+				stats.failed++;
+		}
+		/* Keep a name that came too late, for the lookups to come */
+		if (copy != NULL) {
+			e->name = copy;
+			e->state = RES_FOUND;
+		} else
+			e->state = RES_NONE;
+	}
+	/* NOTREACHED */
+	return (NULL);
+}
+
+/*
+ * Start nthreads resolver threads, looking names up with func and
+ * giving up on them after timeout milliseconds, and have ipaddr_string()
+ * and ip6addr_string() use them.  Returns 0 on success, -1 with a
+ * message in errbuf on failure.
+ *
+ * The threads run until the process exits; one may be waiting for an
+ * answer that never comes.
+ */
+int
+nd_resolver_start(u_int nthreads, u_int timeout, nd_resolve_func func,
+		  void *arg, char *errbuf, size_t errbuf_size)
+{
+	pthread_t thread;
+	pthread_attr_t attr;
+	sigset_t all, old;
+	u_int i;
+	int err;
+
+	if (nd_resolver_running) {
+		snprintf(errbuf, errbuf_size, "resolver already started");
+		return (-1);
+	}
+	if (nthreads < 1 || nthreads > RESOLVER_THREADS_MAX) {
+		snprintf(errbuf, errbuf_size,
+		    "invalid number of resolver threads %u", nthreads);
+		return (-1);
+	}
+	entries = calloc(RESOLVER_ENTRIES, sizeof(*entries));
+	buckets = calloc(RESOLVER_BUCKETS, sizeof(*buckets));
+	if (entries == NULL || buckets == NULL) {
+		snprintf(errbuf, errbuf_size, "%s: calloc", __func__);
+		free(entries);
+		free(buckets);
+		return (-1);
+	}
+	/* Not secret, but it can't be known before tcpdump starts */
+	seed = (uint32_t)time(NULL) ^ (uint32_t)(uintptr_t)entries;
+	timeout_ms = timeout;
+	resolve = func;
+	resolve_arg = arg;
+
+	/* The threads inherit this; signals are for the main thread. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for (i = 0; i < nthreads; i++) {
+		err = pthread_create(&thread, &attr, resolver_main, NULL);
+		if (err != 0) {
+			snprintf(errbuf, errbuf_size,
+			    "can't create resolver thread: %s", strerror(err));
+			break;
+		}
+	}
+	pthread_attr_destroy(&attr);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (i == 0)
+		return (-1);
+	/* With some of the threads, it still works. */
+	nd_resolver_running = 1;
+	return (0);
+}
+
+/*
+ * Look up the name of an AF_INET or AF_INET6 address: copy it to name
+ * and return RESOLVER_FOUND, or return RESOLVER_NONE if there's none,
+ * or return RESOLVER_PENDING, queueing the address if it isn't already,
+ * if that isn't known yet.
+ */
+int
+nd_resolver_lookup(int af, const void *addr, char *name, size_t namesize)
+{
+	struct res_entry *e;
+	uint32_t bucket, n;
+	int r;
+
+	bucket = res_hash(af, addr);
+	pthread_mutex_lock(&res_lock);
+	n = res_find(af, addr, bucket);
+	if (n != 0) {
+		e = &entries[n - 1];
+		switch (e->state) {
+
+		case RES_FOUND:
+			strlcpy(name, e->name, namesize);
+			r = RESOLVER_FOUND;
+			break;
+
+		case RES_QUEUED:
+			if (now_ms() < e->deadline) {
+				r = RESOLVER_PENDING;
+				break;
+			}
+			e->state = RES_NONE;
+			stats.timed_out++;
+			/* FALLTHROUGH */
+
+		default:
+			r = RESOLVER_NONE;
+			break;
+		}
+		pthread_mutex_unlock(&res_lock);
+		return (r);
+	}
+
+	if (qtail - qhead == RESOLVER_QUEUE_MAX ||
+	    (n = res_alloc()) == 0) {
+		stats.dropped++;
+		pthread_mutex_unlock(&res_lock);
+		return (RESOLVER_PENDING);
+	}
+	e = &entries[n - 1];
+	e->af = (uint8_t)af;
+	e->state = RES_QUEUED;
+	memcpy(e->addr, addr, addr_len(af));
+	e->deadline = now_ms() + timeout_ms;
+	e->next = buckets[bucket];
+	buckets[bucket] = n;
+	queue[qtail % RESOLVER_QUEUE_MAX] = n;
+	qtail++;
+	stats.queued++;
+	pthread_cond_signal(&res_cv);
+	pthread_mutex_unlock(&res_lock);
+	return (RESOLVER_PENDING);
+}
+
+void
+nd_resolver_get_stats(struct nd_resolver_stats *statsp)
+{
+	pthread_mutex_lock(&res_lock);
+	*statsp = stats;
+	pthread_mutex_unlock(&res_lock);
+}
+
+/*
+ * The nd_resolve_func that uses the system's resolver.
+ */
+int
+nd_resolve_getnameinfo(int af, const void *addr, char *name, size_t namesize,
+		       void *arg _U_)
+{
+	struct sockaddr_storage ss;
+	struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+	socklen_t sslen;
+
+	memset(&ss, 0, sizeof(ss));
+	if (af == AF_INET6) {
+		sin6->sin6_family = AF_INET6;
+		memcpy(&sin6->sin6_addr, addr, sizeof(sin6->sin6_addr));
+		sslen = sizeof(*sin6);
+	} else {
+		sin->sin_family = AF_INET;
+		memcpy(&sin->sin_addr, addr, sizeof(sin->sin_addr));
+		sslen = sizeof(*sin);
+	}
+	if (getnameinfo((struct sockaddr *)&ss, sslen, name, (socklen_t)namesize,
+	    NULL, 0, NI_NAMEREQD) != 0)
+		return (-1);
+	return (0);
+}
+#endif /* HAVE_LIBPTHREAD */
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef netdissect_resolver_h
+#define netdissect_resolver_h
+
+/*
+ * Looking up the names of IPv4 and IPv6 addresses in the background
+ * (--resolver-threads).
+ *
+ * Once nd_resolver_start() has been called, ipaddr_string() and
+ * ip6addr_string() no longer wait for the name of an address they
+ * haven't seen before: they queue the address to a pool of resolver
+ * threads and print it as a number until the name is in.  The results,
+ * names found and addresses with none, are kept for the process, so
+ * that all the netdissect_options in it, such as those of the
+ * --workers threads, share them.
+ *
+ * If we don't have both <pthread.h> and the threads library, undefine
+ * HAVE_LIBPTHREAD, so that later tests are done only on HAVE_LIBPTHREAD.
+ */
+#ifndef HAVE_PTHREAD_H
+#undef HAVE_LIBPTHREAD
+#endif
+
+/* What nd_resolver_lookup() found */
+#define RESOLVER_FOUND		0	/* the name; it's been copied out */
+#define RESOLVER_PENDING	1	/* not yet; print the number for now */
+#define RESOLVER_NONE		2	/* no name, or the lookup timed out */
+
+/*
+ * Look up the name of an AF_INET or AF_INET6 address, copying it to
+ * name; returns 0 if one was found, -1 otherwise.  This is called
+ * from the resolver threads, several at once.
+ */
+typedef int (*nd_resolve_func)(int, const void *, char *, size_t, void *);
+
+struct nd_resolver_stats {
+	uint64_t queued;	/* addresses queued for lookup */
+	uint64_t found;		/* ...whose name was found */
+	uint64_t failed;	/* ...which had no name */
+	uint64_t timed_out;	/* ...not looked up in time */
+	uint64_t dropped;	/* addresses not queued, the queue being full */
+};
+
+#ifdef HAVE_LIBPTHREAD
+/* Most resolver threads nd_resolver_start() accepts */
+#define RESOLVER_THREADS_MAX	64
+
+extern int nd_resolver_start(u_int, u_int, nd_resolve_func, void *,
+    char *, size_t);
+extern int nd_resolver_lookup(int, const void *, char *, size_t);
+extern void nd_resolver_get_stats(struct nd_resolver_stats *);
+extern int nd_resolve_getnameinfo(int, const void *, char *, size_t, void *);
+#endif /* HAVE_LIBPTHREAD */
+
+extern int nd_resolver_running;
+
+#endif /* netdissect_resolver_h */
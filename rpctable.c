@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Table of requests, for matching replies to them.
+ *
+ * The requests of all kinds are in one hash table on their kind and
+ * key, which doubles in size as it fills, and in a list, least recently
+ * used first, from which they're forgotten when they've been idle too
+ * long or when there are too many of them.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "netdissect.h"
+#include "rpctable.h"
+
+#define RPCTABLE_HASH_MIN	256
+
+struct rpc_entry {
+	struct rpc_entry *hnext;	/* next in the hash chain */
+	struct rpc_entry *prev;		/* used less recently */
+	struct rpc_entry *next;		/* used more recently */
+	struct timeval last_ts;		/* time stamp of the last use */
+	u_int kind;
+	u_int keylen;
+	u_char key[RPCTABLE_KEYLEN];
+	union {
+		uint64_t align;		/* for the structures put in it */
+		u_char bytes[RPCTABLE_VALLEN];
+	} val;
+};
+
+struct rpctable_state {
+	struct rpc_entry **hash;
+	u_int hash_size;	/* a power of 2 */
+	struct rpc_entry *oldest;
+	struct rpc_entry *newest;
+	struct nd_rpc_table_stats stats;
+};
+
+static struct rpctable_state *
+rpctable_state(netdissect_options *ndo)
+{
+	struct rpctable_state *st = ndo->ndo_rpctable;
+
+	if (st == NULL) {
+		st = calloc(1, sizeof(*st));
+		if (st == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+			    "rpctable_state: calloc");
+		ndo->ndo_rpctable = st;
+		st->hash_size = RPCTABLE_HASH_MIN;
+		st->hash = calloc(st->hash_size, sizeof(*st->hash));
+		if (st->hash == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+			    "rpctable_state: calloc");
+		st->stats.bytes = sizeof(*st) +
+		    st->hash_size * sizeof(*st->hash);
+	}
+	return st;
+}
+
+static u_int
+rpc_hash(u_int kind, const u_char *key, u_int keylen)
+{
+	uint32_t h = 2166136261U ^ kind;
+	u_int i;
+
+	for (i = 0; i < keylen; i++)
+		h = (h ^ key[i]) * 16777619U;
+	return h;
+}
+
+static void
+rpc_unlink(struct rpctable_state *st, struct rpc_entry *e)
+{
+	if (e->prev != NULL)
+		e->prev->next = e->next;
+	else
+		st->oldest = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+	else
+		st->newest = e->prev;
+}
+
+static void
+rpc_link(struct rpctable_state *st, struct rpc_entry *e)
+{
+	e->next = NULL;
+	e->prev = st->newest;
+	if (st->newest != NULL)
+		st->newest->next = e;
+	else
+		st->oldest = e;
+	st->newest = e;
+}
+
+static void
+rpc_free(struct rpctable_state *st, struct rpc_entry *e)
+{
+	struct rpc_entry **pp;
+
+	pp = &st->hash[rpc_hash(e->kind, e->key, e->keylen) &
+	    (st->hash_size - 1)];
+	while (*pp != e)
+		pp = &(*pp)->hnext;
+	*pp = e->hnext;
+	rpc_unlink(st, e);
+	st->stats.entries--;
+	st->stats.bytes -= sizeof(*e);
+	free(e);
+}
+
+/* Forget the requests idle too long */
+static void
+rpc_expire(netdissect_options *ndo, struct rpctable_state *st)
+{
+	struct rpc_entry *e;
+	time_t timeout, secs;
+
+	timeout = ndo->ndo_rpc_table_timeout != 0 ?
+	    ndo->ndo_rpc_table_timeout : RPCTABLE_TIMEOUT_DEFAULT;
+	while ((e = st->oldest) != NULL) {
+		secs = ndo->ndo_ts.tv_sec - e->last_ts.tv_sec;
+		if (secs < timeout || (secs == timeout &&
+		    ndo->ndo_ts.tv_usec <= e->last_ts.tv_usec))
+			break;
+		st->stats.timed_out++;
+		rpc_free(st, e);
+	}
+}
+
+static void
+rpc_grow(netdissect_options *ndo, struct rpctable_state *st)
+{
+	struct rpc_entry **hash, *e, *enext;
+	u_int size, b, i;
+
+	size = st->hash_size * 2;
+	hash = calloc(size, sizeof(*hash));
+	if (hash == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC, "rpc_grow: calloc");
+	for (i = 0; i < st->hash_size; i++) {
+		for (e = st->hash[i]; e != NULL; e = enext) {
+			enext = e->hnext;
+			b = rpc_hash(e->kind, e->key, e->keylen) & (size - 1);
+			e->hnext = hash[b];
+			hash[b] = e;
+		}
+	}
+	free(st->hash);
+	st->stats.bytes += (size - st->hash_size) * sizeof(*hash);
+	st->hash = hash;
+	st->hash_size = size;
+}
+
+static struct rpc_entry *
+rpc_lookup(netdissect_options *ndo, struct rpctable_state *st, u_int kind,
+    const void *key, u_int keylen)
+{
+	struct rpc_entry *e;
+	u_int chain;
+
+	rpc_expire(ndo, st);
+	chain = 0;
+	for (e = st->hash[rpc_hash(kind, key, keylen) & (st->hash_size - 1)];
+	    e != NULL; e = e->hnext) {
+		chain++;
+		if (e->kind == kind && e->keylen == keylen &&
+		    memcmp(e->key, key, keylen) == 0)
+			break;
+	}
+	st->stats.lookups++;
+	st->stats.probes += chain;
+	if (chain > st->stats.longest_chain)
+		st->stats.longest_chain = chain;
+	if (e != NULL) {
+		rpc_unlink(st, e);
+		rpc_link(st, e);
+		e->last_ts = ndo->ndo_ts;
+	}
+	return e;
+}
+
+/*
+ * Enter a request of the given kind under "key", replacing any request
+ * already entered under it, and return its value, zeroed, for the
+ * printer to fill in.
+ */
+void *
+rpctable_enter(netdissect_options *ndo, u_int kind, const void *key,
+    u_int keylen)
+{
+	struct rpctable_state *st = rpctable_state(ndo);
+	struct rpc_entry *e;
+	u_int max, b;
+
+	if (kind >= RPCTABLE_KINDS || keylen > RPCTABLE_KEYLEN)
+		return NULL;
+	st->stats.entered[kind]++;
+	e = rpc_lookup(ndo, st, kind, key, keylen);
+	if (e == NULL) {
+		/* Stay within the limit, forgetting the idlest requests */
+		max = ndo->ndo_rpc_table_max != 0 ?
+		    ndo->ndo_rpc_table_max : RPCTABLE_MAX_DEFAULT;
+		while (st->stats.entries >= max && st->oldest != NULL) {
+			st->stats.evicted++;
+			rpc_free(st, st->oldest);
+		}
+
+		e = malloc(sizeof(*e));
+		if (e == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+			    "rpctable_enter: malloc");
+		e->kind = kind;
+		e->keylen = keylen;
+		memcpy(e->key, key, keylen);
+		e->last_ts = ndo->ndo_ts;
+		b = rpc_hash(kind, key, keylen) & (st->hash_size - 1);
+		e->hnext = st->hash[b];
+		st->hash[b] = e;
+		rpc_link(st, e);
+		st->stats.entries++;
+		st->stats.bytes += sizeof(*e);
+		if (st->stats.entries > st->hash_size)
+			rpc_grow(ndo, st);
+	}
+	memset(&e->val, 0, sizeof(e->val));
+	return &e->val;
+}
+
+/*
+ * Return the value of the request of the given kind entered under
+ * "key", or NULL if there's none.
+ */
+void *
+rpctable_find(netdissect_options *ndo, u_int kind, const void *key,
+    u_int keylen)
+{
+	struct rpctable_state *st;
+	struct rpc_entry *e;
+
+	if (kind >= RPCTABLE_KINDS || keylen > RPCTABLE_KEYLEN)
+		return NULL;
+	st = rpctable_state(ndo);
+	e = rpc_lookup(ndo, st, kind, key, keylen);
+	if (e == NULL) {
+		st->stats.misses[kind]++;
+		return NULL;
+	}
+	st->stats.hits[kind]++;
+	return &e->val;
+}
+
+void
+nd_get_rpc_table_stats(netdissect_options *ndo,
+    struct nd_rpc_table_stats *stats)
+{
+	struct rpctable_state *st = ndo->ndo_rpctable;
+
+	if (st == NULL) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+	*stats = st->stats;
+}
+
+void
+rpctable_free_state(netdissect_options *ndo)
+{
+	struct rpctable_state *st = ndo->ndo_rpctable;
+	struct rpc_entry *e, *enext;
+
+	if (st == NULL)
+		return;
+	for (e = st->oldest; e != NULL; e = enext) {
+		enext = e->next;
+		free(e);
+	}
+	free(st->hash);
+	free(st);
+	ndo->ndo_rpctable = NULL;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef netdissect_rpctable_h
+#define netdissect_rpctable_h
+
+/*
+ * Table of the requests seen, for printers that need a request to make
+ * sense of its reply: the NFS calls, for their procedure and version,
+ * the AFS Rx calls, for their opcode, and the ISAKMP initiators, for
+ * who started an exchange.
+ *
+ * A printer enters a request under a key of its own making, with the
+ * kind of request, and gets back the value to fill in; looking up the
+ * reply's key gets that value back.  Requests not looked up for
+ * ndo_rpc_table_timeout seconds, in packet time stamps, are forgotten,
+ * as are those looked up least recently when there are more than
+ * ndo_rpc_table_max.
+ */
+
+/* Kinds of request */
+#define RPCTABLE_NFS		0
+#define RPCTABLE_RX		1
+#define RPCTABLE_ISAKMP		2
+#define RPCTABLE_KINDS		ND_RPC_KINDS
+
+#define RPCTABLE_KEYLEN		40	/* longest key */
+#define RPCTABLE_VALLEN		40	/* longest value */
+
+#define RPCTABLE_MAX_DEFAULT		65536
+#define RPCTABLE_TIMEOUT_DEFAULT	600
+
+extern void *rpctable_enter(netdissect_options *, u_int, const void *, u_int);
+extern void *rpctable_find(netdissect_options *, u_int, const void *, u_int);
+
+#endif /* netdissect_rpctable_h */
@@ -22,9 +22,9 @@
 #include "extract.h"
 #include "smb.h"
 
-static int stringlen_is_set;
-static uint32_t stringlen;
-extern const u_char *startbuf;
+static ND_THREAD_LOCAL int stringlen_is_set;
+static ND_THREAD_LOCAL uint32_t stringlen;
+extern ND_THREAD_LOCAL const u_char *startbuf;
 
 /*
  * Reset SMB state.
@@ -798,7 +798,8 @@ smb_fdata1(netdissect_options *ndo,
 	case 'T':
 	  {
 	    time_t t;
-	    struct tm *lt;
+	    struct tm tmbuf, *lt;
+	    char tbuf[32];
 	    const char *tstring;
 	    uint32_t x;
 
@@ -831,10 +832,12 @@ smb_fdata1(netdissect_options *ndo,
 		break;
 	    }
 	    if (t != 0) {
-		lt = localtime(&t);
-		if (lt != NULL)
-		    tstring = asctime(lt);
-		else
+		lt = nd_localtime(&t, &tmbuf);
+		if (lt != NULL) {
+		    /* asctime() format, without its static buffer */
+		    strftime(tbuf, sizeof(tbuf), "%a %b %e %H:%M:%S %Y\n", lt);
+		    tstring = tbuf;
+		} else
 		    tstring = "(Can't convert time)\n";
 	    } else
 		tstring = "NULL\n";
@@ -866,7 +869,7 @@ smb_fdata(netdissect_options *ndo,
           const u_char *buf, const char *fmt, const u_char *maxbuf,
           int unicodestr)
 {
-    static int depth = 0;
+    static ND_THREAD_LOCAL int depth = 0;
     char s[128];
     char *p;
 
@@ -1096,7 +1099,7 @@ static const struct {
 const char *
 smb_errstr(int class, int num)
 {
-    static char ret[128];
+    static ND_THREAD_LOCAL char ret[128];
     int i, j;
 
     ret[0] = 0;
@@ -1988,7 +1991,7 @@ static const nt_err_code_struct nt_errors[] = {
 const char *
 nt_errstr(uint32_t err)
 {
-    static char ret[128];
+    static ND_THREAD_LOCAL char ret[128];
     int i;
 
     ret[0] = 0;
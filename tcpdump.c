@@ -67,6 +67,10 @@ The Regents of the University of California.  All rights reserved.\n";
 #include <fcntl.h>
 #endif
 
+#if defined(HAVE_LIBPTHREAD) && !defined(_WIN32)
+#include <pthread.h>
+#endif
+
 #ifdef HAVE_LIBCRYPTO
 #include <openssl/crypto.h>
 #endif
@@ -142,6 +146,7 @@ The Regents of the University of California.  All rights reserved.\n";
 #endif /* __FreeBSD__ */
 
 #include "netdissect.h"
+#include "netdissect-ctype.h"
 #include "interface.h"
 #include "addrtoname.h"
 #include "machdep.h"
@@ -152,6 +157,18 @@ The Regents of the University of California.  All rights reserved.\n";
 
 #include "fptype.h"
 
+#include "workers.h"
+#include "chunks.h"
+#include "zfile.h"
+#include "merge.h"
+#include "mfile.h"
+#include "tsindex.h"
+#include "flowhash.h"
+#include "namemap.h"
+#include "ipreasm.h"
+#include "tcpreasm.h"
+#include "resolver.h"
+
 #ifndef PATH_MAX
 #define PATH_MAX 1024
 #endif
@@ -199,6 +216,7 @@ int dflag;				/* print filter code */
 static int Gflag;			/* rotate dump files after this many seconds */
 static int Gflag_count;			/* number of files created with Gflag rotation */
 static time_t Gflag_time;		/* The last time_t the dump file was rotated. */
+static int rotation_clock = -1;		/* --rotation-clock, -1 for the default */
 static int Lflag;			/* list available data link types and exit */
 static int Iflag;			/* rfmon (monitor) mode */
 #ifdef HAVE_PCAP_SET_TSTAMP_TYPE
@@ -216,15 +234,50 @@ static int Uflag;			/* "unbuffered" output of dump files */
 static int Wflag;			/* recycle output files after this number of files */
 static int WflagChars;
 static char *zflag = NULL;		/* compress each savefile using a specified command (like gzip or bzip2) */
+static int compress_method = ZFILE_NONE;	/* --compress */
+static int compress_level = -1;		/* its level, -1 for the default */
+static int mmap_flag;			/* --mmap: read savefiles from a mapping */
+static int merge_flag;			/* --merge: merge savefiles by time stamp */
+static int chunks_count;		/* --chunks: dissection threads, 0 if none */
+static size_t chunk_size;		/* --chunks: size of a chunk, in bytes */
+static int index_flag;			/* --index: index the savefiles written */
+static int index_build;			/* --index with no -w: index those read */
+static uint64_t range_start = TSINDEX_NONE;	/* --start-time, in ns */
+static uint64_t range_end = TSINDEX_NONE;	/* --end-time, in ns */
+static uint64_t range_skip;		/* --skip: packets still to skip */
+static int range_flag;			/* any of those three */
+static int range_filtered;		/* there's a filter expression */
+static uint64_t range_stop = TSINDEX_NONE;	/* where to stop reading */
+static int range_stopped;		/* we stopped reading there */
+static int range_cnt = -1;		/* -c, with any of those */
+static int range_count;			/* packets passed on */
+static pcap_handler range_callback;	/* to pass them on to */
+static int nano_tstamps;		/* time stamps are read in ns */
+static u_int sample_every;		/* --sample: dissect 1 in N packets */
+static u_int sample_rate;		/* --sample-rate: N packets a second */
+static u_int sample_flows;		/* --sample-flows: 1 in N flows */
+static int sample_flag;			/* any of those three */
+static int sample_linktype;		/* of the packets, for flow_hash() */
+static u_int sample_count;		/* packets since the last one sampled */
+static time_t sample_sec;		/* second sample_in_sec is for */
+static u_int sample_in_sec;		/* packets sampled in that second */
+static u_int packets_sampled;
 static int timeout = 1000;		/* default timeout = 1000 ms = 1 s */
 #ifdef HAVE_PCAP_SET_IMMEDIATE_MODE
 static int immediate_mode;
 #endif
 static int count_mode;
+#ifdef HAVE_LIBPTHREAD
+static int workers_count;		/* --workers: dissection threads, 0 if none */
+static u_int resolver_threads;		/* --resolver-threads, 0 if none */
+static u_int resolver_timeout = 5;	/* --resolver-timeout, in seconds */
+#endif
 
 static int infodelay;
 static int infoprint;
 
+static netdissect_options *gndo;	/* to write its buffered output on exit */
+
 char *program_name;
 
 #ifdef HAVE_CASPER
@@ -254,7 +307,19 @@ static NORETURN void show_remote_devices_and_exit(void);
 static void print_packet(u_char *, const struct pcap_pkthdr *, const u_char *);
 static void dump_packet_and_trunc(u_char *, const struct pcap_pkthdr *, const u_char *);
 static void dump_packet(u_char *, const struct pcap_pkthdr *, const u_char *);
+static void dissect_packet(netdissect_options *, const struct pcap_pkthdr *, const u_char *);
+static void range_packet(u_char *, const struct pcap_pkthdr *, const u_char *);
+static int sample_packet(const struct pcap_pkthdr *, const u_char *);
 static void droproot(const char *, const char *);
+static void savefile_helper_stop(void);
+static pcap_dumper_t *dump_fdopen_pcap(pcap_t *, int, const char *);
+static struct tsindex_writer *dump_index_open(void);
+struct dump_info;
+static void dump_index_close(struct dump_info *, struct tsindex_writer *,
+    const char *);
+#ifdef HAVE_PCAP_DUMP_FLUSH
+static void dump_flush(pcap_dumper_t *);
+#endif
 
 #ifdef SIGNAL_REQ_INFO
 static void requestinfo(int);
@@ -272,6 +337,15 @@ static void flushpcap(int);
 #endif /* _WIN32 */
 
 static void info(int);
+static void alloc_info(void);
+static void name_cache_info(void);
+static void reasm_info(void);
+static void tcp_reasm_info(void);
+static void tcp_seq_info(void);
+static void rpc_table_info(void);
+#ifdef HAVE_LIBPTHREAD
+static void resolver_info(void);
+#endif
 static u_int packets_captured;
 
 #ifdef HAVE_PCAP_FINDALLDEVS
@@ -291,6 +365,24 @@ static const struct tok status_flags[] = {
 #endif
 
 static pcap_t *pd;
+static struct mfile *pd_mfile;		/* pd's savefile, if it's mapped */
+
+/*
+ * The savefiles being merged with --merge; the first is pd, whose filter
+ * is the one in main().
+ */
+struct merge_file {
+	const char *name;
+	pcap_t *pd;
+	struct mfile *mf;
+	struct bpf_program fcode;
+	int dlt;
+	if_printer_t printer;
+	int void_printer;
+};
+static struct merge_file *merge_files;
+static u_int merge_nfiles;
+static struct merge *pd_merge;
 static pcap_dumper_t *pdd = NULL;
 
 static int supports_monitor_mode;
@@ -305,11 +397,37 @@ struct dump_info {
 	pcap_t	*pd;
 	pcap_dumper_t *pdd;
 	netdissect_options *ndo;
+	struct tsindex_writer *index;	/* --index: the current file's */
 #ifdef HAVE_CAPSICUM
 	int	dirfd;
 #endif
+	uint64_t bytes;		/* written to the current file */
+	int	started;	/* a packet has been written */
+	time_t	clock_sec;	/* packet time stamp clock_now was read for */
+	time_t	clock_now;	/* the system time then */
 };
 
+/* What -G rotates on */
+#define ROTATION_CLOCK_SYSTEM	0	/* the system clock */
+#define ROTATION_CLOCK_PACKET	1	/* the packets' time stamps */
+
+/* Bytes pcap_dump() writes in front of each packet */
+#define SF_PKTHDR_LEN		16
+
+/*
+ * With thread support, a helper thread closes (and, with -z,
+ * compresses) the savefiles rotated away from, and creates a spare
+ * file for the next one ahead of time, so that rotating the savefile
+ * only renames the spare and never waits on the file system.
+ */
+#if defined(HAVE_LIBPTHREAD) && !defined(_WIN32)
+#define SAVEFILE_HELPER
+#endif
+
+#ifdef SAVEFILE_HELPER
+static void savefile_helper_start(struct dump_info *);
+#endif
+
 #if defined(HAVE_PCAP_SET_PARSER_DEBUG)
 /*
  * We have pcap_set_parser_debug() in libpcap; declare it (it's not declared
@@ -400,6 +518,10 @@ warning(const char *fmt, ...)
 static void
 exit_tcpdump(int status)
 {
+	savefile_helper_stop();
+	zfile_close_all();
+	if (gndo != NULL)
+		nd_flush_output(gndo);
 	nd_cleanup();
 	exit(status);
 }
@@ -692,6 +814,37 @@ show_remote_devices_and_exit(void)
 #define OPTION_TSTAMP_NANO		134
 #define OPTION_FP_TYPE			135
 #define OPTION_COUNT			136
+#define OPTION_WORKERS			137
+#define OPTION_DECODE_AS		138
+#define OPTION_NAME_CACHE_SIZE		139
+#define OPTION_RESOLVER_THREADS		140
+#define OPTION_RESOLVER_TIMEOUT		141
+#define OPTION_NAME_MAP			142
+#define OPTION_REASSEMBLE		143
+#define OPTION_REASSEMBLY_MEMORY	144
+#define OPTION_REASSEMBLY_TIMEOUT	145
+#define OPTION_REASSEMBLY_OVERLAP	146
+#define OPTION_REASSEMBLE_TCP		147
+#define OPTION_TCP_REASSEMBLY_MEMORY	148
+#define OPTION_TCP_REASSEMBLY_FLOW_MEMORY	149
+#define OPTION_TCP_SEQ_MAX		150
+#define OPTION_TCP_SEQ_TIMEOUT		151
+#define OPTION_RPC_TABLE_SIZE		152
+#define OPTION_RPC_TABLE_TIMEOUT	153
+#define OPTION_ROTATION_CLOCK		154
+#define OPTION_COMPRESS			155
+#define OPTION_MMAP			156
+#define OPTION_MERGE			157
+#define OPTION_CHUNKS			158
+#define OPTION_INDEX			159
+#define OPTION_START_TIME		160
+#define OPTION_END_TIME			161
+#define OPTION_SKIP			162
+#define OPTION_SAMPLE			163
+#define OPTION_SAMPLE_RATE		164
+#define OPTION_SAMPLE_FLOWS		165
+#define OPTION_PROTOCOL_STATS		166
+#define OPTION_PROTOCOL_STATS_INTERVAL	167
 
 static const struct option longopts[] = {
 #if defined(HAVE_PCAP_CREATE) || defined(_WIN32)
@@ -736,10 +889,43 @@ static const struct option longopts[] = {
 #endif
 	{ "relinquish-privileges", required_argument, NULL, 'Z' },
 	{ "count", no_argument, NULL, OPTION_COUNT },
+	{ "decode-as", required_argument, NULL, OPTION_DECODE_AS },
 	{ "fp-type", no_argument, NULL, OPTION_FP_TYPE },
+	{ "name-cache-size", required_argument, NULL, OPTION_NAME_CACHE_SIZE },
+	{ "name-map", required_argument, NULL, OPTION_NAME_MAP },
 	{ "number", no_argument, NULL, '#' },
 	{ "print", no_argument, NULL, OPTION_PRINT },
+	{ "reassemble", no_argument, NULL, OPTION_REASSEMBLE },
+	{ "reassemble-tcp", no_argument, NULL, OPTION_REASSEMBLE_TCP },
+	{ "reassembly-memory", required_argument, NULL, OPTION_REASSEMBLY_MEMORY },
+	{ "reassembly-overlap", required_argument, NULL, OPTION_REASSEMBLY_OVERLAP },
+	{ "reassembly-timeout", required_argument, NULL, OPTION_REASSEMBLY_TIMEOUT },
+	{ "tcp-reassembly-flow-memory", required_argument, NULL, OPTION_TCP_REASSEMBLY_FLOW_MEMORY },
+	{ "tcp-reassembly-memory", required_argument, NULL, OPTION_TCP_REASSEMBLY_MEMORY },
+	{ "tcp-seq-max", required_argument, NULL, OPTION_TCP_SEQ_MAX },
+	{ "tcp-seq-timeout", required_argument, NULL, OPTION_TCP_SEQ_TIMEOUT },
+	{ "rpc-table-size", required_argument, NULL, OPTION_RPC_TABLE_SIZE },
+	{ "rpc-table-timeout", required_argument, NULL, OPTION_RPC_TABLE_TIMEOUT },
+	{ "rotation-clock", required_argument, NULL, OPTION_ROTATION_CLOCK },
+	{ "compress", required_argument, NULL, OPTION_COMPRESS },
+	{ "mmap", no_argument, NULL, OPTION_MMAP },
+	{ "merge", no_argument, NULL, OPTION_MERGE },
+	{ "index", no_argument, NULL, OPTION_INDEX },
+	{ "start-time", required_argument, NULL, OPTION_START_TIME },
+	{ "end-time", required_argument, NULL, OPTION_END_TIME },
+	{ "skip", required_argument, NULL, OPTION_SKIP },
+	{ "sample", required_argument, NULL, OPTION_SAMPLE },
+	{ "sample-rate", required_argument, NULL, OPTION_SAMPLE_RATE },
+	{ "sample-flows", required_argument, NULL, OPTION_SAMPLE_FLOWS },
+	{ "protocol-stats", no_argument, NULL, OPTION_PROTOCOL_STATS },
+	{ "protocol-stats-interval", required_argument, NULL, OPTION_PROTOCOL_STATS_INTERVAL },
 	{ "version", no_argument, NULL, OPTION_VERSION },
+#ifdef HAVE_LIBPTHREAD
+	{ "resolver-threads", required_argument, NULL, OPTION_RESOLVER_THREADS },
+	{ "resolver-timeout", required_argument, NULL, OPTION_RESOLVER_TIMEOUT },
+	{ "workers", required_argument, NULL, OPTION_WORKERS },
+	{ "chunks", required_argument, NULL, OPTION_CHUNKS },
+#endif
 	{ NULL, 0, NULL, 0 }
 };
 
@@ -857,6 +1043,21 @@ MakeFilename(char *buffer, char *orig_name, int cnt, int max_chars)
                   /* Report an error if the filename is too large */
                   error("too many output files or filename is too long (> %d)", PATH_MAX);
         free(filename);
+
+	/*
+	 * Compressed savefiles get the compression method's suffix, as
+	 * they would from the compression program.
+	 */
+	if (compress_method != ZFILE_NONE && strcmp(buffer, "-") != 0) {
+		const char *suffix = zfile_suffix(compress_method);
+		size_t len = strlen(buffer), slen = strlen(suffix);
+
+		if (len < slen || strcmp(buffer + len - slen, suffix) != 0) {
+			if (len + slen > PATH_MAX)
+				error("too many output files or filename is too long (> %d)", PATH_MAX);
+			memcpy(buffer + len, suffix, slen + 1);
+		}
+	}
 }
 
 static char *
@@ -876,6 +1077,219 @@ get_next_file(FILE *VFile, char *ptr)
 	return ret;
 }
 
+/*
+ * If the savefile "name" has an index, start reading it at the first
+ * packet --start-time or --skip might let through, and note where the
+ * packets --end-time lets through end.  Without an index, or with one
+ * that doesn't match the savefile, it's read from the start.
+ */
+static void
+seek_savefile(const char *name, pcap_t *p, struct mfile *mf)
+{
+	char errbuf[PCAP_ERRBUF_SIZE];
+	struct tsindex_plan plan;
+	struct tsindex *ix;
+	uint64_t skip;
+	int ret;
+
+	range_stop = TSINDEX_NONE;
+	ix = tsindex_open(name, errbuf, sizeof(errbuf));
+	if (ix == NULL) {
+		if (errbuf[0] != '\0')
+			warning("%s; reading %s from the start", errbuf, name);
+		return;
+	}
+	/*
+	 * The index counts all the packets, and --skip counts those that
+	 * get through the filter and --start-time, so it can only be used
+	 * for --skip if they all do.  When merging, the packets skipped
+	 * come from all the savefiles.
+	 */
+	skip = range_start == TSINDEX_NONE && !range_filtered && !merge_flag ?
+	    range_skip : 0;
+	ret = tsindex_plan(ix, name, nano_tstamps, range_start, range_end,
+	    skip, &plan, errbuf, sizeof(errbuf));
+	tsindex_close(ix);
+	if (ret == -1) {
+		warning("%s; reading it from the start", errbuf);
+		return;
+	}
+	if (mf != NULL ? mfile_seek(mf, plan.offset) == -1 :
+	    tsindex_seek(pcap_file(p), plan.offset) == -1) {
+		warning("%s can't be read from its index; reading it from the start",
+		    name);
+		return;
+	}
+	range_skip -= plan.skipped < skip ? plan.skipped : skip;
+	if (!merge_flag)
+		range_stop = plan.stop;
+}
+
+/*
+ * Open a savefile to read, decompressing it as it's read if it's
+ * compressed, and limit the rights on its descriptor.  With --mmap,
+ * also map it, if it can be, and set *mfp to the mapping.  With
+ * --index, index it first; with --start-time, --end-time or --skip,
+ * use its index, if it has one.
+ */
+static pcap_t *
+open_savefile(netdissect_options *ndo _U_, const char *name, char *ebuf,
+    struct mfile **mfp)
+{
+	char zbuf[PCAP_ERRBUF_SIZE];
+	char zerr[PCAP_ERRBUF_SIZE / 2];	/* leaves room for the name */
+	struct stat st;
+	pcap_t *p;
+	FILE *fp;
+	int fd = -1, method = ZFILE_NONE;
+#ifdef HAVE_CAPSICUM
+	cap_rights_t rights;
+#endif
+
+	if (index_build && strcmp(name, "-") != 0 &&
+	    tsindex_build(name, zbuf, sizeof(zbuf)) == -1)
+		warning("%s; not indexing it", zbuf);
+
+	/*
+	 * Only regular files can be compressed; opening a FIFO here, only
+	 * to close it again, could lose what's been written to it.
+	 */
+	if (strcmp(name, "-") != 0 && stat(name, &st) == 0 &&
+	    S_ISREG(st.st_mode) && (fd = open(name, O_RDONLY)) != -1 &&
+	    (method = zfile_detect(fd)) == ZFILE_NONE) {
+		close(fd);
+		fd = -1;
+	}
+	if (method != ZFILE_NONE) {
+		fp = zfile_ropen(fd, method, zerr, sizeof(zerr));
+		if (fp == NULL) {
+			close(fd);
+			snprintf(ebuf, PCAP_ERRBUF_SIZE, "%.*s: %s",
+			    (int)(PCAP_ERRBUF_SIZE - sizeof(zerr) - 2), name, zerr);
+			return (NULL);
+		}
+#ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
+		p = pcap_fopen_offline_with_tstamp_precision(fp,
+		    ndo->ndo_tstamp_precision, ebuf);
+#else
+		p = pcap_fopen_offline(fp, ebuf);
+#endif
+		if (p == NULL)
+			fclose(fp);
+	} else {
+#ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
+		p = pcap_open_offline_with_tstamp_precision(name,
+		    ndo->ndo_tstamp_precision, ebuf);
+#else
+		p = pcap_open_offline(name, ebuf);
+#endif
+		if (p != NULL)
+			fd = fileno(pcap_file(p));
+	}
+	*mfp = NULL;
+	if (p != NULL && (mmap_flag || chunks_count != 0) &&
+	    method == ZFILE_NONE && strcmp(name, "-") != 0) {
+		*mfp = mfile_open(p, fd, zbuf, sizeof(zbuf));
+		if (*mfp == NULL && zbuf[0] != '\0' && mmap_flag)
+			warning("%s: %s; reading it without --mmap", name,
+			    zbuf);
+	}
+	if (p != NULL && range_flag && method == ZFILE_NONE &&
+	    strcmp(name, "-") != 0)
+		seek_savefile(name, p, *mfp);
+#ifdef HAVE_CAPSICUM
+	if (p != NULL) {
+		cap_rights_init(&rights, CAP_READ);
+		if (range_flag)
+			cap_rights_set(&rights, CAP_SEEK);
+		if (cap_rights_limit(fd, &rights) < 0 && errno != ENOSYS)
+			error("unable to limit pcap descriptor");
+	}
+#endif
+	return (p);
+}
+
+/*
+ * Report a savefile we're reading.
+ */
+static void
+show_savefile(const char *name, pcap_t *p)
+{
+	int dlt = pcap_datalink(p);
+	const char *dlt_name = pcap_datalink_val_to_name(dlt);
+
+	fprintf(stderr, "reading from file %s", name);
+	if (dlt_name == NULL) {
+		fprintf(stderr, ", link-type %u", dlt);
+	} else {
+		fprintf(stderr, ", link-type %s (%s)", dlt_name,
+			pcap_datalink_val_to_description(dlt));
+	}
+	fprintf(stderr, ", snapshot length %d\n", pcap_snapshot(p));
+}
+
+/*
+ * Add a savefile to those to merge with --merge.
+ */
+static void
+add_merge_file(const char *name)
+{
+	struct merge_file *files;
+
+	files = (struct merge_file *)realloc(merge_files,
+	    (merge_nfiles + 1) * sizeof(*merge_files));
+	if (files == NULL)
+		error("%s", pcap_strerror(ENOMEM));
+	merge_files = files;
+	memset(&merge_files[merge_nfiles], 0, sizeof(*merge_files));
+	merge_files[merge_nfiles++].name = name;
+}
+
+/*
+ * Hand the packets of the savefiles being merged to the callback in
+ * time stamp order, as pcap_loop() would, each with the printer for its
+ * own link-layer header type.  An error reading one of the savefiles is
+ * reported here, and the others are still read; -1 is returned at the
+ * end if there was one.
+ */
+static int
+merge_loop(netdissect_options *ndo, int cnt, pcap_handler callback,
+    u_char *user)
+{
+	struct pcap_pkthdr *h;
+	const u_char *data;
+	u_int in, cur = 0;
+	int n = 0, r, status = 0;
+
+	for (;;) {
+		r = merge_next(pd_merge, &h, &data, &in);
+		if (r == -1) {
+			(void)fprintf(stderr, "%s: %s: %s\n", program_name,
+			    merge_files[in].name, merge_geterr(pd_merge));
+			status = -1;
+			continue;
+		}
+		if (r != 1)
+			return (r == -2 ? -2 : status);
+		if (merge_files[in].dlt != merge_files[cur].dlt) {
+			ndo->ndo_if_printer = merge_files[in].printer;
+			ndo->ndo_void_printer = merge_files[in].void_printer;
+			sample_linktype = merge_files[in].dlt;
+			if (ndo->ndo_proto_stats)
+				nd_set_proto_stats_linktype(ndo,
+				    merge_files[in].dlt);
+#ifdef HAVE_LIBPTHREAD
+			if (workers_count != 0)
+				workers_set_linktype(merge_files[in].dlt);
+#endif
+		}
+		cur = in;
+		(*callback)(user, h, data);
+		if (cnt > 0 && ++n >= cnt)
+			return (status);
+	}
+}
+
 #ifdef HAVE_CASPER
 static cap_channel_t *
 capdns_setup(void)
@@ -903,6 +1317,25 @@ capdns_setup(void)
 
 	return (capdnsloc);
 }
+
+#ifdef HAVE_LIBPTHREAD
+/*
+ * Look a name up for the resolver threads through the Casper service;
+ * it returns the name in a static buffer, so there's only one thread.
+ */
+static int
+capdns_resolve(int af, const void *addr, char *name, size_t namesize,
+    void *arg _U_)
+{
+	struct hostent *hp;
+
+	hp = cap_gethostbyaddr(capdns, addr, af == AF_INET6 ? 16 : 4, af);
+	if (hp == NULL)
+		return (-1);
+	strlcpy(name, hp->h_name, namesize);
+	return (0);
+}
+#endif /* HAVE_LIBPTHREAD */
 #endif	/* HAVE_CASPER */
 
 #ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
@@ -935,6 +1368,55 @@ tstamp_precision_to_string(int precision)
 }
 #endif
 
+/*
+ * Parse the time for --start-time or --end-time - seconds since the
+ * epoch, or a local date and time, "YYYY-MM-DD HH:MM:SS" or
+ * "YYYY-MM-DDTHH:MM:SS", either with an optional fraction of a second -
+ * and return it in nanoseconds since the epoch.
+ */
+static uint64_t
+parse_time(const char *arg, const char *what)
+{
+	struct tm tm;
+	const char *p;
+	char *endp, sep;
+	uint64_t sec, ns;
+	uint32_t scale;
+	time_t t;
+	int n;
+
+	memset(&tm, 0, sizeof(tm));
+	if (sscanf(arg, "%d-%d-%d%c%d:%d:%d%n", &tm.tm_year, &tm.tm_mon,
+	    &tm.tm_mday, &sep, &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &n) == 7 &&
+	    (sep == ' ' || sep == 'T')) {
+		tm.tm_year -= 1900;
+		tm.tm_mon -= 1;
+		tm.tm_isdst = -1;
+		t = mktime(&tm);
+		if (t == (time_t)-1 || t < 0)
+			error("invalid %s %s", what, arg);
+		sec = (uint64_t)t;
+		p = arg + n;
+	} else {
+		if (!ND_ASCII_ISDIGIT(*arg))
+			error("invalid %s %s", what, arg);
+		sec = strtoull(arg, &endp, 10);
+		p = endp;
+	}
+	if (sec > UINT32_MAX)
+		error("invalid %s %s", what, arg);
+	ns = 0;
+	if (*p == '.') {
+		for (p++, scale = 100000000; ND_ASCII_ISDIGIT(*p); p++) {
+			ns += (*p - '0') * scale;
+			scale /= 10;
+		}
+	}
+	if (*p != '\0')
+		error("invalid %s %s", what, arg);
+	return (sec * 1000000000 + ns);
+}
+
 #ifdef HAVE_CAPSICUM
 /*
  * Ensure that, on a dump file's descriptor, we have all the rights
@@ -990,9 +1472,8 @@ tstamp_precision_to_string(int precision)
  *	   what the standard I/O library happens to require this week.
  */
 static void
-set_dumper_capsicum_rights(pcap_dumper_t *p)
+set_dumper_capsicum_rights(int fd)
 {
-	int fd = fileno(pcap_dump_file(p));
 	cap_rights_t rights;
 
 	cap_rights_init(&rights, CAP_SEEK, CAP_WRITE, CAP_FCNTL);
@@ -1477,6 +1958,9 @@ main(int argc, char **argv)
 	int yflag_dlt = -1;
 	const char *yflag_dlt_name = NULL;
 	int print = 0;
+	struct merge_file *mfp;
+	u_int mi;
+	pcap_t *dumppd = NULL;
 
 	netdissect_options Ndo;
 	netdissect_options *ndo = &Ndo;
@@ -1489,6 +1973,8 @@ main(int argc, char **argv)
 
 	memset(ndo, 0, sizeof(*ndo));
 	ndo_set_function_pointers(ndo);
+	nd_init_state(ndo);
+	gndo = ndo;
 
 	cnt = -1;
 	device = NULL;
@@ -1739,6 +2225,7 @@ main(int argc, char **argv)
 
 		case 'r':
 			RFileName = optarg;
+			add_merge_file(optarg);
 			break;
 
 		case 's':
@@ -1917,6 +2404,320 @@ main(int argc, char **argv)
 			count_mode = 1;
 			break;
 
+		case OPTION_DECODE_AS:
+		{
+			long port;
+
+			port = strtol(optarg, &endp, 10);
+			if (endp == optarg || *endp != '=' ||
+			    port < 0 || port > 65535)
+				error("invalid --decode-as %s, must be port=protocol",
+				    optarg);
+			if (nd_decode_as(ndo, (u_int)port, endp + 1, ebuf,
+			    sizeof(ebuf)) < 0)
+				error("%s", ebuf);
+			break;
+		}
+
+		case OPTION_NAME_CACHE_SIZE:
+		{
+			long kib;
+
+			kib = strtol(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' || kib <= 0 ||
+			    (unsigned long)kib > SIZE_MAX / 1024)
+				error("invalid name cache size %s", optarg);
+			ndo->ndo_name_cache_max = (size_t)kib * 1024;
+			break;
+		}
+
+		case OPTION_NAME_MAP:
+			if (ndo->ndo_name_map != NULL)
+				error("only one --name-map file can be given");
+			ndo->ndo_name_map = nd_name_map_load(optarg, ebuf,
+			    sizeof(ebuf));
+			if (ndo->ndo_name_map == NULL)
+				error("%s", ebuf);
+			break;
+
+		case OPTION_REASSEMBLE:
+			ndo->ndo_reassemble = 1;
+			break;
+
+		case OPTION_REASSEMBLY_MEMORY:
+		{
+			long kib;
+
+			kib = strtol(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' || kib <= 0 ||
+			    (unsigned long)kib > SIZE_MAX / 1024)
+				error("invalid reassembly memory size %s",
+				    optarg);
+			ndo->ndo_reasm_max = (size_t)kib * 1024;
+			break;
+		}
+
+		case OPTION_REASSEMBLY_TIMEOUT:
+		{
+			long secs;
+
+			secs = strtol(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' ||
+			    secs < 1 || secs > 3600)
+				error("invalid reassembly timeout %s", optarg);
+			ndo->ndo_reasm_timeout = (u_int)secs;
+			break;
+		}
+
+		case OPTION_REASSEMBLE_TCP:
+			ndo->ndo_tcp_reassemble = 1;
+			break;
+
+		case OPTION_TCP_REASSEMBLY_MEMORY:
+		case OPTION_TCP_REASSEMBLY_FLOW_MEMORY:
+		{
+			long kib;
+
+			kib = strtol(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' || kib <= 0 ||
+			    (unsigned long)kib > UINT_MAX / 1024)
+				error("invalid TCP reassembly memory size %s",
+				    optarg);
+			if (op == OPTION_TCP_REASSEMBLY_MEMORY)
+				ndo->ndo_tcp_reasm_max = (size_t)kib * 1024;
+			else
+				ndo->ndo_tcp_reasm_flow_max = (size_t)kib * 1024;
+			break;
+		}
+
+		case OPTION_TCP_SEQ_MAX:
+		{
+			long count;
+
+			count = strtol(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' || count <= 0 ||
+			    (unsigned long)count > UINT_MAX)
+				error("invalid TCP conversation count %s",
+				    optarg);
+			ndo->ndo_tcp_seq_max = (u_int)count;
+			break;
+		}
+
+		case OPTION_TCP_SEQ_TIMEOUT:
+		{
+			long secs;
+
+			/* 0 or "none" is for never forgetting them */
+			if (strcmp(optarg, "none") == 0) {
+				ndo->ndo_tcp_seq_timeout =
+				    ND_TCP_SEQ_NO_TIMEOUT;
+				break;
+			}
+			secs = strtol(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' ||
+			    secs < 0 || secs > 86400)
+				error("invalid TCP conversation timeout %s",
+				    optarg);
+			ndo->ndo_tcp_seq_timeout = secs == 0 ?
+			    ND_TCP_SEQ_NO_TIMEOUT : (u_int)secs;
+			break;
+		}
+
+		case OPTION_RPC_TABLE_SIZE:
+		{
+			long count;
+
+			count = strtol(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' || count <= 0 ||
+			    (unsigned long)count > UINT_MAX)
+				error("invalid request table size %s", optarg);
+			ndo->ndo_rpc_table_max = (u_int)count;
+			break;
+		}
+
+		case OPTION_RPC_TABLE_TIMEOUT:
+		{
+			long secs;
+
+			secs = strtol(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' ||
+			    secs < 1 || secs > 86400)
+				error("invalid request table timeout %s",
+				    optarg);
+			ndo->ndo_rpc_table_timeout = (u_int)secs;
+			break;
+		}
+
+		case OPTION_ROTATION_CLOCK:
+			if (ascii_strcasecmp(optarg, "packet") == 0)
+				rotation_clock = ROTATION_CLOCK_PACKET;
+			else if (ascii_strcasecmp(optarg, "system") == 0)
+				rotation_clock = ROTATION_CLOCK_SYSTEM;
+			else
+				error("invalid rotation clock %s", optarg);
+			break;
+
+		case OPTION_COMPRESS:
+		{
+			char *colon;
+			long level;
+
+			/* method[:level] */
+			colon = strchr(optarg, ':');
+			if (colon != NULL) {
+				*colon = '\0';
+				level = strtol(colon + 1, &endp, 10);
+				if (endp == colon + 1 || *endp != '\0' ||
+				    level < 1 || level > 22)
+					error("invalid compression level %s",
+					    colon + 1);
+				compress_level = (int)level;
+			}
+			compress_method = zfile_method(optarg);
+			if (compress_method == -1)
+				error("compression method %s isn't supported",
+				    optarg);
+			break;
+		}
+
+		case OPTION_MMAP:
+			mmap_flag = 1;
+			break;
+
+		case OPTION_MERGE:
+			merge_flag = 1;
+			break;
+
+		case OPTION_INDEX:
+			index_flag = 1;
+			break;
+
+		case OPTION_START_TIME:
+			range_start = parse_time(optarg, "start time");
+			break;
+
+		case OPTION_END_TIME:
+			range_end = parse_time(optarg, "end time");
+			break;
+
+		case OPTION_SKIP:
+			range_skip = strtoull(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' || *optarg == '-')
+				error("invalid number of packets to skip %s",
+				    optarg);
+			break;
+
+		case OPTION_SAMPLE:
+			sample_every = (u_int)strtoul(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' ||
+			    !ND_ASCII_ISDIGIT(*optarg) || sample_every < 1)
+				error("invalid sampling interval %s", optarg);
+			break;
+
+		case OPTION_SAMPLE_RATE:
+			sample_rate = (u_int)strtoul(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' ||
+			    !ND_ASCII_ISDIGIT(*optarg) || sample_rate < 1)
+				error("invalid sampling rate %s", optarg);
+			break;
+
+		case OPTION_SAMPLE_FLOWS:
+			sample_flows = (u_int)strtoul(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' ||
+			    !ND_ASCII_ISDIGIT(*optarg) || sample_flows < 1)
+				error("invalid flow sampling interval %s",
+				    optarg);
+			break;
+
+		case OPTION_PROTOCOL_STATS:
+			ndo->ndo_proto_stats = 1;
+			break;
+
+		case OPTION_PROTOCOL_STATS_INTERVAL:
+		{
+			long secs;
+
+			secs = strtol(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' ||
+			    secs < 1 || secs > 86400)
+				error("invalid protocol statistics interval %s",
+				    optarg);
+			ndo->ndo_proto_stats_interval = (u_int)secs;
+			ndo->ndo_proto_stats = 1;
+			break;
+		}
+
+		case OPTION_REASSEMBLY_OVERLAP:
+			if (ascii_strcasecmp(optarg, "first") == 0)
+				ndo->ndo_reasm_overlap = REASM_OVERLAP_FIRST;
+			else if (ascii_strcasecmp(optarg, "last") == 0)
+				ndo->ndo_reasm_overlap = REASM_OVERLAP_LAST;
+			else if (ascii_strcasecmp(optarg, "drop") == 0)
+				ndo->ndo_reasm_overlap = REASM_OVERLAP_DROP;
+			else
+				error("invalid reassembly overlap policy %s",
+				    optarg);
+			break;
+
+#ifdef HAVE_LIBPTHREAD
+		case OPTION_WORKERS:
+			workers_count = (int)strtol(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' ||
+			    workers_count < 1 || workers_count > WORKERS_MAX)
+				error("invalid number of workers %s", optarg);
+			break;
+
+		case OPTION_CHUNKS:
+		{
+			char *colon;
+			long kbytes = CHUNKS_DEFAULT_KBYTES;
+
+			/* threads[:kbytes] */
+			colon = strchr(optarg, ':');
+			if (colon != NULL) {
+				*colon = '\0';
+				kbytes = strtol(colon + 1, &endp, 10);
+				if (endp == colon + 1 || *endp != '\0' ||
+				    kbytes < 1 || kbytes > 1024 * 1024)
+					error("invalid chunk size %s",
+					    colon + 1);
+			}
+			chunks_count = (int)strtol(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' ||
+			    chunks_count < 1 ||
+			    chunks_count > CHUNKS_MAX_THREADS)
+				error("invalid number of chunk threads %s",
+				    optarg);
+			chunk_size = (size_t)kbytes * 1024;
+			break;
+		}
+
+		case OPTION_RESOLVER_THREADS:
+		{
+			long n;
+
+			n = strtol(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' ||
+			    n < 1 || n > RESOLVER_THREADS_MAX)
+				error("invalid number of resolver threads %s",
+				    optarg);
+			resolver_threads = (u_int)n;
+			break;
+		}
+
+		case OPTION_RESOLVER_TIMEOUT:
+		{
+			long secs;
+
+			secs = strtol(optarg, &endp, 10);
+			if (endp == optarg || *endp != '\0' ||
+			    secs < 1 || secs > 3600)
+				error("invalid resolver timeout %s", optarg);
+			resolver_timeout = (u_int)secs;
+			break;
+		}
+#endif
+
 		default:
 			print_usage();
 			exit_tcpdump(S_ERR_HOST_PROGRAM);
@@ -1958,8 +2759,75 @@ main(int argc, char **argv)
 	if (ndo->ndo_fflag != 0 && (VFileName != NULL || RFileName != NULL))
 		error("-f can not be used with -V or -r");
 
+	/*
+	 * Printed packets are written in batches; write each one as
+	 * soon as it's printed if asked to with -l or -U, or if the
+	 * output is a terminal, which stdio would have line-buffered.
+	 */
+	if (lflag || isatty(1))
+		ndo->ndo_flush_packets = 1;
+#ifdef HAVE_PCAP_DUMP_FLUSH
+	if (Uflag)
+		ndo->ndo_flush_packets = 1;
+#endif
+
 	if (VFileName != NULL && RFileName != NULL)
 		error("-V and -r are mutually exclusive.");
+	if (merge_flag && VFileName == NULL && RFileName == NULL)
+		error("--merge requires -r or -V");
+#ifdef HAVE_LIBPTHREAD
+	if (chunks_count != 0) {
+		if (RFileName == NULL || VFileName != NULL || merge_flag)
+			error("--chunks requires a single -r file");
+		if (WFileName != NULL || count_mode)
+			error("--chunks only applies to printing packets");
+		if (workers_count != 0)
+			error("--chunks and --workers are mutually exclusive");
+	}
+#endif
+	range_flag = range_start != TSINDEX_NONE ||
+	    range_end != TSINDEX_NONE || range_skip != 0;
+	if (range_flag) {
+		if (RFileName == NULL && VFileName == NULL)
+			error("--start-time, --end-time and --skip require -r or -V");
+		if (chunks_count != 0)
+			error("--chunks can't be used with --start-time, --end-time or --skip");
+		if (range_end < range_start && range_start != TSINDEX_NONE)
+			error("the end time is before the start time");
+		range_filtered = infile != NULL || optind < argc;
+	}
+	if (index_flag) {
+		if (WFileName == NULL) {
+			if (RFileName == NULL && VFileName == NULL)
+				error("--index requires -w, -r or -V");
+			index_build = 1;
+		} else if (strcmp(WFileName, "-") == 0)
+			error("--index can't index the standard output");
+		else if (zflag != NULL || compress_method != ZFILE_NONE)
+			error("--index can't be used with -z or --compress");
+	}
+#ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
+	nano_tstamps = ndo->ndo_tstamp_precision == PCAP_TSTAMP_PRECISION_NANO;
+#endif
+	sample_flag = sample_every > 1 || sample_rate != 0 || sample_flows > 1;
+	if (sample_flag) {
+		if ((WFileName != NULL && !print) || count_mode)
+			error("--sample, --sample-rate and --sample-flows only apply to printing packets");
+		if (chunks_count != 0)
+			error("--chunks can't be used with --sample, --sample-rate or --sample-flows");
+	}
+	if (ndo->ndo_proto_stats) {
+		if ((WFileName != NULL && !print) || count_mode)
+			error("--protocol-stats only applies to printing packets");
+		if (ndo->ndo_xflag || ndo->ndo_Xflag || ndo->ndo_Aflag)
+			error("--protocol-stats can't be used with -x, -X or -A");
+#ifdef HAVE_LIBPTHREAD
+		if (workers_count != 0 || chunks_count != 0)
+			error("--protocol-stats can't be used with --workers or --chunks");
+#endif
+		/* Nothing's printed, so don't look up names */
+		ndo->ndo_nflag = 1;
+	}
 
 	/*
 	 * If we're printing dissected packets to the standard output,
@@ -2024,42 +2892,59 @@ main(int argc, char **argv)
 			if (VFile == NULL)
 				error("Unable to open file: %s\n", pcap_strerror(errno));
 
-			ret = get_next_file(VFile, VFileLine);
-			if (!ret)
-				error("Nothing in %s\n", VFileName);
-			RFileName = VFileLine;
-		}
-
-#ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
-		pd = pcap_open_offline_with_tstamp_precision(RFileName,
-		    ndo->ndo_tstamp_precision, ebuf);
-#else
-		pd = pcap_open_offline(RFileName, ebuf);
-#endif
+			if (merge_flag) {
+				/*
+				 * Merging; take all the files now.
+				 */
+				while (get_next_file(VFile, VFileLine) != NULL) {
+					if ((cp = strdup(VFileLine)) == NULL)
+						error("%s", pcap_strerror(errno));
+					add_merge_file(cp);
+				}
+				if (merge_nfiles == 0)
+					error("Nothing in %s\n", VFileName);
+				RFileName = (char *)merge_files[0].name;
+			} else {
+				ret = get_next_file(VFile, VFileLine);
+				if (!ret)
+					error("Nothing in %s\n", VFileName);
+				RFileName = VFileLine;
+			}
+		} else if (merge_flag)
+			RFileName = (char *)merge_files[0].name;
 
+		pd = open_savefile(ndo, RFileName, ebuf, &pd_mfile);
 		if (pd == NULL)
 			error("%s", ebuf);
-#ifdef HAVE_CAPSICUM
-		cap_rights_init(&rights, CAP_READ);
-		if (cap_rights_limit(fileno(pcap_file(pd)), &rights) < 0 &&
-		    errno != ENOSYS) {
-			error("unable to limit pcap descriptor");
+		if (chunks_count != 0 && pd_mfile == NULL) {
+			warning("%s can't be read in chunks; reading it whole",
+			    RFileName);
+			chunks_count = 0;
 		}
-#endif
 		dlt = pcap_datalink(pd);
-		dlt_name = pcap_datalink_val_to_name(dlt);
-		fprintf(stderr, "reading from file %s", RFileName);
-		if (dlt_name == NULL) {
-			fprintf(stderr, ", link-type %u", dlt);
-		} else {
-			fprintf(stderr, ", link-type %s (%s)", dlt_name,
-				pcap_datalink_val_to_description(dlt));
-		}
-		fprintf(stderr, ", snapshot length %d\n", pcap_snapshot(pd));
+		show_savefile(RFileName, pd);
 #ifdef DLT_LINUX_SLL2
 		if (dlt == DLT_LINUX_SLL2)
 			fprintf(stderr, "Warning: interface names might be incorrect\n");
 #endif
+		if (merge_flag) {
+			/*
+			 * Open the rest of the files to merge now too,
+			 * while we still can.
+			 */
+			merge_files[0].pd = pd;
+			merge_files[0].mf = pd_mfile;
+			merge_files[0].dlt = dlt;
+			for (mi = 1; mi < merge_nfiles; mi++) {
+				mfp = &merge_files[mi];
+				mfp->pd = open_savefile(ndo, mfp->name, ebuf,
+				    &mfp->mf);
+				if (mfp->pd == NULL)
+					error("%s", ebuf);
+				mfp->dlt = pcap_datalink(mfp->pd);
+				show_savefile(mfp->name, mfp->pd);
+			}
+		}
 	} else if (dflag && !device) {
 		int dump_dlt = DLT_EN10MB;
 		/*
@@ -2231,6 +3116,23 @@ main(int argc, char **argv)
 		capdns = capdns_setup();
 #endif	/* HAVE_CASPER */
 
+#ifdef HAVE_LIBPTHREAD
+	if (resolver_threads != 0 && !ndo->ndo_nflag) {
+		nd_resolve_func resolve = nd_resolve_getnameinfo;
+
+#ifdef HAVE_CASPER
+		if (capdns != NULL) {
+			resolve = capdns_resolve;
+			resolver_threads = 1;
+		}
+#endif
+		if (nd_resolver_start(resolver_threads,
+		    resolver_timeout * 1000, resolve, NULL, ebuf,
+		    sizeof(ebuf)) < 0)
+			error("%s", ebuf);
+	}
+#endif
+
 	init_print(ndo, localnet, netmask);
 
 #ifndef _WIN32
@@ -2309,6 +3211,25 @@ DIAG_ON_CLANG(assign-enum)
 
 	if (pcap_setfilter(pd, &fcode) < 0)
 		error("%s", pcap_geterr(pd));
+	if (merge_flag) {
+		/*
+		 * Each of the files being merged gets the filter compiled
+		 * for its own link-layer header type.
+		 */
+		pd_merge = merge_new(merge_nfiles);
+		if (pd_merge == NULL)
+			error("%s", pcap_strerror(ENOMEM));
+		merge_set_input(pd_merge, 0, pd, pd_mfile, &fcode);
+		for (mi = 1; mi < merge_nfiles; mi++) {
+			mfp = &merge_files[mi];
+			if (pcap_compile(mfp->pd, &mfp->fcode, cmdbuf, Oflag,
+			    netmask) < 0 ||
+			    pcap_setfilter(mfp->pd, &mfp->fcode) < 0)
+				error("%s: %s", mfp->name, pcap_geterr(mfp->pd));
+			merge_set_input(pd_merge, mi, mfp->pd, mfp->mf,
+			    &mfp->fcode);
+		}
+	}
 #ifdef HAVE_CAPSICUM
 	if (RFileName == NULL && VFileName == NULL && pcap_fileno(pd) != -1) {
 		static const unsigned long cmds[] = { BIOCGSTATS, BIOCROTZBUF };
@@ -2330,6 +3251,43 @@ DIAG_ON_CLANG(assign-enum)
 	}
 #endif
 	if (WFileName) {
+		memset(&dumpinfo, 0, sizeof(dumpinfo));
+		dumppd = pd;
+		if (pd_merge != NULL) {
+			/*
+			 * A savefile has one link-layer header type, so the
+			 * files being merged must all have the same one; the
+			 * savefile gets the largest of their snapshot lengths.
+			 */
+			int snaplen = pcap_snapshot(pd);
+
+			for (mi = 1; mi < merge_nfiles; mi++) {
+				mfp = &merge_files[mi];
+				if (mfp->dlt != dlt)
+					error("%s: link-type doesn't match that of %s",
+					    mfp->name, RFileName);
+				if (pcap_snapshot(mfp->pd) > snaplen)
+					snaplen = pcap_snapshot(mfp->pd);
+			}
+			if (snaplen != pcap_snapshot(pd)) {
+#ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
+				dumppd = pcap_open_dead_with_tstamp_precision(dlt,
+				    snaplen, ndo->ndo_tstamp_precision);
+#else
+				dumppd = pcap_open_dead(dlt, snaplen);
+#endif
+				if (dumppd == NULL)
+					error("%s", pcap_strerror(ENOMEM));
+			}
+		}
+		/*
+		 * Rotate on the packets' time stamps when reading
+		 * savefiles, as the system clock says nothing about them.
+		 */
+		if (rotation_clock == -1)
+			rotation_clock = RFileName != NULL ?
+			    ROTATION_CLOCK_PACKET : ROTATION_CLOCK_SYSTEM;
+
 		/* Do not exceed the default PATH_MAX for files. */
 		dumpinfo.CurrentFileName = (char *)malloc(PATH_MAX + 1);
 
@@ -2342,7 +3300,22 @@ DIAG_ON_CLANG(assign-enum)
 		else
 		  MakeFilename(dumpinfo.CurrentFileName, WFileName, 0, 0);
 
-		pdd = pcap_dump_open(pd, dumpinfo.CurrentFileName);
+		if (compress_method != ZFILE_NONE) {
+			int fd;
+
+			if (strcmp(dumpinfo.CurrentFileName, "-") == 0)
+				fd = fileno(stdout);
+			else
+				fd = open(dumpinfo.CurrentFileName,
+				    O_CREAT | O_WRONLY | O_TRUNC, 0666);
+			if (fd == -1)
+				error("unable to open file %s: %s",
+				    dumpinfo.CurrentFileName,
+				    pcap_strerror(errno));
+			pdd = dump_fdopen_pcap(dumppd, fd,
+			    dumpinfo.CurrentFileName);
+		} else
+			pdd = pcap_dump_open(dumppd, dumpinfo.CurrentFileName);
 #ifdef HAVE_LIBCAP_NG
 		/* Give up CAP_DAC_OVERRIDE capability.
 		 * Only allow it to be restored if the -C or -G flag have been
@@ -2357,10 +3330,12 @@ DIAG_ON_CLANG(assign-enum)
 		capng_apply(CAPNG_SELECT_BOTH);
 #endif /* HAVE_LIBCAP_NG */
 		if (pdd == NULL)
-			error("%s", pcap_geterr(pd));
+			error("%s", pcap_geterr(dumppd));
 #ifdef HAVE_CAPSICUM
-		set_dumper_capsicum_rights(pdd);
+		if (compress_method == ZFILE_NONE)
+			set_dumper_capsicum_rights(fileno(pcap_dump_file(pdd)));
 #endif
+		dumpinfo.index = dump_index_open();
 		if (Cflag != 0 || Gflag != 0) {
 #ifdef HAVE_CAPSICUM
 			dumpinfo.WFileName = strdup(basename(WFileName));
@@ -2375,7 +3350,9 @@ DIAG_ON_CLANG(assign-enum)
 				    dirname(WFileName));
 			}
 			cap_rights_init(&rights, CAP_CREATE, CAP_FCNTL,
-			    CAP_FTRUNCATE, CAP_LOOKUP, CAP_SEEK, CAP_WRITE);
+			    CAP_FTRUNCATE, CAP_LOOKUP, CAP_SEEK, CAP_WRITE,
+			    CAP_RENAMEAT_SOURCE, CAP_RENAMEAT_TARGET,
+			    CAP_UNLINKAT);
 			if (cap_rights_limit(dumpinfo.dirfd, &rights) < 0 &&
 			    errno != ENOSYS) {
 				error("unable to limit directory rights");
@@ -2388,13 +3365,20 @@ DIAG_ON_CLANG(assign-enum)
 			dumpinfo.WFileName = WFileName;
 #endif
 			callback = dump_packet_and_trunc;
-			dumpinfo.pd = pd;
+			dumpinfo.pd = dumppd;
 			dumpinfo.pdd = pdd;
+			dumpinfo.bytes = sizeof(struct pcap_file_header);
 			pcap_userdata = (u_char *)&dumpinfo;
+#ifdef SAVEFILE_HELPER
+			savefile_helper_start(&dumpinfo);
+#endif
 		} else {
 			callback = dump_packet;
+#ifdef HAVE_CAPSICUM
+			dumpinfo.dirfd = AT_FDCWD;
+#endif
 			dumpinfo.WFileName = WFileName;
-			dumpinfo.pd = pd;
+			dumpinfo.pd = dumppd;
 			dumpinfo.pdd = pdd;
 			pcap_userdata = (u_char *)&dumpinfo;
 		}
@@ -2407,7 +3391,7 @@ DIAG_ON_CLANG(assign-enum)
 
 #ifdef HAVE_PCAP_DUMP_FLUSH
 		if (Uflag)
-			pcap_dump_flush(pdd);
+			dump_flush(pdd);
 #endif
 	} else {
 		dlt = pcap_datalink(pd);
@@ -2415,6 +3399,34 @@ DIAG_ON_CLANG(assign-enum)
 		callback = print_packet;
 		pcap_userdata = (u_char *)ndo;
 	}
+	if (pd_merge != NULL) {
+		/*
+		 * Look up the printers of the files being merged now, so
+		 * that switching between them is cheap; the first file's
+		 * is looked up last, as it's the one we start with.
+		 */
+		for (mi = merge_nfiles; mi-- > 0;) {
+			mfp = &merge_files[mi];
+			mfp->printer = get_if_printer(ndo, mfp->dlt);
+			mfp->void_printer = ndo->ndo_void_printer;
+		}
+		ndo->ndo_if_printer = merge_files[0].printer;
+	}
+	sample_linktype = dlt;
+	if (ndo->ndo_proto_stats)
+		nd_set_proto_stats_linktype(ndo, dlt);
+
+#ifdef HAVE_LIBPTHREAD
+	if (workers_count != 0) {
+		if ((WFileName == NULL || print) && !count_mode) {
+			if (workers_start(ndo, dlt, workers_count,
+			    ndo->ndo_flush_packets, localnet, netmask, ebuf,
+			    sizeof(ebuf)) < 0)
+				error("%s", ebuf);
+		} else
+			workers_count = 0;
+	}
+#endif
 
 #ifdef SIGNAL_REQ_INFO
 	/*
@@ -2488,7 +3500,7 @@ DIAG_ON_CLANG(assign-enum)
 	}
 
 #ifdef HAVE_CAPSICUM
-	cansandbox = (VFileName == NULL && zflag == NULL);
+	cansandbox = (VFileName == NULL && zflag == NULL && !index_flag);
 #ifdef HAVE_CASPER
 	cansandbox = (cansandbox && (ndo->ndo_nflag || capdns != NULL));
 #else
@@ -2498,13 +3510,51 @@ DIAG_ON_CLANG(assign-enum)
 		error("unable to enter the capability mode");
 #endif	/* HAVE_CAPSICUM */
 
+	/*
+	 * With --start-time, --end-time or --skip, the packets are passed
+	 * through range_packet(), which does -c as well.
+	 */
+	if (range_flag) {
+		range_callback = callback;
+		callback = range_packet;
+		range_cnt = cnt;
+		cnt = -1;
+	}
+
 	do {
-		status = pcap_loop(pd, cnt, callback, pcap_userdata);
+		range_count = 0;
+		if (pd_merge != NULL)
+			status = merge_loop(ndo, cnt, callback, pcap_userdata);
+#ifdef HAVE_LIBPTHREAD
+		else if (chunks_count != 0)
+			status = chunks_run(ndo, pd_mfile, &fcode, chunks_count,
+			    chunk_size, cnt, localnet, netmask,
+			    &packets_captured, ebuf, sizeof(ebuf));
+#endif
+		else if (pd_mfile != NULL)
+			status = mfile_loop(pd_mfile, cnt, callback,
+			    pcap_userdata, &fcode);
+		else
+			status = pcap_loop(pd, cnt, callback, pcap_userdata);
+		if (status == -2 && range_stopped) {
+			/* range_packet() stopped reading the savefile */
+			range_stopped = 0;
+			status = 0;
+		}
+#ifdef HAVE_LIBPTHREAD
+		/*
+		 * Write out everything the workers still have before
+		 * reporting anything on the standard error.
+		 */
+		if (workers_count != 0)
+			workers_drain();
+#endif
 		if (WFileName == NULL) {
 			/*
 			 * We're printing packets.  Flush the printed output,
 			 * so it doesn't get intermingled with error output.
 			 */
+			nd_flush_output(ndo);
 			if (status == -2) {
 				/*
 				 * We got interrupted, so perhaps we didn't
@@ -2523,12 +3573,15 @@ DIAG_ON_CLANG(assign-enum)
 			VFileName = NULL;
 			ret = NULL;
 		}
-		if (status == -1) {
+		if (status == -1 && pd_merge == NULL) {
 			/*
-			 * Error.  Report it.
+			 * Error.  Report it.  (merge_loop() has reported
+			 * its errors already.)
 			 */
 			(void)fprintf(stderr, "%s: pcap_loop: %s\n",
-			    program_name, pcap_geterr(pd));
+			    program_name, chunks_count != 0 ? ebuf :
+			    pd_mfile != NULL ? mfile_geterr(pd_mfile) :
+			    pcap_geterr(pd));
 		}
 		if (RFileName == NULL) {
 			/*
@@ -2537,23 +3590,29 @@ DIAG_ON_CLANG(assign-enum)
 			 */
 			info(1);
 		}
+		if (pd_mfile != NULL) {
+			mfile_close(pd_mfile);
+			pd_mfile = NULL;
+		}
 		pcap_close(pd);
+		if (pd_merge != NULL) {
+			for (mi = 1; mi < merge_nfiles; mi++) {
+				mfp = &merge_files[mi];
+				if (mfp->mf != NULL)
+					mfile_close(mfp->mf);
+				pcap_close(mfp->pd);
+				pcap_freecode(&mfp->fcode);
+			}
+		}
 		if (VFileName != NULL) {
 			ret = get_next_file(VFile, VFileLine);
 			if (ret) {
 				int new_dlt;
 
 				RFileName = VFileLine;
-				pd = pcap_open_offline(RFileName, ebuf);
+				pd = open_savefile(ndo, RFileName, ebuf, &pd_mfile);
 				if (pd == NULL)
 					error("%s", ebuf);
-#ifdef HAVE_CAPSICUM
-				cap_rights_init(&rights, CAP_READ);
-				if (cap_rights_limit(fileno(pcap_file(pd)),
-				    &rights) < 0 && errno != ENOSYS) {
-					error("unable to limit pcap descriptor");
-				}
-#endif
 				new_dlt = pcap_datalink(pd);
 				if (new_dlt != dlt) {
 					/*
@@ -2585,6 +3644,14 @@ DIAG_ON_CLANG(assign-enum)
 					 */
 					dlt = new_dlt;
 					ndo->ndo_if_printer = get_if_printer(ndo, dlt);
+					sample_linktype = dlt;
+					if (ndo->ndo_proto_stats)
+						nd_set_proto_stats_linktype(ndo,
+						    dlt);
+#ifdef HAVE_LIBPTHREAD
+					if (workers_count != 0)
+						workers_set_linktype(dlt);
+#endif
 					if (pcap_compile(pd, &fcode, cmdbuf, Oflag, netmask) < 0)
 						error("%s", pcap_geterr(pd));
 				}
@@ -2598,16 +3665,7 @@ DIAG_ON_CLANG(assign-enum)
 				/*
 				 * Report the new file.
 				 */
-				dlt_name = pcap_datalink_val_to_name(dlt);
-				fprintf(stderr, "reading from file %s", RFileName);
-				if (dlt_name == NULL) {
-					fprintf(stderr, ", link-type %u", dlt);
-				} else {
-					fprintf(stderr, ", link-type %s (%s)",
-						dlt_name,
-						pcap_datalink_val_to_description(dlt));
-				}
-				fprintf(stderr, ", snapshot length %d\n", pcap_snapshot(pd));
+				show_savefile(RFileName, pd);
 			}
 		}
 	}
@@ -2616,9 +3674,28 @@ DIAG_ON_CLANG(assign-enum)
 	if (count_mode && RFileName != NULL)
 		fprintf(stderr, "%u packet%s\n", packets_captured,
 			PLURAL_SUFFIX(packets_captured));
-
+	if (ndo->ndo_proto_stats)
+		nd_print_proto_stats(ndo);
+	if (sample_flag && RFileName != NULL)
+		fprintf(stderr, "%u packet%s read, %u sampled\n",
+			packets_captured, PLURAL_SUFFIX(packets_captured),
+			packets_sampled);
+	if (WFileName != NULL && dumpinfo.index != NULL)
+		dump_index_close(&dumpinfo, dumpinfo.index,
+		    dumpinfo.CurrentFileName);
+
+#ifdef HAVE_LIBPTHREAD
+	if (workers_count != 0)
+		workers_finish();
+#endif
+	nd_free_state(ndo);
+	nd_name_map_free(ndo->ndo_name_map);
 	free(cmdbuf);
 	pcap_freecode(&fcode);
+	if (dumppd != NULL && dumppd != pd)
+		pcap_close(dumppd);
+	if (pd_merge != NULL)
+		merge_free(pd_merge);
 	exit_tcpdump(status == -1 ? 1 : 0);
 }
 
@@ -2671,6 +3748,14 @@ cleanup(int signo _U_)
 	 * the ANSI C standard doesn't say it is).
 	 */
 	pcap_breakloop(pd);
+	if (pd_mfile != NULL)
+		mfile_breakloop(pd_mfile);
+	if (pd_merge != NULL)
+		merge_breakloop(pd_merge);
+#ifdef HAVE_LIBPTHREAD
+	if (chunks_count != 0)
+		chunks_breakloop();
+#endif
 #else
 	/*
 	 * We don't have "pcap_breakloop()"; this isn't safe, but
@@ -2684,6 +3769,7 @@ cleanup(int signo _U_)
 		 * manage to finish a line we were printing.
 		 * Print an extra newline, just in case.
 		 */
+		nd_flush_output(gndo);
 		putchar('\n');
 		(void)fflush(stdout);
 		info(1);
@@ -2729,6 +3815,14 @@ info(int verbose)
 		fputs(", ", stderr);
 	else
 		putc('\n', stderr);
+	if (sample_flag) {
+		(void)fprintf(stderr, "%u packet%s sampled", packets_sampled,
+		    PLURAL_SUFFIX(packets_sampled));
+		if (!verbose)
+			fputs(", ", stderr);
+		else
+			putc('\n', stderr);
+	}
 	(void)fprintf(stderr, "%u packet%s received by filter", stats.ps_recv,
 	    PLURAL_SUFFIX(stats.ps_recv));
 	if (!verbose)
@@ -2746,9 +3840,234 @@ info(int verbose)
 		    stats.ps_ifdrop, PLURAL_SUFFIX(stats.ps_ifdrop));
 	} else
 		putc('\n', stderr);
+	if (verbose && gndo != NULL && gndo->ndo_vflag) {
+		alloc_info();
+		name_cache_info();
+		if (gndo->ndo_reassemble)
+			reasm_info();
+		if (gndo->ndo_tcp_reassemble)
+			tcp_reasm_info();
+		if (!gndo->ndo_Sflag)
+			tcp_seq_info();
+		rpc_table_info();
+#ifdef HAVE_LIBPTHREAD
+		if (nd_resolver_running)
+			resolver_info();
+#endif
+	}
 	infoprint = 0;
 }
 
+/*
+ * Report how much per-packet dissection memory nd_malloc() needed,
+ * so that the arena's slab size can be checked against real traffic.
+ */
+static void
+alloc_info(void)
+{
+	struct nd_alloc_stats stats;
+
+#ifdef HAVE_LIBPTHREAD
+	if (workers_count != 0)
+		workers_get_alloc_stats(&stats);
+	else
+#endif
+		nd_get_alloc_stats(gndo, &stats);
+	(void)fprintf(stderr,
+	    "%zu byte%s of dissection memory per packet at most, "
+	    "%zu byte%s in %u slab%s\n",
+	    stats.high_water, PLURAL_SUFFIX(stats.high_water),
+	    stats.slab_bytes, PLURAL_SUFFIX(stats.slab_bytes),
+	    stats.slabs, PLURAL_SUFFIX(stats.slabs));
+}
+
+/*
+ * Report how well the cache of names for addresses and ports did, so
+ * that a --name-cache-size can be chosen.
+ */
+static void
+name_cache_info(void)
+{
+	struct nd_name_cache_stats stats;
+
+#ifdef HAVE_LIBPTHREAD
+	if (workers_count != 0)
+		workers_get_name_cache_stats(&stats);
+	else
+#endif
+		nd_get_name_cache_stats(gndo, &stats);
+	(void)fprintf(stderr,
+	    "%" PRIu64 " name lookup%s found in the cache, %" PRIu64 " not, "
+	    "%" PRIu64 " name%s discarded\n",
+	    stats.hits, PLURAL_SUFFIX(stats.hits),
+	    stats.misses,
+	    stats.evictions, PLURAL_SUFFIX(stats.evictions));
+	(void)fprintf(stderr, "%u name%s cached in %zu byte%s\n",
+	    stats.names, PLURAL_SUFFIX(stats.names),
+	    stats.bytes, PLURAL_SUFFIX(stats.bytes));
+}
+
+/*
+ * Report what fragment reassembly did, so that --reassembly-memory and
+ * --reassembly-timeout can be chosen.
+ */
+static void
+reasm_info(void)
+{
+	struct nd_reasm_stats stats;
+
+#ifdef HAVE_LIBPTHREAD
+	if (workers_count != 0)
+		workers_get_reasm_stats(&stats);
+	else
+#endif
+		nd_get_reasm_stats(gndo, &stats);
+	(void)fprintf(stderr,
+	    "%" PRIu64 " fragment%s, %" PRIu64 " datagram%s reassembled, "
+	    "%u incomplete\n",
+	    stats.fragments, PLURAL_SUFFIX(stats.fragments),
+	    stats.datagrams, PLURAL_SUFFIX(stats.datagrams),
+	    stats.pending);
+	(void)fprintf(stderr,
+	    "%" PRIu64 " datagram%s timed out, %" PRIu64 " given up on "
+	    "for memory, %" PRIu64 " discarded, %" PRIu64 " overlapping "
+	    "fragment%s\n",
+	    stats.timed_out, PLURAL_SUFFIX(stats.timed_out),
+	    stats.evicted, stats.discarded,
+	    stats.overlaps, PLURAL_SUFFIX(stats.overlaps));
+	(void)fprintf(stderr,
+	    "%zu byte%s of fragments kept, %zu at most\n",
+	    stats.bytes, PLURAL_SUFFIX(stats.bytes), stats.peak_bytes);
+}
+
+/*
+ * Report what TCP stream reassembly did, so that --tcp-reassembly-memory
+ * and --tcp-reassembly-flow-memory can be chosen.
+ */
+static void
+tcp_reasm_info(void)
+{
+	struct nd_tcp_reasm_stats stats;
+
+#ifdef HAVE_LIBPTHREAD
+	if (workers_count != 0)
+		workers_get_tcp_reasm_stats(&stats);
+	else
+#endif
+		nd_get_tcp_reasm_stats(gndo, &stats);
+	(void)fprintf(stderr,
+	    "%" PRIu64 " TCP segment%s with data, %" PRIu64 " byte%s "
+	    "printed, %u stream%s followed\n",
+	    stats.segments, PLURAL_SUFFIX(stats.segments),
+	    stats.delivered, PLURAL_SUFFIX(stats.delivered),
+	    stats.streams, PLURAL_SUFFIX(stats.streams));
+	(void)fprintf(stderr,
+	    "%" PRIu64 " retransmitted, %" PRIu64 " out of order, %" PRIu64
+	    " held for the rest of a PDU, %" PRIu64 " gap%s\n",
+	    stats.retransmitted, stats.out_of_order, stats.held,
+	    stats.gaps, PLURAL_SUFFIX(stats.gaps));
+	(void)fprintf(stderr,
+	    "%" PRIu64 " stream%s timed out, %" PRIu64 " given up on for "
+	    "memory, %zu byte%s kept, %zu at most\n",
+	    stats.timed_out, PLURAL_SUFFIX(stats.timed_out),
+	    stats.evicted, stats.bytes, PLURAL_SUFFIX(stats.bytes),
+	    stats.peak_bytes);
+}
+
+/*
+ * Report how the table of TCP conversations for relative sequence
+ * numbers did, so that --tcp-seq-max and --tcp-seq-timeout can be
+ * chosen.
+ */
+static void
+tcp_seq_info(void)
+{
+	struct nd_tcp_seq_stats stats;
+
+#ifdef HAVE_LIBPTHREAD
+	if (workers_count != 0)
+		workers_get_tcp_seq_stats(&stats);
+	else
+#endif
+		nd_get_tcp_seq_stats(gndo, &stats);
+	if (stats.lookups == 0)
+		return;
+	(void)fprintf(stderr,
+	    "%u TCP conversation%s remembered, %" PRIu64 " closed, %" PRIu64
+	    " timed out, %" PRIu64 " given up on for the limit\n",
+	    stats.flows, PLURAL_SUFFIX(stats.flows), stats.closed,
+	    stats.timed_out, stats.evicted);
+	(void)fprintf(stderr,
+	    "%.2f entries looked at per lookup, %u at most, %zu byte%s\n",
+	    (double)stats.probes / stats.lookups, stats.longest_chain,
+	    stats.bytes, PLURAL_SUFFIX(stats.bytes));
+}
+
+/*
+ * Report how many replies the NFS, AFS Rx and ISAKMP printers matched to
+ * their requests, so that --rpc-table-size and --rpc-table-timeout can
+ * be chosen.
+ */
+static void
+rpc_table_info(void)
+{
+	static const char *kinds[ND_RPC_KINDS] = { "NFS", "Rx", "ISAKMP" };
+	struct nd_rpc_table_stats stats;
+	u_int i;
+
+#ifdef HAVE_LIBPTHREAD
+	if (workers_count != 0)
+		workers_get_rpc_table_stats(&stats);
+	else
+#endif
+		nd_get_rpc_table_stats(gndo, &stats);
+	if (stats.lookups == 0)
+		return;
+	for (i = 0; i < ND_RPC_KINDS; i++) {
+		if (stats.entered[i] == 0 && stats.hits[i] == 0 &&
+		    stats.misses[i] == 0)
+			continue;
+		(void)fprintf(stderr,
+		    "%s: %" PRIu64 " request%s remembered, %" PRIu64
+		    " found, %" PRIu64 " not found\n", kinds[i],
+		    stats.entered[i], PLURAL_SUFFIX(stats.entered[i]),
+		    stats.hits[i], stats.misses[i]);
+	}
+	(void)fprintf(stderr,
+	    "%u request%s remembered, %" PRIu64 " timed out, %" PRIu64
+	    " given up on for the limit\n",
+	    stats.entries, PLURAL_SUFFIX(stats.entries), stats.timed_out,
+	    stats.evicted);
+	(void)fprintf(stderr,
+	    "%.2f entries looked at per lookup, %u at most, %zu byte%s\n",
+	    (double)stats.probes / stats.lookups, stats.longest_chain,
+	    stats.bytes, PLURAL_SUFFIX(stats.bytes));
+}
+
+#ifdef HAVE_LIBPTHREAD
+/*
+ * Report what the resolver threads did, so that --resolver-threads and
+ * --resolver-timeout can be chosen.
+ */
+static void
+resolver_info(void)
+{
+	struct nd_resolver_stats stats;
+
+	nd_resolver_get_stats(&stats);
+	(void)fprintf(stderr,
+	    "%" PRIu64 " address%s looked up in the background, "
+	    "%" PRIu64 " with a name, %" PRIu64 " without, "
+	    "%" PRIu64 " timed out\n",
+	    stats.queued, stats.queued == 1 ? "" : "es",
+	    stats.found, stats.failed, stats.timed_out);
+	if (stats.dropped != 0)
+		(void)fprintf(stderr,
+		    "%" PRIu64 " address%s not queued, the queue being full\n",
+		    stats.dropped, stats.dropped == 1 ? "" : "es");
+}
+#endif
+
 #if defined(HAVE_FORK) || defined(HAVE_VFORK)
 #ifdef HAVE_FORK
 #define fork_subprocess() fork()
@@ -2802,10 +4121,458 @@ compress_savefile(const char *filename)
 }
 #endif /* HAVE_FORK && HAVE_VFORK */
 
+/*
+ * Create a savefile, with the privileges needed to do so, and return
+ * a descriptor for it, or -1 with errno set.
+ */
+#ifdef SAVEFILE_HELPER
+static pthread_mutex_t create_mtx = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static int
+create_savefile(struct dump_info *dump_info _U_, const char *name)
+{
+	int fd, save_errno;
+
+#ifdef SAVEFILE_HELPER
+	/* libcap-ng keeps the capabilities to apply in one place */
+	pthread_mutex_lock(&create_mtx);
+#endif
+#ifdef HAVE_LIBCAP_NG
+	capng_update(CAPNG_ADD, CAPNG_EFFECTIVE, CAP_DAC_OVERRIDE);
+	capng_apply(CAPNG_SELECT_BOTH);
+#endif /* HAVE_LIBCAP_NG */
+#ifdef HAVE_CAPSICUM
+	fd = openat(dump_info->dirfd, name, O_CREAT | O_WRONLY | O_TRUNC,
+	    0644);
+#else
+	fd = open(name, O_CREAT | O_WRONLY | O_TRUNC, 0666);
+#endif
+	save_errno = errno;
+#ifdef HAVE_LIBCAP_NG
+	capng_update(CAPNG_DROP, CAPNG_EFFECTIVE, CAP_DAC_OVERRIDE);
+	capng_apply(CAPNG_SELECT_BOTH);
+#endif /* HAVE_LIBCAP_NG */
+#ifdef SAVEFILE_HELPER
+	pthread_mutex_unlock(&create_mtx);
+#endif
+	errno = save_errno;
+	return (fd);
+}
+
+/*
+ * Return a dumper writing the savefile "name" to the descriptor "fd",
+ * through the compressor if the user asked for one.
+ */
+static pcap_dumper_t *
+dump_fdopen_pcap(pcap_t *pd, int fd, const char *name)
+{
+	char errbuf[PCAP_ERRBUF_SIZE];
+	pcap_dumper_t *p;
+	FILE *fp;
+
+#ifdef HAVE_CAPSICUM
+	set_dumper_capsicum_rights(fd);
+#endif
+	if (compress_method != ZFILE_NONE) {
+		fp = zfile_wopen(fd, compress_method, compress_level, errbuf,
+		    sizeof(errbuf));
+		if (fp == NULL)
+			error("%s: %s", name, errbuf);
+	} else {
+		fp = fdopen(fd, "w");
+		if (fp == NULL)
+			error("unable to fdopen file %s", name);
+	}
+	p = pcap_dump_fopen(pd, fp);
+	if (p == NULL)
+		error("%s", pcap_geterr(pd));
+	return (p);
+}
+
+/*
+ * Start the index of a savefile, if the user asked for them.
+ */
+static struct tsindex_writer *
+dump_index_open(void)
+{
+	struct tsindex_writer *w;
+
+	if (!index_flag)
+		return (NULL);
+	w = tsindex_wopen(nano_tstamps);
+	if (w == NULL)
+		error("out of memory for the savefile index");
+	return (w);
+}
+
+/*
+ * Write out the index of the savefile "name", next to it, and free it.
+ */
+static void
+dump_index_close(struct dump_info *dump_info, struct tsindex_writer *w,
+    const char *name)
+{
+	char idxname[PATH_MAX + 1], errbuf[PCAP_ERRBUF_SIZE];
+	int fd;
+
+#ifdef HAVE_CAPSICUM
+	const char *slash;
+
+	/* With -C or -G, they're created in dump_info->dirfd */
+	if (dump_info->dirfd != AT_FDCWD &&
+	    (slash = strrchr(name, '/')) != NULL)
+		name = slash + 1;
+#endif
+	if (snprintf(idxname, sizeof(idxname), "%s%s", name,
+	    TSINDEX_SUFFIX) >= (int)sizeof(idxname)) {
+		warning("%s: name too long; not indexing it", name);
+		(void)tsindex_wclose(w, -1, errbuf, sizeof(errbuf));
+		return;
+	}
+	fd = create_savefile(dump_info, idxname);
+	if (fd == -1) {
+		warning("unable to open file %s: %s", idxname,
+		    pcap_strerror(errno));
+		(void)tsindex_wclose(w, -1, errbuf, sizeof(errbuf));
+		return;
+	}
+	if (tsindex_wclose(w, fd, errbuf, sizeof(errbuf)) == -1)
+		warning("%s: %s", idxname, errbuf);
+}
+
+/*
+ * Start writing the savefile with the descriptor "fd", named
+ * dump_info->CurrentFileName.
+ */
+static void
+dump_fdopen(struct dump_info *dump_info, int fd)
+{
+	dump_info->pdd = dump_fdopen_pcap(dump_info->pd, fd,
+	    dump_info->CurrentFileName);
+	dump_info->bytes = sizeof(struct pcap_file_header);
+	dump_info->index = dump_index_open();
+}
+
+/*
+ * The size of the current savefile, for -C: the bytes written to it or,
+ * if it's compressed, the compressed bytes.
+ */
+static uint64_t
+dump_size(struct dump_info *dump_info)
+{
+	if (compress_method != ZFILE_NONE)
+		return (zfile_written(pcap_dump_file(dump_info->pdd)));
+	return (dump_info->bytes);
+}
+
+#ifdef HAVE_PCAP_DUMP_FLUSH
+/*
+ * Flush a savefile for -U, through the compressor if it's compressed.
+ */
+static void
+dump_flush(pcap_dumper_t *p)
+{
+	pcap_dump_flush(p);
+	if (compress_method != ZFILE_NONE)
+		(void)zfile_flush(pcap_dump_file(p));
+}
+#endif
+
+/*
+ * Close a savefile we're done with, write out its index if it has one
+ * and, if the user asked for it, compress it.
+ */
+static void
+dump_close_file(struct dump_info *dump_info, pcap_dumper_t *pdd,
+    struct tsindex_writer *index, char *name)
+{
+	pcap_dump_close(pdd);
+	if (index != NULL)
+		dump_index_close(dump_info, index, name);
+	if (zflag != NULL)
+		compress_savefile(name);
+	free(name);
+}
+
+#ifdef SAVEFILE_HELPER
+struct retired_file {
+	struct retired_file *next;
+	pcap_dumper_t *pdd;
+	struct tsindex_writer *index;
+	char *name;
+};
+
+static pthread_mutex_t helper_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t helper_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t helper_thread;
+static int helper_running;
+static int helper_stop;
+static struct retired_file *retired_head;	/* files to close */
+static struct retired_file **retired_tail = &retired_head;
+static int spare_fd = -1;	/* the spare file, or -1 if there's none */
+static int spare_failed;	/* couldn't create it; don't try again */
+static char spare_name[PATH_MAX + 1];
+
+static void
+remove_spare(struct dump_info *dump_info _U_)
+{
+	if (spare_fd == -1)
+		return;
+	close(spare_fd);
+	spare_fd = -1;
+#ifdef HAVE_CAPSICUM
+	(void)unlinkat(dump_info->dirfd, spare_name, 0);
+#else
+	(void)unlink(spare_name);
+#endif
+}
+
+static void *
+savefile_helper(void *arg)
+{
+	struct dump_info *dump_info = arg;
+	struct retired_file *rf;
+	int fd;
+
+	pthread_mutex_lock(&helper_mtx);
+	for (;;) {
+		if ((rf = retired_head) != NULL) {
+			retired_head = rf->next;
+			if (retired_head == NULL)
+				retired_tail = &retired_head;
+			pthread_mutex_unlock(&helper_mtx);
+			dump_close_file(dump_info, rf->pdd, rf->index,
+			    rf->name);
+			free(rf);
+			pthread_mutex_lock(&helper_mtx);
+			continue;
+		}
+		if (helper_stop)
+			break;
+		if (spare_fd == -1 && !spare_failed) {
+			pthread_mutex_unlock(&helper_mtx);
+			fd = create_savefile(dump_info, spare_name);
+			pthread_mutex_lock(&helper_mtx);
+			if (fd == -1)
+				spare_failed = 1;
+			else
+				spare_fd = fd;
+			continue;
+		}
+		pthread_cond_wait(&helper_cond, &helper_mtx);
+	}
+	remove_spare(dump_info);
+	pthread_mutex_unlock(&helper_mtx);
+	return (NULL);
+}
+
+/*
+ * Start the helper thread, with the spare file next to the first
+ * savefile.
+ */
+static void
+savefile_helper_start(struct dump_info *dump_info)
+{
+	const char *slash;
+	sigset_t all, old;
+	int dirlen, err;
+
+#ifdef HAVE_CAPSICUM
+	/* It's created in the directory dump_info->dirfd refers to */
+	slash = NULL;
+#else
+	slash = strrchr(dump_info->CurrentFileName, '/');
+#endif
+	dirlen = slash == NULL ? 0 :
+	    (int)(slash - dump_info->CurrentFileName + 1);
+	if (snprintf(spare_name, sizeof(spare_name), "%.*s.tcpdump-%ld.spare",
+	    dirlen, dump_info->CurrentFileName, (long)getpid()) >=
+	    (int)sizeof(spare_name))
+		return;
+	/* The thread inherits this; signals are for the main thread. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	err = pthread_create(&helper_thread, NULL, savefile_helper, dump_info);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (err != 0) {
+		warning("can't create the savefile helper thread");
+		return;
+	}
+	helper_running = 1;
+}
+
+/*
+ * Rename the spare file, if there is one, to "name", and return its
+ * descriptor, or return -1.
+ */
+static int
+take_spare(struct dump_info *dump_info _U_, const char *name)
+{
+	int fd = -1, ret;
+
+	if (!helper_running)
+		return (-1);
+	pthread_mutex_lock(&helper_mtx);
+	if (spare_fd != -1) {
+#ifdef HAVE_CAPSICUM
+		ret = renameat(dump_info->dirfd, spare_name,
+		    dump_info->dirfd, name);
+#else
+		ret = rename(spare_name, name);
+#endif
+		if (ret == 0) {
+			fd = spare_fd;
+			spare_fd = -1;
+			pthread_cond_signal(&helper_cond);
+		}
+	}
+	pthread_mutex_unlock(&helper_mtx);
+	return (fd);
+}
+
+/* Have the helper thread close a savefile we're done with */
+static void
+retire_file(struct dump_info *dump_info, pcap_dumper_t *pdd,
+    struct tsindex_writer *index, char *name)
+{
+	struct retired_file *rf;
+
+	rf = malloc(sizeof(*rf));
+	if (rf == NULL) {
+		dump_close_file(dump_info, pdd, index, name);
+		return;
+	}
+	rf->next = NULL;
+	rf->pdd = pdd;
+	rf->index = index;
+	rf->name = name;
+	pthread_mutex_lock(&helper_mtx);
+	*retired_tail = rf;
+	retired_tail = &rf->next;
+	pthread_cond_signal(&helper_cond);
+	pthread_mutex_unlock(&helper_mtx);
+}
+#endif /* SAVEFILE_HELPER */
+
+/*
+ * Wait for the savefiles rotated away from to be closed, and remove
+ * the spare file.
+ */
+static void
+savefile_helper_stop(void)
+{
+#ifdef SAVEFILE_HELPER
+	if (!helper_running)
+		return;
+	pthread_mutex_lock(&helper_mtx);
+	helper_stop = 1;
+	pthread_cond_signal(&helper_cond);
+	pthread_mutex_unlock(&helper_mtx);
+	pthread_join(helper_thread, NULL);
+	helper_running = 0;
+#endif
+}
+
+/*
+ * Go on from the current savefile to the one named "name", which is
+ * freed with it later.
+ */
+static void
+dump_rotate(struct dump_info *dump_info, char *name)
+{
+	pcap_dumper_t *old_pdd = dump_info->pdd;
+	struct tsindex_writer *old_index = dump_info->index;
+	char *old_name = dump_info->CurrentFileName;
+	int fd;
+
+	dump_info->CurrentFileName = name;
+#ifdef SAVEFILE_HELPER
+	/*
+	 * Rename the spare to the new name, unless it's the same as the
+	 * old one, which would then be compressed after we've started
+	 * writing to it.
+	 */
+	if (strcmp(name, old_name) != 0 &&
+	    (fd = take_spare(dump_info, name)) != -1) {
+		dump_fdopen(dump_info, fd);
+		retire_file(dump_info, old_pdd, old_index, old_name);
+		return;
+	}
+#endif
+	/*
+	 * Close the current file and open a new one.
+	 */
+	dump_close_file(dump_info, old_pdd, old_index, old_name);
+	fd = create_savefile(dump_info, name);
+	if (fd == -1)
+		error("unable to open file %s: %s", name, pcap_strerror(errno));
+	dump_fdopen(dump_info, fd);
+}
+
+/*
+ * When rotating on the packets' time stamps, the first savefile is
+ * named for the first packet's time, not for the time we started.
+ */
+static void
+dump_set_start_time(struct dump_info *dump_info, time_t t)
+{
+	char *name;
+#ifdef HAVE_CAPSICUM
+	const char *old_name;
+#endif
+	int ret;
+
+	Gflag_time = t;
+	name = (char *)malloc(PATH_MAX + 1);
+	if (name == NULL)
+		error("dump_set_start_time: malloc");
+	MakeFilename(name, dump_info->WFileName, 0, Cflag != 0 ? WflagChars : 0);
+	if (strcmp(name, dump_info->CurrentFileName) == 0) {
+		free(name);
+		return;
+	}
+#ifdef HAVE_CAPSICUM
+	/* The first file was opened by its full name */
+	old_name = strrchr(dump_info->CurrentFileName, '/');
+	old_name = old_name != NULL ? old_name + 1 : dump_info->CurrentFileName;
+	ret = renameat(dump_info->dirfd, old_name, dump_info->dirfd, name);
+#else
+	ret = rename(dump_info->CurrentFileName, name);
+#endif
+	if (ret == 0) {
+		free(dump_info->CurrentFileName);
+		dump_info->CurrentFileName = name;
+	} else {
+		/* Start a new file, leaving the empty one */
+		dump_rotate(dump_info, name);
+	}
+}
+
+/*
+ * The time to rotate -G savefiles on: the packet's time stamp, or the
+ * system time, read at most once per second of packet time stamps.
+ */
+static time_t
+dump_clock(struct dump_info *dump_info, const struct pcap_pkthdr *h)
+{
+	if (rotation_clock == ROTATION_CLOCK_PACKET)
+		return (h->ts.tv_sec);
+	if (h->ts.tv_sec != dump_info->clock_sec || dump_info->clock_now == 0) {
+		dump_info->clock_sec = h->ts.tv_sec;
+		if ((dump_info->clock_now = time(NULL)) == (time_t)-1) {
+			error("dump_and_trunc_packet: can't get current_time: %s",
+			    pcap_strerror(errno));
+		}
+	}
+	return (dump_info->clock_now);
+}
+
 static void
 dump_packet_and_trunc(u_char *user, const struct pcap_pkthdr *h, const u_char *sp)
 {
 	struct dump_info *dump_info;
+	char *name;
 
 	++packets_captured;
 
@@ -2825,51 +4592,43 @@ dump_packet_and_trunc(u_char *user, const struct pcap_pkthdr *h, const u_char *s
 		/* Check if it is time to rotate */
 		time_t t;
 
-		/* Get the current time */
-		if ((t = time(NULL)) == (time_t)-1) {
-			error("dump_and_trunc_packet: can't get current_time: %s",
-			    pcap_strerror(errno));
-		}
-
+		t = dump_clock(dump_info, h);
+		if (!dump_info->started &&
+		    rotation_clock == ROTATION_CLOCK_PACKET)
+			dump_set_start_time(dump_info, t);
 
 		/* If the time is greater than the specified window, rotate */
 		if (t - Gflag_time >= Gflag) {
-#ifdef HAVE_CAPSICUM
-			FILE *fp;
-			int fd;
-#endif
-
 			/* Update the Gflag_time */
 			Gflag_time = t;
 			/* Update Gflag_count */
 			Gflag_count++;
-			/*
-			 * Close the current file and open a new one.
-			 */
-			pcap_dump_close(dump_info->pdd);
-
-			/*
-			 * Compress the file we just closed, if the user asked for it
-			 */
-			if (zflag != NULL)
-				compress_savefile(dump_info->CurrentFileName);
 
 			/*
 			 * Check to see if we've exceeded the Wflag (when
 			 * not using Cflag).
 			 */
 			if (Cflag == 0 && Wflag > 0 && Gflag_count >= Wflag) {
+				/*
+				 * Close the current file, compressing it
+				 * if the user asked for it, and the ones
+				 * still being closed.
+				 */
+				dump_close_file(dump_info, dump_info->pdd,
+				    dump_info->index, dump_info->CurrentFileName);
+				dump_info->pdd = NULL;
+				dump_info->index = NULL;
+				dump_info->CurrentFileName = NULL;
+				savefile_helper_stop();
 				(void)fprintf(stderr, "Maximum file limit reached: %d\n",
 				    Wflag);
 				info(1);
 				exit_tcpdump(S_SUCCESS);
 				/* NOTREACHED */
 			}
-			if (dump_info->CurrentFileName != NULL)
-				free(dump_info->CurrentFileName);
 			/* Allocate space for max filename + \0. */
-			dump_info->CurrentFileName = (char *)malloc(PATH_MAX + 1);
-			if (dump_info->CurrentFileName == NULL)
+			name = (char *)malloc(PATH_MAX + 1);
+			if (name == NULL)
 				error("dump_packet_and_trunc: malloc");
 			/*
 			 * Gflag was set otherwise we wouldn't be here. Reset the count
@@ -2884,133 +4643,48 @@ dump_packet_and_trunc(u_char *user, const struct pcap_pkthdr *h, const u_char *s
 			 * We also don't need numbering if Cflag is not set.
 			 */
 			if (Cflag != 0)
-				MakeFilename(dump_info->CurrentFileName, dump_info->WFileName, 0,
+				MakeFilename(name, dump_info->WFileName, 0,
 				    WflagChars);
 			else
-				MakeFilename(dump_info->CurrentFileName, dump_info->WFileName, 0, 0);
+				MakeFilename(name, dump_info->WFileName, 0, 0);
 
-#ifdef HAVE_LIBCAP_NG
-			capng_update(CAPNG_ADD, CAPNG_EFFECTIVE, CAP_DAC_OVERRIDE);
-			capng_apply(CAPNG_SELECT_BOTH);
-#endif /* HAVE_LIBCAP_NG */
-#ifdef HAVE_CAPSICUM
-			fd = openat(dump_info->dirfd,
-			    dump_info->CurrentFileName,
-			    O_CREAT | O_WRONLY | O_TRUNC, 0644);
-			if (fd < 0) {
-				error("unable to open file %s",
-				    dump_info->CurrentFileName);
-			}
-			fp = fdopen(fd, "w");
-			if (fp == NULL) {
-				error("unable to fdopen file %s",
-				    dump_info->CurrentFileName);
-			}
-			dump_info->pdd = pcap_dump_fopen(dump_info->pd, fp);
-#else	/* !HAVE_CAPSICUM */
-			dump_info->pdd = pcap_dump_open(dump_info->pd, dump_info->CurrentFileName);
-#endif
-#ifdef HAVE_LIBCAP_NG
-			capng_update(CAPNG_DROP, CAPNG_EFFECTIVE, CAP_DAC_OVERRIDE);
-			capng_apply(CAPNG_SELECT_BOTH);
-#endif /* HAVE_LIBCAP_NG */
-			if (dump_info->pdd == NULL)
-				error("%s", pcap_geterr(pd));
-#ifdef HAVE_CAPSICUM
-			set_dumper_capsicum_rights(dump_info->pdd);
-#endif
+			dump_rotate(dump_info, name);
 		}
 	}
+	dump_info->started = 1;
 
 	/*
 	 * XXX - this won't prevent capture files from getting
 	 * larger than Cflag - the last packet written to the
 	 * file could put it over Cflag.
+	 *
+	 * We count the bytes written ourselves, rather than asking
+	 * the file where it is for each packet.
 	 */
-	if (Cflag != 0) {
-#ifdef HAVE_PCAP_DUMP_FTELL64
-		int64_t size = pcap_dump_ftell64(dump_info->pdd);
-#else
-		/*
-		 * XXX - this only handles a Cflag value > 2^31-1 on
-		 * LP64 platforms; to handle ILP32 (32-bit UN*X and
-		 * Windows) or LLP64 (64-bit Windows) would require
-		 * a version of libpcap with pcap_dump_ftell64().
-		 */
-		long size = pcap_dump_ftell(dump_info->pdd);
-#endif
-
-		if (size == -1)
-			error("ftell fails on output file");
-		if (size > Cflag) {
-#ifdef HAVE_CAPSICUM
-			FILE *fp;
-			int fd;
-#endif
-
-			/*
-			 * Close the current file and open a new one.
-			 */
-			pcap_dump_close(dump_info->pdd);
-
-			/*
-			 * Compress the file we just closed, if the user
-			 * asked for it.
-			 */
-			if (zflag != NULL)
-				compress_savefile(dump_info->CurrentFileName);
-
-			Cflag_count++;
-			if (Wflag > 0) {
-				if (Cflag_count >= Wflag)
-					Cflag_count = 0;
-			}
-			if (dump_info->CurrentFileName != NULL)
-				free(dump_info->CurrentFileName);
-			dump_info->CurrentFileName = (char *)malloc(PATH_MAX + 1);
-			if (dump_info->CurrentFileName == NULL)
-				error("dump_packet_and_trunc: malloc");
-			MakeFilename(dump_info->CurrentFileName, dump_info->WFileName, Cflag_count, WflagChars);
-#ifdef HAVE_LIBCAP_NG
-			capng_update(CAPNG_ADD, CAPNG_EFFECTIVE, CAP_DAC_OVERRIDE);
-			capng_apply(CAPNG_SELECT_BOTH);
-#endif /* HAVE_LIBCAP_NG */
-#ifdef HAVE_CAPSICUM
-			fd = openat(dump_info->dirfd, dump_info->CurrentFileName,
-			    O_CREAT | O_WRONLY | O_TRUNC, 0644);
-			if (fd < 0) {
-				error("unable to open file %s",
-				    dump_info->CurrentFileName);
-			}
-			fp = fdopen(fd, "w");
-			if (fp == NULL) {
-				error("unable to fdopen file %s",
-				    dump_info->CurrentFileName);
-			}
-			dump_info->pdd = pcap_dump_fopen(dump_info->pd, fp);
-#else	/* !HAVE_CAPSICUM */
-			dump_info->pdd = pcap_dump_open(dump_info->pd, dump_info->CurrentFileName);
-#endif
-#ifdef HAVE_LIBCAP_NG
-			capng_update(CAPNG_DROP, CAPNG_EFFECTIVE, CAP_DAC_OVERRIDE);
-			capng_apply(CAPNG_SELECT_BOTH);
-#endif /* HAVE_LIBCAP_NG */
-			if (dump_info->pdd == NULL)
-				error("%s", pcap_geterr(pd));
-#ifdef HAVE_CAPSICUM
-			set_dumper_capsicum_rights(dump_info->pdd);
-#endif
+	if (Cflag != 0 && dump_size(dump_info) > (uint64_t)Cflag) {
+		Cflag_count++;
+		if (Wflag > 0) {
+			if (Cflag_count >= Wflag)
+				Cflag_count = 0;
 		}
+		name = (char *)malloc(PATH_MAX + 1);
+		if (name == NULL)
+			error("dump_packet_and_trunc: malloc");
+		MakeFilename(name, dump_info->WFileName, Cflag_count, WflagChars);
+		dump_rotate(dump_info, name);
 	}
 
 	pcap_dump((u_char *)dump_info->pdd, h, sp);
+	dump_info->bytes += SF_PKTHDR_LEN + h->caplen;
+	if (dump_info->index != NULL)
+		tsindex_add(dump_info->index, h);
 #ifdef HAVE_PCAP_DUMP_FLUSH
 	if (Uflag)
-		pcap_dump_flush(dump_info->pdd);
+		dump_flush(dump_info->pdd);
 #endif
 
 	if (dump_info->ndo != NULL)
-		pretty_print_packet(dump_info->ndo, h, sp, packets_captured);
+		dissect_packet(dump_info->ndo, h, sp);
 
 	--infodelay;
 	if (infoprint)
@@ -3029,13 +4703,15 @@ dump_packet(u_char *user, const struct pcap_pkthdr *h, const u_char *sp)
 	dump_info = (struct dump_info *)user;
 
 	pcap_dump((u_char *)dump_info->pdd, h, sp);
+	if (dump_info->index != NULL)
+		tsindex_add(dump_info->index, h);
 #ifdef HAVE_PCAP_DUMP_FLUSH
 	if (Uflag)
-		pcap_dump_flush(dump_info->pdd);
+		dump_flush(dump_info->pdd);
 #endif
 
 	if (dump_info->ndo != NULL)
-		pretty_print_packet(dump_info->ndo, h, sp, packets_captured);
+		dissect_packet(dump_info->ndo, h, sp);
 
 	--infodelay;
 	if (infoprint)
@@ -3050,13 +4726,119 @@ print_packet(u_char *user, const struct pcap_pkthdr *h, const u_char *sp)
 	++infodelay;
 
 	if (!count_mode)
-		pretty_print_packet((netdissect_options *)user, h, sp, packets_captured);
+		dissect_packet((netdissect_options *)user, h, sp);
 
 	--infodelay;
 	if (infoprint)
 		info(0);
 }
 
+/*
+ * Stop reading the savefile, for range_packet().
+ */
+static void
+range_break(void)
+{
+	range_stopped = 1;
+	if (pd_merge != NULL)
+		merge_breakloop(pd_merge);
+	else if (pd_mfile != NULL)
+		mfile_breakloop(pd_mfile);
+#ifdef HAVE_PCAP_BREAKLOOP
+	else
+		pcap_breakloop(pd);
+#endif
+}
+
+/*
+ * Pass on the packets from --start-time to --end-time, after the first
+ * --skip of them, up to -c of them.  Once a packet is past the end
+ * time, and the savefile's index says the packets from here on all
+ * are, stop reading it.
+ */
+static void
+range_packet(u_char *user, const struct pcap_pkthdr *h, const u_char *sp)
+{
+	uint64_t ns, off;
+
+	ns = (uint64_t)h->ts.tv_sec * 1000000000 +
+	    (uint64_t)h->ts.tv_usec * (nano_tstamps ? 1 : 1000);
+	if (ns < range_start && range_start != TSINDEX_NONE)
+		return;
+	if (ns > range_end) {
+		if (range_stop != TSINDEX_NONE) {
+			off = pd_mfile != NULL ? mfile_tell(pd_mfile) :
+			    tsindex_tell(pcap_file(pd));
+			if (off >= range_stop)
+				range_break();
+		}
+		return;
+	}
+	if (range_skip != 0) {
+		range_skip--;
+		return;
+	}
+	(*range_callback)(user, h, sp);
+	if (range_cnt > 0 && ++range_count >= range_cnt)
+		range_break();
+}
+
+/*
+ * Decide whether to dissect a packet, with --sample-flows, --sample
+ * and --sample-rate: keep the packets of 1 in --sample-flows flows,
+ * then 1 in --sample of those, then no more than --sample-rate of
+ * those with time stamps in any one second.  All three go by what's in
+ * the packets, so the same ones are picked whenever a savefile is read.
+ */
+static int
+sample_packet(const struct pcap_pkthdr *h, const u_char *sp)
+{
+	u_int hash;
+
+	if (sample_flows > 1) {
+		/* Mix the hash's bits, so that any N will do */
+		hash = flow_hash(sample_linktype, h, sp, 1);
+		hash ^= hash >> 16;
+		hash *= 0x45d9f3bU;
+		hash ^= hash >> 16;
+		if (hash % sample_flows != 0)
+			return (0);
+	}
+	if (sample_every > 1) {
+		if (sample_count++ % sample_every != 0)
+			return (0);
+	}
+	if (sample_rate != 0) {
+		if (h->ts.tv_sec != sample_sec) {
+			sample_sec = h->ts.tv_sec;
+			sample_in_sec = 0;
+		}
+		if (sample_in_sec >= sample_rate)
+			return (0);
+		sample_in_sec++;
+	}
+	packets_sampled++;
+	return (1);
+}
+
+/*
+ * Print a packet, or hand it to the worker threads if we have them.
+ */
+static void
+dissect_packet(netdissect_options *ndo, const struct pcap_pkthdr *h,
+    const u_char *sp)
+{
+	if (sample_flag && !sample_packet(h, sp))
+		return;
+#ifdef HAVE_LIBPTHREAD
+	if (workers_count != 0) {
+		workers_submit(h, sp, packets_captured);
+		return;
+	}
+#endif
+	pretty_print_packet(ndo, h, sp, packets_captured);
+}
+
 #ifdef SIGNAL_REQ_INFO
 static void
 requestinfo(int signo _U_)
@@ -3152,7 +4934,9 @@ print_usage(void)
 	(void)fprintf(stderr,
 "Usage: %s [-Abd" D_FLAG "efhH" I_FLAG J_FLAG "KlLnNOpqStu" U_FLAG "vxX#]" B_FLAG_USAGE " [ -c count ] [--count]\n", program_name);
 	(void)fprintf(stderr,
-"\t\t[ -C file_size ] [ -E algo:secret ] [ -F file ] [ -G seconds ]\n");
+"\t\t[ -C file_size ] [ --decode-as port=protocol ] [ -E algo:secret ]\n");
+	(void)fprintf(stderr,
+"\t\t[ -F file ] [ -G seconds ]\n");
 	(void)fprintf(stderr,
 "\t\t[ -i interface ]" IMMEDIATE_MODE_USAGE j_FLAG_USAGE "\n");
 #ifdef HAVE_PCAP_FINDALLDEVS_EX
@@ -3164,14 +4948,44 @@ print_usage(void)
 "\t\t" m_FLAG_USAGE "\n");
 #endif
 	(void)fprintf(stderr,
-"\t\t[ -M secret ] [ --number ] [ --print ]" Q_FLAG_USAGE "\n");
+"\t\t[ -M secret ] [ --name-cache-size size ] [ --name-map file ]\n");
+	(void)fprintf(stderr,
+"\t\t[ --number ] [ --print ]" Q_FLAG_USAGE "\n");
+	(void)fprintf(stderr,
+"\t\t[ --reassemble ] [ --reassembly-memory size ]\n");
 	(void)fprintf(stderr,
-"\t\t[ -r file ] [ -s snaplen ] [ -T type ] [ --version ]\n");
+"\t\t[ --reassembly-overlap first|last|drop ]\n");
 	(void)fprintf(stderr,
-"\t\t[ -V file ] [ -w file ] [ -W filecount ] [ -y datalinktype ]\n");
+"\t\t[ --reassembly-timeout seconds ] [ --reassemble-tcp ]\n");
+	(void)fprintf(stderr,
+"\t\t[ --tcp-reassembly-memory size ] [ --tcp-reassembly-flow-memory size ]\n");
+	(void)fprintf(stderr,
+"\t\t[ --rpc-table-size count ] [ --rpc-table-timeout seconds ]\n");
+	(void)fprintf(stderr,
+"\t\t[ --tcp-seq-max count ] [ --tcp-seq-timeout seconds ]\n");
+	(void)fprintf(stderr,
+"\t\t[ -r file ] [ --mmap ] [ -s snaplen ] [ -T type ] [ --version ]\n");
+	(void)fprintf(stderr,
+"\t\t[ -V file ] [ --merge ] [ -w file ] [ -W filecount ]\n");
+	(void)fprintf(stderr,
+"\t\t[ --index ] [ --start-time time ] [ --end-time time ] [ --skip count ]\n");
+	(void)fprintf(stderr,
+"\t\t[ --sample count ] [ --sample-rate count ] [ --sample-flows count ]\n");
+	(void)fprintf(stderr,
+"\t\t[ --protocol-stats ] [ --protocol-stats-interval seconds ]\n");
+	(void)fprintf(stderr,
+"\t\t[ -y datalinktype ] [ --rotation-clock packet|system ]\n");
+	(void)fprintf(stderr,
+"\t\t[ --compress method[:level] ]\n");
 #ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
 	(void)fprintf(stderr,
 "\t\t[ --time-stamp-precision precision ] [ --micro ] [ --nano ]\n");
+#endif
+#ifdef HAVE_LIBPTHREAD
+	(void)fprintf(stderr,
+"\t\t[ --resolver-threads count ] [ --resolver-timeout seconds ]\n");
+	(void)fprintf(stderr,
+"\t\t[ --workers count ] [ --chunks threads[:kbytes] ]\n");
 #endif
 	(void)fprintf(stderr,
 "\t\t[ -z postrotate-command ] [ -Z user ] [ expression ]\n");
@@ -0,0 +1,591 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Reassembly of TCP streams.
+ *
+ * Each direction of a connection being followed has a buffer holding
+ * the data from "base", the sequence number of the first byte not yet
+ * handed to the printer, on, and a sorted list of the ranges of it
+ * that have come in; data is handed back from the front of the buffer
+ * once the first range starts there.  The directions are in a hash
+ * table on their addresses and ports, and in a list, least recently
+ * used first, from which they're forgotten when they've been idle too
+ * long or when the memory they take is over the limit.
+ *
+ * In the usual case, a segment in order with nothing kept ahead of it,
+ * the data is handed back where it is, and only what's left of a PDU
+ * at its end is copied.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "netdissect.h"
+#include "netdissect-alloc.h"
+#include "ipreasm.h"
+#include "tcpreasm.h"
+
+#define STREAM_HASH_MIN		64
+
+#define SEQ_LT(a, b)	((int32_t)((a) - (b)) < 0)
+#define SEQ_GEQ(a, b)	((int32_t)((a) - (b)) >= 0)
+
+struct stream_range {
+	u_int start;		/* offsets from base */
+	u_int end;
+};
+
+struct tcp_stream {
+	struct tcp_stream *hnext;	/* next in the hash chain */
+	struct tcp_stream *prev;	/* used less recently */
+	struct tcp_stream *next;	/* used more recently */
+	u_int ver;
+	u_char src[16];
+	u_char dst[16];
+	uint16_t sport;
+	uint16_t dport;
+	struct timeval last_ts;	/* time stamp of the last segment */
+	uint32_t base;		/* sequence number of buf[0] */
+	int have_fin;
+	uint32_t fin_seq;	/* sequence number the FIN takes */
+	u_char *buf;
+	u_int size;		/* bytes allocated for buf */
+	struct stream_range *ranges;	/* the data in buf */
+	u_int nranges;
+	u_int ranges_size;	/* entries allocated for ranges */
+};
+
+struct tcpreasm_state {
+	struct tcp_stream **hash;
+	u_int hash_size;	/* a power of 2 */
+	u_int count;
+	struct tcp_stream *oldest;
+	struct tcp_stream *newest;
+	struct nd_tcp_reasm_stats stats;
+};
+
+static struct tcpreasm_state *
+tcpreasm_state(netdissect_options *ndo)
+{
+	struct tcpreasm_state *st = ndo->ndo_tcpreasm;
+
+	if (st == NULL) {
+		st = calloc(1, sizeof(*st));
+		if (st == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+			    "tcpreasm_state: calloc");
+		ndo->ndo_tcpreasm = st;
+		st->hash_size = STREAM_HASH_MIN;
+		st->hash = calloc(st->hash_size, sizeof(*st->hash));
+		if (st->hash == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+			    "tcpreasm_state: calloc");
+		st->stats.bytes = sizeof(*st) +
+		    st->hash_size * sizeof(*st->hash);
+	}
+	return st;
+}
+
+static u_int
+stream_hash(u_int ver, const u_char *src, const u_char *dst,
+    uint16_t sport, uint16_t dport)
+{
+	u_int alen = ver == 6 ? 16 : 4;
+	uint32_t h = 2166136261U ^ ((uint32_t)sport << 16 | dport);
+	u_int i;
+
+	for (i = 0; i < alen; i++)
+		h = (h ^ src[i]) * 16777619U;
+	for (i = 0; i < alen; i++)
+		h = (h ^ dst[i]) * 16777619U;
+	return h;
+}
+
+static size_t
+stream_bytes(const struct tcp_stream *s)
+{
+	return sizeof(*s) + s->size +
+	    s->ranges_size * sizeof(struct stream_range);
+}
+
+static void
+hash_grow(netdissect_options *ndo, struct tcpreasm_state *st)
+{
+	struct tcp_stream **hash, *s;
+	u_int size, b;
+
+	size = st->hash_size * 2;
+	hash = calloc(size, sizeof(*hash));
+	if (hash == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC, "hash_grow: calloc");
+	for (s = st->oldest; s != NULL; s = s->next) {
+		b = stream_hash(s->ver, s->src, s->dst, s->sport, s->dport) &
+		    (size - 1);
+		s->hnext = hash[b];
+		hash[b] = s;
+	}
+	free(st->hash);
+	st->stats.bytes += (size - st->hash_size) * sizeof(*hash);
+	st->hash = hash;
+	st->hash_size = size;
+}
+
+static void
+stream_unlink(struct tcpreasm_state *st, struct tcp_stream *s)
+{
+	if (s->prev != NULL)
+		s->prev->next = s->next;
+	else
+		st->oldest = s->next;
+	if (s->next != NULL)
+		s->next->prev = s->prev;
+	else
+		st->newest = s->prev;
+}
+
+static void
+stream_link(struct tcpreasm_state *st, struct tcp_stream *s)
+{
+	s->next = NULL;
+	s->prev = st->newest;
+	if (st->newest != NULL)
+		st->newest->next = s;
+	else
+		st->oldest = s;
+	st->newest = s;
+}
+
+/* Forget the data kept for a direction, but not where it's got to */
+static void
+stream_clear(struct tcpreasm_state *st, struct tcp_stream *s)
+{
+	st->stats.bytes -= stream_bytes(s) - sizeof(*s);
+	free(s->buf);
+	free(s->ranges);
+	s->buf = NULL;
+	s->size = 0;
+	s->ranges = NULL;
+	s->nranges = 0;
+	s->ranges_size = 0;
+}
+
+static void
+stream_free(struct tcpreasm_state *st, struct tcp_stream *s)
+{
+	struct tcp_stream **sp;
+
+	sp = &st->hash[stream_hash(s->ver, s->src, s->dst, s->sport,
+	    s->dport) & (st->hash_size - 1)];
+	while (*sp != s)
+		sp = &(*sp)->hnext;
+	*sp = s->hnext;
+	stream_unlink(st, s);
+	st->count--;
+	stream_clear(st, s);
+	st->stats.bytes -= sizeof(*s);
+	free(s);
+}
+
+/* Forget the directions that have been idle too long */
+static void
+expire(netdissect_options *ndo, struct tcpreasm_state *st)
+{
+	u_int timeout;
+	struct tcp_stream *s;
+	time_t secs;
+
+	timeout = ndo->ndo_reasm_timeout != 0 ?
+	    ndo->ndo_reasm_timeout : REASM_TIMEOUT_DEFAULT;
+	while ((s = st->oldest) != NULL) {
+		secs = ndo->ndo_ts.tv_sec - s->last_ts.tv_sec;
+		if (secs < (time_t)timeout || (secs == (time_t)timeout &&
+		    ndo->ndo_ts.tv_usec <= s->last_ts.tv_usec))
+			break;
+		st->stats.timed_out++;
+		stream_free(st, s);
+	}
+}
+
+/* Find the direction a segment is for, and make it the most recently used */
+static struct tcp_stream *
+stream_find(netdissect_options *ndo, struct tcpreasm_state *st,
+    const struct tcpreasm_seg *seg)
+{
+	u_int alen = seg->ver == 6 ? 16 : 4;
+	struct tcp_stream *s;
+	u_int b;
+
+	b = stream_hash(seg->ver, seg->src, seg->dst, seg->sport,
+	    seg->dport) & (st->hash_size - 1);
+	for (s = st->hash[b]; s != NULL; s = s->hnext) {
+		if (s->ver == seg->ver && s->sport == seg->sport &&
+		    s->dport == seg->dport &&
+		    memcmp(s->src, seg->src, alen) == 0 &&
+		    memcmp(s->dst, seg->dst, alen) == 0) {
+			stream_unlink(st, s);
+			stream_link(st, s);
+			s->last_ts = ndo->ndo_ts;
+			return s;
+		}
+	}
+
+	s = calloc(1, sizeof(*s));
+	if (s == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+		    "stream_find: calloc");
+	s->ver = seg->ver;
+	memcpy(s->src, seg->src, alen);
+	memcpy(s->dst, seg->dst, alen);
+	s->sport = seg->sport;
+	s->dport = seg->dport;
+	s->last_ts = ndo->ndo_ts;
+	/* With no SYN seen, follow the stream from this segment on */
+	s->base = seg->seq;
+	s->hnext = st->hash[b];
+	st->hash[b] = s;
+	stream_link(st, s);
+	st->count++;
+	st->stats.bytes += sizeof(*s);
+	if (st->count > st->hash_size)
+		hash_grow(ndo, st);
+	return s;
+}
+
+/* The length of the data at the front of the buffer */
+static u_int
+stream_contig(const struct tcp_stream *s)
+{
+	if (s->nranges == 0 || s->ranges[0].start != 0)
+		return 0;
+	return s->ranges[0].end;
+}
+
+/*
+ * Copy the data at offset "off" into the buffer, keeping the data
+ * already there where it overlaps, and return the number of bytes that
+ * were new.
+ */
+static u_int
+stream_store(netdissect_options *ndo, struct tcpreasm_state *st,
+    struct tcp_stream *s, u_int off, const u_char *data, u_int len)
+{
+	u_int end = off + len, size, pos, i, j, added;
+	struct stream_range *r;
+	u_char *p;
+
+	if (end > s->size) {
+		size = s->size * 2;
+		if (size < end)
+			size = end;
+		p = realloc(s->buf, size);
+		if (p == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+			    "stream_store: realloc");
+		st->stats.bytes += size - s->size;
+		s->buf = p;
+		s->size = size;
+	}
+	if (s->nranges + 1 > s->ranges_size) {
+		size = s->ranges_size != 0 ? s->ranges_size * 2 : 4;
+		r = realloc(s->ranges, size * sizeof(*r));
+		if (r == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+			    "stream_store: realloc");
+		st->stats.bytes += (size - s->ranges_size) * sizeof(*r);
+		s->ranges = r;
+		s->ranges_size = size;
+	}
+
+	/* Fill in the holes between the ranges already there */
+	added = 0;
+	pos = off;
+	for (i = 0; i < s->nranges && pos < end; i++) {
+		r = &s->ranges[i];
+		if (r->end <= pos)
+			continue;
+		if (r->start > pos) {
+			j = r->start < end ? r->start : end;
+			memcpy(s->buf + pos, data + (pos - off), j - pos);
+			added += j - pos;
+		}
+		if (r->end > pos)
+			pos = r->end;
+	}
+	if (pos < end) {
+		memcpy(s->buf + pos, data + (pos - off), end - pos);
+		added += end - pos;
+	}
+	if (added == 0)
+		return 0;
+
+	/* Merge [off, end) into the ranges */
+	for (i = 0; i < s->nranges && s->ranges[i].end < off; i++)
+		;
+	for (j = i; j < s->nranges && s->ranges[j].start <= end; j++) {
+		if (s->ranges[j].start < off)
+			off = s->ranges[j].start;
+		if (s->ranges[j].end > end)
+			end = s->ranges[j].end;
+	}
+	if (j == i) {
+		memmove(&s->ranges[i + 1], &s->ranges[i],
+		    (s->nranges - i) * sizeof(*s->ranges));
+		s->nranges++;
+	} else if (j > i + 1) {
+		memmove(&s->ranges[i + 1], &s->ranges[j],
+		    (s->nranges - j) * sizeof(*s->ranges));
+		s->nranges -= j - i - 1;
+	}
+	s->ranges[i].start = off;
+	s->ranges[i].end = end;
+	return added;
+}
+
+/* Drop "len" bytes, handed to the printer, from the front of the buffer */
+static void
+stream_consume(struct tcp_stream *s, u_int len)
+{
+	u_int last, i;
+
+	last = s->ranges[s->nranges - 1].end;
+	memmove(s->buf, s->buf + len, last - len);
+	if (s->ranges[0].end == len) {
+		memmove(&s->ranges[0], &s->ranges[1],
+		    (s->nranges - 1) * sizeof(*s->ranges));
+		s->nranges--;
+		i = 0;
+	} else {
+		s->ranges[0].end -= len;
+		i = 1;
+	}
+	for (; i < s->nranges; i++) {
+		s->ranges[i].start -= len;
+		s->ranges[i].end -= len;
+	}
+	s->base += len;
+}
+
+/* The length of the whole PDUs at the front of the "len" bytes at "p" */
+static u_int
+pdu_frame(tcp_pdu_len_t pdu_len, const u_char *p, u_int len)
+{
+	u_int off, n;
+
+	if (pdu_len == NULL)
+		return len;
+	for (off = 0; off < len; off += n) {
+		n = pdu_len(p + off, len - off);
+		if (n == TCP_PDU_BAD)
+			return len;
+		if (n == TCP_PDU_MORE || n > len - off)
+			break;
+	}
+	return off;
+}
+
+/*
+ * Add a segment to its direction of the connection, and return the
+ * data now ready for the printer, either the segment's own or a buffer
+ * freed with the rest of the packet's memory, setting *lenp to its
+ * length, or NULL if there's none; set *statusp to the TCP_REASM_
+ * flags saying what was done with the segment.  A segment whose "data"
+ * is NULL wasn't captured in full; the data before and in it is
+ * skipped.
+ */
+const u_char *
+tcpreasm_add(netdissect_options *ndo, const struct tcpreasm_seg *seg,
+    u_int *lenp, u_int *statusp)
+{
+	struct tcpreasm_state *st = tcpreasm_state(ndo);
+	struct tcp_stream *s;
+	const u_char *data = seg->data, *out = NULL;
+	u_int len = seg->len, status = 0, off = 0, contig, k = 0, d;
+	uint32_t seq = seg->seq;
+	size_t max, flow_max;
+	int flush;
+	u_char *buf;
+
+	expire(ndo, st);
+	s = stream_find(ndo, st, seg);
+	if (seg->syn) {
+		/* A new connection; its data starts after the SYN */
+		stream_clear(st, s);
+		s->have_fin = 0;
+		seq++;
+		s->base = seq;
+	}
+	if (seg->fin) {
+		s->have_fin = 1;
+		s->fin_seq = seq + len;
+	}
+	if (len != 0)
+		st->stats.segments++;
+
+	if (data == NULL) {
+		if (s->nranges != 0 || seq != s->base) {
+			status |= TCP_REASM_GAP;
+			st->stats.gaps++;
+		}
+		stream_clear(st, s);
+		s->base = seq + len;
+		len = 0;
+	}
+
+	/* Drop what's been handed to the printer already */
+	if (len != 0 && SEQ_LT(seq, s->base)) {
+		d = s->base - seq;
+		if (d >= len) {
+			status |= TCP_REASM_RETRANS;
+			st->stats.retransmitted++;
+			len = 0;
+		} else {
+			data += d;
+			len -= d;
+			seq = s->base;
+		}
+	}
+
+	flow_max = ndo->ndo_tcp_reasm_flow_max != 0 ?
+	    ndo->ndo_tcp_reasm_flow_max : TCP_REASM_FLOW_MAX_DEFAULT;
+	flush = seg->rst;
+	if (len != 0 && s->nranges == 0 && seq == s->base) {
+		/* The usual case: in order, with nothing kept */
+		if (s->have_fin && seq + len == s->fin_seq)
+			flush = 1;
+		k = flush ? len : pdu_frame(seg->pdu_len, data, len);
+		if (k != 0) {
+			out = data;
+			s->base += k;
+		}
+		if (k < len) {
+			if (len - k > flow_max) {
+				/* Too long a PDU; hand it on as it is */
+				out = data;
+				s->base += len - k;
+				k = len;
+			} else {
+				stream_store(ndo, st, s, 0, data + k, len - k);
+				status |= TCP_REASM_HELD;
+				st->stats.held++;
+			}
+		}
+	} else {
+		if (len != 0) {
+			off = seq - s->base;
+			if (off > flow_max || len > flow_max - off) {
+				/*
+				 * That's too much to keep; skip the data
+				 * still missing, and anything kept.
+				 */
+				status |= TCP_REASM_GAP;
+				st->stats.gaps++;
+				stream_clear(st, s);
+				s->base = seq;
+				off = 0;
+			}
+			if (stream_store(ndo, st, s, off, data, len) == 0) {
+				status |= TCP_REASM_RETRANS;
+				st->stats.retransmitted++;
+			} else if (stream_contig(s) < off + len) {
+				status |= TCP_REASM_OUT_OF_ORDER;
+				st->stats.out_of_order++;
+			}
+		}
+		contig = stream_contig(s);
+		if (s->have_fin && SEQ_GEQ(s->base + contig, s->fin_seq))
+			flush = 1;
+		k = flush ? contig : pdu_frame(seg->pdu_len, s->buf, contig);
+		if (k == 0 && contig >= flow_max)
+			k = contig;	/* too long a PDU */
+		if (k != 0) {
+			buf = nd_malloc(ndo, k);
+			if (buf == NULL)
+				(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+				    "tcpreasm_add: nd_malloc");
+			memcpy(buf, s->buf, k);
+			stream_consume(s, k);
+			out = buf;
+			if (len == 0 || off != 0 || k != len)
+				status |= TCP_REASM_JOINED;
+		}
+		if (len != 0 && contig > k &&
+		    (status & (TCP_REASM_RETRANS|TCP_REASM_OUT_OF_ORDER)) == 0) {
+			status |= TCP_REASM_HELD;
+			st->stats.held++;
+		}
+	}
+	st->stats.delivered += k;
+
+	if (flush) {
+		/* The connection's done, in this direction */
+		stream_free(st, s);
+	} else {
+		/* Stay within the limit, forgetting the idlest directions */
+		max = ndo->ndo_tcp_reasm_max != 0 ?
+		    ndo->ndo_tcp_reasm_max : TCP_REASM_MAX_DEFAULT;
+		while (st->stats.bytes > max && st->oldest != s) {
+			st->stats.evicted++;
+			stream_free(st, st->oldest);
+		}
+		if (st->stats.bytes > max && s->nranges != 0) {
+			status |= TCP_REASM_GAP;
+			st->stats.gaps++;
+			s->base += s->ranges[s->nranges - 1].end;
+			stream_clear(st, s);
+		}
+	}
+	if (st->stats.bytes > st->stats.peak_bytes)
+		st->stats.peak_bytes = st->stats.bytes;
+
+	*statusp = status;
+	*lenp = k;
+	return out;
+}
+
+void
+nd_get_tcp_reasm_stats(netdissect_options *ndo,
+    struct nd_tcp_reasm_stats *stats)
+{
+	struct tcpreasm_state *st = ndo->ndo_tcpreasm;
+
+	if (st == NULL) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+	*stats = st->stats;
+	stats->streams = st->count;
+}
+
+void
+tcpreasm_free_state(netdissect_options *ndo)
+{
+	struct tcpreasm_state *st = ndo->ndo_tcpreasm;
+
+	if (st == NULL)
+		return;
+	while (st->oldest != NULL)
+		stream_free(st, st->oldest);
+	free(st->hash);
+	free(st);
+	ndo->ndo_tcpreasm = NULL;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef netdissect_tcpreasm_h
+#define netdissect_tcpreasm_h
+
+/*
+ * Reassembly of TCP streams (--reassemble-tcp).
+ *
+ * tcp_print() hands the data of each segment for a port it has a
+ * printer for to tcpreasm_add(), which keeps, for each direction of a
+ * connection, the data not yet handed to the printer: what's come in
+ * ahead of data still missing, and the start of a PDU whose end
+ * hasn't come in yet.  It hands back the data that's now in order and,
+ * if the printer's protocol has a way of telling where its PDUs end,
+ * made of whole PDUs, so that each PDU is printed once, in full.
+ *
+ * Retransmitted data is dropped.  A direction idle for more than
+ * ndo_reasm_timeout seconds, in packet time stamps, is forgotten, as
+ * are the directions idle longest when the data kept takes more than
+ * ndo_tcp_reasm_max bytes; a direction that would keep more than
+ * ndo_tcp_reasm_flow_max bytes skips the data that's missing.
+ */
+
+#define TCP_REASM_MAX_DEFAULT		(16 * 1024 * 1024)
+#define TCP_REASM_FLOW_MAX_DEFAULT	(1024 * 1024)
+
+/*
+ * Given the "len" bytes of in-order data at "p", starting with a PDU,
+ * return the length of that PDU, TCP_PDU_MORE if more data is needed
+ * to tell, or TCP_PDU_BAD if it doesn't look like a PDU, in which case
+ * all the data is handed to the printer as it is.
+ */
+typedef u_int (*tcp_pdu_len_t)(const u_char *p, u_int len);
+
+#define TCP_PDU_MORE	0
+#define TCP_PDU_BAD	0xffffffffU
+
+/* What tcpreasm_add() did with a segment */
+#define TCP_REASM_RETRANS	0x01	/* no new data in it */
+#define TCP_REASM_OUT_OF_ORDER	0x02	/* kept until the data before it comes */
+#define TCP_REASM_HELD		0x04	/* kept until the rest of a PDU comes */
+#define TCP_REASM_JOINED	0x08	/* handed back with data kept earlier */
+#define TCP_REASM_GAP		0x10	/* data missing before it was skipped */
+
+struct tcpreasm_seg {
+	u_int ver;		/* 4 or 6 */
+	const u_char *src;	/* addresses, 4 or 16 bytes */
+	const u_char *dst;
+	uint16_t sport;
+	uint16_t dport;
+	uint32_t seq;		/* absolute sequence number */
+	int syn;		/* SYN, FIN, RST flags */
+	int fin;
+	int rst;
+	const u_char *data;
+	u_int len;
+	tcp_pdu_len_t pdu_len;	/* NULL if the data has no PDUs to find */
+};
+
+extern const u_char *tcpreasm_add(netdissect_options *,
+    const struct tcpreasm_seg *, u_int *, u_int *);
+
+#endif /* netdissect_tcpreasm_h */
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Benchmark for chunk-parallel dissection: the time tcpdump takes to
+ * print a large generated capture, without --chunks and with --chunks
+ * and 1, 2, 4, ... threads, up to the number of processors.  The output
+ * with --chunks must be the same whatever the number of threads, which
+ * is checked by comparing hashes of it.
+ *
+ * Build it with "make chunks-bench" and run it with the tcpdump to run
+ * ("./tcpdump" by default), the number of megabytes of packets to
+ * generate (256 by default), and the directory to write the capture in
+ * (the current one by default) as arguments.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <sys/time.h>
+
+#include <pcap.h>
+
+struct result {
+	uint64_t lines;
+	uint64_t bytes;
+	u_int hash;
+};
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1e6);
+}
+
+static uint32_t seed = 1;
+
+static uint32_t
+random32(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 1);
+}
+
+/*
+ * Make a packet of Ethernet, IPv4, and TCP or UDP, in one of 64
+ * conversations; most are either bare TCP ACKs or full-sized, as in a
+ * bulk transfer.
+ */
+static u_int
+make_packet(u_char *pkt, uint32_t *seqs)
+{
+	static const u_char ether[14] = {
+		0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+		0x00, 0x66, 0x77, 0x88, 0x99, 0xaa,
+		0x08, 0x00
+	};
+	uint32_t r = random32();
+	u_int len, i, conv;
+	int tcp;
+
+	switch (r % 10) {
+	case 0: case 1: case 2: case 3:
+		len = 66;
+		break;
+	case 4: case 5: case 6:
+		len = 1514;
+		break;
+	default:
+		len = 100 + (r >> 8) % 1300;
+		break;
+	}
+	conv = (r >> 20) % 64;
+	tcp = conv % 8 != 0;
+	memcpy(pkt, ether, sizeof(ether));
+	memset(pkt + 14, 0, 40);
+	pkt[14] = 0x45;
+	pkt[16] = (u_char)((len - 14) >> 8);
+	pkt[17] = (u_char)(len - 14);
+	pkt[22] = 64;
+	pkt[23] = tcp ? 6 : 17;
+	pkt[26] = 10;
+	pkt[29] = (u_char)conv;
+	pkt[30] = 10;
+	pkt[33] = 200;
+	pkt[34] = 0x80;
+	pkt[35] = (u_char)conv;
+	pkt[36] = 0;
+	pkt[37] = 80;
+	if (tcp) {
+		pkt[38] = (u_char)(seqs[conv] >> 24);
+		pkt[39] = (u_char)(seqs[conv] >> 16);
+		pkt[40] = (u_char)(seqs[conv] >> 8);
+		pkt[41] = (u_char)seqs[conv];
+		pkt[46] = 0x50;
+		pkt[47] = 0x18;
+		pkt[48] = 0x10;
+		seqs[conv] += len - 54;
+		i = 54;
+	} else {
+		pkt[38] = (u_char)((len - 34) >> 8);
+		pkt[39] = (u_char)(len - 34);
+		i = 42;
+	}
+	for (; i < len; i++)
+		pkt[i] = (u_char)random32();
+	return (len);
+}
+
+static void
+put32(FILE *fp, uint32_t v)
+{
+	fwrite(&v, sizeof(v), 1, fp);
+}
+
+static void
+put16(FILE *fp, uint16_t v)
+{
+	fwrite(&v, sizeof(v), 1, fp);
+}
+
+/*
+ * Write "mbytes" megabytes of packets to a pcap savefile, in our own
+ * byte order; return the number of packets.
+ */
+static uint64_t
+generate(const char *path, u_long mbytes)
+{
+	u_char pkt[1514];
+	uint32_t seqs[64];
+	FILE *fp;
+	uint64_t npackets, written, ts;
+	u_int len, i;
+
+	fp = fopen(path, "wb");
+	if (fp == NULL) {
+		fprintf(stderr, "chunks-bench: %s\n", strerror(errno));
+		exit(1);
+	}
+	setvbuf(fp, NULL, _IOFBF, 1024 * 1024);
+	for (i = 0; i < 64; i++)
+		seqs[i] = random32();
+
+	put32(fp, 0xa1b2c3d4);
+	put16(fp, 2);
+	put16(fp, 4);
+	put32(fp, 0);
+	put32(fp, 0);
+	put32(fp, 65535);
+	put32(fp, DLT_EN10MB);
+
+	ts = (uint64_t)1700000000 * 1000000;
+	for (npackets = 0, written = 0; written < mbytes * 1000000;
+	    npackets++) {
+		len = make_packet(pkt, seqs);
+		ts += 1 + random32() % 200;
+		put32(fp, (uint32_t)(ts / 1000000));
+		put32(fp, (uint32_t)(ts % 1000000));
+		put32(fp, len);
+		put32(fp, len);
+		fwrite(pkt, len, 1, fp);
+		written += 16 + len;
+	}
+	if (fclose(fp) == EOF) {
+		fprintf(stderr, "chunks-bench: %s\n", strerror(errno));
+		exit(1);
+	}
+	return (npackets);
+}
+
+/* Run tcpdump on the savefile; return the time taken */
+static double
+run(const char *tcpdump, const char *path, int threads, struct result *res)
+{
+	char cmd[2048], buf[65536];
+	double start;
+	size_t n, i;
+	FILE *fp;
+
+	if (threads == 0)
+		snprintf(cmd, sizeof(cmd), "%s -n -r %s 2>/dev/null", tcpdump,
+		    path);
+	else
+		snprintf(cmd, sizeof(cmd), "%s -n -r %s --chunks=%d 2>/dev/null",
+		    tcpdump, path, threads);
+	memset(res, 0, sizeof(*res));
+	res->hash = 2166136261U;	/* FNV-1a */
+	start = now();
+	fp = popen(cmd, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "chunks-bench: %s: %s\n", cmd,
+		    strerror(errno));
+		exit(1);
+	}
+	while ((n = fread(buf, 1, sizeof(buf), fp)) != 0) {
+		for (i = 0; i < n; i++) {
+			res->hash ^= (u_char)buf[i];
+			res->hash *= 16777619U;
+			if (buf[i] == '\n')
+				res->lines++;
+		}
+		res->bytes += n;
+	}
+	if (pclose(fp) != 0) {
+		fprintf(stderr, "chunks-bench: %s failed\n", cmd);
+		exit(1);
+	}
+	return (now() - start);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *tcpdump = "./tcpdump", *dir = ".";
+	char path[1024];
+	struct result base, res;
+	u_long mbytes = 256;
+	uint64_t npackets;
+	double start, secs, secs1 = 0;
+	long ncpus = 1;
+	int threads;
+
+	if (argc > 1)
+		tcpdump = argv[1];
+	if (argc > 2)
+		mbytes = strtoul(argv[2], NULL, 10);
+	if (argc > 3)
+		dir = argv[3];
+	if (mbytes == 0)
+		mbytes = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus < 1)
+		ncpus = 1;
+#endif
+
+	snprintf(path, sizeof(path), "%s/chunks-bench.%ld.pcap", dir,
+	    (long)getpid());
+	start = now();
+	npackets = generate(path, mbytes);
+	printf("%lu MB of packets, %llu packets, generated in %.1f s\n",
+	    mbytes, (unsigned long long)npackets, now() - start);
+	printf("%-9s %8s %12s %8s %10s\n", "threads", "secs", "packets/s",
+	    "speedup", "hash");
+
+	/* Once to get the savefile into the page cache */
+	(void)run(tcpdump, path, 0, &base);
+	secs = run(tcpdump, path, 0, &base);
+	printf("%-9s %8.3f %12.0f %8s %10x\n", "none", secs,
+	    base.lines / secs, "", base.hash);
+	fflush(stdout);
+
+	for (threads = 1; threads <= ncpus; threads *= 2) {
+		secs = run(tcpdump, path, threads, &res);
+		if (threads == 1) {
+			secs1 = secs;
+			base = res;
+		}
+		printf("%-9d %8.3f %12.0f %7.2fx %10x\n", threads, secs,
+		    res.lines / secs, secs1 / secs, res.hash);
+		fflush(stdout);
+		if (res.lines != base.lines || res.bytes != base.bytes ||
+		    res.hash != base.hash) {
+			fprintf(stderr,
+			    "chunks-bench: the output with %d threads differs\n",
+			    threads);
+			unlink(path);
+			exit(1);
+		}
+		if (threads < ncpus && threads * 2 > ncpus)
+			threads = (int)ncpus / 2;
+	}
+
+	unlink(path);
+	return (0);
+}
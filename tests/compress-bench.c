@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Benchmark for compressed savefiles: the time to write the packets of
+ * a capture, over and over, to a savefile compressed with --compress,
+ * and to write them uncompressed and then compress the savefile with
+ * the program -z would run, as well as the bytes written to disk each
+ * way.  So that the copies aren't just compressed away, each one is
+ * given later time stamps and has one byte in 16 after the link-layer
+ * header replaced with a random one.  "write s" is the time spent
+ * writing the packets, which is the time taken from the capture;
+ * "total s" includes compressing all the data and ending the file.
+ *
+ * Build it with "make compress-bench" and run it in the tests
+ * directory, or with a capture file, the number of megabytes of packets
+ * to write and the directory to write them in as arguments.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if defined(HAVE_FORK) && !defined(_WIN32)
+#include <sys/wait.h>
+#endif
+#include <sys/time.h>
+
+#include <pcap.h>
+
+#include "zfile.h"
+
+#define MAX_PACKETS	4096
+
+static struct pcap_pkthdr hdrs[MAX_PACKETS];
+static u_char *data[MAX_PACKETS];
+static u_int npackets;
+static uint64_t capture_bytes;	/* bytes of savefile per pass */
+static u_char *scratch;		/* a packet being written */
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1e6);
+}
+
+static off_t
+file_size(const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) == -1)
+		return (0);
+	return (st.st_size);
+}
+
+static pcap_t *
+read_capture(const char *file)
+{
+	char ebuf[PCAP_ERRBUF_SIZE];
+	struct pcap_pkthdr *h;
+	const u_char *sp;
+	pcap_t *pd;
+
+	pd = pcap_open_offline(file, ebuf);
+	if (pd == NULL) {
+		fprintf(stderr, "compress-bench: %s\n", ebuf);
+		exit(1);
+	}
+	for (npackets = 0; npackets < MAX_PACKETS &&
+	    pcap_next_ex(pd, &h, &sp) == 1; npackets++) {
+		hdrs[npackets] = *h;
+		data[npackets] = malloc(h->caplen);
+		if (data[npackets] == NULL) {
+			fprintf(stderr, "compress-bench: malloc\n");
+			exit(1);
+		}
+		memcpy(data[npackets], sp, h->caplen);
+		capture_bytes += 16 + h->caplen;
+	}
+	scratch = malloc(pcap_snapshot(pd));
+	if (scratch == NULL) {
+		fprintf(stderr, "compress-bench: malloc\n");
+		exit(1);
+	}
+	if (npackets == 0) {
+		fprintf(stderr, "compress-bench: no packets in %s\n", file);
+		exit(1);
+	}
+	return (pd);
+}
+
+/* Write "passes" copies of the packets to "fp"; return the time taken */
+static double
+write_packets(pcap_t *pd, FILE *fp, u_long passes, pcap_dumper_t **pddp)
+{
+	struct pcap_pkthdr h;
+	pcap_dumper_t *pdd;
+	double start;
+	uint32_t seed = 1;
+	u_long pass;
+	u_int i, j;
+
+	start = now();
+	pdd = pcap_dump_fopen(pd, fp);
+	if (pdd == NULL) {
+		fprintf(stderr, "compress-bench: %s\n", pcap_geterr(pd));
+		exit(1);
+	}
+	for (pass = 0; pass < passes; pass++) {
+		for (i = 0; i < npackets; i++) {
+			h = hdrs[i];
+			h.ts.tv_sec += pass * 3600;
+			memcpy(scratch, data[i], h.caplen);
+			for (j = 14; j < h.caplen; j += 16) {
+				seed = seed * 1103515245 + 12345;
+				scratch[j] = (u_char)(seed >> 16);
+			}
+			pcap_dump((u_char *)pdd, &h, scratch);
+		}
+	}
+	*pddp = pdd;
+	return (now() - start);
+}
+
+static void
+report(const char *name, double write_time, double total, uint64_t bytes,
+    off_t disk, off_t size)
+{
+	printf("%-18s %8.2f %8.2f %8.1f %9.1f %7.2f\n", name, write_time,
+	    total, bytes / 1e6 / total, disk / 1e6, (double)bytes / size);
+	fflush(stdout);
+}
+
+/* --compress */
+static void
+bench_compress(pcap_t *pd, const char *method, const char *path,
+    u_long passes)
+{
+	char name[64], ebuf[PCAP_ERRBUF_SIZE];
+	pcap_dumper_t *pdd;
+	double start, write_time;
+	FILE *fp;
+	int fd;
+
+	snprintf(name, sizeof(name), "--compress %s", method);
+	if (zfile_method(method) == -1) {
+		printf("%-18s (not supported)\n", name);
+		return;
+	}
+	start = now();
+	fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0666);
+	if (fd == -1) {
+		fprintf(stderr, "compress-bench: %s: %s\n", path,
+		    strerror(errno));
+		exit(1);
+	}
+	fp = zfile_wopen(fd, zfile_method(method), -1, ebuf, sizeof(ebuf));
+	if (fp == NULL) {
+		fprintf(stderr, "compress-bench: %s\n", ebuf);
+		exit(1);
+	}
+	write_time = write_packets(pd, fp, passes, &pdd);
+	pcap_dump_close(pdd);
+	report(name, write_time, now() - start,
+	    sizeof(struct pcap_file_header) + capture_bytes * passes,
+	    file_size(path), file_size(path));
+	unlink(path);
+}
+
+/* -z: write the savefile, then run the program on it */
+static void
+bench_program(pcap_t *pd, const char *program, const char *suffix,
+    const char *path, u_long passes)
+{
+#if defined(HAVE_FORK) && !defined(_WIN32)
+	char name[64], zpath[1024];
+	pcap_dumper_t *pdd;
+	double start, write_time;
+	off_t raw;
+	pid_t child;
+	FILE *fp;
+	int status;
+
+	snprintf(name, sizeof(name), "-z %s", program);
+	start = now();
+	fp = fopen(path, "w");
+	if (fp == NULL) {
+		fprintf(stderr, "compress-bench: %s: %s\n", path,
+		    strerror(errno));
+		exit(1);
+	}
+	write_time = write_packets(pd, fp, passes, &pdd);
+	pcap_dump_close(pdd);
+	raw = file_size(path);
+
+	child = fork();
+	if (child == -1) {
+		fprintf(stderr, "compress-bench: fork: %s\n", strerror(errno));
+		exit(1);
+	}
+	if (child == 0) {
+		/* As -z does, but remove the savefile, as gzip does */
+		if (strcmp(program, "zstd") == 0)
+			execlp(program, program, "-q", "--rm", path,
+			    (char *)NULL);
+		else
+			execlp(program, program, path, (char *)NULL);
+		_exit(127);
+	}
+	if (waitpid(child, &status, 0) == -1 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 0) {
+		printf("%-18s (%s failed)\n", name, program);
+		unlink(path);
+		return;
+	}
+	snprintf(zpath, sizeof(zpath), "%s%s", path, suffix);
+	report(name, write_time, now() - start,
+	    sizeof(struct pcap_file_header) + capture_bytes * passes,
+	    raw + file_size(zpath), file_size(zpath));
+	unlink(zpath);
+#else
+	printf("-z %-15s (not supported)\n", program);
+#endif
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *file = "afs.pcap", *dir = ".";
+	u_long mbytes = 256, passes;
+	char path[1024];
+	pcap_t *pd;
+	u_int i;
+
+	if (argc > 1)
+		file = argv[1];
+	if (argc > 2)
+		mbytes = strtoul(argv[2], NULL, 10);
+	if (argc > 3)
+		dir = argv[3];
+	if (mbytes == 0)
+		mbytes = 1;
+
+	pd = read_capture(file);
+	passes = (u_long)((mbytes * 1000000 + capture_bytes - 1) /
+	    capture_bytes);
+	snprintf(path, sizeof(path), "%s/compress-bench.%ld.pcap", dir,
+	    (long)getpid());
+
+	printf("%lu MB of %s, %u packets written %lu times\n", mbytes,
+	    file, npackets, passes);
+	printf("%-18s %8s %8s %8s %9s %7s\n", "method", "write s",
+	    "total s", "MB/s", "disk MB", "ratio");
+	bench_program(pd, "gzip", ".gz", path, passes);
+	bench_compress(pd, "gzip", path, passes);
+	bench_program(pd, "zstd", ".zst", path, passes);
+	bench_compress(pd, "zstd", path, passes);
+
+	pcap_close(pd);
+	for (i = 0; i < npackets; i++)
+		free(data[i]);
+	free(scratch);
+	return (0);
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Benchmark for ESP decryption (-E): the time to dissect each packet of
+ * the ESP test captures, with their own SAs and with thousands of other
+ * SAs, for other SPIs and destinations, added after them, as for a
+ * capture on an IPsec gateway.
+ *
+ * Build it with "make esp-bench" and run it in the tests directory, or
+ * with the tests directory and the number of times to dissect each
+ * capture as arguments.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "netdissect.h"
+#include "print.h"
+
+#ifdef HAVE_LIBCRYPTO
+
+#define MAX_PACKETS	64
+
+static const struct {
+	const char *file;
+	const char *secrets;
+} captures[] = {
+	{ "02-sunrise-sunset-esp.pcap",
+	  "0x12345678@192.1.2.45 3des-cbc-hmac96:0x4043434545464649494a4a4c4c4f4f515152525454575758" },
+	{ "08-sunrise-sunset-esp2.pcap",
+	  "0x12345678@192.1.2.45 3des-cbc-hmac96:0x43434545464649494a4a4c4c4f4f51515252545457575840,"
+	  "0xabcdabcd@192.0.1.1 3des-cbc-hmac96:0x434545464649494a4a4c4c4f4f5151525254545757584043" },
+	{ "08-sunrise-sunset-aes.pcap",
+	  "0xd1234567@192.1.2.45 aes256-cbc-hmac96:0xaaaabbbbccccdddd4043434545464649494a4a4c4c4f4f515152525454575758" },
+	{ "espudp1.pcap",
+	  "0x12345678@192.1.2.45 3des-cbc-hmac96:0x43434545464649494a4a4c4c4f4f51515252545457575840" },
+};
+
+static const u_int sa_counts[] = { 0, 1000, 10000 };
+
+static struct pcap_pkthdr hdrs[MAX_PACKETS];
+static u_char *data[MAX_PACKETS];
+static u_int npackets;
+
+static int
+null_printf(netdissect_options *ndo _U_, const char *fmt _U_, ...)
+{
+	return (0);
+}
+
+static int
+read_capture(const char *dir, const char *file)
+{
+	char path[1024], ebuf[PCAP_ERRBUF_SIZE];
+	struct pcap_pkthdr *h;
+	const u_char *sp;
+	pcap_t *pd;
+	int dlt;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	pd = pcap_open_offline(path, ebuf);
+	if (pd == NULL) {
+		fprintf(stderr, "esp-bench: %s\n", ebuf);
+		exit(1);
+	}
+	for (npackets = 0; npackets < MAX_PACKETS &&
+	    pcap_next_ex(pd, &h, &sp) == 1; npackets++) {
+		hdrs[npackets] = *h;
+		data[npackets] = malloc(h->caplen);
+		if (data[npackets] == NULL) {
+			fprintf(stderr, "esp-bench: malloc\n");
+			exit(1);
+		}
+		memcpy(data[npackets], sp, h->caplen);
+	}
+	dlt = pcap_datalink(pd);
+	pcap_close(pd);
+	return (dlt);
+}
+
+/*
+ * The secrets for a capture, followed by "count" SAs of no use for it,
+ * which are looked at first.
+ */
+static char *
+make_secrets(const char *secrets, u_int count)
+{
+	size_t size, len;
+	char *s;
+	u_int i;
+
+	size = strlen(secrets) + 1 + (size_t)count * 96;
+	s = malloc(size);
+	if (s == NULL) {
+		fprintf(stderr, "esp-bench: malloc\n");
+		exit(1);
+	}
+	len = strlcpy(s, secrets, size);
+	for (i = 0; i < count; i++)
+		len += snprintf(s + len, size - len,
+		    ",0x%08x@198.18.%u.%u 3des-cbc-hmac96:0x%048x",
+		    0x10000000U + i, (i >> 8) & 0xff, i & 0xff, i);
+	return (s);
+}
+
+static double
+bench(int dlt, const char *secrets, u_int count, u_long passes)
+{
+	netdissect_options ndo;
+	clock_t start;
+	double elapsed;
+	u_long pass;
+	u_int i;
+
+	memset(&ndo, 0, sizeof(ndo));
+	ndo_set_function_pointers(&ndo);
+	ndo.ndo_printf = null_printf;
+	ndo.ndo_nflag = 1;
+	ndo.program_name = "esp-bench";
+	ndo.ndo_espsecret = make_secrets(secrets, count);
+	init_print(&ndo, 0, 0);
+	ndo.ndo_if_printer = get_if_printer(&ndo, dlt);
+
+	/* The first pass reads the secrets */
+	for (i = 0; i < npackets; i++)
+		pretty_print_packet(&ndo, &hdrs[i], data[i], i + 1);
+
+	start = clock();
+	for (pass = 0; pass < passes; pass++)
+		for (i = 0; i < npackets; i++)
+			pretty_print_packet(&ndo, &hdrs[i], data[i], i + 1);
+	elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	nd_free_state(&ndo);
+	free(ndo.ndo_espsecret);
+	return (elapsed * 1e9 / ((double)passes * npackets));
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *dir = ".";
+	u_long passes = 20000;
+	char ebuf[PCAP_ERRBUF_SIZE];
+	u_int c, n, i;
+	int dlt;
+
+	if (argc > 1)
+		dir = argv[1];
+	if (argc > 2)
+		passes = strtoul(argv[2], NULL, 10);
+	if (passes == 0)
+		passes = 1;
+	if (nd_init(ebuf, sizeof(ebuf)) == -1) {
+		fprintf(stderr, "esp-bench: %s\n", ebuf);
+		return (1);
+	}
+
+	printf("%-28s", "ns per packet, other SAs:");
+	for (n = 0; n < sizeof(sa_counts) / sizeof(sa_counts[0]); n++)
+		printf(" %10u", sa_counts[n]);
+	printf("\n");
+	for (c = 0; c < sizeof(captures) / sizeof(captures[0]); c++) {
+		dlt = read_capture(dir, captures[c].file);
+		printf("%-28s", captures[c].file);
+		for (n = 0; n < sizeof(sa_counts) / sizeof(sa_counts[0]); n++) {
+			printf(" %10.0f", bench(dlt, captures[c].secrets,
+			    sa_counts[n], passes));
+			fflush(stdout);
+		}
+		printf("\n");
+		for (i = 0; i < npackets; i++)
+			free(data[i]);
+	}
+	nd_cleanup();
+	return (0);
+}
+#else /* HAVE_LIBCRYPTO */
+int
+main(void)
+{
+	printf("esp-bench: no ESP decryption (built without libcrypto)\n");
+	return (0);
+}
+#endif /* HAVE_LIBCRYPTO */
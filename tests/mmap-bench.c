@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Benchmark for memory-mapped savefiles: the records read per second
+ * from a large generated capture, in pcap and in pcapng format, by
+ * pcap_loop() and by the --mmap reader, with no filter and with the
+ * filter "tcp".  The callback touches the last byte of each packet, so
+ * that the packet data is read as well as the record headers.  "cold"
+ * is with the savefile dropped from the page cache first, where the
+ * system lets us do that; "warm" is with it already in the cache.
+ *
+ * Build it with "make mmap-bench" and run it with the number of
+ * megabytes of packets to generate (1024 by default) and the directory
+ * to write the captures in (the current one by default) as arguments.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <sys/time.h>
+
+#include <pcap.h>
+
+#include "mfile.h"
+
+struct counts {
+	uint64_t packets;
+	uint64_t bytes;
+	u_int sum;
+};
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1e6);
+}
+
+static uint32_t seed = 1;
+
+static uint32_t
+random32(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 1);
+}
+
+/*
+ * Make a packet of Ethernet, IPv4, and TCP or UDP; most are either
+ * bare TCP ACKs or full-sized, as in a bulk transfer.
+ */
+static u_int
+make_packet(u_char *pkt)
+{
+	static const u_char ether[14] = {
+		0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+		0x00, 0x66, 0x77, 0x88, 0x99, 0xaa,
+		0x08, 0x00
+	};
+	uint32_t r = random32();
+	u_int len, i;
+	int tcp;
+
+	switch (r % 10) {
+	case 0: case 1: case 2: case 3:
+		len = 66;
+		break;
+	case 4: case 5: case 6:
+		len = 1514;
+		break;
+	default:
+		len = 100 + (r >> 8) % 1300;
+		break;
+	}
+	tcp = (r >> 4) % 8 != 0;
+	memcpy(pkt, ether, sizeof(ether));
+	memset(pkt + 14, 0, 20);
+	pkt[14] = 0x45;
+	pkt[16] = (u_char)((len - 14) >> 8);
+	pkt[17] = (u_char)(len - 14);
+	pkt[22] = 64;
+	pkt[23] = tcp ? 6 : 17;
+	pkt[26] = 10;
+	pkt[29] = (u_char)r;
+	pkt[30] = 10;
+	pkt[33] = (u_char)(r >> 8);
+	for (i = 34; i < len; i++)
+		pkt[i] = (u_char)random32();
+	return (len);
+}
+
+static void
+put32(FILE *fp, uint32_t v)
+{
+	fwrite(&v, sizeof(v), 1, fp);
+}
+
+static void
+put16(FILE *fp, uint16_t v)
+{
+	fwrite(&v, sizeof(v), 1, fp);
+}
+
+/*
+ * Write "mbytes" megabytes of packets to a pcap and a pcapng savefile,
+ * in our own byte order; return the number of packets.
+ */
+static uint64_t
+generate(const char *pcap_path, const char *pcapng_path, u_long mbytes)
+{
+	static const u_char pad[4];
+	u_char pkt[1514];
+	FILE *fp, *ngfp;
+	uint64_t npackets, written, ts;
+	u_int len;
+
+	fp = fopen(pcap_path, "wb");
+	ngfp = fopen(pcapng_path, "wb");
+	if (fp == NULL || ngfp == NULL) {
+		fprintf(stderr, "mmap-bench: %s\n", strerror(errno));
+		exit(1);
+	}
+	setvbuf(fp, NULL, _IOFBF, 1024 * 1024);
+	setvbuf(ngfp, NULL, _IOFBF, 1024 * 1024);
+
+	/* pcap file header */
+	put32(fp, 0xa1b2c3d4);
+	put16(fp, 2);
+	put16(fp, 4);
+	put32(fp, 0);
+	put32(fp, 0);
+	put32(fp, 65535);
+	put32(fp, DLT_EN10MB);
+
+	/* pcapng Section Header and Interface Description Blocks */
+	put32(ngfp, 0x0A0D0D0A);
+	put32(ngfp, 28);
+	put32(ngfp, 0x1A2B3C4D);
+	put16(ngfp, 1);
+	put16(ngfp, 0);
+	put32(ngfp, 0xffffffff);
+	put32(ngfp, 0xffffffff);
+	put32(ngfp, 28);
+	put32(ngfp, 1);
+	put32(ngfp, 20);
+	put16(ngfp, DLT_EN10MB);
+	put16(ngfp, 0);
+	put32(ngfp, 65535);
+	put32(ngfp, 20);
+
+	ts = (uint64_t)1700000000 * 1000000;
+	for (npackets = 0, written = 0; written < mbytes * 1000000;
+	    npackets++) {
+		len = make_packet(pkt);
+		ts += 1 + random32() % 200;
+
+		put32(fp, (uint32_t)(ts / 1000000));
+		put32(fp, (uint32_t)(ts % 1000000));
+		put32(fp, len);
+		put32(fp, len);
+		fwrite(pkt, len, 1, fp);
+		written += 16 + len;
+
+		put32(ngfp, 6);
+		put32(ngfp, 32 + ((len + 3) & ~3U));
+		put32(ngfp, 0);
+		put32(ngfp, (uint32_t)(ts >> 32));
+		put32(ngfp, (uint32_t)ts);
+		put32(ngfp, len);
+		put32(ngfp, len);
+		fwrite(pkt, len, 1, ngfp);
+		fwrite(pad, (4 - len % 4) % 4, 1, ngfp);
+		put32(ngfp, 32 + ((len + 3) & ~3U));
+	}
+	if (fclose(fp) == EOF || fclose(ngfp) == EOF) {
+		fprintf(stderr, "mmap-bench: %s\n", strerror(errno));
+		exit(1);
+	}
+	return (npackets);
+}
+
+/* Drop the savefile from the page cache, if we can */
+static int
+drop_cache(const char *path)
+{
+#ifdef POSIX_FADV_DONTNEED
+	int fd, ret;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return (0);
+	ret = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+	close(fd);
+	return (ret);
+#else
+	return (0);
+#endif
+}
+
+static void
+count_packet(u_char *user, const struct pcap_pkthdr *h, const u_char *sp)
+{
+	struct counts *c = (struct counts *)user;
+
+	c->packets++;
+	c->bytes += h->caplen;
+	if (h->caplen != 0)
+		c->sum += sp[h->caplen - 1];
+}
+
+/* Read the savefile once; return the time taken */
+static double
+read_savefile(const char *path, int use_mmap, const char *filter,
+    struct counts *c)
+{
+	char ebuf[PCAP_ERRBUF_SIZE];
+	struct bpf_program fcode;
+	struct mfile *mf = NULL;
+	double start;
+	pcap_t *pd;
+	int status;
+
+	memset(c, 0, sizeof(*c));
+	start = now();
+	pd = pcap_open_offline(path, ebuf);
+	if (pd == NULL) {
+		fprintf(stderr, "mmap-bench: %s\n", ebuf);
+		exit(1);
+	}
+	if (filter != NULL) {
+		if (pcap_compile(pd, &fcode, filter, 1,
+		    PCAP_NETMASK_UNKNOWN) < 0 || pcap_setfilter(pd, &fcode) < 0) {
+			fprintf(stderr, "mmap-bench: %s\n", pcap_geterr(pd));
+			exit(1);
+		}
+	}
+	if (use_mmap) {
+		mf = mfile_open(pd, fileno(pcap_file(pd)), ebuf, sizeof(ebuf));
+		if (mf == NULL) {
+			fprintf(stderr, "mmap-bench: %s: %s\n", path,
+			    ebuf[0] != '\0' ? ebuf : "can't be mapped");
+			exit(1);
+		}
+		status = mfile_loop(mf, -1, count_packet, (u_char *)c,
+		    filter != NULL ? &fcode : NULL);
+	} else
+		status = pcap_loop(pd, -1, count_packet, (u_char *)c);
+	if (status == -1) {
+		fprintf(stderr, "mmap-bench: %s\n",
+		    mf != NULL ? mfile_geterr(mf) : pcap_geterr(pd));
+		exit(1);
+	}
+	if (mf != NULL)
+		mfile_close(mf);
+	pcap_close(pd);
+	if (filter != NULL)
+		pcap_freecode(&fcode);
+	return (now() - start);
+}
+
+static void
+bench(const char *format, const char *path, const char *filter, int cold)
+{
+	struct counts c[2];
+	double secs;
+	int use_mmap;
+
+	if (cold && !drop_cache(path)) {
+		printf("%-7s %-8s %-7s %-5s (can't drop the page cache)\n",
+		    format, "both", filter != NULL ? filter : "none", "cold");
+		return;
+	}
+	for (use_mmap = 0; use_mmap < 2; use_mmap++) {
+		if (cold)
+			(void)drop_cache(path);
+		secs = read_savefile(path, use_mmap, filter, &c[use_mmap]);
+		printf("%-7s %-8s %-7s %-5s %8.3f %12.0f %9.1f\n", format,
+		    use_mmap ? "--mmap" : "libpcap",
+		    filter != NULL ? filter : "none", cold ? "cold" : "warm",
+		    secs, c[use_mmap].packets / secs,
+		    c[use_mmap].bytes / 1e6 / secs);
+		fflush(stdout);
+	}
+	if (c[0].packets != c[1].packets || c[0].bytes != c[1].bytes ||
+	    c[0].sum != c[1].sum) {
+		fprintf(stderr, "mmap-bench: %s: the readers disagree\n", path);
+		exit(1);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *dir = ".";
+	char pcap_path[1024], pcapng_path[1024];
+	u_long mbytes = 1024;
+	uint64_t npackets;
+	double start;
+
+	if (argc > 1)
+		mbytes = strtoul(argv[1], NULL, 10);
+	if (argc > 2)
+		dir = argv[2];
+	if (mbytes == 0)
+		mbytes = 1;
+
+	snprintf(pcap_path, sizeof(pcap_path), "%s/mmap-bench.%ld.pcap", dir,
+	    (long)getpid());
+	snprintf(pcapng_path, sizeof(pcapng_path), "%s/mmap-bench.%ld.pcapng",
+	    dir, (long)getpid());
+	start = now();
+	npackets = generate(pcap_path, pcapng_path, mbytes);
+	printf("%lu MB of packets, %llu packets, generated in %.1f s\n",
+	    mbytes, (unsigned long long)npackets, now() - start);
+	printf("%-7s %-8s %-7s %-5s %8s %12s %9s\n", "format", "reader",
+	    "filter", "cache", "secs", "records/s", "MB/s");
+
+	bench("pcap", pcap_path, NULL, 1);
+	bench("pcap", pcap_path, NULL, 0);
+	bench("pcap", pcap_path, "tcp", 0);
+	bench("pcapng", pcapng_path, NULL, 1);
+	bench("pcapng", pcapng_path, NULL, 0);
+	bench("pcapng", pcapng_path, "tcp", 0);
+
+	unlink(pcap_path);
+	unlink(pcapng_path);
+	return (0);
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Benchmark for --name-map files: the time to load a file with a
+ * million entries, mostly IPv4 addresses, with some IPv6 addresses, MAC
+ * addresses and ports, in shuffled and in sorted order, and the time
+ * per lookup.
+ *
+ * Build it with "make name-map-bench" and run it with no arguments, or
+ * with the number of entries; it writes its files in the current
+ * directory, and removes them.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "netdissect.h"
+#include "namemap.h"
+
+#define NLOOKUPS	10000000
+
+static volatile size_t sink;
+
+static double
+now(void)
+{
+	return ((double)clock() / CLOCKS_PER_SEC);
+}
+
+/* The i'th IPv4 address in the file */
+static uint32_t
+nth_addr(u_long i)
+{
+	return (htonl(0x0a000000U + (uint32_t)i));
+}
+
+static void
+write_file(const char *file, u_long n, int shuffled)
+{
+	FILE *fp;
+	u_long i, j;
+	uint32_t a;
+
+	fp = fopen(file, "w");
+	if (fp == NULL) {
+		perror(file);
+		exit(1);
+	}
+	fprintf(fp, "# %lu names\n", n);
+	for (i = 0; i < n; i++) {
+		/* A prime multiplier visits each of the n entries once */
+		j = shuffled ? (u_long)(((uint64_t)i * 2654435761U) % n) : i;
+		switch (j % 16) {
+
+		case 0:
+			fprintf(fp, "2001:db8::%lx:%lx\thost6-%lu\n",
+			    j >> 16, j & 0xffff, j);
+			break;
+
+		case 1:
+			fprintf(fp, "02:00:%02lx:%02lx:%02lx:%02lx,mac-%lu\n",
+			    (j >> 24) & 0xff, (j >> 16) & 0xff,
+			    (j >> 8) & 0xff, j & 0xff, j);
+			break;
+
+		case 2:
+			fprintf(fp, "%lu/%s\tservice-%lu\n", (j / 16) % 65536,
+			    j & 16 ? "udp" : "tcp", j);
+			break;
+
+		default:
+			a = ntohl(nth_addr(j));
+			fprintf(fp, "%u.%u.%u.%u\thost-%lu.example.com\n",
+			    a >> 24, (a >> 16) & 0xff, (a >> 8) & 0xff,
+			    a & 0xff, j);
+			break;
+		}
+	}
+	fclose(fp);
+}
+
+static void
+bench_load(const char *file, u_long n, int shuffled)
+{
+	struct nd_name_map *map;
+	char errbuf[256];
+	double start, load, lookup;
+	u_long i, hits = 0;
+	uint32_t addr;
+	size_t len;
+
+	write_file(file, n, shuffled);
+	start = now();
+	map = nd_name_map_load(file, errbuf, sizeof(errbuf));
+	load = now() - start;
+	if (map == NULL) {
+		fprintf(stderr, "name-map-bench: %s\n", errbuf);
+		exit(1);
+	}
+
+	start = now();
+	for (i = 0; i < NLOOKUPS; i++) {
+		/* Three in four are in the map */
+		addr = nth_addr((i * 40503UL) % (n + n / 3));
+		if (nd_name_map_lookup(map, NAME_MAP_IPV4, &addr, &len) != NULL)
+			hits++;
+	}
+	lookup = now() - start;
+	sink = hits;
+
+	printf("%-10s %8lu %10u %10.1f %10.0f %10.1f\n",
+	    shuffled ? "shuffled" : "sorted", n,
+	    nd_name_map_count(map, NAME_MAP_IPV4), load * 1e3,
+	    n / load / 1e3, lookup * 1e9 / NLOOKUPS);
+	nd_name_map_free(map);
+	remove(file);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *file = "name-map-bench.txt";
+	u_long n = 1000000;
+
+	if (argc > 1)
+		n = strtoul(argv[1], NULL, 10);
+	if (n == 0)
+		n = 1;
+
+	printf("%-10s %8s %10s %10s %10s %10s\n", "file", "entries",
+	    "IPv4", "load ms", "k/s", "ns/lookup");
+	bench_load(file, n, 0);
+	bench_load(file, n, 1);
+	return (0);
+}
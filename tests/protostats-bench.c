@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Benchmark for --protocol-stats: the time tcpdump takes to go through
+ * a large generated capture printing each packet, with -n and with
+ * -n -v, and counting its protocols with --protocol-stats instead.  The
+ * total number of packets counted must be the number of lines printed
+ * with -n.
+ *
+ * Build it with "make protostats-bench" and run it with the tcpdump to
+ * run ("./tcpdump" by default), the number of megabytes of packets to
+ * generate (256 by default), and the directory to write the capture in
+ * (the current one by default) as arguments.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <sys/time.h>
+
+#include <pcap.h>
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1e6);
+}
+
+static uint32_t seed = 1;
+
+static uint32_t
+random32(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 1);
+}
+
+/*
+ * Make a packet of Ethernet, IPv4, and TCP to port 80, UDP to port 53
+ * or ICMP, in one of 64 conversations.
+ */
+static u_int
+make_packet(u_char *pkt)
+{
+	static const u_char ether[14] = {
+		0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+		0x00, 0x66, 0x77, 0x88, 0x99, 0xaa,
+		0x08, 0x00
+	};
+	uint32_t r = random32();
+	u_int len, i, conv, proto;
+
+	conv = (r >> 20) % 64;
+	switch (r % 10) {
+	case 0: case 1: case 2: case 3: case 4: case 5:
+		proto = 6;
+		len = r % 3 == 0 ? 66 : 100 + (r >> 8) % 1400;
+		break;
+	case 6: case 7: case 8:
+		proto = 17;
+		len = 80 + (r >> 8) % 100;
+		break;
+	default:
+		proto = 1;
+		len = 98;
+		break;
+	}
+	memcpy(pkt, ether, sizeof(ether));
+	memset(pkt + 14, 0, 40);
+	pkt[14] = 0x45;
+	pkt[16] = (u_char)((len - 14) >> 8);
+	pkt[17] = (u_char)(len - 14);
+	pkt[22] = 64;
+	pkt[23] = (u_char)proto;
+	pkt[26] = 10;
+	pkt[29] = (u_char)conv;
+	pkt[30] = 10;
+	pkt[33] = 200;
+	switch (proto) {
+	case 6:
+		pkt[34] = 0x80;
+		pkt[35] = (u_char)conv;
+		pkt[37] = 80;
+		pkt[46] = 0x50;
+		pkt[47] = 0x18;
+		pkt[48] = 0x10;
+		i = 54;
+		break;
+	case 17:
+		pkt[34] = 0x80;
+		pkt[35] = (u_char)conv;
+		pkt[37] = 53;
+		pkt[38] = (u_char)((len - 34) >> 8);
+		pkt[39] = (u_char)(len - 34);
+		i = 42;
+		break;
+	default:
+		pkt[34] = 8;
+		i = 42;
+		break;
+	}
+	for (; i < len; i++)
+		pkt[i] = (u_char)random32();
+	return (len);
+}
+
+static void
+put32(FILE *fp, uint32_t v)
+{
+	fwrite(&v, sizeof(v), 1, fp);
+}
+
+static void
+put16(FILE *fp, uint16_t v)
+{
+	fwrite(&v, sizeof(v), 1, fp);
+}
+
+/*
+ * Write "mbytes" megabytes of packets to a pcap savefile, in our own
+ * byte order; return the number of packets.
+ */
+static uint64_t
+generate(const char *path, u_long mbytes)
+{
+	u_char pkt[1514];
+	FILE *fp;
+	uint64_t npackets, written, ts;
+	u_int len;
+
+	fp = fopen(path, "wb");
+	if (fp == NULL) {
+		fprintf(stderr, "protostats-bench: %s\n", strerror(errno));
+		exit(1);
+	}
+	setvbuf(fp, NULL, _IOFBF, 1024 * 1024);
+	put32(fp, 0xa1b2c3d4);
+	put16(fp, 2);
+	put16(fp, 4);
+	put32(fp, 0);
+	put32(fp, 0);
+	put32(fp, 65535);
+	put32(fp, DLT_EN10MB);
+
+	ts = (uint64_t)1700000000 * 1000000;
+	for (npackets = 0, written = 0; written < mbytes * 1000000;
+	    npackets++) {
+		len = make_packet(pkt);
+		ts += 1 + random32() % 200;
+		put32(fp, (uint32_t)(ts / 1000000));
+		put32(fp, (uint32_t)(ts % 1000000));
+		put32(fp, len);
+		put32(fp, len);
+		fwrite(pkt, len, 1, fp);
+		written += 16 + len;
+	}
+	if (fclose(fp) == EOF) {
+		fprintf(stderr, "protostats-bench: %s\n", strerror(errno));
+		exit(1);
+	}
+	return (npackets);
+}
+
+/*
+ * Run tcpdump on the savefile; return the time taken, and the number
+ * of lines printed, or the total of the packets counted.
+ */
+static double
+run(const char *tcpdump, const char *path, const char *args,
+    uint64_t *countp)
+{
+	char cmd[2048], line[256];
+	double start;
+	FILE *fp;
+
+	snprintf(cmd, sizeof(cmd), "%s %s -r %s 2>/dev/null", tcpdump, args,
+	    path);
+	*countp = 0;
+	start = now();
+	fp = popen(cmd, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "protostats-bench: %s: %s\n", cmd,
+		    strerror(errno));
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (strncmp(line, "total ", 6) == 0)
+			*countp = strtoull(line + 6, NULL, 10);
+		else if (strchr(line, '\n') != NULL &&
+		    strstr(args, "--protocol-stats") == NULL)
+			(*countp)++;
+	}
+	if (pclose(fp) != 0) {
+		fprintf(stderr, "protostats-bench: %s failed\n", cmd);
+		exit(1);
+	}
+	return (now() - start);
+}
+
+int
+main(int argc, char **argv)
+{
+	/* -v puts the IP header on a line of its own, so don't count those */
+	static const struct {
+		const char *args;
+		int check;
+	} modes[] = {
+		{ "-n", 1 },
+		{ "-n -v", 0 },
+		{ "--protocol-stats", 1 },
+	};
+	const char *tcpdump = "./tcpdump", *dir = ".";
+	char path[1024];
+	u_long mbytes = 256;
+	uint64_t npackets, count;
+	double start, secs, base = 0;
+	u_int i;
+
+	if (argc > 1)
+		tcpdump = argv[1];
+	if (argc > 2)
+		mbytes = strtoul(argv[2], NULL, 10);
+	if (argc > 3)
+		dir = argv[3];
+	if (mbytes == 0)
+		mbytes = 1;
+
+	snprintf(path, sizeof(path), "%s/protostats-bench.%ld.pcap", dir,
+	    (long)getpid());
+	start = now();
+	npackets = generate(path, mbytes);
+	printf("%lu MB of packets, %llu packets, generated in %.1f s\n",
+	    mbytes, (unsigned long long)npackets, now() - start);
+	printf("%-18s %8s %12s %8s\n", "mode", "secs", "packets/s",
+	    "speedup");
+
+	/* Once to get the savefile into the page cache */
+	(void)run(tcpdump, path, "--count", &count);
+	for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		secs = run(tcpdump, path, modes[i].args, &count);
+		if (i == 0)
+			base = secs;
+		printf("%-18s %8.3f %12.0f %7.2fx\n", modes[i].args, secs,
+		    npackets / secs, base / secs);
+		fflush(stdout);
+		if (modes[i].check && count != npackets) {
+			fprintf(stderr,
+			    "protostats-bench: %s got %llu packets, not %llu\n",
+			    modes[i].args, (unsigned long long)count,
+			    (unsigned long long)npackets);
+			unlink(path);
+			exit(1);
+		}
+	}
+
+	unlink(path);
+	return (0);
+}
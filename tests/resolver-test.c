@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Test of the resolver threads (--resolver-threads), with a stub
+ * resolver in place of the system's, so that no network is needed:
+ * names come in the background, failures are remembered, lookups that
+ * take too long are given up on, and no more lookups than there are
+ * threads are ever made at once.
+ *
+ * "make check" runs it; it exits with status 1 if a test fails.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netdissect.h"
+#include "addrtoname.h"
+#include "netdissect-alloc.h"
+#include "resolver.h"
+
+#ifdef HAVE_LIBPTHREAD
+
+#include <pthread.h>
+#include <time.h>
+
+#define NTHREADS	3
+#define TIMEOUT_MS	1000
+
+/*
+ * The stub: 192.0.2.n is named "host-n.example" for odd n and has no
+ * name for even n, except that 192.0.2.200 takes three seconds to answer;
+ * 2001:db8::1 is "v6.example".
+ */
+static pthread_mutex_t stub_lock = PTHREAD_MUTEX_INITIALIZER;
+static u_int stub_calls[256];
+static u_int stub_busy, stub_busy_max;
+
+static void
+sleep_ms(u_int ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (long)(ms % 1000) * 1000000;
+	nanosleep(&ts, NULL);
+}
+
+static int
+stub_resolve(int af, const void *addr, char *name, size_t namesize,
+	     void *arg _U_)
+{
+	const u_char *a = addr;
+	int r;
+
+	pthread_mutex_lock(&stub_lock);
+	if (++stub_busy > stub_busy_max)
+		stub_busy_max = stub_busy;
+	if (af == AF_INET)
+		stub_calls[a[3]]++;
+	pthread_mutex_unlock(&stub_lock);
+
+	if (af == AF_INET6) {
+		snprintf(name, namesize, "v6.example");
+		r = a[15] == 1 ? 0 : -1;
+	} else if (a[3] == 200) {
+		sleep_ms(3000);
+		snprintf(name, namesize, "slow.example");
+		r = 0;
+	} else {
+		sleep_ms(5);
+		snprintf(name, namesize, "host-%u.example", a[3]);
+		r = a[3] % 2 == 1 ? 0 : -1;
+	}
+
+	pthread_mutex_lock(&stub_lock);
+	stub_busy--;
+	pthread_mutex_unlock(&stub_lock);
+	return (r);
+}
+
+static int failures;
+
+static void
+check(int ok, const char *what)
+{
+	printf("    %-60s: %s\n", what, ok ? "passed" : "FAILED");
+	if (!ok)
+		failures++;
+}
+
+/* Look an address up until it's no longer pending */
+static int
+wait_for(int af, const u_char *addr, char *name, size_t namesize)
+{
+	int i, r;
+
+	for (i = 0; i < 300; i++) {
+		r = nd_resolver_lookup(af, addr, name, namesize);
+		if (r != RESOLVER_PENDING)
+			return (r);
+		sleep_ms(10);
+	}
+	return (RESOLVER_PENDING);
+}
+
+static NORETURN void
+ndo_error_exit(netdissect_options *ndo _U_, status_exit_codes_t status,
+	       FORMAT_STRING(const char *fmt), ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+	exit(status);
+}
+
+int
+main(void)
+{
+	netdissect_options ndo;
+	char errbuf[256], name[NI_MAXHOST];
+	u_char a4[4] = { 192, 0, 2, 0 };
+	u_char a6[16] = { 0x20, 0x01, 0x0d, 0xb8 };
+	struct nd_resolver_stats stats;
+	const char *s1, *s2;
+	u_int i;
+	int r, ok;
+
+	if (nd_resolver_start(NTHREADS, TIMEOUT_MS, stub_resolve, NULL,
+	    errbuf, sizeof(errbuf)) < 0) {
+		fprintf(stderr, "resolver-test: %s\n", errbuf);
+		return (1);
+	}
+
+	a4[3] = 1;
+	r = nd_resolver_lookup(AF_INET, a4, name, sizeof(name));
+	check(r == RESOLVER_PENDING, "first lookup is pending");
+	r = wait_for(AF_INET, a4, name, sizeof(name));
+	check(r == RESOLVER_FOUND && strcmp(name, "host-1.example") == 0,
+	    "name found in the background");
+
+	a4[3] = 2;
+	r = wait_for(AF_INET, a4, name, sizeof(name));
+	for (i = 0; i < 10; i++)
+		if (nd_resolver_lookup(AF_INET, a4, name, sizeof(name)) !=
+		    RESOLVER_NONE)
+			r = RESOLVER_PENDING;
+	check(r == RESOLVER_NONE && stub_calls[2] == 1,
+	    "address without a name looked up once");
+
+	a6[15] = 1;
+	r = wait_for(AF_INET6, a6, name, sizeof(name));
+	check(r == RESOLVER_FOUND && strcmp(name, "v6.example") == 0,
+	    "IPv6 name found");
+
+	a4[3] = 200;
+	r = wait_for(AF_INET, a4, name, sizeof(name));
+	check(r == RESOLVER_NONE, "slow lookup timed out");
+
+	/* Queue a burst of addresses, more than there are threads */
+	for (i = 3; i < 100; i++) {
+		a4[3] = (u_char)i;
+		(void)nd_resolver_lookup(AF_INET, a4, name, sizeof(name));
+	}
+	ok = 1;
+	for (i = 3; i < 100; i++) {
+		a4[3] = (u_char)i;
+		r = wait_for(AF_INET, a4, name, sizeof(name));
+		if (r != (i % 2 == 1 ? RESOLVER_FOUND : RESOLVER_NONE))
+			ok = 0;
+	}
+	check(ok, "burst of addresses resolved");
+	check(stub_busy_max <= NTHREADS, "no more lookups at once than threads");
+
+	/* Through ipaddr_string(), with a cache of its own */
+	memset(&ndo, 0, sizeof(ndo));
+	nd_init_state(&ndo);
+	ndo.ndo_error = ndo_error_exit;
+	a4[3] = 141;
+	s1 = ipaddr_string(&ndo, a4);
+	a4[3] = 143;
+	s2 = ipaddr_string(&ndo, a4);
+	check(strcmp(s1, "192.0.2.141") == 0 && strcmp(s2, "192.0.2.143") == 0,
+	    "ipaddr_string() prints pending addresses as numbers");
+	nd_free_all(&ndo);
+	a4[3] = 141;
+	(void)wait_for(AF_INET, a4, name, sizeof(name));
+	check(strcmp(ipaddr_string(&ndo, a4), "host-141.example") == 0,
+	    "ipaddr_string() prints the name once it's in");
+	ndo.ndo_Nflag = 1;
+	a4[3] = 143;
+	(void)wait_for(AF_INET, a4, name, sizeof(name));
+	check(strcmp(ipaddr_string(&ndo, a4), "host-143") == 0,
+	    "ipaddr_string() removes the domain with -N");
+	a4[3] = 142;
+	(void)ipaddr_string(&ndo, a4);
+	(void)wait_for(AF_INET, a4, name, sizeof(name));
+	check(strcmp(ipaddr_string(&ndo, a4), "192.0.2.142") == 0,
+	    "ipaddr_string() prints an address without a name as a number");
+	nd_free_state(&ndo);
+
+	nd_resolver_get_stats(&stats);
+	check(stats.timed_out == 1 && stats.dropped == 0 &&
+	    stats.found + stats.failed + stats.timed_out == stats.queued,
+	    "counters add up");
+
+	if (failures != 0) {
+		printf("%d resolver test%s failed\n", failures,
+		    failures == 1 ? "" : "s");
+		return (1);
+	}
+	return (0);
+}
+#else /* HAVE_LIBPTHREAD */
+int
+main(void)
+{
+	printf("    %-60s: skipped (no thread support)\n", "resolver tests");
+	return (0);
+}
+#endif /* HAVE_LIBPTHREAD */
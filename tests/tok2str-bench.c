@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Microbenchmark for tok2str() and bittok2str(): the time per lookup,
+ * for a few kinds of table, with libnetdissect's indexed lookups and
+ * with the linear scans they replaced.
+ *
+ * Build it with "make tok2str-bench" and run it with no arguments, or
+ * with the number of lookups to time for each table.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "netdissect.h"
+#include "oui.h"
+
+#define TABLE_MAX	1024
+#define NVALUES		4096	/* values looked up, round-robin */
+
+static struct tok dense[256 + 1];
+static struct tok sparse[300 + 1];
+static char names[TABLE_MAX][16];
+
+static const struct tok small[] = {
+	{ 1, "one" },
+	{ 2, "two" },
+	{ 3, "three" },
+	{ 5, "five" },
+	{ 8, "eight" },
+	{ 13, "thirteen" },
+	{ 0, NULL }
+};
+
+static const struct tok flags[] = {
+	{ 0x0001, "A" }, { 0x0002, "B" }, { 0x0004, "C" }, { 0x0008, "D" },
+	{ 0x0010, "E" }, { 0x0020, "F" }, { 0x0040, "G" }, { 0x0080, "H" },
+	{ 0x0100, "I" }, { 0x0200, "J" }, { 0x0400, "K" }, { 0x0800, "L" },
+	{ 0x1000, "M" }, { 0x2000, "N" }, { 0x4000, "O" }, { 0x8000, "P" },
+	{ 0, NULL }
+};
+
+static volatile size_t sink;
+
+/* tok2strbuf() as it was, scanning the table */
+static const char *
+scan_tok2str(const struct tok *lp, const char *fmt, u_int v)
+{
+	static char buf[128];
+
+	while (lp->s != NULL) {
+		if (lp->v == v)
+			return (lp->s);
+		++lp;
+	}
+	(void)snprintf(buf, sizeof(buf), fmt, v);
+	return (buf);
+}
+
+/* bittok2str_internal() as it was, trying each bit for each token */
+static const char *
+scan_bittok2str(const struct tok *lp, const char *fmt, u_int v)
+{
+	static char buf[1024+1];
+	u_int rotbit, tokval;
+	const char *sepstr = "";
+
+	buf[0] = '\0';
+	while (lp->s != NULL) {
+		tokval = lp->v;
+		rotbit = 1;
+		while (rotbit != 0) {
+			if (tokval == (v & rotbit)) {
+				strlcat(buf, sepstr, sizeof(buf));
+				strlcat(buf, lp->s, sizeof(buf));
+				sepstr = ", ";
+				break;
+			}
+			rotbit = rotbit << 1;
+		}
+		lp++;
+	}
+	if (buf[0] == '\0')
+		(void)snprintf(buf, sizeof(buf), fmt, v);
+	return (buf);
+}
+
+/*
+ * Pick values to look up: mostly ones in the table, with one in
+ * eight not in it.
+ */
+static void
+pick_values(const struct tok *table, u_int *values)
+{
+	u_int n, i;
+
+	for (n = 0; table[n].s != NULL; n++)
+		;
+	srand(1);
+	for (i = 0; i < NVALUES; i++) {
+		if (i % 8 == 7)
+			values[i] = 0xfffffff0U - i;
+		else
+			values[i] = table[(u_int)rand() % n].v;
+	}
+}
+
+static double
+time_lookups(const char *(*lookup)(const struct tok *, const char *, u_int),
+    const struct tok *table, const u_int *values, u_long count)
+{
+	clock_t start;
+	u_long i;
+	size_t sum = 0;
+
+	start = clock();
+	for (i = 0; i < count; i++)
+		sum += (size_t)lookup(table, "#%u", values[i % NVALUES])[0];
+	sink = sum;
+	return ((double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / count);
+}
+
+static const char *
+lib_tok2str(const struct tok *lp, const char *fmt, u_int v)
+{
+	return (tok2str(lp, fmt, v));
+}
+
+static const char *
+lib_bittok2str(const struct tok *lp, const char *fmt, u_int v)
+{
+	return (bittok2str(lp, fmt, v));
+}
+
+static void
+bench(const char *name, const struct tok *table, u_long count)
+{
+	u_int values[NVALUES];
+	double before, after;
+
+	pick_values(table, values);
+	before = time_lookups(scan_tok2str, table, values, count);
+	after = time_lookups(lib_tok2str, table, values, count);
+	printf("%-24s %10.1f %10.1f\n", name, before, after);
+}
+
+int
+main(int argc, char **argv)
+{
+	u_long count = 10000000;
+	u_int values[NVALUES];
+	u_int i;
+	double before, after;
+
+	if (argc > 1)
+		count = strtoul(argv[1], NULL, 10);
+
+	for (i = 0; i < 256; i++) {
+		snprintf(names[i], sizeof(names[i]), "dense-%u", i);
+		dense[i].v = i;
+		dense[i].s = names[i];
+	}
+	for (i = 0; i < 300; i++) {
+		snprintf(names[256 + i], sizeof(names[0]), "sparse-%u", i);
+		sparse[i].v = i * 7919U + 17;
+		sparse[i].s = names[256 + i];
+	}
+
+	printf("%-24s %10s %10s\n", "ns per lookup", "scan", "indexed");
+	bench("tok2str, 6 entries", small, count);
+	bench("tok2str, 256 dense", dense, count);
+	bench("tok2str, 300 sparse", sparse, count);
+	bench("tok2str, oui_values", oui_values, count);
+
+	for (i = 0; i < NVALUES; i++)
+		values[i] = (i * 2654435761U) & 0xffff;
+	before = time_lookups(scan_bittok2str, flags, values, count / 10);
+	after = time_lookups(lib_bittok2str, flags, values, count / 10);
+	printf("%-24s %10.1f %10.1f\n", "bittok2str, 16 bits", before, after);
+
+	tok_index_free();
+	return (0);
+}
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Benchmark for savefile indexes: what indexing costs per packet
+ * written, how long indexing a savefile already written takes, and how
+ * long getting the packets of a one-second time range takes, from
+ * different places in a large generated capture, reading the savefile
+ * from the start and starting where its index says.  Both ways must
+ * get the same packets.
+ *
+ * Build it with "make tsindex-bench" and run it with the number of
+ * megabytes of packets to generate (1024 by default) and the directory
+ * to write the capture in (the current one by default) as arguments.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <sys/time.h>
+
+#include <pcap.h>
+
+#include "tsindex.h"
+
+#define START_SEC	1700000000
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1e6);
+}
+
+static uint32_t seed = 1;
+
+static uint32_t
+random32(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 1);
+}
+
+static void
+put32(FILE *fp, uint32_t v)
+{
+	fwrite(&v, sizeof(v), 1, fp);
+}
+
+static void
+put16(FILE *fp, uint16_t v)
+{
+	fwrite(&v, sizeof(v), 1, fp);
+}
+
+/*
+ * Write "mbytes" megabytes of packets, about 20,000 a second, to a pcap
+ * savefile, in our own byte order; return the time stamp of the last
+ * one, in microseconds.
+ */
+static uint64_t
+generate(const char *path, u_long mbytes, uint64_t *npacketsp)
+{
+	u_char pkt[1514];
+	FILE *fp;
+	uint64_t npackets, written, ts;
+	u_int len, i;
+
+	fp = fopen(path, "wb");
+	if (fp == NULL) {
+		fprintf(stderr, "tsindex-bench: %s\n", strerror(errno));
+		exit(1);
+	}
+	setvbuf(fp, NULL, _IOFBF, 1024 * 1024);
+	put32(fp, 0xa1b2c3d4);
+	put16(fp, 2);
+	put16(fp, 4);
+	put32(fp, 0);
+	put32(fp, 0);
+	put32(fp, 65535);
+	put32(fp, DLT_EN10MB);
+
+	for (i = 0; i < sizeof(pkt); i++)
+		pkt[i] = (u_char)i;
+	ts = (uint64_t)START_SEC * 1000000;
+	for (npackets = 0, written = 0; written < mbytes * 1000000;
+	    npackets++) {
+		len = random32() % 2 ? 66 : 1514;
+		ts += 1 + random32() % 100;
+		put32(fp, (uint32_t)(ts / 1000000));
+		put32(fp, (uint32_t)(ts % 1000000));
+		put32(fp, len);
+		put32(fp, len);
+		fwrite(pkt, len, 1, fp);
+		written += 16 + len;
+	}
+	if (fclose(fp) == EOF) {
+		fprintf(stderr, "tsindex-bench: %s\n", strerror(errno));
+		exit(1);
+	}
+	*npacketsp = npackets;
+	return (ts);
+}
+
+/*
+ * Add the headers of all the records of the savefile to an index, as
+ * they would be added as it was written; return the time taken.
+ */
+static double
+index_cost(const char *path, uint64_t npackets)
+{
+	struct tsindex_writer *w;
+	struct pcap_pkthdr *hdrs, h;
+	const u_char *data;
+	char ebuf[PCAP_ERRBUF_SIZE];
+	uint64_t i, n = 0;
+	double start;
+	pcap_t *pd;
+
+	hdrs = malloc(npackets * sizeof(*hdrs));
+	pd = pcap_open_offline(path, ebuf);
+	if (hdrs == NULL || pd == NULL) {
+		fprintf(stderr, "tsindex-bench: %s\n",
+		    pd == NULL ? ebuf : "out of memory");
+		exit(1);
+	}
+	while (n < npackets && (data = pcap_next(pd, &h)) != NULL)
+		hdrs[n++] = h;
+	pcap_close(pd);
+
+	w = tsindex_wopen(0);
+	start = now();
+	for (i = 0; i < n; i++)
+		tsindex_add(w, &hdrs[i]);
+	start = now() - start;
+	(void)tsindex_wclose(w, -1, ebuf, sizeof(ebuf));
+	free(hdrs);
+	return (start);
+}
+
+/*
+ * Read the packets from "from" to "to" seconds, from the start of the
+ * savefile or from where its index says; return the time taken.
+ */
+static double
+read_range(const char *path, uint64_t from, uint64_t to, int use_index,
+    uint64_t *countp)
+{
+	char ebuf[PCAP_ERRBUF_SIZE];
+	struct tsindex_plan plan;
+	struct tsindex *ix;
+	struct pcap_pkthdr *h;
+	const u_char *data;
+	uint64_t start_ns = from * 1000000000, end_ns = to * 1000000000, ns;
+	double start;
+	pcap_t *pd;
+
+	*countp = 0;
+	start = now();
+	pd = pcap_open_offline(path, ebuf);
+	if (pd == NULL) {
+		fprintf(stderr, "tsindex-bench: %s\n", ebuf);
+		exit(1);
+	}
+	plan.stop = TSINDEX_NONE;
+	if (use_index) {
+		ix = tsindex_open(path, ebuf, sizeof(ebuf));
+		if (ix == NULL || tsindex_plan(ix, path, 0, start_ns, end_ns,
+		    0, &plan, ebuf, sizeof(ebuf)) == -1 ||
+		    tsindex_seek(pcap_file(pd), plan.offset) == -1) {
+			fprintf(stderr, "tsindex-bench: %s\n", ebuf);
+			exit(1);
+		}
+		tsindex_close(ix);
+	}
+	while (pcap_next_ex(pd, &h, &data) == 1) {
+		ns = (uint64_t)h->ts.tv_sec * 1000000000 +
+		    (uint64_t)h->ts.tv_usec * 1000;
+		if (ns > end_ns) {
+			/* Without an index, we can't know it's sorted */
+			if (plan.stop != TSINDEX_NONE &&
+			    tsindex_tell(pcap_file(pd)) >= plan.stop)
+				break;
+			continue;
+		}
+		if (ns >= start_ns)
+			(*countp)++;
+	}
+	pcap_close(pd);
+	return (now() - start);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *dir = ".";
+	char path[1024], idxpath[1024 + sizeof(TSINDEX_SUFFIX)];
+	char ebuf[PCAP_ERRBUF_SIZE];
+	u_long mbytes = 1024;
+	uint64_t npackets, last, secs, from, count[2];
+	double start, t[2];
+	int i;
+
+	if (argc > 1)
+		mbytes = strtoul(argv[1], NULL, 10);
+	if (argc > 2)
+		dir = argv[2];
+	if (mbytes == 0)
+		mbytes = 1;
+
+	snprintf(path, sizeof(path), "%s/tsindex-bench.%ld.pcap", dir,
+	    (long)getpid());
+	start = now();
+	last = generate(path, mbytes, &npackets);
+	secs = last / 1000000 - START_SEC;
+	printf("%lu MB of packets, %llu packets over %llu s, generated in %.1f s\n",
+	    mbytes, (unsigned long long)npackets, (unsigned long long)secs,
+	    now() - start);
+
+	t[0] = index_cost(path, npackets);
+	printf("indexing while writing: %.1f ns per packet\n",
+	    t[0] * 1e9 / npackets);
+	start = now();
+	if (tsindex_build(path, ebuf, sizeof(ebuf)) == -1) {
+		fprintf(stderr, "tsindex-bench: %s\n", ebuf);
+		exit(1);
+	}
+	printf("indexing the savefile: %.3f s\n", now() - start);
+
+	printf("%-10s %12s %12s %10s %9s\n", "range at", "no index",
+	    "index", "speedup", "packets");
+	for (i = 0; i <= 4; i++) {
+		from = START_SEC + secs * i / 4;
+		if (from + 1 > START_SEC + secs)
+			from = START_SEC + secs - 1;
+		t[0] = read_range(path, from, from + 1, 0, &count[0]);
+		t[1] = read_range(path, from, from + 1, 1, &count[1]);
+		printf("%3d%%       %10.4f s %10.4f s %9.1fx %9llu\n", i * 25,
+		    t[0], t[1], t[0] / t[1], (unsigned long long)count[1]);
+		fflush(stdout);
+		if (count[0] != count[1]) {
+			fprintf(stderr,
+			    "tsindex-bench: the index gets %llu packets, not %llu\n",
+			    (unsigned long long)count[1],
+			    (unsigned long long)count[0]);
+			exit(1);
+		}
+	}
+
+	unlink(path);
+	snprintf(idxpath, sizeof(idxpath), "%s%s", path, TSINDEX_SUFFIX);
+	unlink(idxpath);
+	return (0);
+}
@@ -0,0 +1,614 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Savefile indexes.
+ *
+ * An index file is a header - TSINDEX_MAGIC, then the version and the
+ * block size as 4-byte little-endian numbers - followed by an entry for
+ * each block of the savefile, in order, of seven 8-byte little-endian
+ * numbers: the offset of the block's first record, the length of the
+ * block, the number, counting from 0, of its first packet, the number
+ * of packets in it, and the time stamps, in nanoseconds since the
+ * epoch, of its first packet, of its earliest packet and of its latest
+ * packet.  The blocks follow each other with no gaps, from the first
+ * record of the savefile to, if the index is up to date, its end, and
+ * each but the last ends with the record that takes it to the block
+ * size or past it.  The block size an index was written with is the
+ * one it's checked against, whatever TSINDEX_BLOCK_SIZE is now.
+ *
+ * The time stamps in a savefile usually go up, but they needn't, so
+ * the earliest and latest time stamps in each block are kept: reading
+ * for the packets from a time on starts at the first block with a
+ * packet at or after that time, and reading for the packets up to a
+ * time stops at the first block after which all the packets are later
+ * than that.
+ *
+ * Before an index is used, the record it says is at the block to be
+ * read from is checked to be there, with the first time stamp the
+ * index has for the block; an index left over from an earlier savefile
+ * of the same name isn't likely to pass that.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "netdissect.h"
+#include "extract.h"
+#include "tsindex.h"
+
+#define TSINDEX_MAGIC		"tcpdidx\n"
+#define TSINDEX_VERSION		1
+#define TSINDEX_HDRLEN		16
+#define TSINDEX_ENTRYLEN	56
+
+/* pcap */
+#define PCAP_MAGIC		0xa1b2c3d4	/* microsecond time stamps */
+#define PCAP_NSEC_MAGIC		0xa1b23c4d	/* nanosecond time stamps */
+#define PCAP_FILE_HDRLEN	24
+#define PCAP_REC_HDRLEN		16
+
+struct tsindex_entry {
+	uint64_t offset;	/* of the block's first record */
+	uint64_t bytes;		/* in the block */
+	uint64_t first_packet;	/* the number of the block's first packet */
+	uint64_t npackets;
+	uint64_t first_ns;	/* time stamp of the first packet */
+	uint64_t min_ns;	/* earliest time stamp */
+	uint64_t max_ns;	/* latest time stamp */
+};
+
+struct tsindex {
+	struct tsindex_entry *entries;
+	size_t nentries;
+	size_t entries_size;
+};
+
+struct tsindex_writer {
+	struct tsindex ix;
+	struct tsindex_entry cur;	/* the block being added to */
+	uint64_t offset;		/* of the next record */
+	uint64_t npackets;
+	int nano;			/* time stamps are in nanoseconds */
+	int failed;			/* ran out of memory */
+};
+
+/* A savefile's byte order and time stamp units, from its header */
+struct ts_savefile {
+	FILE *fp;
+	uint64_t size;
+	int be;
+	int nano;
+};
+
+static uint64_t
+ts_ns(uint64_t sec, uint64_t frac, int nano)
+{
+	return (sec * 1000000000 + (nano ? frac : frac * 1000));
+}
+
+static int
+ix_append(struct tsindex *ix, const struct tsindex_entry *e)
+{
+	struct tsindex_entry *entries;
+	size_t size;
+
+	if (ix->nentries == ix->entries_size) {
+		size = ix->entries_size == 0 ? 64 : 2 * ix->entries_size;
+		entries = realloc(ix->entries, size * sizeof(*entries));
+		if (entries == NULL)
+			return (-1);
+		ix->entries = entries;
+		ix->entries_size = size;
+	}
+	ix->entries[ix->nentries++] = *e;
+	return (0);
+}
+
+/*
+ * Start the index of a savefile about to be written, whose time stamps
+ * are in nanoseconds if "nano" is set and in microseconds otherwise.
+ */
+struct tsindex_writer *
+tsindex_wopen(int nano)
+{
+	struct tsindex_writer *w;
+
+	w = calloc(1, sizeof(*w));
+	if (w == NULL)
+		return (NULL);
+	w->offset = PCAP_FILE_HDRLEN;
+	w->nano = nano;
+	return (w);
+}
+
+/* Add a packet written to the savefile */
+void
+tsindex_add(struct tsindex_writer *w, const struct pcap_pkthdr *h)
+{
+	struct tsindex_entry *e = &w->cur;
+	uint64_t ns;
+
+	ns = ts_ns((uint64_t)h->ts.tv_sec, (uint64_t)h->ts.tv_usec, w->nano);
+	if (e->npackets == 0) {
+		e->offset = w->offset;
+		e->first_packet = w->npackets;
+		e->first_ns = e->min_ns = e->max_ns = ns;
+	} else if (ns < e->min_ns)
+		e->min_ns = ns;
+	else if (ns > e->max_ns)
+		e->max_ns = ns;
+	e->npackets++;
+	w->npackets++;
+	w->offset += PCAP_REC_HDRLEN + h->caplen;
+	if (w->offset - e->offset >= TSINDEX_BLOCK_SIZE) {
+		e->bytes = w->offset - e->offset;
+		if (!w->failed && ix_append(&w->ix, e) == -1)
+			w->failed = 1;
+		e->npackets = 0;
+	}
+}
+
+static void
+put_le64(u_char *p, uint64_t v)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		p[i] = (u_char)(v >> (8 * i));
+}
+
+/*
+ * Write the index, when the savefile has been written, to the
+ * descriptor "fd", which is closed, and free it.  If "fd" is -1, just
+ * free it.  Return -1 on an error.
+ */
+int
+tsindex_wclose(struct tsindex_writer *w, int fd, char *errbuf,
+    size_t errbuf_size)
+{
+	struct tsindex_entry *e = &w->cur;
+	u_char buf[TSINDEX_ENTRYLEN];
+	FILE *fp;
+	size_t i;
+	int ret = 0;
+
+	if (e->npackets != 0) {
+		e->bytes = w->offset - e->offset;
+		if (!w->failed && ix_append(&w->ix, e) == -1)
+			w->failed = 1;
+	}
+	if (fd == -1)
+		goto done;
+	if (w->failed) {
+		snprintf(errbuf, errbuf_size, "out of memory for the index");
+		close(fd);
+		ret = -1;
+		goto done;
+	}
+	fp = fdopen(fd, "wb");
+	if (fp == NULL) {
+		snprintf(errbuf, errbuf_size, "%s", strerror(errno));
+		close(fd);
+		ret = -1;
+		goto done;
+	}
+	memcpy(buf, TSINDEX_MAGIC, 8);
+	buf[8] = TSINDEX_VERSION;
+	buf[9] = buf[10] = buf[11] = 0;
+	buf[12] = (u_char)TSINDEX_BLOCK_SIZE;
+	buf[13] = (u_char)(TSINDEX_BLOCK_SIZE >> 8);
+	buf[14] = (u_char)(TSINDEX_BLOCK_SIZE >> 16);
+	buf[15] = (u_char)(TSINDEX_BLOCK_SIZE >> 24);
+	(void)fwrite(buf, TSINDEX_HDRLEN, 1, fp);
+	for (i = 0; i < w->ix.nentries; i++) {
+		e = &w->ix.entries[i];
+		put_le64(buf, e->offset);
+		put_le64(buf + 8, e->bytes);
+		put_le64(buf + 16, e->first_packet);
+		put_le64(buf + 24, e->npackets);
+		put_le64(buf + 32, e->first_ns);
+		put_le64(buf + 40, e->min_ns);
+		put_le64(buf + 48, e->max_ns);
+		(void)fwrite(buf, TSINDEX_ENTRYLEN, 1, fp);
+	}
+	if (ferror(fp)) {
+		snprintf(errbuf, errbuf_size, "%s", strerror(errno));
+		ret = -1;
+	}
+	if (fclose(fp) == EOF && ret == 0) {
+		snprintf(errbuf, errbuf_size, "%s", strerror(errno));
+		ret = -1;
+	}
+done:
+	free(w->ix.entries);
+	free(w);
+	return (ret);
+}
+
+/* Seek to "off" in a stream; return -1 if we can't */
+int
+tsindex_seek(FILE *fp, uint64_t off)
+{
+#ifdef HAVE_FSEEKO
+	if (off > (uint64_t)INT64_MAX)
+		return (-1);
+	return (fseeko(fp, (off_t)off, SEEK_SET));
+#else
+	if (off > (uint64_t)LONG_MAX)
+		return (-1);
+	return (fseek(fp, (long)off, SEEK_SET));
+#endif
+}
+
+/* The offset in a stream */
+uint64_t
+tsindex_tell(FILE *fp)
+{
+#ifdef HAVE_FSEEKO
+	return ((uint64_t)ftello(fp));
+#else
+	return ((uint64_t)ftell(fp));
+#endif
+}
+
+/*
+ * Open a pcap savefile, not through libpcap, and get its byte order and
+ * time stamp units from its header.
+ */
+static int
+ts_savefile_open(struct ts_savefile *sf, const char *name, char *errbuf,
+    size_t errbuf_size)
+{
+	u_char hdr[PCAP_FILE_HDRLEN];
+	struct stat st;
+	uint32_t magic;
+
+	sf->fp = fopen(name, "rb");
+	if (sf->fp == NULL) {
+		snprintf(errbuf, errbuf_size, "%s: %s", name, strerror(errno));
+		return (-1);
+	}
+	if (fstat(fileno(sf->fp), &st) == -1 || !S_ISREG(st.st_mode)) {
+		snprintf(errbuf, errbuf_size, "%s isn't a regular file", name);
+		goto fail;
+	}
+	sf->size = (uint64_t)st.st_size;
+	if (fread(hdr, sizeof(hdr), 1, sf->fp) != 1)
+		goto notpcap;
+	magic = EXTRACT_LE_U_4(hdr);
+	if (magic == PCAP_MAGIC || magic == PCAP_NSEC_MAGIC)
+		sf->be = 0;
+	else {
+		magic = EXTRACT_BE_U_4(hdr);
+		if (magic != PCAP_MAGIC && magic != PCAP_NSEC_MAGIC)
+			goto notpcap;
+		sf->be = 1;
+	}
+	sf->nano = magic == PCAP_NSEC_MAGIC;
+	return (0);
+
+notpcap:
+	snprintf(errbuf, errbuf_size, "%s isn't a pcap savefile", name);
+fail:
+	fclose(sf->fp);
+	return (-1);
+}
+
+/*
+ * Read the header of the record at "off"; return 0 if there's no whole
+ * record there.
+ */
+static int
+ts_read_record(struct ts_savefile *sf, uint64_t off, uint32_t *secp,
+    uint32_t *fracp, uint32_t *caplenp)
+{
+	u_char hdr[PCAP_REC_HDRLEN];
+	uint32_t caplen;
+
+	if (off + PCAP_REC_HDRLEN > sf->size)
+		return (0);
+	if (fread(hdr, sizeof(hdr), 1, sf->fp) != 1)
+		return (0);
+	if (sf->be) {
+		*secp = EXTRACT_BE_U_4(hdr);
+		*fracp = EXTRACT_BE_U_4(hdr + 4);
+		caplen = EXTRACT_BE_U_4(hdr + 8);
+	} else {
+		*secp = EXTRACT_LE_U_4(hdr);
+		*fracp = EXTRACT_LE_U_4(hdr + 4);
+		caplen = EXTRACT_LE_U_4(hdr + 8);
+	}
+	if (off + PCAP_REC_HDRLEN + caplen > sf->size)
+		return (0);
+	*caplenp = caplen;
+	return (1);
+}
+
+/*
+ * Index the savefile "name", writing the index next to it.  Return -1
+ * on an error.
+ */
+int
+tsindex_build(const char *name, char *errbuf, size_t errbuf_size)
+{
+	char idxname[PATH_MAX + 1];
+	struct ts_savefile sf;
+	struct tsindex_writer *w;
+	struct pcap_pkthdr h;
+	u_char skipbuf[65536];
+	uint64_t off;
+	uint32_t sec, frac, caplen, left, n;
+	int fd;
+
+	if (snprintf(idxname, sizeof(idxname), "%s%s", name,
+	    TSINDEX_SUFFIX) >= (int)sizeof(idxname)) {
+		snprintf(errbuf, errbuf_size, "%s: name too long", name);
+		return (-1);
+	}
+	if (ts_savefile_open(&sf, name, errbuf, errbuf_size) == -1)
+		return (-1);
+	w = tsindex_wopen(sf.nano);
+	if (w == NULL) {
+		fclose(sf.fp);
+		snprintf(errbuf, errbuf_size, "out of memory for the index");
+		return (-1);
+	}
+	/*
+	 * Read the records in order, skipping their data; a record cut
+	 * short at the end of the savefile isn't indexed.
+	 */
+	memset(&h, 0, sizeof(h));
+	for (off = PCAP_FILE_HDRLEN;
+	    ts_read_record(&sf, off, &sec, &frac, &caplen);
+	    off += PCAP_REC_HDRLEN + caplen) {
+		h.ts.tv_sec = sec;
+		h.ts.tv_usec = frac;
+		h.caplen = caplen;
+		tsindex_add(w, &h);
+		for (left = caplen; left != 0; left -= n) {
+			n = left < sizeof(skipbuf) ? left :
+			    (uint32_t)sizeof(skipbuf);
+			if (fread(skipbuf, n, 1, sf.fp) != 1)
+				break;
+		}
+	}
+	fclose(sf.fp);
+
+	fd = open(idxname, O_CREAT | O_WRONLY | O_TRUNC, 0666);
+	if (fd == -1) {
+		snprintf(errbuf, errbuf_size, "%s: %s", idxname,
+		    strerror(errno));
+		(void)tsindex_wclose(w, -1, errbuf, errbuf_size);
+		return (-1);
+	}
+	return (tsindex_wclose(w, fd, errbuf, errbuf_size));
+}
+
+/*
+ * Read the index of the savefile "name".  Return NULL, with an empty
+ * error message, if it has none.
+ */
+struct tsindex *
+tsindex_open(const char *name, char *errbuf, size_t errbuf_size)
+{
+	char idxname[PATH_MAX + 1];
+	u_char buf[TSINDEX_ENTRYLEN];
+	struct tsindex *ix;
+	struct tsindex_entry *e, *prev;
+	struct stat st;
+	uint64_t n;
+	uint32_t block_size;
+	FILE *fp;
+	size_t i;
+
+	errbuf[0] = '\0';
+	if (snprintf(idxname, sizeof(idxname), "%s%s", name,
+	    TSINDEX_SUFFIX) >= (int)sizeof(idxname))
+		return (NULL);
+	fp = fopen(idxname, "rb");
+	if (fp == NULL) {
+		if (errno != ENOENT)
+			snprintf(errbuf, errbuf_size, "%s: %s", idxname,
+			    strerror(errno));
+		return (NULL);
+	}
+	ix = calloc(1, sizeof(*ix));
+	if (ix == NULL) {
+		snprintf(errbuf, errbuf_size, "out of memory for the index");
+		fclose(fp);
+		return (NULL);
+	}
+	if (fstat(fileno(fp), &st) == -1 || st.st_size < TSINDEX_HDRLEN ||
+	    (st.st_size - TSINDEX_HDRLEN) % TSINDEX_ENTRYLEN != 0 ||
+	    fread(buf, TSINDEX_HDRLEN, 1, fp) != 1 ||
+	    memcmp(buf, TSINDEX_MAGIC, 8) != 0 ||
+	    EXTRACT_LE_U_4(buf + 8) != TSINDEX_VERSION)
+		goto bad;
+	block_size = EXTRACT_LE_U_4(buf + 12);
+	if (block_size == 0)
+		goto bad;
+	n = ((uint64_t)st.st_size - TSINDEX_HDRLEN) / TSINDEX_ENTRYLEN;
+	if (n > SIZE_MAX / sizeof(*ix->entries))
+		goto bad;
+	if (n != 0) {
+		ix->entries = malloc((size_t)n * sizeof(*ix->entries));
+		if (ix->entries == NULL) {
+			snprintf(errbuf, errbuf_size,
+			    "out of memory for the index");
+			goto fail;
+		}
+	}
+	prev = NULL;
+	for (i = 0; i < n; i++) {
+		if (fread(buf, TSINDEX_ENTRYLEN, 1, fp) != 1)
+			goto bad;
+		e = &ix->entries[i];
+		e->offset = EXTRACT_LE_U_8(buf);
+		e->bytes = EXTRACT_LE_U_8(buf + 8);
+		e->first_packet = EXTRACT_LE_U_8(buf + 16);
+		e->npackets = EXTRACT_LE_U_8(buf + 24);
+		e->first_ns = EXTRACT_LE_U_8(buf + 32);
+		e->min_ns = EXTRACT_LE_U_8(buf + 40);
+		e->max_ns = EXTRACT_LE_U_8(buf + 48);
+		/* The blocks must follow each other */
+		if (e->npackets == 0 ||
+		    e->bytes < e->npackets * PCAP_REC_HDRLEN ||
+		    e->offset > UINT64_MAX - e->bytes ||
+		    e->min_ns > e->first_ns || e->first_ns > e->max_ns)
+			goto bad;
+		if (prev == NULL ? e->offset != PCAP_FILE_HDRLEN ||
+		    e->first_packet != 0 :
+		    e->offset != prev->offset + prev->bytes ||
+		    e->first_packet != prev->first_packet + prev->npackets ||
+		    prev->bytes < block_size)
+			goto bad;
+		prev = e;
+	}
+	ix->nentries = (size_t)n;
+	fclose(fp);
+	return (ix);
+
+bad:
+	snprintf(errbuf, errbuf_size, "%s isn't a savefile index", idxname);
+fail:
+	fclose(fp);
+	tsindex_close(ix);
+	return (NULL);
+}
+
+/*
+ * Round a time stamp down to the units it's read in, so that what's
+ * compared is what the packets will be given.
+ */
+static uint64_t
+ts_round(uint64_t ns, int nano)
+{
+	return (nano ? ns : ns - ns % 1000);
+}
+
+/*
+ * Plan reading the savefile "name", whose time stamps are being read in
+ * nanoseconds if "nano" is set and in microseconds otherwise, for the
+ * packets at or after "start_ns" or, if it's TSINDEX_NONE, for all of
+ * them, skipping the first "skip" of them, up to "end_ns", if it's not
+ * TSINDEX_NONE.  Return -1 if the index doesn't match the savefile.
+ */
+int
+tsindex_plan(const struct tsindex *ix, const char *name, int nano,
+    uint64_t start_ns, uint64_t end_ns, uint64_t skip,
+    struct tsindex_plan *plan, char *errbuf, size_t errbuf_size)
+{
+	const struct tsindex_entry *e, *last;
+	struct ts_savefile sf;
+	uint64_t end, min_ns;
+	uint32_t sec, frac, caplen;
+	size_t i, j, n = ix->nentries;
+
+	if (ts_savefile_open(&sf, name, errbuf, errbuf_size) == -1)
+		return (-1);
+	plan->offset = PCAP_FILE_HDRLEN;
+	plan->skipped = 0;
+	plan->stop = TSINDEX_NONE;
+	if (n == 0) {
+		fclose(sf.fp);
+		return (0);
+	}
+	last = &ix->entries[n - 1];
+	end = last->offset + last->bytes;
+	if (end > sf.size)
+		goto stale;
+
+	/*
+	 * Start at the first block that has a packet at or after the
+	 * start time, or that has the packet after the ones to skip.
+	 */
+	i = 0;
+	if (start_ns != TSINDEX_NONE || skip != 0) {
+		for (i = 0; i < n; i++) {
+			e = &ix->entries[i];
+			if (start_ns != TSINDEX_NONE &&
+			    ts_round(e->max_ns, nano) >= start_ns)
+				break;
+			if (skip != 0 && e->first_packet + e->npackets > skip)
+				break;
+		}
+	}
+
+	/*
+	 * Stop at the first block from which on all the packets are
+	 * after the end time - if the index covers the rest of the
+	 * savefile.
+	 */
+	if (end_ns != TSINDEX_NONE && end == sf.size) {
+		min_ns = TSINDEX_NONE;
+		for (j = n; j > i; j--) {
+			e = &ix->entries[j - 1];
+			if (e->min_ns < min_ns)
+				min_ns = e->min_ns;
+			if (ts_round(min_ns, nano) <= end_ns)
+				break;
+		}
+		if (j == i)
+			i = n;		/* there's nothing to read */
+		else if (j < n)
+			plan->stop = ix->entries[j].offset;
+	}
+
+	/* Check that the block we'd start at, or the last one, is there */
+	e = &ix->entries[i < n ? i : n - 1];
+	if (tsindex_seek(sf.fp, e->offset) == -1 ||
+	    !ts_read_record(&sf, e->offset, &sec, &frac, &caplen) ||
+	    ts_ns(sec, frac, sf.nano) != e->first_ns ||
+	    PCAP_REC_HDRLEN + (uint64_t)caplen > e->bytes)
+		goto stale;
+	fclose(sf.fp);
+	if (i < n) {
+		plan->offset = e->offset;
+		plan->skipped = e->first_packet;
+	} else {
+		plan->offset = end;
+		plan->skipped = last->first_packet + last->npackets;
+	}
+	return (0);
+
+stale:
+	fclose(sf.fp);
+	snprintf(errbuf, errbuf_size, "%s%s doesn't match %s", name,
+	    TSINDEX_SUFFIX, name);
+	return (-1);
+}
+
+void
+tsindex_close(struct tsindex *ix)
+{
+	free(ix->entries);
+	free(ix);
+}
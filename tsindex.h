@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef tsindex_h
+#define tsindex_h
+
+/*
+ * Savefile indexes (--index, --start-time, --end-time, --skip).
+ *
+ * An index describes a pcap savefile in blocks of about
+ * TSINDEX_BLOCK_SIZE bytes of records: where each block starts, the
+ * number of its first packet and how many packets it has, and the time
+ * stamp of its first packet and the earliest and latest time stamps in
+ * it.  It's kept next to the savefile, in a file with the savefile's
+ * name and TSINDEX_SUFFIX.
+ *
+ * tsindex_wopen() starts the index of a savefile being written, and
+ * tsindex_add() adds each packet written to it, which costs little more
+ * than adding up the lengths of the records; the index is kept in
+ * memory until tsindex_wclose() writes it out, when the savefile is
+ * closed.  tsindex_build() indexes a savefile that's already written.
+ *
+ * tsindex_open() reads the index of a savefile, and tsindex_plan()
+ * finds from it where to start reading the savefile for the packets
+ * from a given time or packet number on, and where to stop reading for
+ * the packets up to a given time, having checked that the index still
+ * describes the savefile.
+ */
+
+#define TSINDEX_SUFFIX		".idx"
+#define TSINDEX_BLOCK_SIZE	(1024 * 1024)
+#define TSINDEX_NONE		UINT64_MAX	/* no time or offset */
+
+struct tsindex_writer;
+struct tsindex;
+
+struct tsindex_plan {
+	uint64_t offset;	/* of the record to start reading at */
+	uint64_t skipped;	/* the number of packets before it */
+	uint64_t stop;		/* where to stop reading, or TSINDEX_NONE */
+};
+
+extern struct tsindex_writer *tsindex_wopen(int);
+extern void tsindex_add(struct tsindex_writer *, const struct pcap_pkthdr *);
+extern int tsindex_wclose(struct tsindex_writer *, int, char *, size_t);
+extern int tsindex_build(const char *, char *, size_t);
+extern struct tsindex *tsindex_open(const char *, char *, size_t);
+extern int tsindex_plan(const struct tsindex *, const char *, int, uint64_t,
+    uint64_t, uint64_t, struct tsindex_plan *, char *, size_t);
+extern void tsindex_close(struct tsindex *);
+extern int tsindex_seek(FILE *, uint64_t);
+extern uint64_t tsindex_tell(FILE *);
+
+#endif /* tsindex_h */
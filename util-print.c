@@ -60,9 +60,6 @@
 
 #define TOKBUFSIZE 128
 
-enum date_flag { WITHOUT_DATE = 0, WITH_DATE = 1 };
-enum time_flag { UTC_TIME = 0, LOCAL_TIME = 1 };
-
 /*
  * Print out a character, filtering out the non-printable ones
  */
@@ -229,28 +226,97 @@ nd_printzp(netdissect_options *ndo,
 }
 
 /*
- * Print the timestamp .FRAC part (Microseconds/nanoseconds)
+ * Format the timestamp .FRAC part (Microseconds/nanoseconds) into buf,
+ * which must have room for TS_FRAC_BUFSIZE characters; returns the
+ * end of the string.  This is called for every packet, so the digits
+ * are done by hand rather than with snprintf().
  */
-static void
-ts_frac_print(netdissect_options *ndo, long usec)
+#define TS_FRAC_BUFSIZE	12	/* "." and up to 10 digits, or ".{unknown}" */
+
+static char *
+ts_frac_format(netdissect_options *ndo _U_, char *buf, long usec)
 {
+	u_int frac = (unsigned)usec;
+	u_int digits, i;
+
 #ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
 	switch (ndo->ndo_tstamp_precision) {
 
 	case PCAP_TSTAMP_PRECISION_MICRO:
-		ND_PRINT(".%06u", (unsigned)usec);
+		digits = 6;
 		break;
 
 	case PCAP_TSTAMP_PRECISION_NANO:
-		ND_PRINT(".%09u", (unsigned)usec);
+		digits = 9;
 		break;
 
 	default:
-		ND_PRINT(".{unknown}");
-		break;
+		memcpy(buf, ".{unknown}", sizeof(".{unknown}"));
+		return (buf + sizeof(".{unknown}") - 1);
 	}
 #else
-	ND_PRINT(".%06u", (unsigned)usec);
+	digits = 6;
+#endif
+	/* More digits than that, from a bad file? */
+	if (frac >= (digits == 6 ? 1000000U : 1000000000U))
+		return (buf + snprintf(buf, TS_FRAC_BUFSIZE, ".%0*u", digits, frac));
+
+	*buf++ = '.';
+	for (i = digits; i != 0; i--) {
+		buf[i - 1] = (char)('0' + frac % 10);
+		frac /= 10;
+	}
+	buf += digits;
+	*buf = '\0';
+	return (buf);
+}
+
+/*
+ * Print the timestamp .FRAC part (Microseconds/nanoseconds)
+ */
+static void
+ts_frac_print(netdissect_options *ndo, long usec)
+{
+	char buf[TS_FRAC_BUFSIZE];
+
+	ts_frac_format(ndo, buf, usec);
+	ND_PRINT("%s", buf);
+}
+
+/*
+ * localtime() and gmtime() that convert into a struct tm supplied by
+ * the caller, so that printers in different threads don't share the
+ * C library's buffer.  (On Windows that buffer is per-thread.)
+ */
+struct tm *
+nd_localtime(const time_t *timep, struct tm *result)
+{
+#ifdef HAVE_LOCALTIME_R
+	return localtime_r(timep, result);
+#else
+	struct tm *tm;
+
+	tm = localtime(timep);
+	if (tm == NULL)
+		return NULL;
+	*result = *tm;
+	return result;
+#endif
+}
+
+struct tm *
+nd_gmtime(const time_t *timep, struct tm *result)
+{
+#ifdef HAVE_GMTIME_R
+	return gmtime_r(timep, result);
+#else
+	struct tm *tm;
+
+	tm = gmtime(timep);
+	if (tm == NULL)
+		return NULL;
+	*result = *tm;
+	return result;
 #endif
 }
 
@@ -258,36 +324,50 @@ ts_frac_print(netdissect_options *ndo, long usec)
  * Print the timestamp as [YY:MM:DD] HH:MM:SS.FRAC.
  *   if time_flag == LOCAL_TIME print local time else UTC/GMT time
  *   if date_flag == WITH_DATE print YY:MM:DD before HH:MM:SS.FRAC
+ *
+ * Converting the seconds is the expensive part, and consecutive packets
+ * mostly arrive in the same second, so the formatted seconds are kept
+ * in ndo_ts_cache and only redone when the second, or the format,
+ * changes.
  */
 static void
 ts_date_hmsfrac_print(netdissect_options *ndo, long sec, long usec,
 		      enum date_flag date_flag, enum time_flag time_flag)
 {
+	struct nd_ts_cache *tc = &ndo->ndo_ts_cache;
 	time_t Time = sec;
-	struct tm *tm;
-	char timestr[32];
+	struct tm tmbuf, *tm;
+	char timestr[sizeof(tc->str) + TS_FRAC_BUFSIZE];
 
 	if ((unsigned)sec & 0x80000000) {
 		ND_PRINT("[Error converting time]");
 		return;
 	}
 
-	if (time_flag == LOCAL_TIME)
-		tm = localtime(&Time);
-	else
-		tm = gmtime(&Time);
+	if (tc->len == 0 || tc->sec != Time || tc->date_flag != date_flag ||
+	    tc->time_flag != time_flag) {
+		if (time_flag == LOCAL_TIME)
+			tm = nd_localtime(&Time, &tmbuf);
+		else
+			tm = nd_gmtime(&Time, &tmbuf);
 
-	if (!tm) {
-		ND_PRINT("[Error converting time]");
-		return;
+		if (!tm) {
+			ND_PRINT("[Error converting time]");
+			return;
+		}
+		if (date_flag == WITH_DATE)
+			tc->len = (u_int)strftime(tc->str, sizeof(tc->str),
+			    "%Y-%m-%d %H:%M:%S", tm);
+		else
+			tc->len = (u_int)strftime(tc->str, sizeof(tc->str),
+			    "%H:%M:%S", tm);
+		tc->sec = Time;
+		tc->date_flag = date_flag;
+		tc->time_flag = time_flag;
 	}
-	if (date_flag == WITH_DATE)
-		strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", tm);
-	else
-		strftime(timestr, sizeof(timestr), "%H:%M:%S", tm);
+	memcpy(timestr, tc->str, tc->len);
+	ts_frac_format(ndo, timestr + tc->len, usec);
 	ND_PRINT("%s", timestr);
-
-	ts_frac_print(ndo, usec);
 }
 
 /*
@@ -312,7 +392,7 @@ void
 ts_print(netdissect_options *ndo,
          const struct timeval *tvp)
 {
-	static struct timeval tv_ref;
+	struct timeval *tv_ref = &ndo->ndo_tv_ref;
 	struct timeval tv_result;
 	int negative_offset;
 	int nano_prec;
@@ -350,14 +430,14 @@ ts_print(netdissect_options *ndo,
 #else
 		nano_prec = 0;
 #endif
-		if (!(netdissect_timevalisset(&tv_ref)))
-			tv_ref = *tvp; /* set timestamp for first packet */
+		if (!(netdissect_timevalisset(tv_ref)))
+			*tv_ref = *tvp; /* set timestamp for first packet */
 
-		negative_offset = netdissect_timevalcmp(tvp, &tv_ref, <);
+		negative_offset = netdissect_timevalcmp(tvp, tv_ref, <);
 		if (negative_offset)
-			netdissect_timevalsub(&tv_ref, tvp, &tv_result, nano_prec);
+			netdissect_timevalsub(tv_ref, tvp, &tv_result, nano_prec);
 		else
-			netdissect_timevalsub(tvp, &tv_ref, &tv_result, nano_prec);
+			netdissect_timevalsub(tvp, tv_ref, &tv_result, nano_prec);
 
 		ND_PRINT((negative_offset ? "-" : " "));
 		ts_date_hmsfrac_print(ndo, tv_result.tv_sec, tv_result.tv_usec,
@@ -365,7 +445,7 @@ ts_print(netdissect_options *ndo,
 		ND_PRINT(" ");
 
                 if (ndo->ndo_tflag == 3)
-			tv_ref = *tvp; /* set timestamp for previous packet */
+			*tv_ref = *tvp; /* set timestamp for previous packet */
 		break;
 
 	case 4: /* Date + Default */
@@ -490,6 +570,228 @@ print_unknown_data(netdissect_options *ndo, const u_char *cp,
 	return(1); /* everything is ok */
 }
 
+/*
+ * Printers call tok2str() and friends over and over with the same
+ * tables, some of them hundreds of entries long.  Most tables are
+ * short, so the first TOK_INDEX_MIN entries are scanned as before; if
+ * the table goes on past them, the rest of the lookup uses an index
+ * built for the table the first time: an array indexed by value if
+ * the values are dense enough, otherwise a hash table of the values.
+ * As with a scan, the first entry for a value wins.
+ *
+ * The indexes are found in a hash table keyed by the address of the
+ * token table, which is always const.  Each thread has its own;
+ * tok_index_free() frees the calling thread's.
+ */
+#define TOK_INDEX_MIN		8
+#define TOK_INDEX_INITSIZE	256	/* slots; must be a power of 2 */
+
+enum tok_index_kind {
+	TOK_SCAN,		/* out of memory; scan the table */
+	TOK_DIRECT,		/* strs[v - min] */
+	TOK_HASH		/* strs[i] for vals[i] == v, i from tok_hash() */
+};
+
+struct tok_index {
+	const struct tok *table;	/* NULL if the slot is free */
+	enum tok_index_kind kind;
+	u_int min;			/* TOK_DIRECT: the lowest value */
+	u_int n;			/* number of elements of strs */
+	const char **strs;		/* NULL for no value */
+	u_int *vals;			/* TOK_HASH: the value for each string */
+};
+
+static ND_THREAD_LOCAL struct tok_index *tok_index_slots;
+static ND_THREAD_LOCAL u_int tok_index_size;
+static ND_THREAD_LOCAL u_int tok_index_count;
+
+static u_int
+tok_hash(uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x45d9f3bU;
+	h ^= h >> 16;
+	return (h);
+}
+
+static void
+tok_index_build(struct tok_index *ti, const struct tok *lp)
+{
+	const struct tok *tp;
+	u_int n, i, min, max;
+
+	ti->table = lp;
+	ti->kind = TOK_SCAN;
+	ti->strs = NULL;
+	ti->vals = NULL;
+
+	min = max = lp->v;
+	for (tp = lp, n = 0; tp->s != NULL; tp++, n++) {
+		if (tp->v < min)
+			min = tp->v;
+		if (tp->v > max)
+			max = tp->v;
+	}
+
+	if (max - min < 4 * n) {
+		ti->strs = calloc(max - min + 1, sizeof(*ti->strs));
+		if (ti->strs == NULL)
+			return;
+		/* Backwards, so that the first entry for a value wins */
+		for (i = n; i != 0; i--)
+			ti->strs[lp[i - 1].v - min] = lp[i - 1].s;
+		ti->kind = TOK_DIRECT;
+		ti->min = min;
+		ti->n = max - min + 1;
+		return;
+	}
+
+	/* At most half full */
+	for (ti->n = 16; ti->n < 2 * n; ti->n *= 2)
+		;
+	ti->strs = calloc(ti->n, sizeof(*ti->strs));
+	ti->vals = calloc(ti->n, sizeof(*ti->vals));
+	if (ti->strs == NULL || ti->vals == NULL) {
+		free(ti->strs);
+		free(ti->vals);
+		ti->strs = NULL;
+		ti->vals = NULL;
+		return;
+	}
+	for (tp = lp; tp->s != NULL; tp++) {
+		for (i = tok_hash(tp->v) & (ti->n - 1);
+		     ti->strs[i] != NULL && ti->vals[i] != tp->v;
+		     i = (i + 1) & (ti->n - 1))
+			;
+		if (ti->strs[i] == NULL) {
+			ti->strs[i] = tp->s;
+			ti->vals[i] = tp->v;
+		}
+	}
+	ti->kind = TOK_HASH;
+}
+
+/*
+ * Double the size of the hash table, or allocate it; returns 0 if
+ * we're out of memory.
+ */
+static int
+tok_index_grow(void)
+{
+	struct tok_index *slots, *ti;
+	u_int size, i, j;
+
+	size = tok_index_size != 0 ? 2 * tok_index_size : TOK_INDEX_INITSIZE;
+	slots = calloc(size, sizeof(*slots));
+	if (slots == NULL)
+		return (0);
+	for (i = 0; i < tok_index_size; i++) {
+		ti = &tok_index_slots[i];
+		if (ti->table == NULL)
+			continue;
+		for (j = tok_hash((uint32_t)((uintptr_t)ti->table >> 3)) & (size - 1);
+		     slots[j].table != NULL; j = (j + 1) & (size - 1))
+			;
+		slots[j] = *ti;
+	}
+	free(tok_index_slots);
+	tok_index_slots = slots;
+	tok_index_size = size;
+	return (1);
+}
+
+/* Find the index for a table, building it if need be */
+static const struct tok_index *
+tok_index_get(const struct tok *lp)
+{
+	struct tok_index *ti;
+	u_int h, i;
+
+	h = tok_hash((uint32_t)((uintptr_t)lp >> 3));
+	if (tok_index_slots != NULL) {
+		for (i = h & (tok_index_size - 1);
+		     (ti = &tok_index_slots[i])->table != NULL;
+		     i = (i + 1) & (tok_index_size - 1))
+			if (ti->table == lp)
+				return (ti);
+	}
+
+	/* Keep the table at most half full */
+	if (2 * (tok_index_count + 1) > tok_index_size) {
+		if (!tok_index_grow())
+			return (NULL);
+	}
+	for (i = h & (tok_index_size - 1);
+	     tok_index_slots[i].table != NULL;
+	     i = (i + 1) & (tok_index_size - 1))
+		;
+	ti = &tok_index_slots[i];
+	tok_index_build(ti, lp);
+	tok_index_count++;
+	return (ti);
+}
+
+/*
+ * Free the calling thread's token table indexes.
+ */
+void
+tok_index_free(void)
+{
+	u_int i;
+
+	for (i = 0; i < tok_index_size; i++) {
+		free(tok_index_slots[i].strs);
+		free(tok_index_slots[i].vals);
+	}
+	free(tok_index_slots);
+	tok_index_slots = NULL;
+	tok_index_size = 0;
+	tok_index_count = 0;
+}
+
+/* Look up a value in a table; returns NULL if it's not there. */
+static const char *
+tok_lookup(const struct tok *lp, u_int v)
+{
+	const struct tok_index *ti;
+	const struct tok *tp;
+	u_int i;
+
+	for (tp = lp; tp < lp + TOK_INDEX_MIN; tp++) {
+		if (tp->s == NULL)
+			return (NULL);
+		if (tp->v == v)
+			return (tp->s);
+	}
+
+	ti = tok_index_get(lp);
+	if (ti != NULL) {
+		switch (ti->kind) {
+
+		case TOK_DIRECT:
+			if (v - ti->min < ti->n)
+				return (ti->strs[v - ti->min]);
+			return (NULL);
+
+		case TOK_HASH:
+			for (i = tok_hash(v) & (ti->n - 1); ti->strs[i] != NULL;
+			     i = (i + 1) & (ti->n - 1))
+				if (ti->vals[i] == v)
+					return (ti->strs[i]);
+			return (NULL);
+
+		case TOK_SCAN:
+			break;
+		}
+	}
+	while (tp->s != NULL) {
+		if (tp->v == v)
+			return (tp->s);
+		++tp;
+	}
+	return (NULL);
+}
+
 /*
  * Convert a token value to a string; use "fmt" if not found.
  */
@@ -497,12 +799,12 @@ const char *
 tok2strbuf(const struct tok *lp, const char *fmt,
 	   u_int v, char *buf, size_t bufsize)
 {
+	const char *s;
+
 	if (lp != NULL) {
-		while (lp->s != NULL) {
-			if (lp->v == v)
-				return (lp->s);
-			++lp;
-		}
+		s = tok_lookup(lp, v);
+		if (s != NULL)
+			return (s);
 	}
 	if (fmt == NULL)
 		fmt = "#%d";
@@ -520,8 +822,8 @@ const char *
 tok2str(const struct tok *lp, const char *fmt,
 	u_int v)
 {
-	static char buf[4][TOKBUFSIZE];
-	static int idx = 0;
+	static ND_THREAD_LOCAL char buf[4][TOKBUFSIZE];
+	static ND_THREAD_LOCAL int idx = 0;
 	char *ret;
 
 	ret = buf[idx];
@@ -538,41 +840,37 @@ static char *
 bittok2str_internal(const struct tok *lp, const char *fmt,
 	   u_int v, const char *sep)
 {
-        static char buf[1024+1]; /* our string buffer */
+        static ND_THREAD_LOCAL char buf[1024+1]; /* our string buffer */
         char *bufp = buf;
         size_t space_left = sizeof(buf), string_size;
-        u_int rotbit; /* this is the bit we rotate through all bitpositions */
         u_int tokval;
         const char * sepstr = "";
 
 	while (lp != NULL && lp->s != NULL) {
             tokval=lp->v;   /* load our first value */
-            rotbit=1;
-            while (rotbit != 0) {
-                /*
-                 * lets AND the rotating bit with our token value
-                 * and see if we have got a match
-                 */
-		if (tokval == (v&rotbit)) {
-                    /* ok we have found something */
-                    if (space_left <= 1)
-                        return (buf); /* only enough room left for NUL, if that */
-                    string_size = strlcpy(bufp, sepstr, space_left);
-                    if (string_size >= space_left)
-                        return (buf);    /* we ran out of room */
-                    bufp += string_size;
-                    space_left -= string_size;
-                    if (space_left <= 1)
-                        return (buf); /* only enough room left for NUL, if that */
-                    string_size = strlcpy(bufp, lp->s, space_left);
-                    if (string_size >= space_left)
-                        return (buf);    /* we ran out of room */
-                    bufp += string_size;
-                    space_left -= string_size;
-                    sepstr = sep;
-                    break;
-                }
-                rotbit=rotbit<<1; /* no match - lets shift and try again */
+            /*
+             * A token matches if it's one of the bits set in v.  A
+             * zero token matches if any bit of v is clear, as it's
+             * equal to v ANDed with that bit.
+             */
+            if (tokval == 0 ? v != 0xffffffff :
+                ((tokval & (tokval - 1)) == 0 && (v & tokval) != 0)) {
+                /* ok we have found something */
+                if (space_left <= 1)
+                    return (buf); /* only enough room left for NUL, if that */
+                string_size = strlcpy(bufp, sepstr, space_left);
+                if (string_size >= space_left)
+                    return (buf);    /* we ran out of room */
+                bufp += string_size;
+                space_left -= string_size;
+                if (space_left <= 1)
+                    return (buf); /* only enough room left for NUL, if that */
+                string_size = strlcpy(bufp, lp->s, space_left);
+                if (string_size >= space_left)
+                    return (buf);    /* we ran out of room */
+                bufp += string_size;
+                space_left -= string_size;
+                sepstr = sep;
             }
             lp++;
 	}
@@ -615,7 +913,7 @@ const char *
 tok2strary_internal(const char **lp, int n, const char *fmt,
 	int v)
 {
-	static char buf[TOKBUFSIZE];
+	static ND_THREAD_LOCAL char buf[TOKBUFSIZE];
 
 	if (v >= 0 && v < n && lp[v] != NULL)
 		return lp[v];
@@ -56,4 +56,26 @@
   #define _U_
 #endif
 
+/*
+ * ND_THREAD_LOCAL: storage class for the static buffers in which some
+ * routines return their result, so that they can be used from several
+ * threads at once.  If we don't know how to do that, they're shared,
+ * and libnetdissect can be used by only one thread at a time.
+ */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+  #define ND_THREAD_LOCAL _Thread_local
+#elif ND_IS_AT_LEAST_GNUC_VERSION(3,3) \
+    || ND_IS_AT_LEAST_SUNC_VERSION(5,9) \
+    || ND_IS_AT_LEAST_XL_C_VERSION(10,1)
+  /*
+   * GCC 3.3 and later, or compilers claiming to be it, such as Clang,
+   * Sun/Oracle C 5.9 and later, and XL C 10.1 and later.
+   */
+  #define ND_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+  #define ND_THREAD_LOCAL __declspec(thread)
+#else
+  #define ND_THREAD_LOCAL
+#endif
+
 #endif
@@ -0,0 +1,619 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Multi-threaded dissection pipeline.
+ *
+ * The capture thread (the one running pcap_loop()) only copies each
+ * packet into a slot of a ring and queues the slot to a worker thread.
+ * Packets are assigned to workers by a symmetric hash of their network
+ * addresses, so both directions of a conversation are dissected by the
+ * same worker, in capture order; that keeps state such as relative TCP
+ * sequence numbers consistent.  Each worker has its own copy of the
+ * netdissect_options, and so its own printer state, and formats each
+ * packet into the slot's text buffer.  A sequencer thread writes the
+ * text buffers to the standard output in capture order, several at a
+ * time with writev(), and hands the slots back to the capture thread.
+ *
+ * If the ring is full, the capture thread waits for the sequencer; it
+ * never drops packets itself, so an overloaded pipeline shows up, as it
+ * does without --workers, in the "dropped by kernel" count.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "netdissect.h"
+#include "addrtoname.h"
+#include "extract.h"
+#include "flowhash.h"
+#include "print.h"
+#include "timeval-operations.h"
+#include "workers.h"
+
+#ifdef HAVE_LIBPTHREAD
+
+#include <pthread.h>
+#include <signal.h>
+#ifdef HAVE_WRITEV
+#include <sys/uio.h>
+#endif
+
+/* Number of packets that can be in the pipeline; must be a power of 2 */
+#define RING_SIZE	4096
+#define RING_SLOT(seq)	(&ring[(seq) & (RING_SIZE - 1)])
+
+/* Initial size of the per-slot text buffer */
+#define SLOT_OUT_SIZE	512
+
+/*
+ * Most slots, and text bytes, the sequencer collects before writing
+ * them; it writes fewer if nothing else is in the pipeline.
+ */
+#define WRITE_SLOTS	64
+#define WRITE_BYTES	32768
+
+struct slot {
+	struct pcap_pkthdr hdr;
+	u_char *data;			/* copy of the packet data */
+	u_int datasize;			/* allocated size of data */
+	u_int packet_number;		/* for -# */
+	if_printer_t printer;		/* printer at capture time (-V) */
+	int void_printer;
+	struct timeval tv_ref;		/* previous or first time stamp */
+	char *out;			/* dissected text */
+	size_t outlen;
+	size_t outsize;
+	int done;			/* dissected, ready to be written */
+};
+
+struct worker {
+	netdissect_options ndo;		/* must be first, see worker_printf() */
+	struct slot *cur;		/* slot being dissected */
+	uint64_t *queue;		/* sequence numbers of queued slots */
+	uint64_t qhead;
+	uint64_t qtail;
+	int idle;			/* waiting on work_cv */
+	pthread_cond_t work_cv;
+	pthread_t thread;
+};
+
+static struct slot *ring;
+static struct worker *workers;
+static int nworkers;
+static int linktype;
+static int flush_each;			/* -l or -U: flush after each packet */
+static netdissect_options *main_ndo;
+
+static pthread_mutex_t pipe_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t space_cv = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cv = PTHREAD_COND_INITIALIZER;
+static uint64_t head;			/* next sequence number to capture */
+static uint64_t tail;			/* next sequence number to write */
+static int stopping;
+static int capture_waiting;		/* capture thread waiting on space_cv */
+static int sequencer_waiting;		/* sequencer waiting on done_cv */
+static uint64_t sequencer_next;		/* slot the sequencer is waiting for */
+static pthread_t sequencer_thread;
+
+/*
+ * ndo_printf for the workers: append to the text buffer of the slot
+ * being dissected.
+ */
+static int
+worker_printf(netdissect_options *ndo, const char *fmt, ...)
+{
+	struct worker *w = (struct worker *)ndo;
+	struct slot *s = w->cur;
+	va_list args;
+	int ret;
+	size_t newsize;
+	char *newout;
+
+	for (;;) {
+		va_start(args, fmt);
+		ret = vsnprintf(s->out + s->outlen, s->outsize - s->outlen,
+				fmt, args);
+		va_end(args);
+		if (ret < 0)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_WRITE_FILE,
+					  "Unable to format output: %s",
+					  strerror(errno));
+		if ((size_t)ret < s->outsize - s->outlen)
+			break;
+		newsize = s->outsize * 2;
+		while (newsize - s->outlen <= (size_t)ret)
+			newsize *= 2;
+		newout = realloc(s->out, newsize);
+		if (newout == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+					  "%s: realloc", __func__);
+		s->out = newout;
+		s->outsize = newsize;
+	}
+	s->outlen += ret;
+	return (ret);
+}
+
+static void *
+worker_main(void *arg)
+{
+	struct worker *w = arg;
+	struct slot *s;
+	uint64_t seq;
+
+	pthread_mutex_lock(&pipe_lock);
+	for (;;) {
+		while (w->qhead == w->qtail && !stopping) {
+			w->idle = 1;
+			pthread_cond_wait(&w->work_cv, &pipe_lock);
+			w->idle = 0;
+		}
+		if (w->qhead == w->qtail)
+			break;
+		seq = w->queue[w->qhead & (RING_SIZE - 1)];
+		w->qhead++;
+		pthread_mutex_unlock(&pipe_lock);
+
+		s = RING_SLOT(seq);
+		s->outlen = 0;
+		w->cur = s;
+		w->ndo.ndo_if_printer = s->printer;
+		w->ndo.ndo_void_printer = s->void_printer;
+		w->ndo.ndo_tv_ref = s->tv_ref;
+		pretty_print_packet(&w->ndo, &s->hdr, s->data,
+				    s->packet_number);
+
+		pthread_mutex_lock(&pipe_lock);
+		s->done = 1;
+		if (seq == sequencer_next && sequencer_waiting)
+			pthread_cond_signal(&done_cv);
+	}
+	pthread_mutex_unlock(&pipe_lock);
+	tok_index_free();
+	return (NULL);
+}
+
+/*
+ * Write the text of the "n" slots starting at "seq".
+ */
+static void
+write_slots(uint64_t seq, uint64_t n)
+{
+#ifdef HAVE_WRITEV
+	struct iovec iov[WRITE_SLOTS];
+	struct iovec *iovp;
+	int niov;
+	ssize_t len;
+
+	niov = 0;
+	for (; n != 0; seq++, n--) {
+		if (RING_SLOT(seq)->outlen == 0)
+			continue;
+		iov[niov].iov_base = RING_SLOT(seq)->out;
+		iov[niov].iov_len = RING_SLOT(seq)->outlen;
+		niov++;
+	}
+	iovp = iov;
+	while (niov != 0) {
+		len = writev(fileno(stdout), iovp, niov);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			(*main_ndo->ndo_error)(main_ndo, S_ERR_ND_WRITE_FILE,
+			    "Unable to write output: %s", strerror(errno));
+		}
+		while (niov != 0 && (size_t)len >= iovp->iov_len) {
+			len -= iovp->iov_len;
+			iovp++;
+			niov--;
+		}
+		if (niov != 0) {
+			iovp->iov_base = (char *)iovp->iov_base + len;
+			iovp->iov_len -= len;
+		}
+	}
+#else
+	struct slot *s;
+
+	for (; n != 0; seq++, n--) {
+		s = RING_SLOT(seq);
+		if (s->outlen != 0 &&
+		    fwrite(s->out, 1, s->outlen, stdout) != s->outlen)
+			(*main_ndo->ndo_error)(main_ndo, S_ERR_ND_WRITE_FILE,
+			    "Unable to write output: %s", strerror(errno));
+	}
+	fflush(stdout);
+#endif
+}
+
+static void *
+sequencer_main(void *arg _U_)
+{
+	uint64_t n;
+	size_t bytes;
+
+	pthread_mutex_lock(&pipe_lock);
+	for (;;) {
+		/*
+		 * Collect the dissected slots at the tail of the ring,
+		 * until there are enough of them, or all the packets
+		 * in the pipeline are dissected, or -l or -U asks for
+		 * each packet to be written as soon as it can be.
+		 */
+		n = 0;
+		bytes = 0;
+		for (;;) {
+			while (tail + n != head && n < WRITE_SLOTS &&
+			    RING_SLOT(tail + n)->done) {
+				bytes += RING_SLOT(tail + n)->outlen;
+				n++;
+			}
+			if (n != 0 && (flush_each || tail + n == head ||
+			    n == WRITE_SLOTS || bytes >= WRITE_BYTES))
+				break;
+			if (stopping && tail == head)
+				goto out;
+			sequencer_next = tail + n;
+			sequencer_waiting = 1;
+			pthread_cond_wait(&done_cv, &pipe_lock);
+			sequencer_waiting = 0;
+		}
+		pthread_mutex_unlock(&pipe_lock);
+
+		write_slots(tail, n);
+
+		pthread_mutex_lock(&pipe_lock);
+		for (; n != 0; n--) {
+			RING_SLOT(tail)->done = 0;
+			tail++;
+		}
+		if (capture_waiting)
+			pthread_cond_signal(&space_cv);
+	}
+out:
+	pthread_mutex_unlock(&pipe_lock);
+	return (NULL);
+}
+
+/*
+ * Start "count" worker threads and the sequencer thread.  "ndo" is
+ * the fully set up netdissect_options of the main thread; each worker
+ * gets a copy of it, with printer state of its own set up as
+ * init_print() does with "localnet" and "mask".
+ */
+int
+workers_start(netdissect_options *ndo, int dlt, int count, int flush,
+	      uint32_t localnet, uint32_t mask, char *errbuf,
+	      size_t errbuf_size)
+{
+	sigset_t all, old;
+	int i, err;
+
+	ring = calloc(RING_SIZE, sizeof(*ring));
+	workers = calloc(count, sizeof(*workers));
+	if (ring == NULL || workers == NULL) {
+		snprintf(errbuf, errbuf_size, "%s: calloc", __func__);
+		return (-1);
+	}
+	for (i = 0; i < RING_SIZE; i++) {
+		ring[i].out = malloc(SLOT_OUT_SIZE);
+		if (ring[i].out == NULL) {
+			snprintf(errbuf, errbuf_size, "%s: malloc", __func__);
+			return (-1);
+		}
+		ring[i].outsize = SLOT_OUT_SIZE;
+	}
+	main_ndo = ndo;
+	linktype = dlt;
+	flush_each = flush;
+
+	/*
+	 * Signals such as SIGINT must be delivered to the capture
+	 * thread, so that pcap_breakloop() interrupts a blocking read;
+	 * the new threads inherit a mask that blocks all of them.
+	 */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for (i = 0; i < count; i++) {
+		struct worker *w = &workers[i];
+
+		w->ndo = *ndo;
+		w->ndo.ndo_printf = worker_printf;
+		w->ndo.ndo_packet_info_stack = NULL;
+		nd_init_state(&w->ndo);
+		init_addrtoname(&w->ndo, localnet, mask);
+		w->queue = malloc(RING_SIZE * sizeof(*w->queue));
+		if (w->queue == NULL) {
+			snprintf(errbuf, errbuf_size, "%s: malloc", __func__);
+			pthread_sigmask(SIG_SETMASK, &old, NULL);
+			return (-1);
+		}
+		pthread_cond_init(&w->work_cv, NULL);
+		err = pthread_create(&w->thread, NULL, worker_main, w);
+		if (err != 0) {
+			snprintf(errbuf, errbuf_size,
+			    "can't create worker thread: %s", strerror(err));
+			pthread_sigmask(SIG_SETMASK, &old, NULL);
+			return (-1);
+		}
+		nworkers++;
+	}
+	err = pthread_create(&sequencer_thread, NULL, sequencer_main, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (err != 0) {
+		snprintf(errbuf, errbuf_size,
+		    "can't create sequencer thread: %s", strerror(err));
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Change the link-layer header type used to find the addresses to
+ * hash, when reading a new file with -V.
+ */
+void
+workers_set_linktype(int dlt)
+{
+	linktype = dlt;
+}
+
+/*
+ * Called from the capture thread for each packet to dissect.
+ */
+void
+workers_submit(const struct pcap_pkthdr *h, const u_char *sp,
+	       u_int packet_number)
+{
+	struct slot *s;
+	struct worker *w;
+	u_char *data;
+
+	pthread_mutex_lock(&pipe_lock);
+	while (head - tail >= RING_SIZE) {
+		capture_waiting = 1;
+		pthread_cond_wait(&space_cv, &pipe_lock);
+		capture_waiting = 0;
+	}
+	s = RING_SLOT(head);
+	pthread_mutex_unlock(&pipe_lock);
+
+	/* The slot is now ours until it's queued. */
+	if (s->datasize < h->caplen) {
+		data = realloc(s->data, h->caplen);
+		if (data == NULL)
+			(*main_ndo->ndo_error)(main_ndo, S_ERR_ND_MEM_ALLOC,
+					       "%s: realloc", __func__);
+		s->data = data;
+		s->datasize = h->caplen;
+	}
+	memcpy(s->data, sp, h->caplen);
+	s->hdr = *h;
+	s->packet_number = packet_number;
+	s->printer = main_ndo->ndo_if_printer;
+	s->void_printer = main_ndo->ndo_void_printer;
+
+	/*
+	 * -ttt and -ttttt depend on the packets before this one, which
+	 * may be dissected by other workers; keep the reference time
+	 * stamp here, as ts_print() would, and pass it along.
+	 */
+	s->tv_ref = main_ndo->ndo_tv_ref;
+	if (main_ndo->ndo_tflag == 3 ||
+	    !netdissect_timevalisset(&main_ndo->ndo_tv_ref))
+		main_ndo->ndo_tv_ref = h->ts;
+	w = &workers[flow_hash(linktype, h, sp, 0) % nworkers];
+
+	pthread_mutex_lock(&pipe_lock);
+	w->queue[w->qtail & (RING_SIZE - 1)] = head;
+	w->qtail++;
+	head++;
+	if (w->idle)
+		pthread_cond_signal(&w->work_cv);
+	pthread_mutex_unlock(&pipe_lock);
+}
+
+/*
+ * Wait until everything submitted so far has been written.
+ */
+void
+workers_drain(void)
+{
+	pthread_mutex_lock(&pipe_lock);
+	while (tail != head) {
+		capture_waiting = 1;
+		pthread_cond_wait(&space_cv, &pipe_lock);
+		capture_waiting = 0;
+	}
+	pthread_mutex_unlock(&pipe_lock);
+}
+
+/*
+ * Combine the workers' nd_malloc() arena counters: the high-water mark
+ * is the largest of theirs, the rest are totals.
+ */
+void
+workers_get_alloc_stats(struct nd_alloc_stats *stats)
+{
+	struct nd_alloc_stats ws;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < nworkers; i++) {
+		nd_get_alloc_stats(&workers[i].ndo, &ws);
+		if (ws.high_water > stats->high_water)
+			stats->high_water = ws.high_water;
+		stats->slab_bytes += ws.slab_bytes;
+		stats->slabs += ws.slabs;
+	}
+}
+
+/*
+ * Add up the workers' name cache counters.
+ */
+void
+workers_get_name_cache_stats(struct nd_name_cache_stats *stats)
+{
+	struct nd_name_cache_stats ws;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < nworkers; i++) {
+		nd_get_name_cache_stats(&workers[i].ndo, &ws);
+		stats->hits += ws.hits;
+		stats->misses += ws.misses;
+		stats->evictions += ws.evictions;
+		stats->names += ws.names;
+		stats->bytes += ws.bytes;
+	}
+}
+
+/*
+ * Add up the workers' fragment reassembly counters.
+ */
+void
+workers_get_reasm_stats(struct nd_reasm_stats *stats)
+{
+	struct nd_reasm_stats ws;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < nworkers; i++) {
+		nd_get_reasm_stats(&workers[i].ndo, &ws);
+		stats->fragments += ws.fragments;
+		stats->datagrams += ws.datagrams;
+		stats->timed_out += ws.timed_out;
+		stats->evicted += ws.evicted;
+		stats->overlaps += ws.overlaps;
+		stats->discarded += ws.discarded;
+		stats->pending += ws.pending;
+		stats->bytes += ws.bytes;
+		stats->peak_bytes += ws.peak_bytes;
+	}
+}
+
+/*
+ * Add up the workers' TCP stream reassembly counters.
+ */
+void
+workers_get_tcp_reasm_stats(struct nd_tcp_reasm_stats *stats)
+{
+	struct nd_tcp_reasm_stats ws;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < nworkers; i++) {
+		nd_get_tcp_reasm_stats(&workers[i].ndo, &ws);
+		stats->segments += ws.segments;
+		stats->delivered += ws.delivered;
+		stats->retransmitted += ws.retransmitted;
+		stats->out_of_order += ws.out_of_order;
+		stats->held += ws.held;
+		stats->gaps += ws.gaps;
+		stats->timed_out += ws.timed_out;
+		stats->evicted += ws.evicted;
+		stats->streams += ws.streams;
+		stats->bytes += ws.bytes;
+		stats->peak_bytes += ws.peak_bytes;
+	}
+}
+
+/*
+ * Add up the workers' relative sequence number table counters.
+ */
+void
+workers_get_tcp_seq_stats(struct nd_tcp_seq_stats *stats)
+{
+	struct nd_tcp_seq_stats ws;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < nworkers; i++) {
+		nd_get_tcp_seq_stats(&workers[i].ndo, &ws);
+		stats->lookups += ws.lookups;
+		stats->probes += ws.probes;
+		stats->closed += ws.closed;
+		stats->timed_out += ws.timed_out;
+		stats->evicted += ws.evicted;
+		stats->flows += ws.flows;
+		if (ws.longest_chain > stats->longest_chain)
+			stats->longest_chain = ws.longest_chain;
+		stats->bytes += ws.bytes;
+	}
+}
+
+/*
+ * Add up the workers' request table counters.
+ */
+void
+workers_get_rpc_table_stats(struct nd_rpc_table_stats *stats)
+{
+	struct nd_rpc_table_stats ws;
+	int i, k;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < nworkers; i++) {
+		nd_get_rpc_table_stats(&workers[i].ndo, &ws);
+		for (k = 0; k < ND_RPC_KINDS; k++) {
+			stats->entered[k] += ws.entered[k];
+			stats->hits[k] += ws.hits[k];
+			stats->misses[k] += ws.misses[k];
+		}
+		stats->lookups += ws.lookups;
+		stats->probes += ws.probes;
+		stats->timed_out += ws.timed_out;
+		stats->evicted += ws.evicted;
+		stats->entries += ws.entries;
+		if (ws.longest_chain > stats->longest_chain)
+			stats->longest_chain = ws.longest_chain;
+		stats->bytes += ws.bytes;
+	}
+}
+
+/*
+ * Write everything that's still in the pipeline and stop the threads.
+ */
+void
+workers_finish(void)
+{
+	int i;
+
+	if (nworkers == 0)
+		return;
+	workers_drain();
+	pthread_mutex_lock(&pipe_lock);
+	stopping = 1;
+	for (i = 0; i < nworkers; i++)
+		pthread_cond_signal(&workers[i].work_cv);
+	pthread_cond_signal(&done_cv);
+	pthread_mutex_unlock(&pipe_lock);
+	for (i = 0; i < nworkers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		nd_free_state(&workers[i].ndo);
+	}
+	pthread_join(sequencer_thread, NULL);
+	nworkers = 0;
+}
+#endif /* HAVE_LIBPTHREAD */
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef workers_h
+#define workers_h
+
+/*
+ * Multi-threaded dissection pipeline (--workers).
+ *
+ * The capture thread copies each packet into a ring and hands it to
+ * one of N worker threads, each with its own netdissect_options; a
+ * sequencer thread writes the dissected text in capture order.
+ *
+ * If we don't have both <pthread.h> and the threads library, undefine
+ * HAVE_LIBPTHREAD, so that later tests are done only on HAVE_LIBPTHREAD.
+ */
+#ifndef HAVE_PTHREAD_H
+#undef HAVE_LIBPTHREAD
+#endif
+
+#ifdef HAVE_LIBPTHREAD
+/* Maximum number of worker threads accepted by --workers */
+#define WORKERS_MAX	256
+
+extern int workers_start(netdissect_options *, int, int, int, uint32_t,
+    uint32_t, char *, size_t);
+extern void workers_set_linktype(int);
+extern void workers_submit(const struct pcap_pkthdr *, const u_char *, u_int);
+extern void workers_drain(void);
+extern void workers_get_alloc_stats(struct nd_alloc_stats *);
+extern void workers_get_name_cache_stats(struct nd_name_cache_stats *);
+extern void workers_get_reasm_stats(struct nd_reasm_stats *);
+extern void workers_get_tcp_reasm_stats(struct nd_tcp_reasm_stats *);
+extern void workers_get_tcp_seq_stats(struct nd_tcp_seq_stats *);
+extern void workers_get_rpc_table_stats(struct nd_rpc_table_stats *);
+extern void workers_finish(void);
+#endif /* HAVE_LIBPTHREAD */
+
+#endif /* workers_h */
@@ -0,0 +1,1043 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Compressed savefiles.
+ *
+ * libpcap writes savefiles to a standard I/O stream; we give it one made
+ * with fopencookie() or funopen(), unbuffered, whose writes are copied
+ * into a buffer.  When the buffer is full it's handed to the stream's
+ * compressing thread, which compresses it and writes the result to the
+ * file, and the writes go on into a second buffer.  If the thread is
+ * still busy with the previous buffer when the second one fills, the
+ * writer waits for it.  Without threads, a full buffer is compressed
+ * and written there and then.
+ *
+ * Compressed savefiles are read the other way round: a readahead thread
+ * reads the file and decompresses it into one of two buffers while the
+ * stream given to libpcap reads from the other one.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_FOPENCOOKIE
+#define _GNU_SOURCE	/* for fopencookie() */
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "zfile.h"
+
+/*
+ * If we don't have the headers, we can't use the libraries, and if we
+ * can't make our own standard I/O streams, libpcap can't use them.
+ */
+#ifndef HAVE_ZLIB_H
+#undef HAVE_LIBZ
+#endif
+#ifndef HAVE_ZSTD_H
+#undef HAVE_LIBZSTD
+#endif
+#ifndef HAVE_PTHREAD_H
+#undef HAVE_LIBPTHREAD
+#endif
+#if !defined(HAVE_FOPENCOOKIE) && !defined(HAVE_FUNOPEN)
+#undef HAVE_LIBZ
+#undef HAVE_LIBZSTD
+#endif
+
+#ifdef HAVE_LIBZ
+#define ZLIB_CONST	/* next_in is const */
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
+
+/* Size of each of the two buffers of data to compress */
+#define ZFILE_BUFSIZE	(256 * 1024)
+
+/* Size of the buffer of compressed data for zlib */
+#define ZFILE_OUTSIZE	(64 * 1024)
+
+/* What the compressing thread is to do with the buffer handed to it */
+#define ZOP_NONE	0	/* nothing; it's done with it */
+#define ZOP_DATA	1	/* compress it */
+#define ZOP_FLUSH	2	/* compress it and write out all the data so far */
+#define ZOP_FINISH	3	/* compress it and end the compressed data */
+
+struct zwriter {
+	struct zwriter *next;	/* in the list of open streams */
+	FILE *fp;
+	int fd;
+	int method;
+#ifdef HAVE_LIBZ
+	z_stream zs;
+#endif
+#ifdef HAVE_LIBZSTD
+	ZSTD_CCtx *cctx;
+#endif
+	u_char *buf[2];		/* buffers of data to compress */
+	u_int cur;		/* the one being filled */
+	size_t fill;		/* bytes in it */
+	u_char *out;		/* compressed data, for the thread */
+	size_t outsize;
+	int threaded;		/* there's a compressing thread */
+#ifdef HAVE_LIBPTHREAD
+	pthread_t thread;
+	pthread_mutex_t mtx;	/* protects the rest */
+	pthread_cond_t cond;
+#endif
+	int op;			/* ZOP_ for the other buffer */
+	size_t len;		/* bytes in it */
+	uint64_t in_bytes;	/* bytes compressed */
+	uint64_t out_bytes;	/* compressed bytes written */
+	int err;		/* errno of the first failure, or 0 */
+};
+
+static struct zwriter *zw_list;
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t zw_list_mtx = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void
+zw_lock(struct zwriter *zw _U_)
+{
+#ifdef HAVE_LIBPTHREAD
+	if (zw == NULL)
+		pthread_mutex_lock(&zw_list_mtx);
+	else if (zw->threaded)
+		pthread_mutex_lock(&zw->mtx);
+#endif
+}
+
+static void
+zw_unlock(struct zwriter *zw _U_)
+{
+#ifdef HAVE_LIBPTHREAD
+	if (zw == NULL)
+		pthread_mutex_unlock(&zw_list_mtx);
+	else if (zw->threaded)
+		pthread_mutex_unlock(&zw->mtx);
+#endif
+}
+
+static int
+zw_write(struct zwriter *zw, const u_char *p, size_t len, uint64_t *outp)
+{
+	ssize_t n;
+
+	while (len != 0) {
+		n = write(zw->fd, p, len);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return (errno);
+		}
+		p += n;
+		len -= n;
+		*outp += n;
+	}
+	return (0);
+}
+
+/*
+ * Compress "len" bytes at "p" and write out what comes of it, adding the
+ * number of bytes written to *outp; return 0 or an errno.
+ */
+static int
+zw_compress(struct zwriter *zw, const u_char *p, size_t len, int op,
+    uint64_t *outp)
+{
+	int err = 0;
+
+	switch (zw->method) {
+#ifdef HAVE_LIBZ
+	case ZFILE_GZIP: {
+		int flush, ret;
+
+		flush = op == ZOP_FINISH ? Z_FINISH :
+		    op == ZOP_FLUSH ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+		zw->zs.next_in = (const Bytef *)p;
+		zw->zs.avail_in = (uInt)len;
+		do {
+			zw->zs.next_out = zw->out;
+			zw->zs.avail_out = (uInt)zw->outsize;
+			ret = deflate(&zw->zs, flush);
+			if (ret == Z_STREAM_ERROR)
+				return (EIO);
+			err = zw_write(zw, zw->out,
+			    zw->outsize - zw->zs.avail_out, outp);
+		} while (err == 0 && zw->zs.avail_out == 0);
+		break;
+	}
+#endif
+#ifdef HAVE_LIBZSTD
+	case ZFILE_ZSTD: {
+		ZSTD_EndDirective mode;
+		ZSTD_inBuffer in;
+		ZSTD_outBuffer out;
+		size_t left;
+
+		mode = op == ZOP_FINISH ? ZSTD_e_end :
+		    op == ZOP_FLUSH ? ZSTD_e_flush : ZSTD_e_continue;
+		in.src = p;
+		in.size = len;
+		in.pos = 0;
+		do {
+			out.dst = zw->out;
+			out.size = zw->outsize;
+			out.pos = 0;
+			left = ZSTD_compressStream2(zw->cctx, &out, &in, mode);
+			if (ZSTD_isError(left))
+				return (EIO);
+			err = zw_write(zw, zw->out, out.pos, outp);
+		} while (err == 0 && (mode == ZSTD_e_continue ?
+		    in.pos < in.size : left != 0));
+		break;
+	}
+#endif
+	}
+	return (err);
+}
+
+/* Compress the other buffer and note what came of it */
+static void
+zw_compress_other(struct zwriter *zw, int op)
+{
+	const u_char *p;
+	size_t len;
+	uint64_t out = 0;
+	int err;
+
+	/* Only the compressing thread looks at the other buffer */
+	p = zw->buf[zw->cur ^ 1];
+	len = zw->len;
+	zw_unlock(zw);
+	err = zw->err == 0 ? zw_compress(zw, p, len, op, &out) : 0;
+	zw_lock(zw);
+	zw->in_bytes += len;
+	zw->out_bytes += out;
+	if (zw->err == 0)
+		zw->err = err;
+	zw->op = ZOP_NONE;
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void *
+zw_thread(void *arg)
+{
+	struct zwriter *zw = arg;
+	int op;
+
+	pthread_mutex_lock(&zw->mtx);
+	do {
+		while (zw->op == ZOP_NONE)
+			pthread_cond_wait(&zw->cond, &zw->mtx);
+		op = zw->op;
+		zw_compress_other(zw, op);
+		pthread_cond_broadcast(&zw->cond);
+	} while (op != ZOP_FINISH);
+	pthread_mutex_unlock(&zw->mtx);
+	return (NULL);
+}
+#endif
+
+/* Wait until the compressing thread is done with the other buffer */
+static void
+zw_wait(struct zwriter *zw _U_)
+{
+#ifdef HAVE_LIBPTHREAD
+	while (zw->op != ZOP_NONE)
+		pthread_cond_wait(&zw->cond, &zw->mtx);
+#endif
+}
+
+/*
+ * Hand the buffer being filled to the compressing thread, or compress
+ * it now, and go on to the other one; return 0 or the errno of an
+ * earlier failure.
+ */
+static int
+zw_handoff(struct zwriter *zw, int op)
+{
+	int err;
+
+	zw_lock(zw);
+	zw_wait(zw);
+	zw->len = zw->fill;
+	zw->op = op;
+	zw->cur ^= 1;
+	if (zw->threaded) {
+#ifdef HAVE_LIBPTHREAD
+		pthread_cond_broadcast(&zw->cond);
+		if (op == ZOP_FLUSH)
+			zw_wait(zw);
+#endif
+	} else
+		zw_compress_other(zw, op);
+	err = zw->err;
+	zw_unlock(zw);
+	zw->fill = 0;
+	return (err);
+}
+
+static ssize_t
+zw_cookie_write(void *cookie, const char *p, size_t len)
+{
+	struct zwriter *zw = cookie;
+	size_t done, n;
+	int err;
+
+	for (done = 0; done < len; done += n) {
+		n = ZFILE_BUFSIZE - zw->fill;
+		if (n > len - done)
+			n = len - done;
+		memcpy(zw->buf[zw->cur] + zw->fill, p + done, n);
+		zw->fill += n;
+		if (zw->fill == ZFILE_BUFSIZE &&
+		    (err = zw_handoff(zw, ZOP_DATA)) != 0) {
+			errno = err;
+			return (-1);
+		}
+	}
+	return ((ssize_t)len);
+}
+
+static int
+zw_cookie_close(void *cookie)
+{
+	struct zwriter *zw = cookie, **zwp;
+	int err;
+
+	err = zw_handoff(zw, ZOP_FINISH);
+#ifdef HAVE_LIBPTHREAD
+	if (zw->threaded) {
+		pthread_join(zw->thread, NULL);
+		err = zw->err;
+		pthread_mutex_destroy(&zw->mtx);
+		pthread_cond_destroy(&zw->cond);
+	}
+#endif
+	zw_lock(NULL);
+	for (zwp = &zw_list; *zwp != zw; zwp = &(*zwp)->next)
+		;
+	*zwp = zw->next;
+	zw_unlock(NULL);
+
+	if (close(zw->fd) == -1 && err == 0)
+		err = errno;
+#ifdef HAVE_LIBZ
+	if (zw->method == ZFILE_GZIP)
+		deflateEnd(&zw->zs);
+#endif
+#ifdef HAVE_LIBZSTD
+	if (zw->method == ZFILE_ZSTD)
+		ZSTD_freeCCtx(zw->cctx);
+#endif
+	free(zw->buf[0]);
+	free(zw->buf[1]);
+	free(zw->out);
+	free(zw);
+	if (err != 0) {
+		errno = err;
+		return (-1);
+	}
+	return (0);
+}
+
+#if !defined(HAVE_FOPENCOOKIE) && defined(HAVE_FUNOPEN)
+static int
+zw_funopen_write(void *cookie, const char *p, int len)
+{
+	return ((int)zw_cookie_write(cookie, p, (size_t)len));
+}
+#endif
+
+static FILE *
+zw_fopen(struct zwriter *zw)
+{
+#ifdef HAVE_FOPENCOOKIE
+	static const cookie_io_functions_t funcs = {
+		NULL, zw_cookie_write, NULL, zw_cookie_close
+	};
+
+	return (fopencookie(zw, "w", funcs));
+#else
+	return (funopen(zw, NULL, zw_funopen_write, NULL, zw_cookie_close));
+#endif
+}
+
+struct zreader {
+	int fd;
+	int method;
+#ifdef HAVE_LIBZ
+	z_stream zs;
+#endif
+#ifdef HAVE_LIBZSTD
+	ZSTD_DCtx *dctx;
+#endif
+	u_char *in;		/* compressed data read from the file */
+	size_t insize;
+	size_t inlen;		/* bytes in it */
+	size_t inpos;		/* bytes of it decompressed */
+	int in_eof;		/* the whole file's been read */
+	u_char *buf[2];		/* decompressed data */
+	u_int cur;		/* the one being read from the stream */
+	size_t pos;		/* bytes of it read */
+	int threaded;		/* there's a readahead thread */
+#ifdef HAVE_LIBPTHREAD
+	pthread_t thread;
+	pthread_mutex_t mtx;	/* protects the rest */
+	pthread_cond_t cond;
+#endif
+	size_t len[2];		/* bytes in each buffer */
+	int full[2];		/* filled, and not yet all read */
+	int eof;		/* no buffer will be filled after "last" */
+	u_int last;
+	int err;		/* errno of a failure, or 0 */
+	int stop;		/* the stream's being closed */
+};
+
+static void
+zr_lock(struct zreader *zr _U_)
+{
+#ifdef HAVE_LIBPTHREAD
+	if (zr->threaded)
+		pthread_mutex_lock(&zr->mtx);
+#endif
+}
+
+static void
+zr_unlock(struct zreader *zr _U_)
+{
+#ifdef HAVE_LIBPTHREAD
+	if (zr->threaded)
+		pthread_mutex_unlock(&zr->mtx);
+#endif
+}
+
+static void
+zr_signal(struct zreader *zr _U_)
+{
+#ifdef HAVE_LIBPTHREAD
+	if (zr->threaded)
+		pthread_cond_broadcast(&zr->cond);
+#endif
+}
+
+/*
+ * Decompress data into the "size" bytes at "out", setting *lenp to the
+ * number of bytes and *endp if the data's all been decompressed; return
+ * 0 or an errno.  A file cut short ends where it's cut, as it would if
+ * it weren't compressed.
+ */
+static int
+zr_decompress(struct zreader *zr, u_char *out, size_t size, size_t *lenp,
+    int *endp)
+{
+	size_t len = 0;
+	ssize_t n;
+
+	*endp = 0;
+	while (len < size) {
+		if (zr->inpos == zr->inlen) {
+			if (!zr->in_eof) {
+				n = read(zr->fd, zr->in, zr->insize);
+				if (n == -1) {
+					if (errno == EINTR)
+						continue;
+					*lenp = len;
+					return (errno);
+				}
+				zr->inlen = n;
+				zr->inpos = 0;
+				if (n == 0)
+					zr->in_eof = 1;
+			}
+			if (zr->in_eof) {
+				*endp = 1;
+				break;
+			}
+		}
+		switch (zr->method) {
+#ifdef HAVE_LIBZ
+		case ZFILE_GZIP: {
+			int ret;
+
+			zr->zs.next_in = zr->in + zr->inpos;
+			zr->zs.avail_in = (uInt)(zr->inlen - zr->inpos);
+			zr->zs.next_out = out + len;
+			zr->zs.avail_out = (uInt)(size - len);
+			ret = inflate(&zr->zs, Z_NO_FLUSH);
+			zr->inpos = zr->inlen - zr->zs.avail_in;
+			len = size - zr->zs.avail_out;
+			if (ret == Z_STREAM_END) {
+				/* Another gzip member may follow */
+				inflateReset(&zr->zs);
+			} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+				*lenp = len;
+				return (EIO);
+			}
+			break;
+		}
+#endif
+#ifdef HAVE_LIBZSTD
+		case ZFILE_ZSTD: {
+			ZSTD_inBuffer in;
+			ZSTD_outBuffer o;
+
+			in.src = zr->in;
+			in.size = zr->inlen;
+			in.pos = zr->inpos;
+			o.dst = out;
+			o.size = size;
+			o.pos = len;
+			if (ZSTD_isError(ZSTD_decompressStream(zr->dctx, &o,
+			    &in))) {
+				*lenp = len;
+				return (EIO);
+			}
+			zr->inpos = in.pos;
+			len = o.pos;
+			break;
+		}
+#endif
+		}
+	}
+	*lenp = len;
+	return (0);
+}
+
+/* Fill buffer "i"; called, and returns, with the lock held */
+static void
+zr_fill(struct zreader *zr, u_int i)
+{
+	size_t len;
+	int end, err;
+
+	zr_unlock(zr);
+	err = zr_decompress(zr, zr->buf[i], ZFILE_BUFSIZE, &len, &end);
+	zr_lock(zr);
+	zr->len[i] = len;
+	zr->full[i] = 1;
+	if (err != 0 || end) {
+		zr->err = err;
+		zr->eof = 1;
+		zr->last = i;
+	}
+	zr_signal(zr);
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void *
+zr_thread(void *arg)
+{
+	struct zreader *zr = arg;
+	u_int i = 0;
+
+	pthread_mutex_lock(&zr->mtx);
+	while (!zr->eof) {
+		while (zr->full[i] && !zr->stop)
+			pthread_cond_wait(&zr->cond, &zr->mtx);
+		if (zr->stop)
+			break;
+		zr_fill(zr, i);
+		i ^= 1;
+	}
+	pthread_mutex_unlock(&zr->mtx);
+	return (NULL);
+}
+#endif
+
+static ssize_t
+zr_cookie_read(void *cookie, char *p, size_t size)
+{
+	struct zreader *zr = cookie;
+	size_t n;
+	int err;
+
+	zr_lock(zr);
+	for (;;) {
+		if (!zr->full[zr->cur]) {
+#ifdef HAVE_LIBPTHREAD
+			if (zr->threaded) {
+				pthread_cond_wait(&zr->cond, &zr->mtx);
+				continue;
+			}
+#endif
+			zr_fill(zr, zr->cur);
+			continue;
+		}
+		if (zr->pos < zr->len[zr->cur])
+			break;
+		if (zr->eof && zr->cur == zr->last) {
+			err = zr->err;
+			zr_unlock(zr);
+			if (err != 0) {
+				errno = err;
+				return (-1);
+			}
+			return (0);
+		}
+		/* Give this buffer back, and go on to the other one */
+		zr->full[zr->cur] = 0;
+		zr->cur ^= 1;
+		zr->pos = 0;
+		zr_signal(zr);
+	}
+	zr_unlock(zr);
+
+	/* The thread leaves a full buffer alone */
+	n = zr->len[zr->cur] - zr->pos;
+	if (n > size)
+		n = size;
+	memcpy(p, zr->buf[zr->cur] + zr->pos, n);
+	zr->pos += n;
+	return ((ssize_t)n);
+}
+
+static void
+zr_free(struct zreader *zr)
+{
+#ifdef HAVE_LIBZ
+	if (zr->method == ZFILE_GZIP)
+		inflateEnd(&zr->zs);
+#endif
+#ifdef HAVE_LIBZSTD
+	if (zr->method == ZFILE_ZSTD)
+		ZSTD_freeDCtx(zr->dctx);
+#endif
+	free(zr->in);
+	free(zr->buf[0]);
+	free(zr->buf[1]);
+	free(zr);
+}
+
+static int
+zr_cookie_close(void *cookie)
+{
+	struct zreader *zr = cookie;
+	int ret;
+
+#ifdef HAVE_LIBPTHREAD
+	if (zr->threaded) {
+		pthread_mutex_lock(&zr->mtx);
+		zr->stop = 1;
+		pthread_cond_broadcast(&zr->cond);
+		pthread_mutex_unlock(&zr->mtx);
+		pthread_join(zr->thread, NULL);
+		pthread_mutex_destroy(&zr->mtx);
+		pthread_cond_destroy(&zr->cond);
+	}
+#endif
+	ret = close(zr->fd);
+	zr_free(zr);
+	return (ret);
+}
+
+#if !defined(HAVE_FOPENCOOKIE) && defined(HAVE_FUNOPEN)
+static int
+zr_funopen_read(void *cookie, char *p, int len)
+{
+	return ((int)zr_cookie_read(cookie, p, (size_t)len));
+}
+#endif
+
+static FILE *
+zr_fopen(struct zreader *zr)
+{
+#ifdef HAVE_FOPENCOOKIE
+	static const cookie_io_functions_t funcs = {
+		zr_cookie_read, NULL, NULL, zr_cookie_close
+	};
+
+	return (fopencookie(zr, "r", funcs));
+#else
+	return (funopen(zr, zr_funopen_read, NULL, NULL, zr_cookie_close));
+#endif
+}
+#endif /* HAVE_LIBZ || HAVE_LIBZSTD */
+
+/*
+ * Return the compression method with the given name, or -1 if there's
+ * none by that name or we weren't built with it.
+ */
+int
+zfile_method(const char *name)
+{
+#ifdef HAVE_LIBZ
+	if (strcmp(name, "gzip") == 0)
+		return (ZFILE_GZIP);
+#endif
+#ifdef HAVE_LIBZSTD
+	if (strcmp(name, "zstd") == 0)
+		return (ZFILE_ZSTD);
+#endif
+	return (-1);
+}
+
+/* The usual suffix of the names of files compressed with a method */
+const char *
+zfile_suffix(int method)
+{
+	switch (method) {
+	case ZFILE_GZIP:
+		return (".gz");
+	case ZFILE_ZSTD:
+		return (".zst");
+	}
+	return ("");
+}
+
+/*
+ * Return a stream writing to "fd", with "method" at "level", or the
+ * method's default level if "level" is -1; the descriptor is closed when
+ * the stream is.  On failure, return NULL, with a message in "errbuf".
+ */
+FILE *
+zfile_wopen(int fd _U_, int method, int level _U_, char *errbuf,
+    size_t errbuflen)
+{
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
+	struct zwriter *zw;
+	FILE *fp;
+
+	zw = calloc(1, sizeof(*zw));
+	if (zw == NULL) {
+		snprintf(errbuf, errbuflen, "zfile_wopen: calloc");
+		return (NULL);
+	}
+	zw->fd = fd;
+	zw->method = method;
+	switch (method) {
+#ifdef HAVE_LIBZ
+	case ZFILE_GZIP:
+		/* 16 more window bits for a gzip header and trailer */
+		if (deflateInit2(&zw->zs,
+		    level == -1 ? Z_DEFAULT_COMPRESSION : level, Z_DEFLATED,
+		    15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			snprintf(errbuf, errbuflen,
+			    "invalid gzip compression level %d", level);
+			free(zw);
+			return (NULL);
+		}
+		zw->outsize = ZFILE_OUTSIZE;
+		break;
+#endif
+#ifdef HAVE_LIBZSTD
+	case ZFILE_ZSTD:
+		zw->cctx = ZSTD_createCCtx();
+		if (zw->cctx == NULL) {
+			snprintf(errbuf, errbuflen,
+			    "zfile_wopen: ZSTD_createCCtx");
+			free(zw);
+			return (NULL);
+		}
+		if (level != -1 && ZSTD_isError(ZSTD_CCtx_setParameter(zw->cctx,
+		    ZSTD_c_compressionLevel, level))) {
+			snprintf(errbuf, errbuflen,
+			    "invalid zstd compression level %d", level);
+			ZSTD_freeCCtx(zw->cctx);
+			free(zw);
+			return (NULL);
+		}
+		zw->outsize = ZSTD_CStreamOutSize();
+		break;
+#endif
+	default:
+		snprintf(errbuf, errbuflen, "unsupported compression method");
+		free(zw);
+		return (NULL);
+	}
+	zw->buf[0] = malloc(ZFILE_BUFSIZE);
+	zw->buf[1] = malloc(ZFILE_BUFSIZE);
+	zw->out = malloc(zw->outsize);
+	if (zw->buf[0] == NULL || zw->buf[1] == NULL || zw->out == NULL ||
+	    (fp = zw_fopen(zw)) == NULL) {
+		snprintf(errbuf, errbuflen, "zfile_wopen: %s",
+		    strerror(errno));
+#ifdef HAVE_LIBZ
+		if (method == ZFILE_GZIP)
+			deflateEnd(&zw->zs);
+#endif
+#ifdef HAVE_LIBZSTD
+		if (method == ZFILE_ZSTD)
+			ZSTD_freeCCtx(zw->cctx);
+#endif
+		free(zw->buf[0]);
+		free(zw->buf[1]);
+		free(zw->out);
+		free(zw);
+		return (NULL);
+	}
+	/* The buffering is ours */
+	setvbuf(fp, NULL, _IONBF, 0);
+	zw->fp = fp;
+
+#ifdef HAVE_LIBPTHREAD
+	/* If we can't have a thread, compress as the buffers fill */
+	if (pthread_mutex_init(&zw->mtx, NULL) == 0) {
+		if (pthread_cond_init(&zw->cond, NULL) == 0) {
+			sigset_t all, old;
+
+			/*
+			 * The thread inherits this; signals are for the
+			 * main thread.
+			 */
+			sigfillset(&all);
+			pthread_sigmask(SIG_SETMASK, &all, &old);
+			if (pthread_create(&zw->thread, NULL, zw_thread,
+			    zw) == 0)
+				zw->threaded = 1;
+			else
+				pthread_cond_destroy(&zw->cond);
+			pthread_sigmask(SIG_SETMASK, &old, NULL);
+		}
+		if (!zw->threaded)
+			pthread_mutex_destroy(&zw->mtx);
+	}
+#endif
+
+	zw_lock(NULL);
+	zw->next = zw_list;
+	zw_list = zw;
+	zw_unlock(NULL);
+	return (fp);
+#else
+	snprintf(errbuf, errbuflen, "compressed savefiles aren't supported");
+	return (NULL);
+#endif
+}
+
+/*
+ * Return the number of bytes written to the file of the stream "fp",
+ * counting the data not yet compressed as taking as many bytes as the
+ * data compressed so far took, for -C.
+ */
+uint64_t
+zfile_written(FILE *fp _U_)
+{
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
+	struct zwriter *zw;
+	uint64_t written, pending;
+
+	zw_lock(NULL);
+	for (zw = zw_list; zw != NULL && zw->fp != fp; zw = zw->next)
+		;
+	zw_unlock(NULL);
+	if (zw == NULL)
+		return (0);
+	zw_lock(zw);
+	written = zw->out_bytes;
+	pending = zw->fill + (zw->op != ZOP_NONE ? zw->len : 0);
+	if (zw->in_bytes != 0)
+		written += (uint64_t)((double)pending * zw->out_bytes /
+		    zw->in_bytes);
+	else
+		written += pending;
+	zw_unlock(zw);
+	return (written);
+#else
+	return (0);
+#endif
+}
+
+/*
+ * Compress and write out all the data written to the stream "fp" so
+ * far, for -U; return 0, or -1 with errno set.
+ */
+int
+zfile_flush(FILE *fp _U_)
+{
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
+	struct zwriter *zw;
+	int err;
+
+	zw_lock(NULL);
+	for (zw = zw_list; zw != NULL && zw->fp != fp; zw = zw->next)
+		;
+	zw_unlock(NULL);
+	if (zw == NULL)
+		return (0);
+	err = zw_handoff(zw, ZOP_FLUSH);
+	if (err != 0) {
+		errno = err;
+		return (-1);
+	}
+#endif
+	return (0);
+}
+
+/*
+ * Close the streams still open, so that their compressed data is
+ * ended, before exiting.
+ */
+void
+zfile_close_all(void)
+{
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
+	FILE *fp;
+
+	for (;;) {
+		zw_lock(NULL);
+		fp = zw_list != NULL ? zw_list->fp : NULL;
+		zw_unlock(NULL);
+		if (fp == NULL)
+			break;
+		(void)fclose(fp);
+	}
+#endif
+}
+
+/*
+ * Return the method the file open on "fd" is compressed with, going by
+ * its first bytes, whether or not we were built with it, or ZFILE_NONE
+ * if it's not compressed or not a regular file.
+ */
+int
+zfile_detect(int fd _U_)
+{
+#ifndef _WIN32
+	static const u_char gzip_magic[] = { 0x1f, 0x8b };
+	static const u_char zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+	struct stat st;
+	u_char magic[4];
+
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) ||
+	    pread(fd, magic, sizeof(magic), 0) != (ssize_t)sizeof(magic))
+		return (ZFILE_NONE);
+	if (memcmp(magic, gzip_magic, sizeof(gzip_magic)) == 0)
+		return (ZFILE_GZIP);
+	if (memcmp(magic, zstd_magic, sizeof(zstd_magic)) == 0)
+		return (ZFILE_ZSTD);
+#endif
+	return (ZFILE_NONE);
+}
+
+/*
+ * Return a stream reading the data compressed with "method" in the file
+ * open on "fd", which is closed when the stream is.  On failure, return
+ * NULL, with a message in "errbuf".
+ */
+FILE *
+zfile_ropen(int fd _U_, int method, char *errbuf, size_t errbuflen)
+{
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
+	struct zreader *zr;
+	FILE *fp;
+
+	zr = calloc(1, sizeof(*zr));
+	if (zr == NULL) {
+		snprintf(errbuf, errbuflen, "zfile_ropen: calloc");
+		return (NULL);
+	}
+	zr->fd = fd;
+	zr->method = method;
+	switch (method) {
+#ifdef HAVE_LIBZ
+	case ZFILE_GZIP:
+		/* 16 more window bits for a gzip header and trailer */
+		if (inflateInit2(&zr->zs, 15 + 16) != Z_OK) {
+			snprintf(errbuf, errbuflen,
+			    "zfile_ropen: inflateInit2 failed");
+			free(zr);
+			return (NULL);
+		}
+		zr->insize = ZFILE_OUTSIZE;
+		break;
+#endif
+#ifdef HAVE_LIBZSTD
+	case ZFILE_ZSTD:
+		zr->dctx = ZSTD_createDCtx();
+		if (zr->dctx == NULL) {
+			snprintf(errbuf, errbuflen,
+			    "zfile_ropen: ZSTD_createDCtx");
+			free(zr);
+			return (NULL);
+		}
+		zr->insize = ZSTD_DStreamInSize();
+		break;
+#endif
+	default:
+		snprintf(errbuf, errbuflen,
+		    "the file is compressed with %s, which isn't supported",
+		    method == ZFILE_ZSTD ? "zstd" : "gzip");
+		free(zr);
+		return (NULL);
+	}
+	zr->in = malloc(zr->insize);
+	zr->buf[0] = malloc(ZFILE_BUFSIZE);
+	zr->buf[1] = malloc(ZFILE_BUFSIZE);
+	if (zr->in == NULL || zr->buf[0] == NULL || zr->buf[1] == NULL ||
+	    (fp = zr_fopen(zr)) == NULL) {
+		snprintf(errbuf, errbuflen, "zfile_ropen: %s",
+		    strerror(errno));
+		zr_free(zr);
+		return (NULL);
+	}
+	/* The buffering is ours */
+	setvbuf(fp, NULL, _IONBF, 0);
+
+#ifdef HAVE_LIBPTHREAD
+	/* If we can't have a thread, decompress as the buffers are read */
+	if (pthread_mutex_init(&zr->mtx, NULL) == 0) {
+		if (pthread_cond_init(&zr->cond, NULL) == 0) {
+			sigset_t all, old;
+
+			/*
+			 * The thread inherits this; signals are for the
+			 * main thread.
+			 */
+			sigfillset(&all);
+			pthread_sigmask(SIG_SETMASK, &all, &old);
+			zr->threaded = 1;
+			if (pthread_create(&zr->thread, NULL, zr_thread,
+			    zr) != 0) {
+				zr->threaded = 0;
+				pthread_cond_destroy(&zr->cond);
+			}
+			pthread_sigmask(SIG_SETMASK, &old, NULL);
+		}
+		if (!zr->threaded)
+			pthread_mutex_destroy(&zr->mtx);
+	}
+#endif
+	return (fp);
+#else
+	snprintf(errbuf, errbuflen,
+	    "the file is compressed with %s, which isn't supported",
+	    method == ZFILE_ZSTD ? "zstd" : "gzip");
+	return (NULL);
+#endif
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef zfile_h
+#define zfile_h
+
+/*
+ * Compressed savefiles (--compress).
+ *
+ * zfile_wopen() returns a standard I/O stream, for pcap_dump_fopen(),
+ * whose data is compressed, with zlib into gzip format or with zstd,
+ * before it's written to a descriptor.  The data written to the stream
+ * is collected in one of two buffers; when it's full, it's handed to a
+ * thread that compresses and writes it while the other buffer fills.
+ * Closing the stream compresses what's left and ends the compressed
+ * data.
+ *
+ * zfile_detect() tells whether a savefile is compressed, and
+ * zfile_ropen() returns a stream, for pcap_fopen_offline(), that reads
+ * it decompressed, a readahead thread decompressing the next buffer of
+ * it while the current one is read.
+ */
+
+/* Compression methods */
+#define ZFILE_NONE	0
+#define ZFILE_GZIP	1
+#define ZFILE_ZSTD	2
+
+extern int zfile_method(const char *);
+extern const char *zfile_suffix(int);
+extern FILE *zfile_wopen(int, int, int, char *, size_t);
+extern uint64_t zfile_written(FILE *);
+extern int zfile_flush(FILE *);
+extern void zfile_close_all(void);
+extern int zfile_detect(int);
+extern FILE *zfile_ropen(int, int, char *, size_t);
+
+#endif /* zfile_h */